@@ -0,0 +1,211 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Asset bundles. A synthetic project's tile sets and images are baked
+ * into a bundle, and the tiles and images a board would use are then
+ * opened from the loose files, decoding each, and from the bundle. The
+ * bundle must give what decoding gives; the time to map the bundle
+ * (cold start) and to open a board's tiles and images (board enter)
+ * are printed for each.
+ */
+
+#include "harness.h"
+#include "../trans3/common/bundle.h"
+#include "../trans3/common/paths.h"
+#include "../tkCommon/tkGfx/CTile.h"
+#include <algorithm>
+#include <vector>
+
+extern const TILE_PIXELS *(*resolveTile)(const STRING &file, const INT number);
+
+static const int TILESETS = 8, TILES = 200, IMAGES = 6;
+static const int IMAGE_WIDTH = 640, IMAGE_HEIGHT = 480;
+
+/*
+ * Write a tile set of random 32x32 tiles at full detail.
+ */
+static void writeTileset(const STRING &file)
+{
+	const TS_HEADER header = {20, TILES, 1};
+	std::vector<BYTE> data(TILES * 32 * 32 * 3);
+	for (unsigned int i = 0; i < data.size(); ++i) data[i] = BYTE(testRandom());
+
+	FILE *const p = fopen(file.c_str(), "wb");
+	fwrite(&header, 6, 1, p);
+	fwrite(&data[0], 1, data.size(), p);
+	fclose(p);
+}
+
+/*
+ * Write a 32 bit bitmap of random blocks.
+ */
+static void writeImage(const STRING &file)
+{
+	std::vector<DWORD> pixels(IMAGE_WIDTH * IMAGE_HEIGHT);
+	for (unsigned int i = 0; i < pixels.size(); i += 16)
+	{
+		std::fill(pixels.begin() + i, pixels.begin() + i + 16, DWORD(testRandom()));
+	}
+
+	BITMAPINFOHEADER info;
+	memset(&info, 0, sizeof(info));
+	info.biSize = sizeof(info);
+	info.biWidth = IMAGE_WIDTH;
+	info.biHeight = IMAGE_HEIGHT;
+	info.biPlanes = 1;
+	info.biBitCount = 32;
+	info.biCompression = BI_RGB;
+
+	BITMAPFILEHEADER header;
+	memset(&header, 0, sizeof(header));
+	header.bfType = 0x4d42;						// "BM"
+	header.bfOffBits = sizeof(header) + sizeof(info);
+	header.bfSize = header.bfOffBits + pixels.size() * sizeof(DWORD);
+
+	FILE *const p = fopen(file.c_str(), "wb");
+	fwrite(&header, sizeof(header), 1, p);
+	fwrite(&info, sizeof(info), 1, p);
+	fwrite(&pixels[0], sizeof(DWORD), pixels.size(), p);
+	fclose(p);
+}
+
+static STRING tilesetName(const int i)
+{
+	TCHAR name[MAX_PATH];
+	_stprintf(name, _T("%sset%d.tst"), TILE_PATH, i);
+	return name;
+}
+
+static STRING imageName(const int i)
+{
+	TCHAR name[MAX_PATH];
+	_stprintf(name, _T("%simage%d.bmp"), BMP_PATH, i);
+	return name;
+}
+
+static bool sameTile(const TILE_PIXELS &a, const TILE_PIXELS &b)
+{
+	return (memcmp(a.pixels, b.pixels, sizeof(a.pixels)) == 0 && memcmp(a.alpha, b.alpha, sizeof(a.alpha)) == 0 &&
+		a.detail == b.detail && a.setType == b.setType && a.bTransparent == b.bTransparent);
+}
+
+TEST(bundle)
+{
+	extern STRING g_projectPath;
+
+	TCHAR temp[MAX_PATH];
+	GetTempPath(MAX_PATH, temp);
+	g_projectPath = STRING(temp) + _T("tktests_project\\");
+	CreateDirectory(g_projectPath.c_str(), NULL);
+	CreateDirectory((g_projectPath + TILE_PATH).c_str(), NULL);
+	CreateDirectory((g_projectPath + BMP_PATH).c_str(), NULL);
+
+	for (int i = 0; i < TILESETS; ++i) writeTileset(g_projectPath + tilesetName(i));
+	for (int i = 0; i < IMAGES; ++i) writeImage(g_projectPath + imageName(i));
+
+	// The tiles of a board: a quarter of each set, and every image.
+	std::vector<TILE_PIXELS> decoded(TILESETS * TILES / 4);
+	std::vector<IMAGE> loose(IMAGES);
+
+	double t = seconds();
+	for (unsigned int i = 0; i < decoded.size(); ++i)
+	{
+		TCHAR number[16];
+		_itot(1 + (i % (TILES / 4)) * 4, number, 10);
+		CHECK(CTile::decodeTile(g_projectPath + tilesetName(i / (TILES / 4)) + number, decoded[i]));
+	}
+	for (int i = 0; i < IMAGES; ++i) CHECK(openImage(g_projectPath + imageName(i), loose[i]));
+	printf("Loose:   board enter %.3f ms\n", (seconds() - t) * 1000.0);
+
+	t = seconds();
+	CHECK(bakeBundle());
+	printf("Bake:    %.3f ms\n", (seconds() - t) * 1000.0);
+
+	t = seconds();
+	openBundle();
+	const double start = seconds() - t;
+	CHECK(resolveTile);
+
+	bool bSame = true;
+	std::vector<IMAGE> bundled(IMAGES);
+	t = seconds();
+	for (unsigned int i = 0; i < decoded.size(); ++i)
+	{
+		const TILE_PIXELS *const pTile = resolveTile(g_projectPath + tilesetName(i / (TILES / 4)), 1 + (i % (TILES / 4)) * 4);
+		bSame = bSame && pTile && sameTile(*pTile, decoded[i]);
+	}
+	for (int i = 0; i < IMAGES; ++i) bSame = bSame && openImage(g_projectPath + imageName(i), bundled[i]);
+	printf("Bundled: cold start %.3f ms, board enter %.3f ms\n", start * 1000.0, (seconds() - t) * 1000.0);
+
+	// Bundled images are 32 bit bottom-up pixels, as the bitmaps.
+	for (int i = 0; i < IMAGES && bSame; ++i)
+	{
+		bSame = (!bundled[i].bmp && bundled[i].width == loose[i].width && bundled[i].height == loose[i].height &&
+			memcmp(bundled[i].bits, loose[i].bits, IMAGE_WIDTH * IMAGE_HEIGHT * 4) == 0);
+	}
+
+	for (int i = 0; i < IMAGES; ++i)
+	{
+		closeImage(loose[i]);
+		closeImage(bundled[i]);
+	}
+	closeBundle();
+
+	// Without the loose files, everything comes from the bundle.
+	for (int i = 0; i < TILESETS; ++i) DeleteFile((g_projectPath + tilesetName(i)).c_str());
+	for (int i = 0; i < IMAGES; ++i) DeleteFile((g_projectPath + imageName(i)).c_str());
+	openBundle();
+	bool bShipped = (resolveTile != NULL);
+	for (unsigned int i = 0; i < decoded.size() && bShipped; ++i)
+	{
+		const TILE_PIXELS *const pTile = resolveTile(g_projectPath + tilesetName(i / (TILES / 4)), 1 + (i % (TILES / 4)) * 4);
+		bShipped = (pTile && sameTile(*pTile, decoded[i]));
+	}
+	for (int i = 0; i < IMAGES && bShipped; ++i)
+	{
+		IMAGE image;
+		bShipped = (openImage(g_projectPath + imageName(i), image) && !image.bmp);
+		if (bShipped) closeImage(image);
+	}
+	closeBundle();
+
+	DeleteFile((g_projectPath + BUNDLE_FILE).c_str());
+	RemoveDirectory((g_projectPath + TILE_PATH).c_str());
+	RemoveDirectory((g_projectPath + BMP_PATH).c_str());
+	RemoveDirectory(g_projectPath.c_str());
+	g_projectPath = _T("");
+
+	CHECK(bSame);
+	CHECK(bShipped);
+	return true;
+}
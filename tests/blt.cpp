@@ -0,0 +1,353 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * The SIMD pixel kernels: every instruction set the CPU supports must
+ * produce exactly the pixels of the documented fixed point formulas,
+ * including in the tail of rows that do not fill a register. They must
+ * also stay within a level of the floating point maths the canvas used
+ * before the kernels. Throughput of each kernel is printed in
+ * megapixels per second.
+ */
+
+#include "harness.h"
+#include "../tkCommon/tkCanvas/BltKernels.h"
+#include <stdlib.h>
+#include <vector>
+
+typedef std::vector<DWORD> PIXELS;
+
+static const char *const g_levels[] = {"scalar", "sse2", "avx2"};
+
+static const DWORD g_keys[] = {0x00ff00ff, 0x00000000};
+
+/*
+ * A random pixel, with a random top byte. One in four is one of
+ * the colour keys, with or without the top byte set.
+ */
+static DWORD randomPixel(void)
+{
+	const DWORD px = (testRandom() << 8) ^ testRandom();
+	if (testRandom() % 4) return px;
+	return g_keys[px & 1] | (px & 0xff000000);
+}
+
+static void randomPixels(PIXELS &pixels)
+{
+	for (unsigned int i = 0; i < pixels.size(); ++i) pixels[i] = randomPixel();
+}
+
+static DWORD bound(const int x)
+{
+	return DWORD(x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+/*
+ * The formulas in BltKernels.h, a pixel at a time.
+ */
+static DWORD translucent(const DWORD dest, const DWORD srcPx, const int a, const DWORD crUnaffected, const DWORD crTransparent)
+{
+	const DWORD src = srcPx & 0x00ffffff;
+	if (src == crUnaffected) return src;
+	if (src == crTransparent) return dest;
+
+	DWORD res = 0;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		const int s = (src >> shift) & 0xff, d = (dest >> shift) & 0xff;
+		res |= DWORD((s * a + d * (256 - a)) >> 8) << shift;
+	}
+	return res;
+}
+
+static DWORD additive(const DWORD dest, const DWORD srcPx, const int p, const DWORD crUnaffected, const DWORD crTransparent)
+{
+	const DWORD src = srcPx & 0x00ffffff;
+	if (src == crUnaffected) return src;
+	if ((dest & 0x00ffffff) == crTransparent) return dest;
+
+	DWORD res = 0;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		const int s = (src >> shift) & 0xff, d = (dest >> shift) & 0xff;
+		res |= bound(d + ((s * p) >> 8)) << shift;
+	}
+	return res;
+}
+
+/*
+ * The floating point maths of the old CCanvas::BltTranslucentPart() and
+ * BltAdditivePart(), which the fixed point weights approximate.
+ */
+static DWORD legacyTranslucent(const DWORD dest, const DWORD srcPx, const double dIntensity, const DWORD crUnaffected, const DWORD crTransparent)
+{
+	const DWORD src = srcPx & 0x00ffffff;
+	if (src == crUnaffected) return src;
+	if (src == crTransparent) return dest;
+
+	DWORD res = 0;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		const int s = (src >> shift) & 0xff, d = (dest >> shift) & 0xff;
+		res |= DWORD(int((s * dIntensity) + (d * (1 - dIntensity)))) << shift;
+	}
+	return res;
+}
+
+static DWORD legacyAdditive(const DWORD dest, const DWORD srcPx, const double percent, const DWORD crUnaffected, const DWORD crTransparent)
+{
+	const DWORD src = srcPx & 0x00ffffff;
+	if (src == crUnaffected) return src;
+	if ((dest & 0x00ffffff) == crTransparent) return dest;
+
+	DWORD res = 0;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		const int s = (src >> shift) & 0xff, d = (dest >> shift) & 0xff;
+		res |= bound(int(s * percent + d)) << shift;
+	}
+	return res;
+}
+
+/*
+ * The largest difference between any channel of two sets of pixels.
+ */
+static int channelDifference(const PIXELS &lhs, const PIXELS &rhs)
+{
+	int worst = 0;
+	for (unsigned int i = 0; i < lhs.size(); ++i)
+	{
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			const int diff = abs(int((lhs[i] >> shift) & 0xff) - int((rhs[i] >> shift) & 0xff));
+			if (diff > worst) worst = diff;
+		}
+	}
+	return worst;
+}
+
+static DWORD transparent(const DWORD dest, const DWORD src, const DWORD crTransparent)
+{
+	return ((src & 0x00ffffff) == crTransparent ? dest : src);
+}
+
+static DWORD shade(const DWORD dest, const DWORD add, const DWORD sub)
+{
+	DWORD res = 0;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		const int d = (dest >> shift) & 0xff, a = (add >> shift) & 0xff, s = (sub >> shift) & 0xff;
+		res |= bound((d + a > 255 ? 255 : d + a) - s) << shift;
+	}
+	return res;
+}
+
+/*
+ * Run each kernel over a block of random pixels, offset into larger
+ * buffers so that rows start at every alignment, and compare every
+ * pixel of the destination buffer with the formulas.
+ */
+static bool checkBlock(const int width, const int height)
+{
+	const int pitch = width + 13, offset = testRandom() % 8;
+	PIXELS src(pitch * height + offset), dest(pitch * height + offset), expected, actual;
+	randomPixels(src);
+	randomPixels(dest);
+
+	const int weights[] = {0, 1, 77, 128, 255, 256};
+	const int percents[] = {-16383, -300, -1, 0, 77, 256, 1000, 16383};
+	const DWORD keys[] = {BLT_NO_KEY, g_keys[0], g_keys[1]};
+
+	for (int k = 0; k < 3; ++k)
+	{
+		const DWORD key = keys[k], other = keys[(k + 1) % 3];
+
+		for (int i = 0; i < 6; ++i)
+		{
+			expected = actual = dest;
+			bltTranslucent32(&actual[offset], pitch, &src[offset], pitch, width, height, weights[i], key, other);
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					const int j = offset + y * pitch + x;
+					expected[j] = translucent(dest[j], src[j], weights[i], key, other);
+				}
+			}
+			CHECK(actual == expected);
+		}
+
+		for (int i = 0; i < 8; ++i)
+		{
+			expected = actual = dest;
+			bltAdditive32(&actual[offset], pitch, &src[offset], pitch, width, height, percents[i], key, other);
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					const int j = offset + y * pitch + x;
+					expected[j] = additive(dest[j], src[j], percents[i], key, other);
+				}
+			}
+			CHECK(actual == expected);
+		}
+
+		expected = actual = dest;
+		bltTransparent32(&actual[offset], pitch, &src[offset], pitch, width, height, key);
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const int j = offset + y * pitch + x;
+				expected[j] = transparent(dest[j], src[j], key);
+			}
+		}
+		CHECK(actual == expected);
+	}
+
+	const DWORD add = randomPixel() & 0x00ffffff, sub = randomPixel() & 0x007f7f7f;
+	expected = actual = dest;
+	bltShade32(&actual[offset], pitch, width, height, add, sub);
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			const int j = offset + y * pitch + x;
+			expected[j] = shade(dest[j], add, sub);
+		}
+	}
+	CHECK(actual == expected);
+	return true;
+}
+
+/*
+ * Run the blending kernels at the canvas' floating point parameters,
+ * converted as the canvas converts them, and find how far they stray
+ * from the old floating point maths. Truncating the weight to 1/256
+ * and truncating the result each lose less than a level, so no
+ * channel should differ by more than one.
+ */
+static const int LEGACY_TOLERANCE = 1;
+
+static bool checkLegacy(const int width, const int height, int &worst)
+{
+	PIXELS src(width * height), dest(width * height), expected, actual;
+	randomPixels(src);
+	randomPixels(dest);
+
+	const double intensities[] = {0.0, 0.1, 0.25, 1.0 / 3.0, 0.5, 0.7, 0.999, 1.0};
+	const double percents[] = {-2.0, -0.6, -0.05, 0.0, 0.1, 1.0 / 3.0, 0.9, 1.5};
+
+	for (int i = 0; i < 8; ++i)
+	{
+		expected = actual = dest;
+		bltTranslucent32(&actual[0], width, &src[0], width, width, height, bltIntensity(intensities[i]), g_keys[0], g_keys[1]);
+		for (unsigned int j = 0; j < dest.size(); ++j)
+		{
+			expected[j] = legacyTranslucent(dest[j], src[j], intensities[i], g_keys[0], g_keys[1]);
+		}
+		const int diff = channelDifference(actual, expected);
+		if (diff > worst) worst = diff;
+		CHECK(diff <= LEGACY_TOLERANCE);
+
+		expected = actual = dest;
+		bltAdditive32(&actual[0], width, &src[0], width, width, height, bltPercent(percents[i]), g_keys[0], g_keys[1]);
+		for (unsigned int j = 0; j < dest.size(); ++j)
+		{
+			expected[j] = legacyAdditive(dest[j], src[j], percents[i], g_keys[0], g_keys[1]);
+		}
+		const int diffAdd = channelDifference(actual, expected);
+		if (diffAdd > worst) worst = diffAdd;
+		CHECK(diffAdd <= LEGACY_TOLERANCE);
+	}
+	return true;
+}
+
+TEST(blt_kernels)
+{
+	for (int level = BLT_SCALAR; level <= BLT_AVX2; ++level)
+	{
+		if (bltSetLevel(BLT_LEVEL(level)) != level)
+		{
+			printf("%s: not supported\n", g_levels[level]);
+			continue;
+		}
+
+		// Every width up to several registers, then some larger blocks.
+		for (int width = 1; width <= 40; ++width)
+		{
+			CHECK(checkBlock(width, 3));
+		}
+		CHECK(checkBlock(257, 17));
+		CHECK(checkBlock(640, 2));
+
+		int worst = 0;
+		CHECK(checkLegacy(37, 29, worst));
+		printf("%s: identical; at most %d from the floating point maths\n", g_levels[level], worst);
+	}
+	bltSetLevel(BLT_AVX2);
+	return true;
+}
+
+TEST(blt_benchmark)
+{
+	const int width = 640, height = 480, repeats = 20;
+	PIXELS src(width * height), dest(width * height);
+	randomPixels(src);
+	randomPixels(dest);
+
+	printf("%-8s %12s %12s %12s %12s  (MPixel/s)\n", "", "translucent", "additive", "transparent", "shade");
+	for (int level = BLT_SCALAR; level <= BLT_AVX2; ++level)
+	{
+		if (bltSetLevel(BLT_LEVEL(level)) != level) continue;
+
+		double rate[4];
+		for (int kernel = 0; kernel < 4; ++kernel)
+		{
+			const double start = seconds();
+			for (int i = 0; i < repeats; ++i)
+			{
+				switch (kernel)
+				{
+					case 0: bltTranslucent32(&dest[0], width, &src[0], width, width, height, 128, BLT_NO_KEY, g_keys[0]); break;
+					case 1: bltAdditive32(&dest[0], width, &src[0], width, width, height, 32, BLT_NO_KEY, g_keys[0]); break;
+					case 2: bltTransparent32(&dest[0], width, &src[0], width, width, height, g_keys[0]); break;
+					case 3: bltShade32(&dest[0], width, width, height, 0x00101010, 0x00080808); break;
+				}
+			}
+			rate[kernel] = double(width) * height * repeats / (seconds() - start) / 1e6;
+		}
+		printf("%-8s %12.0f %12.0f %12.0f %12.0f\n", g_levels[level], rate[0], rate[1], rate[2], rate[3]);
+	}
+	bltSetLevel(BLT_AVX2);
+	return true;
+}
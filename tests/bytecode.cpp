@@ -0,0 +1,196 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * The bytecode engine against the unit interpreter: the same programs
+ * must leave the same results on both, and a tight loop is timed on each.
+ */
+
+#include "harness.h"
+#include "stubs.h"
+#include "rpgcode.h"
+
+/*
+ * Programs covering the constructs CBytecode resolves at compile time:
+ * loop back-edges, elseif chains, method returns, classes, members found
+ * by slot and switches. Each leaves its answer in the global "result".
+ */
+static const struct
+{
+	const char *name;
+	const char *code;
+	const char *expected;
+} g_programs[] =
+{
+	{
+		"branches",
+		"total = 0\n"
+		"for (i = 0; i < 100; i++)\n"
+		"{\n"
+		"	if (i % 3 == 0) { total += i }\n"
+		"	elseif (i % 3 == 1) { total -= 1 }\n"
+		"	else { total += 2 }\n"
+		"}\n"
+		"result = total\n",
+		"1716"
+	},
+	{
+		"while",
+		"n = 27; steps = 0\n"
+		"while (n != 1)\n"
+		"{\n"
+		"	if (n % 2 == 0) { n /= 2 }\n"
+		"	else { n = n * 3 + 1 }\n"
+		"	steps++\n"
+		"}\n"
+		"result = steps\n",
+		"111"
+	},
+	{
+		"strings",
+		"s = \"\"\n"
+		"for (i = 0; i < 3; i++) { s = s + \"ab\" }\n"
+		"result = s + \"!\"\n",
+		"ababab!"
+	},
+	{
+		"arrays",
+		"for (i = 0; i < 10; i++) { a[i] = i * i }\n"
+		"a[\"ten\"] = 10\n"
+		"sum = 0\n"
+		"for (i = 9; i >= 0; i--) { sum += a[i] }\n"
+		"result = sum + a[\"ten\"]\n",
+		"295"
+	},
+	{
+		"recursion",
+		"method fib(n)\n"
+		"{\n"
+		"	if (n < 2) { return n }\n"
+		"	return fib(n - 1) + fib(n - 2)\n"
+		"}\n"
+		"result = fib(15)\n",
+		"610"
+	},
+	{
+		"classes",
+		"struct counter\n"
+		"{\n"
+		"	method counter(start) { m_n = start }\n"
+		"	method add(d) { m_n += d; return m_n }\n"
+		"	var m_n\n"
+		"}\n"
+		"c = counter(5)\n"
+		"c->add(3)\n"
+		"result = c->add(4)\n",
+		"12"
+	},
+	{
+		"members",
+		"struct pt\n"
+		"{\n"
+		"	method pt(x) { m_x = x; this->m_y = x * 2 }\n"
+		"	method sum(o) { m_x += 1; return this->m_x + m_y + o->m_x }\n"
+		"	var m_x\n"
+		"	var m_y\n"
+		"}\n"
+		"m_x = 1000\n"
+		"a = pt(1); b = pt(10); total = 0\n"
+		"for (i = 0; i < 5; i++)\n"
+		"{\n"
+		"	tmp = pt(i)\n"
+		"	total += a->sum(b)\n"
+		"	total += tmp->sum(a)\n"
+		"	tmp->release()\n"
+		"}\n"
+		"result = total + m_x\n",
+		"1135"
+	},
+	{
+		"switch",
+		"result = 0\n"
+		"for (i = 0; i < 6; i++)\n"
+		"{\n"
+		"	switch (i)\n"
+		"	{\n"
+		"		case 0: { result += 1 }\n"
+		"		case 1: { result += 10 }\n"
+		"		default: { result += 100 }\n"
+		"	}\n"
+		"}\n",
+		"411"
+	}
+};
+
+TEST(bytecode_equivalence)
+{
+	initRpgCode();
+
+	for (unsigned int i = 0; i < sizeof(g_programs) / sizeof(g_programs[0]); ++i)
+	{
+		g_messages = 0;
+		const STRING tree = runProgram(g_programs[i].code, false).getLit();
+		const STRING bytecode = runProgram(g_programs[i].code, true).getLit();
+
+		printf("%-10s units: %-8s bytecode: %s\n", g_programs[i].name, tree.c_str(), bytecode.c_str());
+		CHECK(g_messages == 0);
+		CHECK(tree == g_programs[i].expected);
+		CHECK(bytecode == tree);
+	}
+	return true;
+}
+
+TEST(bytecode_benchmark)
+{
+	initRpgCode();
+
+	const int iterations = 200000;
+	char code[256];
+	sprintf(code,
+		"total = 0\n"
+		"for (i = 0; i < %d; i++) { total += i %% 7 }\n"
+		"result = total\n",
+		iterations);
+
+	double expected = 0;
+	for (int i = 0; i < iterations; ++i) expected += i % 7;
+
+	double tree = 0.0, bytecode = 0.0;
+	g_messages = 0;
+	CHECK(runProgram(code, false, &tree).getNum() == expected);
+	CHECK(runProgram(code, true, &bytecode).getNum() == expected);
+	CHECK(g_messages == 0);
+
+	printf("%d iterations: units %.1f ms, bytecode %.1f ms (%.2fx)\n",
+		iterations, tree * 1000.0, bytecode * 1000.0, tree / bytecode);
+	return true;
+}
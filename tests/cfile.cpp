@@ -0,0 +1,347 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Opening a large board. A synthetic board file, laid out field by field
+ * as tagBoard::open() reads a vector board, is written through CFile and
+ * opened with tagBoard::open(). For comparison it is also read with the
+ * single ReadFile() per field that CFile used to make. Both must read
+ * what was written; the read operations counted by
+ * GetProcessIoCounters() and the time of each are printed.
+ */
+
+#include "harness.h"
+#include "stubs.h"
+#include "../trans3/common/CFile.h"
+#include "../trans3/common/board.h"
+#include <vector>
+
+/*
+ * The fields of the synthetic board that open() keeps.
+ */
+typedef struct tagTestBoard
+{
+	SHORT width, height, layers;
+	std::vector<STRING> tiles;			// Tile lookup table.
+	std::vector<SHORT> board;			// Index into the table of each square.
+	std::vector<RGB_SHORT> shading;		// Shading of each square of the first layer.
+	std::vector<std::vector<INT> > vectors;	// Points of each vector.
+	std::vector<STRING> layerTitles;
+
+	bool operator==(const tagTestBoard &rhs) const
+	{
+		if (shading.size() != rhs.shading.size()) return false;
+		for (unsigned int i = 0; i < shading.size(); ++i)
+		{
+			if (memcmp(&shading[i], &rhs.shading[i], sizeof(RGB_SHORT))) return false;
+		}
+		return (width == rhs.width && height == rhs.height && layers == rhs.layers &&
+			tiles == rhs.tiles && board == rhs.board && vectors == rhs.vectors && layerTitles == rhs.layerTitles);
+	}
+
+} TEST_BOARD;
+
+/*
+ * A file read by a ReadFile() of each field, as CFile read before it
+ * mapped its files.
+ */
+class CUnbufferedFile
+{
+public:
+	CUnbufferedFile(const STRING &fileName): m_pos(0)
+	{
+		m_hFile = CreateFile(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	}
+	~CUnbufferedFile() { CloseHandle(m_hFile); }
+
+	CUnbufferedFile &operator>>(SHORT &data) { read(&data, sizeof(data)); return *this; }
+	CUnbufferedFile &operator>>(INT &data) { read(&data, sizeof(data)); return *this; }
+	CUnbufferedFile &operator>>(STRING &data)
+	{
+		data = _T("");
+		CHAR chr = 0;
+		while (read(&chr, sizeof(chr)) && chr) data += chr;
+		return *this;
+	}
+
+private:
+	DWORD read(LPVOID pData, const DWORD bytes)
+	{
+		OVERLAPPED ptr;
+		memset(&ptr, 0, sizeof(ptr));
+		ptr.Offset = m_pos;
+		DWORD read = 0;
+		ReadFile(m_hFile, pData, bytes, &read, &ptr);
+		m_pos += bytes;
+		return read;
+	}
+
+	HANDLE m_hFile;
+	DWORD m_pos;
+};
+
+static TEST_BOARD makeBoard(const int width, const int height, const int layers)
+{
+	TEST_BOARD brd;
+	brd.width = width;
+	brd.height = height;
+	brd.layers = layers;
+
+	brd.tiles.push_back(_T(""));
+	for (int i = 1; i < 500; ++i)
+	{
+		char str[32];
+		sprintf(str, "tileset%u.tst%u", testRandom() % 64, testRandom() % 256);
+		brd.tiles.push_back(str);
+	}
+	for (int i = 0; i < width * height * layers; ++i)
+	{
+		brd.board.push_back(SHORT(testRandom() % brd.tiles.size()));
+	}
+	for (int i = 0; i < width * height; ++i)
+	{
+		const RGB_SHORT rgb = {SHORT(testRandom() % 64), SHORT(testRandom() % 64), SHORT(testRandom() % 64)};
+		brd.shading.push_back(rgb);
+	}
+	for (int i = 0; i < 1000; ++i)
+	{
+		std::vector<INT> pts;
+		for (int j = 0; j < 8; ++j) pts.push_back(INT(testRandom() % 3200));
+		brd.vectors.push_back(pts);
+	}
+	for (int i = 0; i <= layers; ++i)
+	{
+		char str[32];
+		sprintf(str, "Layer %d", i);
+		brd.layerTitles.push_back(str);
+	}
+	return brd;
+}
+
+/*
+ * Write a board in the format of tagBoard::open()'s vector boards,
+ * with no lights, programs, sprites, images or threads.
+ */
+static void writeBoard(const STRING &fileName, const TEST_BOARD &brd)
+{
+	CFile file(fileName, OF_CREATE | OF_WRITE);
+	file << STRING(_T("RPGTLKIT BOARD")) << SHORT(3) << SHORT(4);
+	file << brd.width << brd.height << brd.layers << SHORT(TILE_NORMAL);
+
+	file << SHORT(brd.tiles.size() - 1);
+	for (unsigned int i = 0; i < brd.tiles.size(); ++i) file << brd.tiles[i];
+	for (unsigned int i = 0; i < brd.board.size(); ++i) file << brd.board[i];
+
+	// One layer of shading, each square stored singly.
+	file << SHORT(0) << INT(0);
+	for (unsigned int i = 0; i < brd.shading.size(); ++i)
+	{
+		file << SHORT(1) << brd.shading[i].r << brd.shading[i].g << brd.shading[i].b;
+	}
+
+	// Lights.
+	file << SHORT(-1);
+
+	file << SHORT(brd.vectors.size() - 1);
+	for (unsigned int i = 0; i < brd.vectors.size(); ++i)
+	{
+		const std::vector<INT> &pts = brd.vectors[i];
+		file << SHORT(pts.size() / 2 - 1);
+		for (unsigned int j = 0; j < pts.size(); ++j) file << pts[j];
+		// Open, so that no point is added to close the vector.
+		file << SHORT(0) << SHORT(0) << SHORT(1) << SHORT(TT_SOLID) << STRING();
+	}
+
+	// Programs, sprites, images, threads and constants.
+	file << SHORT(-1) << SHORT(-1) << SHORT(-1) << SHORT(-1) << SHORT(-1);
+
+	for (unsigned int i = 0; i < brd.layerTitles.size(); ++i) file << brd.layerTitles[i];
+	for (int i = 0; i != 4; ++i) file << STRING();
+
+	// Background image and colour, music, entrance program, battles,
+	// saving, ambient effect and start location.
+	file << STRING() << INT(0) << INT(0) << STRING() << STRING() << STRING();
+	file << SHORT(0) << SHORT(0) << SHORT(0);
+	file << SHORT(0) << SHORT(0) << SHORT(0);
+	file << SHORT(64) << SHORT(64) << SHORT(1);
+}
+
+/*
+ * Read the board a field at a time, as open() does.
+ */
+template <class T>
+static TEST_BOARD readBoard(T &file)
+{
+	TEST_BOARD brd;
+	STRING str;
+	SHORT var = 0, count = 0;
+	INT layer = 0;
+	file >> str >> var >> var;
+	file >> brd.width >> brd.height >> brd.layers >> var;
+
+	file >> count;
+	brd.tiles.resize(count + 1);
+	for (int i = 0; i <= count; ++i) file >> brd.tiles[i];
+	brd.board.resize(brd.width * brd.height * brd.layers);
+	for (unsigned int i = 0; i < brd.board.size(); ++i) file >> brd.board[i];
+
+	file >> var >> layer;
+	brd.shading.resize(brd.width * brd.height);
+	for (unsigned int i = 0; i < brd.shading.size(); ++i)
+	{
+		file >> count >> brd.shading[i].r >> brd.shading[i].g >> brd.shading[i].b;
+	}
+
+	file >> var >> count;
+	brd.vectors.resize(count + 1);
+	for (unsigned int i = 0; i < brd.vectors.size(); ++i)
+	{
+		file >> count;
+		brd.vectors[i].resize((count + 1) * 2);
+		for (unsigned int j = 0; j < brd.vectors[i].size(); ++j) file >> brd.vectors[i][j];
+		file >> var >> var >> var >> var >> str;
+	}
+
+	file >> var >> var >> var >> var >> var;
+	brd.layerTitles.resize(brd.layers + 1);
+	for (unsigned int i = 0; i < brd.layerTitles.size(); ++i) file >> brd.layerTitles[i];
+	for (int i = 0; i != 4; ++i) file >> str;
+
+	file >> str >> layer >> layer >> str >> str >> str;
+	for (int i = 0; i != 9; ++i) file >> var;
+	return brd;
+}
+
+/*
+ * The same fields of a board that open() has read.
+ */
+static TEST_BOARD boardFields(const BOARD &board)
+{
+	TEST_BOARD brd;
+	brd.width = board.sizeX;
+	brd.height = board.sizeY;
+	brd.layers = board.sizeL;
+	brd.tiles = board.tileIndex;
+
+	for (int z = 1; z <= board.sizeL; ++z)
+	{
+		for (int y = 1; y <= board.sizeY; ++y)
+		{
+			for (int x = 1; x <= board.sizeX; ++x) brd.board.push_back(board.board[z][y][x]);
+		}
+	}
+
+	if (!board.tileShading.empty())
+	{
+		const RGB_MATRIX &shades = board.tileShading[0]->shades;
+		for (int y = 1; y <= board.sizeY; ++y)
+		{
+			for (int x = 1; x <= board.sizeX; ++x) brd.shading.push_back(shades[x][y]);
+		}
+	}
+
+	for (unsigned int i = 0; i < board.vectors.size(); ++i)
+	{
+		const CVector &v = *board.vectors[i].pV;
+		std::vector<INT> pts;
+		for (int j = 0; j < v.size(); ++j)
+		{
+			pts.push_back(INT(v[j].x));
+			pts.push_back(INT(v[j].y));
+		}
+		brd.vectors.push_back(pts);
+	}
+
+	brd.layerTitles = board.layerTitles;
+	return brd;
+}
+
+static ULONGLONG readOperations(void)
+{
+	IO_COUNTERS io;
+	memset(&io, 0, sizeof(io));
+	GetProcessIoCounters(GetCurrentProcess(), &io);
+	return io.ReadOperationCount;
+}
+
+static ULONGLONG writeOperations(void)
+{
+	IO_COUNTERS io;
+	memset(&io, 0, sizeof(io));
+	GetProcessIoCounters(GetCurrentProcess(), &io);
+	return io.WriteOperationCount;
+}
+
+TEST(cfile_board)
+{
+	// 100x100 squares on eight layers.
+	const TEST_BOARD brd = makeBoard(100, 100, 8);
+
+	TCHAR path[MAX_PATH];
+	GetTempPath(MAX_PATH, path);
+	const STRING fileName = STRING(path) + _T("tktests.brd");
+
+	ULONGLONG ops = writeOperations();
+	double t = seconds();
+	writeBoard(fileName, brd);
+	printf("Write:      %6u writes, %.3f ms\n", unsigned(writeOperations() - ops), (seconds() - t) * 1000.0);
+
+	ops = readOperations();
+	t = seconds();
+	TEST_BOARD unbuffered;
+	{
+		CUnbufferedFile file(fileName);
+		unbuffered = readBoard(file);
+	}
+	const ULONGLONG unbufferedOps = readOperations() - ops;
+	printf("Unbuffered: %6u reads,  %.3f ms\n", unsigned(unbufferedOps), (seconds() - t) * 1000.0);
+
+	g_messages = 0;
+	ops = readOperations();
+	t = seconds();
+	TEST_BOARD opened;
+	{
+		BOARD board;
+		CHECK(board.open(fileName, false));
+		opened = boardFields(board);
+	}
+	const ULONGLONG openOps = readOperations() - ops;
+	printf("open():     %6u reads,  %.3f ms\n", unsigned(openOps), (seconds() - t) * 1000.0);
+
+	DeleteFile(fileName.c_str());
+
+	CHECK(g_messages == 0);
+	CHECK(unbuffered == brd);
+	CHECK(opened == brd);
+	CHECK(openOps * 100 < unbufferedOps);
+	return true;
+}
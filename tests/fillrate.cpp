@@ -0,0 +1,271 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Recomposing damaged areas. On a mostly still scene, recomposing only
+ * the union of the areas that changed must leave the same pixels as
+ * recomposing the whole screen, for a fraction of the fill. Both are
+ * run over the same frames, counting the pixels composed and the time
+ * of each frame.
+ *
+ * The scene is composed by the engine's SCENE from a background and
+ * sprites on CCanvas, in place of the board.
+ */
+
+#include "harness.h"
+#include "../trans3/render/scene.h"
+#include <algorithm>
+#include <vector>
+
+static const int SCREEN_WIDTH = 640, SCREEN_HEIGHT = 480;
+static const RECT SCREEN = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
+
+typedef struct tagTestSprite
+{
+	RECT r;						// Area on the screen.
+	int frame;					// Index of its frame.
+
+} TEST_SPRITE;
+
+static bool intersect(RECT &r, const RECT &a, const RECT &b)
+{
+	r.left = std::max(a.left, b.left);
+	r.top = std::max(a.top, b.top);
+	r.right = std::min(a.right, b.right);
+	r.bottom = std::min(a.bottom, b.bottom);
+	return (r.left < r.right && r.top < r.bottom);
+}
+
+/*
+ * A still background with sprites over it, some of which move.
+ */
+class CTestScene: public CSceneSource
+{
+public:
+	CTestScene(const int sprites, const int moving);
+	~CTestScene();
+
+	// Move and animate the moving sprites, damaging where they were
+	// and where they are.
+	void advance(DAMAGE &damage);
+
+	void renderBackground(CCanvas *const cnv, const RECT &screen);
+	void render(CCanvas *const cnv, const CCanvas &bkg, const RECT &screen, const RECT &area);
+
+private:
+	CTestScene(const CTestScene &);
+	CTestScene &operator=(const CTestScene &);
+
+	CCanvas m_bkg;
+	std::vector<CCanvas *> m_frames;
+	std::vector<TEST_SPRITE> m_sprites;
+	int m_moving;
+};
+
+static long randomColor(void)
+{
+	return long(testRandom() & 0x00ffffff);
+}
+
+CTestScene::CTestScene(const int sprites, const int moving):
+	m_moving(moving)
+{
+	m_bkg.CreateBlank(NULL, SCREEN_WIDTH, SCREEN_HEIGHT);
+	m_bkg.ClearScreen(randomColor());
+	for (int i = 0; i < 200; ++i)
+	{
+		const int x = testRandom() % SCREEN_WIDTH, y = testRandom() % SCREEN_HEIGHT;
+		m_bkg.DrawFilledRect(x, y, x + testRandom() % 64, y + testRandom() % 64, randomColor());
+	}
+
+	// Frames 32x48, transparent around a body.
+	for (int i = 0; i < 8; ++i)
+	{
+		CCanvas *const p = new CCanvas();
+		p->CreateBlank(NULL, 32, 48);
+		p->ClearScreen(TRANSP_COLOR);
+		p->DrawFilledRect(4 + i % 4, 2, 27 - i % 4, 45, randomColor());
+		m_frames.push_back(p);
+	}
+
+	for (int i = 0; i < sprites; ++i)
+	{
+		const int x = testRandom() % (SCREEN_WIDTH - 32), y = testRandom() % (SCREEN_HEIGHT - 48);
+		const TEST_SPRITE s = {{x, y, x + 32, y + 48}, int(testRandom() % m_frames.size())};
+		m_sprites.push_back(s);
+	}
+}
+
+CTestScene::~CTestScene()
+{
+	for (unsigned int i = 0; i < m_frames.size(); ++i) delete m_frames[i];
+}
+
+void CTestScene::advance(DAMAGE &damage)
+{
+	for (int i = 0; i < m_moving; ++i)
+	{
+		TEST_SPRITE &s = m_sprites[i];
+		damage.add(s.r);
+
+		// A step in a random direction, kept on the screen.
+		const int dx = int(testRandom() % 5) - 2, dy = int(testRandom() % 5) - 2;
+		const int x = std::min(std::max(int(s.r.left) + dx, 0), SCREEN_WIDTH - 32);
+		const int y = std::min(std::max(int(s.r.top) + dy, 0), SCREEN_HEIGHT - 48);
+		const RECT r = {x, y, x + 32, y + 48};
+		s.r = r;
+		s.frame = (s.frame + 1) % m_frames.size();
+		damage.add(s.r);
+	}
+}
+
+void CTestScene::renderBackground(CCanvas *const cnv, const RECT &screen)
+{
+	m_bkg.BltPart(cnv, 0, 0, screen.left, screen.top, screen.right - screen.left, screen.bottom - screen.top);
+}
+
+void CTestScene::render(CCanvas *const cnv, const CCanvas &bkg, const RECT &screen, const RECT &area)
+{
+	const int width = area.right - area.left, height = area.bottom - area.top;
+	bkg.BltPart(cnv, 0, 0, area.left - screen.left, area.top - screen.top, width, height);
+
+	for (std::vector<TEST_SPRITE>::const_iterator i = m_sprites.begin(); i != m_sprites.end(); ++i)
+	{
+		RECT r = {0, 0, 0, 0};
+		if (!intersect(r, i->r, area)) continue;
+		m_frames[i->frame]->BltTransparentPart(
+			cnv,
+			r.left - area.left,
+			r.top - area.top,
+			r.left - i->r.left,
+			r.top - i->r.top,
+			r.right - r.left,
+			r.bottom - r.top,
+			TRANSP_COLOR
+		);
+	}
+}
+
+/*
+ * Pixels composed in the last frame.
+ */
+static int composed(const SCENE &scene)
+{
+	int filled = 0;
+	for (std::vector<RECT>::const_iterator i = scene.damaged.begin(); i != scene.damaged.end(); ++i)
+	{
+		filled += (i->right - i->left) * (i->bottom - i->top);
+	}
+	return filled;
+}
+
+static bool samePixels(const CCanvas &a, const CCanvas &b)
+{
+	for (int y = 0; y < a.GetHeight(); ++y)
+	{
+		const CCanvas::PIXEL *const p = a.GetPixels() + y * a.GetPitch(), *const q = b.GetPixels() + y * b.GetPitch();
+		if (!std::equal(p, p + a.GetWidth(), q)) return false;
+	}
+	return true;
+}
+
+/*
+ * Draw a translucent window over a screen, as the message window is,
+ * at a place that changes with the frame.
+ */
+static RECT drawOverlay(CCanvas &screen, const CCanvas &window, const int frame)
+{
+	const int x = (frame * 7) % (SCREEN_WIDTH - window.GetWidth()), y = (frame * 3) % (SCREEN_HEIGHT - window.GetHeight());
+	window.BltTranslucent(&screen, x, y, 0.5, -1, -1);
+	const RECT r = {x, y, x + window.GetWidth(), y + window.GetHeight()};
+	return r;
+}
+
+TEST(damage_equivalence)
+{
+	CTestScene source(40, 6);
+	SCENE full, damaged;
+	DAMAGE all, damage;
+
+	// The back buffer, presented to and drawn over each frame.
+	CCanvas buffer, expected, window;
+	buffer.CreateBlank(NULL, SCREEN_WIDTH, SCREEN_HEIGHT);
+	expected.CreateBlank(NULL, SCREEN_WIDTH, SCREEN_HEIGHT);
+	window.CreateBlank(NULL, 200, 60);
+	window.ClearScreen(randomColor());
+
+	for (int i = 0; i < 500; ++i)
+	{
+		source.advance(damage);
+		full.compose(source, all, SCREEN, true);
+		damaged.compose(source, damage, SCREEN, false);
+		CHECK(samePixels(full.cnv, damaged.cnv));
+
+		// Overlays from the last frame are restored before the next is drawn.
+		damaged.present(&buffer, i != 0);
+		damaged.overlay(drawOverlay(buffer, window, i));
+		full.cnv.Blt(&expected, 0, 0);
+		drawOverlay(expected, window, i);
+		CHECK(samePixels(buffer, expected));
+	}
+	return true;
+}
+
+TEST(damage_benchmark)
+{
+	const int frames = 2000;
+	double filled[2];
+	for (int full = 1; full >= 0; --full)
+	{
+		// Forty sprites, of which two move.
+		testSeed(1);
+		CTestScene source(40, 2);
+		SCENE scene;
+		DAMAGE damage;
+		scene.compose(source, damage, SCREEN, true);
+
+		double pixels = 0.0;
+		const double t = seconds();
+		for (int i = 0; i < frames; ++i)
+		{
+			source.advance(damage);
+			scene.compose(source, damage, SCREEN, full != 0);
+			pixels += composed(scene);
+		}
+		filled[full] = pixels / frames;
+		printf("%-8s %8.0f pixels, %.3f ms a frame\n", full ? "full:" : "damage:", filled[full], (seconds() - t) * 1000.0 / frames);
+	}
+
+	// An order of magnitude less to fill.
+	CHECK(filled[0] * 10 < filled[1]);
+	return true;
+}
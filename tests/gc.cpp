@@ -0,0 +1,152 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * The garbage collector: objects must survive a cycle run in the middle
+ * of a program for as long as they are reachable, and the cost of a
+ * cycle and of the safepoints in a tight loop are timed.
+ *
+ * tktests_locked is built with ENABLE_UNIT_LOCK, which puts back the
+ * critical section every unit used to hold; its gc_benchmark gives the
+ * units per second to compare.
+ */
+
+#include "harness.h"
+#include "stubs.h"
+#include "rpgcode.h"
+#include "../trans3/rpgcode/CGarbageCollector.h"
+
+/*
+ * collect()
+ *
+ * Collect garbage right now, from a program's point of view.
+ */
+static void collect(CALL_DATA &params)
+{
+	CGarbageCollector::getInstance().collectGarbage();
+}
+
+static const char g_box[] =
+	"struct box\n"
+	"{\n"
+	"	method box(v) { m_v = v }\n"
+	"	method get() { return m_v }\n"
+	"	var m_v\n"
+	"}\n";
+
+TEST(gc_reclaim)
+{
+	initRpgCode();
+	CProgram::addFunction(_T("collect"), collect);
+
+	// 2001 boxes are made; only the last two stay reachable.
+	const STRING code = STRING(g_box) +
+		"keep = box(-1)\n"
+		"for (i = 0; i < 2000; i++)\n"
+		"{\n"
+		"	tmp = box(i)\n"
+		"	if (i % 100 == 0) { keep = tmp }\n"
+		"	if (i == 1000) { collect() }\n"
+		"}\n"
+		"result = keep->get()\n";
+
+	CGarbageCollector &gc = CGarbageCollector::getInstance();
+	for (int bytecode = 0; bytecode < 2; ++bytecode)
+	{
+		gc.collectGarbage();
+		const unsigned int reclaimed = gc.getStats().totalReclaimed;
+
+		g_messages = 0;
+		CHECK(runProgram(code, bytecode != 0).getNum() == 1900.0);
+		CHECK(g_messages == 0);
+
+		gc.collectGarbage();
+		printf("%s: %u objects reclaimed, %u left\n", bytecode ? "bytecode" : "units",
+			gc.getStats().totalReclaimed - reclaimed, (unsigned int)CProgram::enumerateObjects().size());
+		CHECK(gc.getStats().totalReclaimed - reclaimed == 1999);
+		CHECK(CProgram::enumerateObjects().size() == 2);
+	}
+
+	CProgram::freeGlobals();
+	return true;
+}
+
+TEST(gc_benchmark)
+{
+	initRpgCode();
+	CGarbageCollector &gc = CGarbageCollector::getInstance();
+
+	// A full cycle over a heap of live objects. Each step examines at
+	// most GARBAGE_BUDGET variables or objects, so the longest step
+	// should not grow with the heap.
+	const int objects = 5000;
+	char code[256];
+	sprintf(code, "for (i = 0; i < %d; i++) { a[i] = box(i) }\n", objects);
+	runProgram(STRING(g_box) + code, true);
+	CHECK((int)CProgram::enumerateObjects().size() == objects);
+
+	double start = seconds();
+	gc.collectGarbage();
+	const double cycle = seconds() - start;
+	CHECK((int)CProgram::enumerateObjects().size() == objects);
+	printf("cycle over %d live objects: %.2f ms, longest step %.3f ms\n",
+		objects, cycle * 1000.0, gc.getStats().maxPause);
+
+	// A tight loop, which reaches a safepoint at every back-edge.
+	const int iterations = 200000;
+	sprintf(code,
+		"total = 0\n"
+		"for (i = 0; i < %d; i++) { total += i %% 7 }\n"
+		"result = total\n",
+		iterations);
+	double total = 0.0;
+	for (int i = 0; i < iterations; ++i) total += i % 7;
+
+#ifdef ENABLE_UNIT_LOCK
+	const char *const lock = "a lock around each unit";
+#else
+	const char *const lock = "safepoints";
+#endif
+	for (int bytecode = 0; bytecode < 2; ++bytecode)
+	{
+		double time = 0.0;
+		const unsigned long units = CProgram::getUnitsExecuted();
+		CHECK(runProgram(code, bytecode != 0, &time).getNum() == total);
+		const unsigned long executed = CProgram::getUnitsExecuted() - units;
+		CHECK(executed > (unsigned long)iterations);
+		printf("%s, %s: %lu units, %.2f million units/s, %.2f million iterations/s\n",
+			bytecode ? "bytecode" : "units", lock, executed, executed / time / 1e6, iterations / time / 1e6);
+	}
+
+	CProgram::freeGlobals();
+	return true;
+}
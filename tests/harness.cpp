@@ -0,0 +1,137 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Test registration and the test runner.
+ */
+
+#include "harness.h"
+#include <string.h>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <time.h>
+#endif
+
+typedef std::pair<std::string, TEST_FUNC> TEST_ENTRY;
+
+static unsigned int g_random = 1;
+
+/*
+ * The registered tests. A function, so that the vector exists before
+ * any test registers itself.
+ */
+static std::vector<TEST_ENTRY> &tests(void)
+{
+	static std::vector<TEST_ENTRY> tests;
+	return tests;
+}
+
+tagTest::tagTest(const char *name, const TEST_FUNC func)
+{
+	tests().push_back(TEST_ENTRY(name, func));
+}
+
+double seconds(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return double(count.QuadPart) / double(freq.QuadPart);
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+unsigned int testRandom(void)
+{
+	// Numerical Recipes' linear congruential generator.
+	g_random = g_random * 1664525 + 1013904223;
+	return g_random >> 8;
+}
+
+void testSeed(const unsigned int seed)
+{
+	g_random = seed;
+}
+
+/*
+ * Run one test, reporting its result.
+ */
+static bool run(const TEST_ENTRY &test)
+{
+	printf("[%s]\n", test.first.c_str());
+	testSeed(1);
+	const double start = seconds();
+	const bool bPassed = test.second();
+	printf("[%s] %s (%.0f ms)\n\n", test.first.c_str(), bPassed ? "passed" : "FAILED", (seconds() - start) * 1000.0);
+	return bPassed;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector<TEST_ENTRY>::const_iterator i;
+	int failures = 0;
+
+	if (argc < 2)
+	{
+		for (i = tests().begin(); i != tests().end(); ++i)
+		{
+			if (!run(*i)) ++failures;
+		}
+		return failures;
+	}
+
+	for (int j = 1; j < argc; ++j)
+	{
+		for (i = tests().begin(); i != tests().end(); ++i)
+		{
+			if (i->first == argv[j]) break;
+		}
+		if (i == tests().end())
+		{
+			printf("No test named %s.\n", argv[j]);
+			++failures;
+		}
+		else if (!run(*i))
+		{
+			++failures;
+		}
+	}
+	return failures;
+}
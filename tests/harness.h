@@ -0,0 +1,84 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Checks and benchmarks of parts of the engine that can be built on
+ * their own. Each test is a function registered with TEST(), run by
+ * name (tktests name ...) or, with no names given, all in turn. A test
+ * fails if any of its CHECK()s does not hold; timings are printed for
+ * comparison but never checked, since they depend on the machine.
+ */
+
+#ifndef _HARNESS_H_
+#define _HARNESS_H_
+
+#include <stdio.h>
+
+typedef bool (*TEST_FUNC)(void);
+
+/*
+ * Registers a test while static objects are constructed.
+ */
+typedef struct tagTest
+{
+	tagTest(const char *name, const TEST_FUNC func);
+
+} TEST_REGISTRATION;
+
+#define TEST(name) \
+	static bool test_##name(void); \
+	static TEST_REGISTRATION register_##name(#name, test_##name); \
+	static bool test_##name(void)
+
+#define CHECK(cond) \
+	if (!(cond)) \
+	{ \
+		printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #cond); \
+		return false; \
+	}
+
+/*
+ * Seconds since an arbitrary point, at the finest resolution available.
+ */
+double seconds(void);
+
+/*
+ * A repeatable pseudo-random number, for test data.
+ */
+unsigned int testRandom(void);
+
+/*
+ * Seed testRandom().
+ */
+void testSeed(const unsigned int seed);
+
+#endif
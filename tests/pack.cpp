@@ -0,0 +1,248 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Packing a project. A synthetic project of some thousands of files is
+ * packed by PackClose(), which deflates on a pool of workers, and in
+ * part by the byte at a time Add() it replaced. Every file must read
+ * back through pakfs as it was written; the time of each pack is
+ * printed. More files than a zip's directory can count must fail.
+ */
+
+#include "harness.h"
+#include "../trans3/common/pakfs.h"
+#include "../tkzip/zippack.h"
+#include "../tkzip/zipoperate.h"
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * A file of the project. Media are random bytes, as compressed
+ * images and sounds are; the rest are text.
+ */
+typedef struct tagTestFile
+{
+	std::string name;					// Name in the project, e.g. Boards\board12.brd
+	std::string path;					// File on disk.
+	std::vector<BYTE> data;
+	bool bMedia;
+
+} TEST_FILE;
+
+static const char *const FOLDERS[] = {"Boards", "Prg", "Tiles", "Media"};
+static const char *const EXTENSIONS[] = {"brd", "prg", "tst", "png"};
+static const char *const WORDS[] = {"player", "item", "board", "tile", "vector", "program", "if", "while", "(", ")", "{", "}", ";", " ", "\r\n"};
+
+static std::string tempPath(const std::string &name)
+{
+	char path[MAX_PATH];
+	GetTempPath(MAX_PATH, path);
+	return std::string(path) + name;
+}
+
+static std::vector<TEST_FILE> makeProject(const std::string &dir, const int files)
+{
+	CreateDirectory(dir.c_str(), NULL);
+	for (int i = 0; i < 4; ++i) CreateDirectory((dir + FOLDERS[i]).c_str(), NULL);
+
+	std::vector<TEST_FILE> project(files);
+	for (int i = 0; i < files; ++i)
+	{
+		TEST_FILE &file = project[i];
+		const int folder = testRandom() % 4;
+		char name[MAX_PATH];
+		sprintf(name, "%s\\file%d.%s", FOLDERS[folder], i, EXTENSIONS[folder]);
+		file.name = name;
+		file.path = dir + name;
+		file.bMedia = (folder == 3);
+
+		const unsigned int size = testRandom() % 8192;
+		while (file.data.size() < size)
+		{
+			if (file.bMedia)
+			{
+				file.data.push_back(BYTE(testRandom()));
+			}
+			else
+			{
+				const char *const word = WORDS[testRandom() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+				file.data.insert(file.data.end(), word, word + strlen(word));
+			}
+		}
+
+		FILE *const p = fopen(file.path.c_str(), "wb");
+		if (!file.data.empty()) fwrite(&file.data[0], 1, file.data.size(), p);
+		fclose(p);
+	}
+	return project;
+}
+
+static void deleteProject(const std::string &dir, const std::vector<TEST_FILE> &project)
+{
+	for (unsigned int i = 0; i < project.size(); ++i) DeleteFile(project[i].path.c_str());
+	for (int i = 0; i < 4; ++i) RemoveDirectory((dir + FOLDERS[i]).c_str());
+	RemoveDirectory(dir.c_str());
+}
+
+/*
+ * Check the first files of a project against an archive, through pakfs.
+ */
+static bool readBack(const std::string &archive, const std::vector<TEST_FILE> &project, const unsigned int files)
+{
+	if (!pakOpen(archive)) return false;
+
+	bool bSame = true;
+	for (unsigned int i = 0; i < files && bSame; ++i)
+	{
+		const TEST_FILE &file = project[i];
+		PAK_FILE *const p = pakAcquire(file.name);
+		bSame = (pakExists(file.name) && p && p->data == file.data);
+		if (p) pakRelease(p);
+
+		// A range from the middle.
+		if (bSame && file.data.size() > 16)
+		{
+			BYTE range[8];
+			const LONG offset = file.data.size() / 2;
+			bSame = (pakRead(file.name, offset, range, sizeof(range)) &&
+				std::equal(range, range + sizeof(range), file.data.begin() + offset));
+		}
+	}
+
+	// The files are found by name whatever the case and separator.
+	if (bSame)
+	{
+		std::string name = project[0].name;
+		for (std::string::iterator i = name.begin(); i != name.end(); ++i)
+		{
+			*i = (*i == '\\') ? '/' : char(toupper((unsigned char)*i));
+		}
+		bSame = pakExists(name);
+	}
+
+	// Extracted to disk.
+	if (bSame)
+	{
+		const std::string extracted = tempPath("tktests.tmp");
+		bSame = pakExtract(project[0].name, extracted);
+		if (bSame)
+		{
+			std::vector<BYTE> data(project[0].data.size() + 1);
+			FILE *const p = fopen(extracted.c_str(), "rb");
+			data.resize(fread(&data[0], 1, data.size(), p));
+			fclose(p);
+			bSame = (data == project[0].data);
+		}
+		DeleteFile(extracted.c_str());
+	}
+
+	pakClose();
+	return bSame;
+}
+
+static double megabytes(const std::vector<TEST_FILE> &project, const unsigned int files)
+{
+	double bytes = 0.0;
+	for (unsigned int i = 0; i < files; ++i) bytes += project[i].data.size();
+	return bytes / (1024.0 * 1024.0);
+}
+
+TEST(pack)
+{
+	// Some thousands of files of up to 8kB; the byte at a time packer
+	// is only given the first few hundred.
+	const int files = 3000, slowFiles = 300;
+	const std::string dir = tempPath("tktests\\");
+	const std::string archive = tempPath("tktests.tpk"), slowArchive = tempPath("tktests_slow.tpk");
+	const std::vector<TEST_FILE> project = makeProject(dir, files);
+
+	double t = seconds();
+	PACK *const pPack = PackCreate(const_cast<char *>(archive.c_str()), 0);
+	CHECK(pPack);
+	for (int i = 0; i < files; ++i)
+	{
+		if (!project[i].bMedia) PackAdd(pPack, const_cast<char *>(project[i].path.c_str()), const_cast<char *>(project[i].name.c_str()));
+	}
+	// Media are already compressed.
+	PackSetStoreOnly(pPack, true);
+	for (int i = 0; i < files; ++i)
+	{
+		if (project[i].bMedia) PackAdd(pPack, const_cast<char *>(project[i].path.c_str()), const_cast<char *>(project[i].name.c_str()));
+	}
+	CHECK(PackClose(pPack) == 1);
+	double elapsed = seconds() - t;
+	printf("PackClose(): %d files, %.1f MB/s\n", files, megabytes(project, files) / elapsed);
+
+	t = seconds();
+	zipFile zf = CreateZip(const_cast<char *>(slowArchive.c_str()), 0);
+	CHECK(zf);
+	for (int i = 0; i < slowFiles; ++i)
+	{
+		Add(const_cast<char *>(project[i].path.c_str()), const_cast<char *>(project[i].name.c_str()), zf);
+	}
+	CloseCreatedZip(zf);
+	elapsed = seconds() - t;
+	printf("Add():       %d files, %.1f MB/s\n", slowFiles, megabytes(project, slowFiles) / elapsed);
+
+	const bool bPacked = readBack(archive, project, files), bSlowPacked = readBack(slowArchive, project, slowFiles);
+	DeleteFile(archive.c_str());
+	DeleteFile(slowArchive.c_str());
+	deleteProject(dir, project);
+
+	CHECK(bPacked);
+	CHECK(bSlowPacked);
+	return true;
+}
+
+TEST(pack_limit)
+{
+	// One empty file, added under 0x10000 names.
+	const std::string file = tempPath("tktests.txt"), archive = tempPath("tktests.tpk");
+	fclose(fopen(file.c_str(), "wb"));
+
+	PACK *const pPack = PackCreate(const_cast<char *>(archive.c_str()), 0);
+	CHECK(pPack);
+	for (int i = 0; i <= 0xFFFF; ++i)
+	{
+		char name[32];
+		sprintf(name, "file%d.txt", i);
+		PackAdd(pPack, const_cast<char *>(file.c_str()), name);
+	}
+	const int result = PackClose(pPack);
+	DeleteFile(archive.c_str());
+	DeleteFile(file.c_str());
+
+	CHECK(result == 0);
+	return true;
+}
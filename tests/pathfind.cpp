@@ -0,0 +1,262 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * A* on synthetic boards. A grid of open and blocked squares is searched
+ * with CPathFind::search(), whose open set is a binary heap, and with the
+ * linear scans it replaced. Both must find the shortest route, as found
+ * by a breadth-first search; node expansions per millisecond are timed.
+ */
+
+#include "harness.h"
+#include "../trans3/movement/CPathFind/CPathFind.h"
+#include <queue>
+#include <stdlib.h>
+
+/*
+ * A board of blocked squares, searched by axial moves.
+ */
+class CGridPathFind: public CPathFind
+{
+public:
+	CGridPathFind(const int width, const int height, const int percentBlocked);
+
+	bool isBlocked(const int x, const int y) const { return m_blocked[y * m_width + x]; }
+
+	// Search by heap (CPathFind::search()) or by linear scans, returning
+	// the cost of the route found, or -1 if there is none.
+	int find(const int sx, const int sy, const int gx, const int gy, const bool bLinear);
+
+	// The length of the shortest route, by breadth-first search, or -1.
+	int shortest(const int sx, const int sy, const int gx, const int gy) const;
+
+	// Nodes expanded by the last search.
+	int expansions(void) const { return m_steps; }
+
+private:
+	int distance(const NODE &a, const NODE &b) const
+	{
+		return abs(int(a.pos.x - b.pos.x)) + abs(int(a.pos.y - b.pos.y));
+	}
+	bool getChild(NODE &child, NODE &parent);
+	bool isChild(const NODE &child, const NODE &parent) const;
+
+	// The search as it was before the heap: the best open node and any
+	// earlier visit to a child are found by scanning every node.
+	bool linearSearch(void);
+
+	std::vector<bool> m_blocked;
+	int m_width, m_height;
+	int m_next;
+};
+
+static const int g_moves[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+
+CGridPathFind::CGridPathFind(const int width, const int height, const int percentBlocked):
+	m_blocked(width * height, false),
+	m_width(width),
+	m_height(height),
+	m_next(0)
+{
+	m_heuristic = PF_AXIAL;
+	for (unsigned int i = 0; i < m_blocked.size(); ++i)
+	{
+		m_blocked[i] = (int(testRandom() % 100) < percentBlocked);
+	}
+}
+
+bool CGridPathFind::getChild(NODE &child, NODE &parent)
+{
+	if (m_next == 4)
+	{
+		m_next = 0;
+		return false;
+	}
+	child.pos.x = parent.pos.x + g_moves[m_next][0];
+	child.pos.y = parent.pos.y + g_moves[m_next][1];
+	child.direction = MV_ENUM(MV_E + 2 * m_next);
+	++m_next;
+	return true;
+}
+
+bool CGridPathFind::isChild(const NODE &child, const NODE &parent) const
+{
+	const int x = int(child.pos.x), y = int(child.pos.y);
+	return (x >= 0 && x < m_width && y >= 0 && y < m_height && !isBlocked(x, y));
+}
+
+int CGridPathFind::find(const int sx, const int sy, const int gx, const int gy, const bool bLinear)
+{
+	const DB_POINT start = {double(sx), double(sy)}, goal = {double(gx), double(gy)};
+	m_start = NODE(start);
+	m_goal = NODE(goal);
+	if (!(bLinear ? linearSearch() : search())) return -1;
+	return m_closedNodes.back().cost;
+}
+
+bool CGridPathFind::linearSearch(void)
+{
+	m_start.dist = distance(m_start, m_goal);
+	m_steps = 0;
+
+	m_openNodes.clear();
+	m_closedNodes.clear();
+	m_openNodes.push_back(m_start);
+
+	while (!m_openNodes.empty())
+	{
+		++m_steps;
+		NV_ITR best = m_openNodes.begin();
+		for (NV_ITR i = m_openNodes.begin(); i != m_openNodes.end(); ++i)
+		{
+			if (i->fValue() < best->fValue()) best = i;
+		}
+		m_closedNodes.push_back(*best);
+		m_openNodes.erase(best);
+		NODE *parent = &m_closedNodes.back();
+
+		if (parent->pos == m_goal.pos) break;
+
+		NODE child;
+		while (getChild(child, *parent))
+		{
+			if (!isChild(child, *parent)) continue;
+
+			child.cost = parent->cost + distance(*parent, child);
+			child.dist = distance(child, m_goal);
+			child.parent = parent - &*m_closedNodes.begin();
+
+			NV_ITR k;
+			for (k = m_closedNodes.begin(); k != m_closedNodes.end(); ++k)
+			{
+				if (k->pos == child.pos)
+				{
+					if (k->cost > child.cost) *k = child;
+					break;
+				}
+			}
+			if (k != m_closedNodes.end()) continue;
+
+			for (k = m_openNodes.begin(); k != m_openNodes.end(); ++k)
+			{
+				if (k->pos == child.pos)
+				{
+					if (k->fValue() > child.fValue()) *k = child;
+					break;
+				}
+			}
+			if (k != m_openNodes.end()) continue;
+
+			m_openNodes.push_back(child);
+		}
+	}
+
+	return (m_closedNodes.back().pos == m_goal.pos);
+}
+
+int CGridPathFind::shortest(const int sx, const int sy, const int gx, const int gy) const
+{
+	std::vector<int> dist(m_blocked.size(), -1);
+	std::queue<int> queue;
+	dist[sy * m_width + sx] = 0;
+	queue.push(sy * m_width + sx);
+
+	while (!queue.empty())
+	{
+		const int i = queue.front();
+		queue.pop();
+		if (i == gy * m_width + gx) return dist[i];
+
+		for (int j = 0; j < 4; ++j)
+		{
+			const int x = i % m_width + g_moves[j][0], y = i / m_width + g_moves[j][1];
+			if (x < 0 || x >= m_width || y < 0 || y >= m_height || isBlocked(x, y)) continue;
+			if (dist[y * m_width + x] != -1) continue;
+			dist[y * m_width + x] = dist[i] + 1;
+			queue.push(y * m_width + x);
+		}
+	}
+	return -1;
+}
+
+/*
+ * Search between random open squares of a board, checking each
+ * route against the shortest, and print the rate of expansion.
+ */
+static bool searchBoard(const int size, const int percentBlocked, const int searches)
+{
+	CGridPathFind board(size, size, percentBlocked);
+
+	std::vector<int> points;
+	while (points.size() < unsigned(searches * 4))
+	{
+		const int x = testRandom() % size, y = testRandom() % size;
+		if (board.isBlocked(x, y)) continue;
+		points.push_back(x);
+		points.push_back(y);
+	}
+
+	double time[2] = {0.0, 0.0};
+	int expanded[2] = {0, 0}, found = 0;
+
+	for (int i = 0; i < searches * 4; i += 4)
+	{
+		const int best = board.shortest(points[i], points[i + 1], points[i + 2], points[i + 3]);
+		if (best > 0) ++found;
+
+		for (int linear = 0; linear < 2; ++linear)
+		{
+			const double start = seconds();
+			const int cost = board.find(points[i], points[i + 1], points[i + 2], points[i + 3], linear != 0);
+			time[linear] += seconds() - start;
+			expanded[linear] += board.expansions();
+
+			CHECK(cost == best);
+		}
+	}
+
+	printf("%dx%d, %d%% blocked, %d of %d routes:\n", size, size, percentBlocked, found, searches);
+	printf("  heap:   %8d expansions, %8.1f per ms\n", expanded[0], expanded[0] / (time[0] * 1000.0));
+	printf("  linear: %8d expansions, %8.1f per ms\n", expanded[1], expanded[1] / (time[1] * 1000.0));
+	return true;
+}
+
+TEST(pathfind)
+{
+	// Boards are kept under PF_MAX_STEPS squares, so that every
+	// search runs to completion.
+	CHECK(searchBoard(12, 20, 400));
+	CHECK(searchBoard(30, 0, 100));
+	CHECK(searchBoard(30, 25, 200));
+	CHECK(searchBoard(30, 40, 200));
+	return true;
+}
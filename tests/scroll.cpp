@@ -0,0 +1,282 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * The scroll cache. tagScrollCache is walked across a synthetic board:
+ * after every frame, each of its canvases must hold what a full redraw
+ * of its bounds would, and the screen must lie within them. The time
+ * and the tiles drawn in each frame are measured, both for a cache
+ * that steps a tile at a time and for one redrawn in full whenever
+ * the screen leaves it, to show the spikes of full redraws.
+ */
+
+#include "harness.h"
+#include "../trans3/render/scrollcache.h"
+#include <algorithm>
+#include <vector>
+
+static const int TILE = 32;
+
+/*
+ * Random tiles on several layers. The first layer is opaque; the
+ * others are mostly transparent.
+ */
+class CTestBoard: public CScrollSource
+{
+public:
+	CTestBoard(const int width, const int height, const int layers);
+	~CTestBoard();
+
+	int pxWidth(void) const { return m_width * TILE; }
+	int pxHeight(void) const { return m_height * TILE; }
+	int layers(void) const { return m_layers; }
+	bool isLayerCached(const int layer) const { return (layer >= 2); }
+	bool isIsometric(void) const { return false; }
+
+	// Tiles drawn so far.
+	unsigned int drawn(void) const { return m_drawn; }
+
+	// Draw the whole tiles of layers lLower to lUpper that overlap an
+	// area of the board onto a canvas, as tagBoard::render() does.
+	void render(CCanvas *const cnv, const int destX, const int destY, const int lLower, const int lUpper,
+		const int x, const int y, const int width, const int height);
+
+private:
+	CTestBoard(const CTestBoard &);
+	CTestBoard &operator=(const CTestBoard &);
+
+	std::vector<CCanvas *> m_tiles;
+	std::vector<int> m_board;			// Tile on each square of each layer, or -1.
+	int m_width, m_height, m_layers;
+	unsigned int m_drawn;
+};
+
+static long randomColor(void)
+{
+	return long(testRandom() & 0x00ffffff);
+}
+
+CTestBoard::CTestBoard(const int width, const int height, const int layers):
+	m_width(width),
+	m_height(height),
+	m_layers(layers),
+	m_drawn(0)
+{
+	// Twelve opaque tiles, then twelve with transparent surrounds.
+	for (int i = 0; i < 24; ++i)
+	{
+		CCanvas *const p = new CCanvas();
+		p->CreateBlank(NULL, TILE, TILE);
+		p->ClearScreen(i < 12 ? randomColor() : TRANSP_COLOR);
+		for (int j = 0; j < 3; ++j)
+		{
+			const int x = testRandom() % TILE, y = testRandom() % TILE;
+			p->DrawFilledRect(x, y, x + testRandom() % TILE, y + testRandom() % TILE, randomColor());
+		}
+		m_tiles.push_back(p);
+	}
+
+	m_board.resize(width * height * layers);
+	for (int i = 0; i < width * height; ++i)
+	{
+		m_board[i] = testRandom() % 12;
+	}
+	for (int i = width * height; i < width * height * layers; ++i)
+	{
+		m_board[i] = (testRandom() % 10 < 3 ? 12 + testRandom() % 12 : -1);
+	}
+}
+
+CTestBoard::~CTestBoard()
+{
+	for (unsigned int i = 0; i < m_tiles.size(); ++i) delete m_tiles[i];
+}
+
+void CTestBoard::render(CCanvas *const cnv, const int destX, const int destY, const int lLower, const int lUpper,
+	const int x, const int y, const int width, const int height)
+{
+	const int left = std::max(x / TILE, 0), right = std::min((x + width - 1) / TILE, m_width - 1);
+	const int top = std::max(y / TILE, 0), bottom = std::min((y + height - 1) / TILE, m_height - 1);
+
+	for (int l = lLower; l <= lUpper; ++l)
+	{
+		for (int j = top; j <= bottom; ++j)
+		{
+			for (int i = left; i <= right; ++i)
+			{
+				const int tile = m_board[((l - 1) * m_height + j) * m_width + i];
+				if (tile < 0) continue;
+				m_tiles[tile]->BltTransparent(cnv, destX + i * TILE - x, destY + j * TILE - y, TRANSP_COLOR);
+				++m_drawn;
+			}
+		}
+	}
+}
+
+static bool samePixels(const CCanvas &a, const CCanvas &b)
+{
+	if (a.GetWidth() != b.GetWidth() || a.GetHeight() != b.GetHeight()) return false;
+	for (int y = 0; y < a.GetHeight(); ++y)
+	{
+		const CCanvas::PIXEL *const p = a.GetPixels() + y * a.GetPitch(), *const q = b.GetPixels() + y * b.GetPitch();
+		if (!std::equal(p, p + a.GetWidth(), q)) return false;
+	}
+	return true;
+}
+
+/*
+ * Does each of the cache's canvases hold what a full redraw of its
+ * bounds would, and does it cover the screen?
+ */
+static bool isCacheCurrent(const SCROLL_CACHE &cache, CTestBoard &board, const RECT &screen)
+{
+	if (screen.left < cache.r.left || screen.top < cache.r.top ||
+		screen.right > cache.r.right || screen.bottom > cache.r.bottom)
+	{
+		return false;
+	}
+
+	const int width = cache.r.right - cache.r.left, height = cache.r.bottom - cache.r.top;
+	CCanvas held, redrawn;
+	held.CreateBlank(NULL, width, height);
+	redrawn.CreateBlank(NULL, width, height);
+
+	for (unsigned int i = 0; i < cache.layers.size(); ++i)
+	{
+		if (i && !cache.layers[i]) continue;
+		cache.get(i ? *cache.layers[i] : cache.cnv, &held, cache.r.left, cache.r.top, cache.r);
+
+		redrawn.ClearScreen(TRANSP_COLOR);
+		board.render(&redrawn, 0, 0, (i ? i : 1), (i ? i : board.layers()), cache.r.left, cache.r.top, width, height);
+		if (!samePixels(held, redrawn)) return false;
+	}
+	return true;
+}
+
+static SCROLL_CACHE *createCache(CTestBoard &board, const RECT &screen)
+{
+	SCROLL_CACHE *const p = new SCROLL_CACHE();
+	p->createCanvas((screen.right - screen.left) * 2, (screen.bottom - screen.top) * 2);
+	p->scroll(board, screen, true, false);
+	return p;
+}
+
+TEST(scroll_equivalence)
+{
+	CTestBoard board(64, 48, 3);
+	const int screenWidth = 320, screenHeight = 240;
+	RECT screen = {0, 0, screenWidth, screenHeight};
+	SCROLL_CACHE *const pCache = createCache(board, screen);
+	CHECK(pCache->layers.size() == 4 && pCache->layers[2] && pCache->layers[3]);
+
+	// Wander in steps of up to a few tiles, sometimes jumping
+	// further than the cache, and sometimes stopping while the
+	// cache catches up.
+	int x = 0, y = 0, moves = 0, wrapped = 0;
+	for (int i = 0; i < 1000; ++i)
+	{
+		const int step = (i % 50 == 49 ? 1200 : (i % 7 == 6 ? 0 : 1 + testRandom() % 100));
+		switch (testRandom() % 4)
+		{
+			case 0: x += step; break;
+			case 1: x -= step; break;
+			case 2: y += step; break;
+			case 3: y -= step; break;
+		}
+		x = std::max(0, std::min(x, board.pxWidth() - screenWidth));
+		y = std::max(0, std::min(y, board.pxHeight() - screenHeight));
+
+		const RECT next = {x, y, x + screenWidth, y + screenHeight};
+		screen = next;
+		if (pCache->scroll(board, screen, false, false)) ++moves;
+		if (pCache->originX || pCache->originY) ++wrapped;
+
+		if (!isCacheCurrent(*pCache, board, screen))
+		{
+			delete pCache;
+			CHECK(!"cache differs from a full redraw");
+		}
+	}
+	delete pCache;
+
+	printf("%d cache moves (%d frames wrapped), all identical\n", moves, wrapped);
+	CHECK(moves > 200);
+	CHECK(wrapped > 200);
+	return true;
+}
+
+TEST(scroll_benchmark)
+{
+	// An 8192x8192 board, walked at four pixels a frame.
+	CTestBoard board(256, 256, 3);
+	const int screenWidth = 640, screenHeight = 480, speed = 4;
+	unsigned int worst[2] = {0, 0};
+
+	for (int whole = 1; whole >= 0; --whole)
+	{
+		RECT screen = {0, 0, screenWidth, screenHeight};
+		SCROLL_CACHE *const pCache = createCache(board, screen);
+		CCanvas cnv;
+		cnv.CreateBlank(NULL, screenWidth, screenHeight);
+
+		std::vector<double> times;
+		unsigned int frames = 0;
+		int x = 0, y = 0;
+		while (x + screenWidth < board.pxWidth() && y + screenHeight < board.pxHeight())
+		{
+			// East, with a step south every fourth frame.
+			x += speed;
+			if (++frames % 4 == 0) y += speed;
+			const RECT next = {x, y, x + screenWidth, y + screenHeight};
+			screen = next;
+
+			const unsigned int drawn = board.drawn();
+			const double t = seconds();
+			pCache->scroll(board, screen, false, whole != 0);
+			pCache->drawLayer(&cnv, 0, screen, screen.left, screen.top);
+			times.push_back((seconds() - t) * 1000.0);
+			worst[whole] = std::max(worst[whole], board.drawn() - drawn);
+		}
+		delete pCache;
+
+		std::sort(times.begin(), times.end());
+		double total = 0.0;
+		for (unsigned int i = 0; i < times.size(); ++i) total += times[i];
+
+		printf("%-6s %u frames: mean %.3f ms, 99th percentile %.3f ms, worst %.3f ms; most tiles in a frame %u\n",
+			whole ? "whole:" : "step:", frames, total / times.size(), times[times.size() * 99 / 100], times.back(), worst[whole]);
+	}
+
+	// No frame draws more than a tenth of what a full redraw does.
+	CHECK(worst[0] * 10 < worst[1]);
+	return true;
+}
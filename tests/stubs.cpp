@@ -0,0 +1,222 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Stand-ins for the parts of the engine that the units under test
+ * refer to but the tests do not use.
+ */
+
+#include "stubs.h"
+#include "../trans3/rpgcode/CProgram.h"
+#include "../trans3/common/board.h"
+#include "../trans3/common/mainfile.h"
+#include "../trans3/common/paths.h"
+#include "../trans3/movement/CSprite/CSprite.h"
+#include "../trans3/movement/CItem/CItem.h"
+#include "../trans3/render/render.h"
+#include <stdio.h>
+
+unsigned int g_messages = 0;
+
+/*
+ * Paths (common/paths.cpp). Files are read straight from disk.
+ */
+STRING g_projectPath;
+STRING g_savePath;
+STRING g_pakTempPath;
+
+static STRING resolveUnchanged(const STRING &path)
+{
+	return path;
+}
+
+// resolve itself is defined in tkGfx/CTile.cpp, as NULL.
+static const bool g_bResolve = ((resolve = resolveUnchanged) != NULL);
+
+STRING removePath(const STRING &str, const STRING &preserveFrom)
+{
+	return str;
+}
+
+/*
+ * The window and the message box (common/mbox.cpp).
+ */
+void messageBox(const STRING str)
+{
+	++g_messages;
+	printf("Message: %s\n", str.c_str());
+}
+
+/*
+ * Time and input (app/replay.cpp, input/input.cpp). Nothing is
+ * recorded or replayed, and no events arrive.
+ */
+DWORD engineTime(void)
+{
+	return GetTickCount();
+}
+
+void processEvent()
+{
+}
+
+bool isQuitting()
+{
+	return false;
+}
+
+/*
+ * Miscellany (misc/misc.cpp, plugins/Callbacks.cpp).
+ */
+FILE *createTemporaryFile()
+{
+	return tmpfile();
+}
+
+STRING &replace(STRING &str, const STRING &find, const STRING &replace)
+{
+	unsigned int pos = STRING::npos;
+	while ((pos = str.find(find)) != STRING::npos)
+	{
+		str.erase(pos, find.length());
+		str.insert(pos, replace);
+	}
+	return str;
+}
+
+CProgram *g_prg = NULL;
+
+/*
+ * RPGCode functions the interpreter itself refers to (rpgcode/functions.cpp).
+ * There is no message window to reset, and no sprites to move.
+ */
+void programInit()
+{
+}
+
+void programFinish()
+{
+}
+
+void multiRunBegin(CALL_DATA &params)
+{
+}
+
+void multiRunEnd(CProgram *prg)
+{
+}
+
+void setErrorHandler(CALL_DATA &params)
+{
+	if (params.params != 1)
+	{
+		throw CError(_T("SetErrorHandler() requires one parameter."));
+	}
+	const STRING label = (params[0].udt & UDT_LABEL) ? params[0].lit : params[0].getLit();
+	params.prg->setErrorHandler(label);
+}
+
+void setResumeNextHandler(CALL_DATA &params)
+{
+	if (params.params != 0)
+	{
+		throw CError(_T("SetResumeNextHandler() requires zero parameters."));
+	}
+	params.prg->setErrorHandler(_T(" "));
+}
+
+void resumeNext(CALL_DATA &params)
+{
+	if (params.params != 0)
+	{
+		throw CError(_T("ResumeNext() requires zero parameters."));
+	}
+	params.prg->resumeFromErrorHandler();
+}
+
+/*
+ * The game (app/winmain.cpp). There is no board and there are no sprites
+ * unless a test makes them.
+ */
+MAIN_FILE g_mainFile;
+LPBOARD g_pBoard = NULL;
+ZO_VECTOR g_sprites;
+
+/*
+ * The screen (render/render.cpp). Nothing is drawn.
+ */
+RECT g_screen = {0, 0, 0, 0};
+DAMAGE g_damage;
+
+void setAmbientLevel(void)
+{
+}
+
+/*
+ * Sprites (movement/CSprite, movement/CItem, common/sprite.cpp), which
+ * boards refer to. Items cannot be loaded.
+ */
+CSprite::CSprite(const bool show):
+m_bActive(show),
+m_pCanvas(NULL),
+m_pPathFind(NULL),
+m_facing(this),
+m_thread(NULL)
+{
+}
+
+void CSprite::setPosition(int x, int y, const int l, const COORD_TYPE coord)
+{
+}
+
+void tagZOrderedSprites::unfile(const CSprite *p)
+{
+}
+
+void tagSpriteAttr::freeAnimations(void)
+{
+}
+
+void tagSpriteAttr::createVectors(const int activationType)
+{
+}
+
+CItem::CItem(const STRING file, const BRD_SPRITE spr, short &version, const bool thread):
+CSprite(false),
+m_pThread(NULL)
+{
+	throw CInvalidItem();
+}
+
+CItem::~CItem()
+{
+}
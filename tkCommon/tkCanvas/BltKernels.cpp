@@ -0,0 +1,606 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2007  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+//--------------------------------------------------------------------------
+// Pixel kernels for 32-bit blts - see BltKernels.h
+//--------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------
+// Inclusions
+//--------------------------------------------------------------------------
+#include "BltKernels.h"				// Contains stuff for this file
+
+// SSE2 is available on every x86 compiler we build with; the CPU is
+// checked before it is used.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#	define BLT_HAVE_SSE2
+#	include <emmintrin.h>
+#endif
+
+// AVX2 needs VC++ 2012 or a GCC that can target it per function.
+#if defined(BLT_HAVE_SSE2) && ((defined(_MSC_VER) && _MSC_VER >= 1700) || (defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))))
+#	define BLT_HAVE_AVX2
+#	include <immintrin.h>
+#	ifdef _MSC_VER
+#		define BLT_AVX2_TARGET
+#	else
+#		define BLT_AVX2_TARGET __attribute__((target("avx2")))
+#	endif
+#endif
+
+#ifdef _MSC_VER
+#	include <intrin.h>				// __cpuid
+#endif
+
+//--------------------------------------------------------------------------
+// Definitions
+//--------------------------------------------------------------------------
+#define BLT_RGB_MASK 0x00ffffff		// The bytes of a pixel holding colour
+
+namespace
+{
+
+	// Kernels for a single row.
+	typedef VOID (*BLT_BLEND_ROW)(DWORD *, CONST DWORD *, CONST INT, CONST INT, CONST DWORD, CONST DWORD);
+	typedef VOID (*BLT_KEY_ROW)(DWORD *, CONST DWORD *, CONST INT, CONST DWORD);
+	typedef VOID (*BLT_SHADE_ROW)(DWORD *, CONST INT, CONST DWORD, CONST DWORD);
+
+	typedef struct tagBltKernels
+	{
+		BLT_LEVEL level;
+		BLT_BLEND_ROW translucent;
+		BLT_BLEND_ROW additive;
+		BLT_KEY_ROW transparent;
+		BLT_SHADE_ROW shade;
+	} BLT_KERNELS;
+
+	//----------------------------------------------------------------------
+	// Scalar kernels: the reference for the others
+	//----------------------------------------------------------------------
+
+	// Bound an INT to [0, 255].
+	INLINE DWORD bound(CONST INT x)
+	{
+		return DWORD(x < 0 ? 0 : (x > 255 ? 255 : x));
+	}
+
+	VOID translucentRow(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST INT a,
+		CONST DWORD crUnaffected,
+		CONST DWORD crTransparent)
+	{
+		CONST INT b = 256 - a;
+		for (INT i = 0; i < width; ++i)
+		{
+			CONST DWORD src = pSrc[i] & BLT_RGB_MASK;
+			if (src == crUnaffected)
+			{
+				pDest[i] = src;
+			}
+			else if (src != crTransparent)
+			{
+				CONST DWORD dest = pDest[i];
+				DWORD res = 0;
+				for (INT shift = 0; shift < 24; shift += 8)
+				{
+					CONST INT s = (src >> shift) & 0xff, d = (dest >> shift) & 0xff;
+					res |= DWORD((s * a + d * b) >> 8) << shift;
+				}
+				pDest[i] = res;
+			}
+		}
+	}
+
+	VOID additiveRow(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST INT p,
+		CONST DWORD crUnaffected,
+		CONST DWORD crTransparent)
+	{
+		for (INT i = 0; i < width; ++i)
+		{
+			CONST DWORD src = pSrc[i] & BLT_RGB_MASK, dest = pDest[i];
+			if (src == crUnaffected)
+			{
+				pDest[i] = src;
+			}
+			else if ((dest & BLT_RGB_MASK) != crTransparent)
+			{
+				DWORD res = 0;
+				for (INT shift = 0; shift < 24; shift += 8)
+				{
+					CONST INT s = (src >> shift) & 0xff, d = (dest >> shift) & 0xff;
+					res |= bound(d + ((s * p) >> 8)) << shift;
+				}
+				pDest[i] = res;
+			}
+		}
+	}
+
+	VOID transparentRow(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST DWORD crTransparent)
+	{
+		for (INT i = 0; i < width; ++i)
+		{
+			if ((pSrc[i] & BLT_RGB_MASK) != crTransparent) pDest[i] = pSrc[i];
+		}
+	}
+
+	VOID shadeRow(
+		DWORD *pDest,
+		CONST INT width,
+		CONST DWORD add,
+		CONST DWORD sub)
+	{
+		for (INT i = 0; i < width; ++i)
+		{
+			CONST DWORD dest = pDest[i];
+			DWORD res = 0;
+			for (INT shift = 0; shift < 24; shift += 8)
+			{
+				CONST INT d = (dest >> shift) & 0xff, a = (add >> shift) & 0xff, s = (sub >> shift) & 0xff;
+				res |= bound((d + a > 255 ? 255 : d + a) - s) << shift;
+			}
+			pDest[i] = res;
+		}
+	}
+
+#ifdef BLT_HAVE_SSE2
+
+	//----------------------------------------------------------------------
+	// SSE2 kernels: four pixels at a time, channels widened to 16 bits
+	//----------------------------------------------------------------------
+
+	VOID translucentRowSSE2(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST INT a,
+		CONST DWORD crUnaffected,
+		CONST DWORD crTransparent)
+	{
+		CONST __m128i zero = _mm_setzero_si128();
+		CONST __m128i mask = _mm_set1_epi32(BLT_RGB_MASK);
+		CONST __m128i va = _mm_set1_epi16(short(a)), vb = _mm_set1_epi16(short(256 - a));
+		CONST __m128i vu = _mm_set1_epi32(INT(crUnaffected)), vt = _mm_set1_epi32(INT(crTransparent));
+
+		INT i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			CONST __m128i s = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<CONST __m128i *>(pSrc + i)), mask);
+			CONST __m128i d = _mm_loadu_si128(reinterpret_cast<CONST __m128i *>(pDest + i));
+
+			// s * a + d * (256 - a) is at most 0xff00, so fits unsigned 16 bits
+			CONST __m128i lo = _mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), va),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), vb));
+			CONST __m128i hi = _mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), va),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), vb));
+			CONST __m128i blend = _mm_and_si128(_mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)), mask);
+
+			// Unaffected pixels take the source, transparent ones the destination
+			CONST __m128i eqU = _mm_cmpeq_epi32(s, vu);
+			CONST __m128i eqT = _mm_andnot_si128(eqU, _mm_cmpeq_epi32(s, vt));
+			__m128i res = _mm_or_si128(_mm_and_si128(eqU, s), _mm_andnot_si128(eqU, blend));
+			res = _mm_or_si128(_mm_and_si128(eqT, d), _mm_andnot_si128(eqT, res));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pDest + i), res);
+		}
+		translucentRow(pDest + i, pSrc + i, width - i, a, crUnaffected, crTransparent);
+	}
+
+	VOID additiveRowSSE2(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST INT p,
+		CONST DWORD crUnaffected,
+		CONST DWORD crTransparent)
+	{
+		CONST __m128i zero = _mm_setzero_si128();
+		CONST __m128i mask = _mm_set1_epi32(BLT_RGB_MASK);
+		CONST __m128i vp = _mm_set1_epi16(short(p * 2));
+		CONST __m128i vu = _mm_set1_epi32(INT(crUnaffected)), vt = _mm_set1_epi32(INT(crTransparent));
+
+		INT i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			CONST __m128i s = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<CONST __m128i *>(pSrc + i)), mask);
+			CONST __m128i d = _mm_loadu_si128(reinterpret_cast<CONST __m128i *>(pDest + i));
+
+			// ((s << 7) * (p << 1)) >> 16 == (s * p) >> 8, rounded down as in the
+			// scalar version; the saturating pack bounds the sum to [0, 255]
+			CONST __m128i lo = _mm_adds_epi16(
+				_mm_unpacklo_epi8(d, zero),
+				_mm_mulhi_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(s, zero), 7), vp));
+			CONST __m128i hi = _mm_adds_epi16(
+				_mm_unpackhi_epi8(d, zero),
+				_mm_mulhi_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(s, zero), 7), vp));
+			CONST __m128i sum = _mm_and_si128(_mm_packus_epi16(lo, hi), mask);
+
+			// Unaffected pixels take the source; transparent destination is kept
+			CONST __m128i eqU = _mm_cmpeq_epi32(s, vu);
+			CONST __m128i eqT = _mm_andnot_si128(eqU, _mm_cmpeq_epi32(_mm_and_si128(d, mask), vt));
+			__m128i res = _mm_or_si128(_mm_and_si128(eqU, s), _mm_andnot_si128(eqU, sum));
+			res = _mm_or_si128(_mm_and_si128(eqT, d), _mm_andnot_si128(eqT, res));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pDest + i), res);
+		}
+		additiveRow(pDest + i, pSrc + i, width - i, p, crUnaffected, crTransparent);
+	}
+
+	VOID transparentRowSSE2(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST DWORD crTransparent)
+	{
+		CONST __m128i mask = _mm_set1_epi32(BLT_RGB_MASK);
+		CONST __m128i vt = _mm_set1_epi32(INT(crTransparent));
+
+		INT i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			CONST __m128i s = _mm_loadu_si128(reinterpret_cast<CONST __m128i *>(pSrc + i));
+			CONST __m128i d = _mm_loadu_si128(reinterpret_cast<CONST __m128i *>(pDest + i));
+			CONST __m128i eqT = _mm_cmpeq_epi32(_mm_and_si128(s, mask), vt);
+			_mm_storeu_si128(
+				reinterpret_cast<__m128i *>(pDest + i), 
+				_mm_or_si128(_mm_and_si128(eqT, d), _mm_andnot_si128(eqT, s)));
+		}
+		transparentRow(pDest + i, pSrc + i, width - i, crTransparent);
+	}
+
+	VOID shadeRowSSE2(
+		DWORD *pDest,
+		CONST INT width,
+		CONST DWORD add,
+		CONST DWORD sub)
+	{
+		CONST __m128i mask = _mm_set1_epi32(BLT_RGB_MASK);
+		CONST __m128i va = _mm_set1_epi32(INT(add)), vs = _mm_set1_epi32(INT(sub));
+
+		INT i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			// Saturating byte arithmetic bounds each channel as it goes
+			CONST __m128i d = _mm_loadu_si128(reinterpret_cast<CONST __m128i *>(pDest + i));
+			_mm_storeu_si128(
+				reinterpret_cast<__m128i *>(pDest + i), 
+				_mm_and_si128(_mm_subs_epu8(_mm_adds_epu8(d, va), vs), mask));
+		}
+		shadeRow(pDest + i, width - i, add, sub);
+	}
+
+#endif // BLT_HAVE_SSE2
+
+#ifdef BLT_HAVE_AVX2
+
+	//----------------------------------------------------------------------
+	// AVX2 kernels: the SSE2 kernels eight pixels at a time. Unpacking and
+	// packing both work within 128-bit lanes, so pixel order is kept.
+	//----------------------------------------------------------------------
+
+	BLT_AVX2_TARGET VOID translucentRowAVX2(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST INT a,
+		CONST DWORD crUnaffected,
+		CONST DWORD crTransparent)
+	{
+		CONST __m256i zero = _mm256_setzero_si256();
+		CONST __m256i mask = _mm256_set1_epi32(BLT_RGB_MASK);
+		CONST __m256i va = _mm256_set1_epi16(short(a)), vb = _mm256_set1_epi16(short(256 - a));
+		CONST __m256i vu = _mm256_set1_epi32(INT(crUnaffected)), vt = _mm256_set1_epi32(INT(crTransparent));
+
+		INT i = 0;
+		for (; i + 8 <= width; i += 8)
+		{
+			CONST __m256i s = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<CONST __m256i *>(pSrc + i)), mask);
+			CONST __m256i d = _mm256_loadu_si256(reinterpret_cast<CONST __m256i *>(pDest + i));
+			CONST __m256i lo = _mm256_add_epi16(
+				_mm256_mullo_epi16(_mm256_unpacklo_epi8(s, zero), va),
+				_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), vb));
+			CONST __m256i hi = _mm256_add_epi16(
+				_mm256_mullo_epi16(_mm256_unpackhi_epi8(s, zero), va),
+				_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), vb));
+			CONST __m256i blend = _mm256_and_si256(_mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)), mask);
+
+			CONST __m256i eqU = _mm256_cmpeq_epi32(s, vu);
+			CONST __m256i eqT = _mm256_andnot_si256(eqU, _mm256_cmpeq_epi32(s, vt));
+			__m256i res = _mm256_blendv_epi8(blend, s, eqU);
+			res = _mm256_blendv_epi8(res, d, eqT);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(pDest + i), res);
+		}
+		translucentRow(pDest + i, pSrc + i, width - i, a, crUnaffected, crTransparent);
+	}
+
+	BLT_AVX2_TARGET VOID additiveRowAVX2(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST INT p,
+		CONST DWORD crUnaffected,
+		CONST DWORD crTransparent)
+	{
+		CONST __m256i zero = _mm256_setzero_si256();
+		CONST __m256i mask = _mm256_set1_epi32(BLT_RGB_MASK);
+		CONST __m256i vp = _mm256_set1_epi16(short(p * 2));
+		CONST __m256i vu = _mm256_set1_epi32(INT(crUnaffected)), vt = _mm256_set1_epi32(INT(crTransparent));
+
+		INT i = 0;
+		for (; i + 8 <= width; i += 8)
+		{
+			CONST __m256i s = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<CONST __m256i *>(pSrc + i)), mask);
+			CONST __m256i d = _mm256_loadu_si256(reinterpret_cast<CONST __m256i *>(pDest + i));
+			CONST __m256i lo = _mm256_adds_epi16(
+				_mm256_unpacklo_epi8(d, zero),
+				_mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_unpacklo_epi8(s, zero), 7), vp));
+			CONST __m256i hi = _mm256_adds_epi16(
+				_mm256_unpackhi_epi8(d, zero),
+				_mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_unpackhi_epi8(s, zero), 7), vp));
+			CONST __m256i sum = _mm256_and_si256(_mm256_packus_epi16(lo, hi), mask);
+
+			CONST __m256i eqU = _mm256_cmpeq_epi32(s, vu);
+			CONST __m256i eqT = _mm256_andnot_si256(eqU, _mm256_cmpeq_epi32(_mm256_and_si256(d, mask), vt));
+			__m256i res = _mm256_blendv_epi8(sum, s, eqU);
+			res = _mm256_blendv_epi8(res, d, eqT);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(pDest + i), res);
+		}
+		additiveRow(pDest + i, pSrc + i, width - i, p, crUnaffected, crTransparent);
+	}
+
+	BLT_AVX2_TARGET VOID transparentRowAVX2(
+		DWORD *pDest,
+		CONST DWORD *pSrc,
+		CONST INT width,
+		CONST DWORD crTransparent)
+	{
+		CONST __m256i mask = _mm256_set1_epi32(BLT_RGB_MASK);
+		CONST __m256i vt = _mm256_set1_epi32(INT(crTransparent));
+
+		INT i = 0;
+		for (; i + 8 <= width; i += 8)
+		{
+			CONST __m256i s = _mm256_loadu_si256(reinterpret_cast<CONST __m256i *>(pSrc + i));
+			CONST __m256i d = _mm256_loadu_si256(reinterpret_cast<CONST __m256i *>(pDest + i));
+			CONST __m256i eqT = _mm256_cmpeq_epi32(_mm256_and_si256(s, mask), vt);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(pDest + i), _mm256_blendv_epi8(s, d, eqT));
+		}
+		transparentRow(pDest + i, pSrc + i, width - i, crTransparent);
+	}
+
+	BLT_AVX2_TARGET VOID shadeRowAVX2(
+		DWORD *pDest,
+		CONST INT width,
+		CONST DWORD add,
+		CONST DWORD sub)
+	{
+		CONST __m256i mask = _mm256_set1_epi32(BLT_RGB_MASK);
+		CONST __m256i va = _mm256_set1_epi32(INT(add)), vs = _mm256_set1_epi32(INT(sub));
+
+		INT i = 0;
+		for (; i + 8 <= width; i += 8)
+		{
+			CONST __m256i d = _mm256_loadu_si256(reinterpret_cast<CONST __m256i *>(pDest + i));
+			_mm256_storeu_si256(
+				reinterpret_cast<__m256i *>(pDest + i), 
+				_mm256_and_si256(_mm256_subs_epu8(_mm256_adds_epu8(d, va), vs), mask));
+		}
+		shadeRow(pDest + i, width - i, add, sub);
+	}
+
+#endif // BLT_HAVE_AVX2
+
+	//----------------------------------------------------------------------
+	// Dispatch
+	//----------------------------------------------------------------------
+
+	//
+	// The best instruction set supported by both the build and the CPU.
+	//
+	BLT_LEVEL cpuLevel(VOID)
+	{
+#if defined(_MSC_VER) && defined(BLT_HAVE_SSE2)
+		INT info[4];
+		__cpuid(info, 0);
+		CONST INT nIds = info[0];
+		__cpuid(info, 1);
+		if (!(info[3] & (1 << 26))) return BLT_SCALAR;
+#	ifdef BLT_HAVE_AVX2
+		// AVX2 also needs the OS to save the YMM registers
+		if (nIds >= 7 && (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5)) return BLT_AVX2;
+		}
+#	endif
+		return BLT_SSE2;
+#elif defined(__GNUC__) && defined(BLT_HAVE_SSE2)
+		__builtin_cpu_init();
+#	ifdef BLT_HAVE_AVX2
+		if (__builtin_cpu_supports("avx2")) return BLT_AVX2;
+#	endif
+		return (__builtin_cpu_supports("sse2") ? BLT_SSE2 : BLT_SCALAR);
+#else
+		return BLT_SCALAR;
+#endif
+	}
+
+	BLT_KERNELS g_kernels;
+	BOOL g_bKernelsSet = FALSE;
+
+	INLINE CONST BLT_KERNELS &kernels(VOID)
+	{
+		if (!g_bKernelsSet) bltSetLevel(BLT_AVX2);
+		return g_kernels;
+	}
+
+}
+
+//--------------------------------------------------------------------------
+// Get the instruction set in use
+//--------------------------------------------------------------------------
+BLT_LEVEL FAST_CALL bltGetLevel(VOID)
+{
+	return kernels().level;
+}
+
+//--------------------------------------------------------------------------
+// Use at most an instruction set
+//--------------------------------------------------------------------------
+BLT_LEVEL FAST_CALL bltSetLevel(CONST BLT_LEVEL level)
+{
+	CONST BLT_LEVEL cpu = cpuLevel();
+	CONST BLT_LEVEL use = (level < cpu ? level : cpu);
+
+	g_kernels.level = BLT_SCALAR;
+	g_kernels.translucent = translucentRow;
+	g_kernels.additive = additiveRow;
+	g_kernels.transparent = transparentRow;
+	g_kernels.shade = shadeRow;
+
+#ifdef BLT_HAVE_SSE2
+	if (use >= BLT_SSE2)
+	{
+		g_kernels.level = BLT_SSE2;
+		g_kernels.translucent = translucentRowSSE2;
+		g_kernels.additive = additiveRowSSE2;
+		g_kernels.transparent = transparentRowSSE2;
+		g_kernels.shade = shadeRowSSE2;
+	}
+#endif
+#ifdef BLT_HAVE_AVX2
+	if (use >= BLT_AVX2)
+	{
+		g_kernels.level = BLT_AVX2;
+		g_kernels.translucent = translucentRowAVX2;
+		g_kernels.additive = additiveRowAVX2;
+		g_kernels.transparent = transparentRowAVX2;
+		g_kernels.shade = shadeRowAVX2;
+	}
+#endif
+
+	g_bKernelsSet = TRUE;
+	return g_kernels.level;
+}
+
+//--------------------------------------------------------------------------
+// Translucent blt
+//--------------------------------------------------------------------------
+VOID FAST_CALL bltTranslucent32(
+	DWORD *pDest,
+	CONST INT destPitch,
+	CONST DWORD *pSrc,
+	CONST INT srcPitch,
+	CONST INT width,
+	CONST INT height,
+	CONST INT a,
+	CONST DWORD crUnaffected,
+	CONST DWORD crTransparent)
+{
+	CONST BLT_BLEND_ROW row = kernels().translucent;
+	for (INT y = 0; y < height; ++y, pDest += destPitch, pSrc += srcPitch)
+	{
+		row(pDest, pSrc, width, a, crUnaffected, crTransparent);
+	}
+}
+
+//--------------------------------------------------------------------------
+// Additive blt
+//--------------------------------------------------------------------------
+VOID FAST_CALL bltAdditive32(
+	DWORD *pDest,
+	CONST INT destPitch,
+	CONST DWORD *pSrc,
+	CONST INT srcPitch,
+	CONST INT width,
+	CONST INT height,
+	CONST INT p,
+	CONST DWORD crUnaffected,
+	CONST DWORD crTransparent)
+{
+	CONST BLT_BLEND_ROW row = kernels().additive;
+	for (INT y = 0; y < height; ++y, pDest += destPitch, pSrc += srcPitch)
+	{
+		row(pDest, pSrc, width, p, crUnaffected, crTransparent);
+	}
+}
+
+//--------------------------------------------------------------------------
+// Colour-keyed blt
+//--------------------------------------------------------------------------
+VOID FAST_CALL bltTransparent32(
+	DWORD *pDest,
+	CONST INT destPitch,
+	CONST DWORD *pSrc,
+	CONST INT srcPitch,
+	CONST INT width,
+	CONST INT height,
+	CONST DWORD crTransparent)
+{
+	CONST BLT_KEY_ROW row = kernels().transparent;
+	for (INT y = 0; y < height; ++y, pDest += destPitch, pSrc += srcPitch)
+	{
+		row(pDest, pSrc, width, crTransparent);
+	}
+}
+
+//--------------------------------------------------------------------------
+// Shade
+//--------------------------------------------------------------------------
+VOID FAST_CALL bltShade32(
+	DWORD *pDest,
+	CONST INT destPitch,
+	CONST INT width,
+	CONST INT height,
+	CONST DWORD add,
+	CONST DWORD sub)
+{
+	CONST BLT_SHADE_ROW row = kernels().shade;
+	for (INT y = 0; y < height; ++y, pDest += destPitch)
+	{
+		row(pDest, width, add & BLT_RGB_MASK, sub & BLT_RGB_MASK);
+	}
+}
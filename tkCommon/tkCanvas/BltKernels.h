@@ -0,0 +1,188 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2007  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+//--------------------------------------------------------------------------
+// Pixel kernels for 32-bit translucent, additive and colour-keyed blts,
+// and for shading a surface in place.
+// Each has a scalar, an SSE2 and an AVX2 version; the fastest the CPU
+// supports is chosen on first use. All versions use the same 8-bit fixed
+// point maths, so they produce identical pixels.
+//
+// Pixels are 32-bit with one byte per channel (any channel order) and an
+// unused top byte. Colour keys are given in the same format; BLT_NO_KEY
+// matches nothing. Pitches are in pixels.
+//--------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------
+// Protect the header
+//--------------------------------------------------------------------------
+#ifndef _BLTKERNELS_H_
+#define _BLTKERNELS_H_
+#ifdef _MSC_VER
+#	pragma once
+#endif
+
+//--------------------------------------------------------------------------
+// Inclusions
+//--------------------------------------------------------------------------
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN		// Flag lean version of Windows
+#	include <windows.h>				// The Windows API
+#else
+#	include "SoftTypes.h"			// Stand-ins for the Windows types used here
+#endif
+
+//--------------------------------------------------------------------------
+// Definitions
+//--------------------------------------------------------------------------
+#if !defined(INLINE) && !defined(FAST_CALL)
+#	if defined(_MSC_VER)
+#		define INLINE __inline		// VC++ prefers the __inline keyword
+#		define FAST_CALL __fastcall
+#	else
+#		define INLINE inline
+#		define FAST_CALL			// Register (fast) calls are specific to VC++
+#	endif
+#endif
+
+#define BLT_NO_KEY 0xffffffff		// Colour key that matches no pixel
+
+// Instruction sets, in increasing order.
+typedef enum tagBltLevel
+{
+	BLT_SCALAR,
+	BLT_SSE2,
+	BLT_AVX2
+} BLT_LEVEL;
+
+//--------------------------------------------------------------------------
+// Kernel selection
+//--------------------------------------------------------------------------
+
+// The instruction set in use.
+BLT_LEVEL FAST_CALL bltGetLevel(VOID);
+
+// Use at most the given instruction set (for testing against the scalar
+// version); returns the level actually selected.
+BLT_LEVEL FAST_CALL bltSetLevel(CONST BLT_LEVEL level);
+
+//--------------------------------------------------------------------------
+// Conversions from the canvas' parameters
+//--------------------------------------------------------------------------
+
+// Translucency in [0, 1] to an 8-bit fixed point weight in [0, 256].
+INLINE INT bltIntensity(CONST double dIntensity)
+{
+	CONST INT a = INT(dIntensity * 256);
+	return (a < 0 ? 0 : (a > 256 ? 256 : a));
+}
+
+// Additive percentage to an 8-bit fixed point weight. Anything beyond
+// +/-64 saturates every channel anyway.
+INLINE INT bltPercent(CONST double percent)
+{
+	CONST INT p = INT(percent * 256);
+	return (p < -16383 ? -16383 : (p > 16383 ? 16383 : p));
+}
+
+//--------------------------------------------------------------------------
+// Kernels
+//--------------------------------------------------------------------------
+
+//
+// dest = (src * a + dest * (256 - a)) >> 8 per channel. Source pixels
+// matching crUnaffected are copied; those matching crTransparent are
+// skipped.
+//
+VOID FAST_CALL bltTranslucent32(
+	DWORD *pDest,
+	CONST INT destPitch,
+	CONST DWORD *pSrc,
+	CONST INT srcPitch,
+	CONST INT width,
+	CONST INT height,
+	CONST INT a,
+	CONST DWORD crUnaffected,
+	CONST DWORD crTransparent
+);
+
+//
+// dest = bound(dest + ((src * p) >> 8)) per channel. Source pixels
+// matching crUnaffected are copied; destination pixels matching
+// crTransparent are left alone.
+//
+VOID FAST_CALL bltAdditive32(
+	DWORD *pDest,
+	CONST INT destPitch,
+	CONST DWORD *pSrc,
+	CONST INT srcPitch,
+	CONST INT width,
+	CONST INT height,
+	CONST INT p,
+	CONST DWORD crUnaffected,
+	CONST DWORD crTransparent
+);
+
+//
+// Copy source pixels that do not match crTransparent.
+//
+VOID FAST_CALL bltTransparent32(
+	DWORD *pDest,
+	CONST INT destPitch,
+	CONST DWORD *pSrc,
+	CONST INT srcPitch,
+	CONST INT width,
+	CONST INT height,
+	CONST DWORD crTransparent
+);
+
+//
+// dest = bound(dest + add - sub) per channel, where add and sub hold an
+// unsigned amount for each channel in the pixels' format.
+//
+VOID FAST_CALL bltShade32(
+	DWORD *pDest,
+	CONST INT destPitch,
+	CONST INT width,
+	CONST INT height,
+	CONST DWORD add,
+	CONST DWORD sub
+);
+
+//--------------------------------------------------------------------------
+// End of the header
+//--------------------------------------------------------------------------
+#endif
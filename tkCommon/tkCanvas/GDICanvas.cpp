@@ -34,12 +34,20 @@
  * to propagate them.
  */
 
+//--------------------------------------------------------------------------
+// Replaced by SoftCanvas.cpp in software builds
+//--------------------------------------------------------------------------
+#ifndef TK_SOFTWARE_CANVAS
+
 //--------------------------------------------------------------------------
 // Inclusions
 //--------------------------------------------------------------------------
 #include "..\tkDirectX\platform.h"	// DirectX interface
 #include "GDICanvas.h"				// Contains stuff for this file
+#include "BltKernels.h"				// SIMD kernels for 32-bit blts
 #include <map>						// Maps
+#include <string.h>					// memmove
+#include <stdlib.h>					// abs
 
 //--------------------------------------------------------------------------
 // Default constructor
@@ -1640,51 +1648,16 @@ INT FAST_CALL CCanvas::BltTranslucentPart(
 				LPDWORD CONST pSurfDest = reinterpret_cast<LPDWORD>(destSurface.lpSurface);
 				LPDWORD CONST pSurfSrc = reinterpret_cast<LPDWORD>(srcSurface.lpSurface);
 
-				// For the y axis
-				for (INT yy = 0; yy < height; yy++)
-				{
-
-					// Calculate index into destination and source, respectively
-					INT idxd = (yy + y) * nDestPixelsPerRow + x;
-					INT idx = (yy + ySrc) * nSrcPixelsPerRow + xSrc;
-
-					// For the x axis
-					for (INT xx = 0; xx < width; xx++)
-					{
-
-						// Obtain a pixel in RGB format
-						CONST LONG srcRGB = ConvertDDColor(pSurfSrc[idx], &ddpfDest);
-
-						// Check for unaffected color
-						if (srcRGB == crUnaffectedColor)
-						{
-							// Directly copy
-							pSurfDest[idxd] = ConvertColorRef(srcRGB, &ddpfDest);
-						}
-
-						// Check for opaque color
-						else if (srcRGB != crTransparentColor)
-						{
-
-							// Obtain destination RGB
-							CONST LONG destRGB = ConvertDDColor(pSurfDest[idxd], &ddpfDest);
+				// Blend with the fastest kernel the CPU supports
+				bltTranslucent32(
+					pSurfDest + y * nDestPixelsPerRow + x, nDestPixelsPerRow,
+					pSurfSrc + ySrc * nSrcPixelsPerRow + xSrc, nSrcPixelsPerRow,
+					width, height,
+					bltIntensity(dIntensity),
+					KernelKey(crUnaffectedColor, &ddpfDest),
+					KernelKey(crTransparentColor, &ddpfDest)
+				);
 
-							// Calculate translucent rgb value
-							CONST INT r = INT((GetRValue(srcRGB) * dIntensity) + (GetRValue(destRGB) * (1 - dIntensity)));
-							CONST INT g = INT((GetGValue(srcRGB) * dIntensity) + (GetGValue(destRGB) * (1 - dIntensity)));
-							CONST INT b = INT((GetBValue(srcRGB) * dIntensity) + (GetBValue(destRGB) * (1 - dIntensity)));
-
-							// Lay down translucently
-							pSurfDest[idxd] = ConvertColorRef(RGB(r, g, b), &ddpfDest);
-
-						}
-
-						// Increment position on surfaces
-						idx++;
-						idxd++;
-
-					} // x axis
-				} // y axis
 			} break; // 32 bit blt
 
 			// 24 bit color depth
@@ -1882,38 +1855,60 @@ BOOL FAST_CALL CCanvas::CheckSurfaces(
 }
 
 //--------------------------------------------------------------------------
-// Shift the canvas left
+// Move the pixels by an offset in place. The rows (or, for GDI, the
+// overlapping self-blt) are copied in an order that does not overwrite
+// pixels still to be read, so no copy of the canvas is needed.
 //--------------------------------------------------------------------------
-INT FAST_CALL CCanvas::ShiftLeft(
-	CONST INT nPixels
+INT FAST_CALL CCanvas::Shift(
+	CONST INT dx,
+	CONST INT dy
 		)
 {
 
+	CONST INT width = m_nWidth - abs(dx), height = m_nHeight - abs(dy);
+	if (width <= 0 || height <= 0) return TRUE;
+
 	// If using DirectX
 	if (usingDX())
 	{
 
-		// Create a copy of this canvas
-		CONST CCanvas temp = *this;
+		// Lock the surface
+		DDSURFACEDESC2 ddsd;
+		DD_INIT_STRUCT(ddsd);
+		HRESULT hr = m_lpddsSurface->Lock(NULL, &ddsd, DDLOCK_SURFACEMEMORYPTR | DDLOCK_NOSYSLOCK | DDLOCK_WAIT, NULL);
 
-		// Setup rects
-		RECT destRect = {0, 0, m_nWidth - nPixels, m_nHeight};
-		RECT rect = {nPixels, 0, m_nWidth, m_nHeight};
+		if (FAILED(hr))
+		{
+			// Return failed
+			return FALSE;
+		}
 
-		// Setup the blt effects
-		DDBLTFX bltFx;
-		DD_INIT_STRUCT(bltFx);
-		bltFx.dwROP = SRCCOPY;
+		CONST INT nBytes = ddsd.ddpfPixelFormat.dwRGBBitCount / 8;
+		CONST INT xSrc = (dx < 0 ? -dx : 0), xDest = (dx > 0 ? dx : 0);
+		CONST INT ySrc = (dy < 0 ? -dy : 0), yDest = (dy > 0 ? dy : 0);
+		LPBYTE CONST pSurface = reinterpret_cast<LPBYTE>(ddsd.lpSurface);
 
-		// Execute the blt
-		return SUCCEEDED(GetDXSurface()->Blt(&destRect, temp.GetDXSurface(), &rect, DDBLT_WAIT | DDBLT_ROP, &bltFx));
+		// Copy downwards from the bottom row when shifting down
+		for (INT i = 0; i < height; ++i)
+		{
+			CONST INT row = (dy > 0 ? height - 1 - i : i);
+			memmove(
+				pSurface + (yDest + row) * ddsd.lPitch + xDest * nBytes,
+				pSurface + (ySrc + row) * ddsd.lPitch + xSrc * nBytes,
+				width * nBytes
+			);
+		}
+
+		// Unlock the surface
+		m_lpddsSurface->Unlock(NULL);
+		return TRUE;
 
 	}
 	else
 	{
 		// Use GDI
 		CONST HDC hdcMe = OpenDC();
-		CONST INT nToRet = BitBlt(hdcMe, -nPixels, 0, GetWidth(), GetHeight(), hdcMe, 0, 0, SRCCOPY);
+		CONST INT nToRet = BitBlt(hdcMe, dx, dy, GetWidth(), GetHeight(), hdcMe, 0, 0, SRCCOPY);
 		CloseDC(hdcMe);
 		return nToRet;
 	}
@@ -1923,6 +1918,16 @@ INT FAST_CALL CCanvas::ShiftLeft(
 
 }
 
+//--------------------------------------------------------------------------
+// Shift the canvas left
+//--------------------------------------------------------------------------
+INT FAST_CALL CCanvas::ShiftLeft(
+	CONST INT nPixels
+		)
+{
+	return Shift(-nPixels, 0);
+}
+
 //--------------------------------------------------------------------------
 // Shift the canvas right
 //--------------------------------------------------------------------------
@@ -1930,39 +1935,7 @@ INT FAST_CALL CCanvas::ShiftRight(
 	CONST INT nPixels
 		)
 {
-
-	// If using DirectX
-	if (usingDX())
-	{
-
-		// Create a copy of this canvas
-		CONST CCanvas temp = *this;
-
-		// Setup rects
-		RECT destRect = {nPixels, 0, m_nWidth, m_nHeight};
-		RECT rect = {0, 0, m_nWidth - nPixels, m_nHeight};
-
-		// Setup the blt effects
-		DDBLTFX bltFx;
-		DD_INIT_STRUCT(bltFx);
-		bltFx.dwROP = SRCCOPY;
-
-		// Execute the blt
-		return SUCCEEDED(GetDXSurface()->Blt(&destRect, temp.GetDXSurface(), &rect, DDBLT_WAIT | DDBLT_ROP, &bltFx));
-
-	}
-	else
-	{
-		// Use GDI
-		CONST HDC hdcMe = OpenDC();
-		CONST INT nToRet = BitBlt(hdcMe, nPixels, 0, GetWidth(), GetHeight(), hdcMe, 0, 0, SRCCOPY);
-		CloseDC(hdcMe);
-		return nToRet;
-	}
-
-	// If here, we've failed
-	return FALSE;
-
+	return Shift(nPixels, 0);
 }
 
 //--------------------------------------------------------------------------
@@ -1972,39 +1945,7 @@ INT FAST_CALL CCanvas::ShiftUp(
 	CONST INT nPixels
 		)
 {
-
-	// If using DirectX
-	if (usingDX())
-	{
-
-		// Create a copy of this canvas
-		CONST CCanvas temp = *this;
-
-		// Setup rects
-		RECT destRect = {0, 0, m_nWidth, m_nHeight - nPixels};
-		RECT rect = {0, nPixels, m_nWidth, m_nHeight};
-
-		// Setup the blt effects
-		DDBLTFX bltFx;
-		DD_INIT_STRUCT(bltFx);
-		bltFx.dwROP = SRCCOPY;
-
-		// Execute the blt
-		return SUCCEEDED(GetDXSurface()->Blt(&destRect, temp.GetDXSurface(), &rect, DDBLT_WAIT | DDBLT_ROP, &bltFx));
-
-	}
-	else
-	{
-		// Use GDI
-		CONST HDC hdcMe = OpenDC();
-		CONST INT nToRet = BitBlt(hdcMe, 0, -nPixels, GetWidth(), GetHeight(), hdcMe, 0, 0, SRCCOPY);
-		CloseDC(hdcMe);
-		return nToRet;
-	}
-
-	// If here, we've failed
-	return FALSE;
-
+	return Shift(0, -nPixels);
 }
 
 //--------------------------------------------------------------------------
@@ -2014,39 +1955,7 @@ INT FAST_CALL CCanvas::ShiftDown(
 	CONST INT nPixels
 		)
 {
-
-	// If using DirectX
-	if (usingDX())
-	{
-
-		// Create a copy of this canvas
-		CONST CCanvas temp = *this;
-
-		// Setup rects
-		RECT destRect = {0, nPixels, m_nWidth, m_nHeight};
-		RECT rect = {0, 0, m_nWidth, m_nHeight - nPixels};
-
-		// Setup the blt effects
-		DDBLTFX bltFx;
-		DD_INIT_STRUCT(bltFx);
-		bltFx.dwROP = SRCCOPY;
-
-		// Execute the blt
-		return SUCCEEDED(GetDXSurface()->Blt(&destRect, temp.GetDXSurface(), &rect, DDBLT_WAIT | DDBLT_ROP, &bltFx));
-
-	}
-	else
-	{
-		// Use GDI
-		CONST HDC hdcMe = OpenDC();
-		CONST INT nToRet = BitBlt(hdcMe, 0, nPixels, GetWidth(), GetHeight(), hdcMe, 0, 0, SRCCOPY);
-		CloseDC(hdcMe);
-		return nToRet;
-	}
-
-	// If here, we've failed
-	return FALSE;
-
+	return Shift(0, nPixels);
 }
 
 //
@@ -2124,52 +2033,16 @@ INT FAST_CALL CCanvas::BltAdditivePart(
 			LPDWORD CONST pSurfDest = reinterpret_cast<LPDWORD>(destSurface.lpSurface);
 			LPDWORD CONST pSurfSrc = reinterpret_cast<LPDWORD>(srcSurface.lpSurface);
 
-			// For the y axis
-			for (INT yy = 0; yy < height; ++yy)
-			{
-
-				// Calculate index into destination and source, respectively
-				INT idxd = (yy + y) * nDestPixelsPerRow + x;
-				INT idx = (yy + ySrc) * nSrcPixelsPerRow + xSrc;
-
-				// For the x axis
-				for (INT xx = 0; xx < width; ++xx)
-				{
-
-					// Obtain a pixel in RGB format
-					CONST LONG srcRGB = ConvertDDColor(pSurfSrc[idx], &ddpfDest);
-
-					// Obtain destination RGB
-					CONST LONG destRGB = ConvertDDColor(pSurfDest[idxd], &ddpfDest);
-
-					// Check for unaffected color
-					if (srcRGB == crUnaffectedColor)
-					{
-						// Directly copy
-						pSurfDest[idxd] = ConvertColorRef(srcRGB, &ddpfDest);
-					}
-
-					// Check for opaque color
-					else if (destRGB != crTransparentColor)
-					{
-
-						// Calculate translucent rgb value
-						CONST LONG r = GetRValue(srcRGB) * percent + GetRValue(destRGB);
-						CONST LONG g = GetGValue(srcRGB) * percent + GetGValue(destRGB);
-						CONST LONG b = GetBValue(srcRGB) * percent + GetBValue(destRGB);
-
-						// Bound in the region [0 255]. No advantage using ULONG.
-						CONST LONG res = RGB(BOUND(r), BOUND(g), BOUND(b));
-						pSurfDest[idxd] = ConvertColorRef(res, &ddpfDest);
-
-					}
-
-					// Increment position on surfaces
-					++idx;
-					++idxd;
+			// Add with the fastest kernel the CPU supports
+			bltAdditive32(
+				pSurfDest + y * nDestPixelsPerRow + x, nDestPixelsPerRow,
+				pSurfSrc + ySrc * nSrcPixelsPerRow + xSrc, nSrcPixelsPerRow,
+				width, height,
+				bltPercent(percent),
+				KernelKey(crUnaffectedColor, &ddpfDest),
+				KernelKey(crTransparentColor, &ddpfDest)
+			);
 
-				} // x axis
-			} // y axis
 		} break; // 32 bit blt
 
 		// 24 bit color depth
@@ -2326,6 +2199,81 @@ INT FAST_CALL CCanvas::BltAdditivePart(
 
 }
 
+//
+// Add a signed amount to each channel of every pixel.
+//
+INT FAST_CALL CCanvas::Shade(
+	CONST INT r,
+	CONST INT g,
+	CONST INT b
+		)
+{
+	// Bound LONG to [0 255]
+	#define BOUND(x) (x & 0x80000000 ? 0 : (x & 0x100 ? 0xFF : x))
+
+	// Only DirectX surfaces can be locked
+	if (!usingDX())
+	{
+		return FALSE;
+	}
+
+	// Nothing to do
+	if (!r && !g && !b)
+	{
+		return TRUE;
+	}
+
+	// Lock the surface
+	DDSURFACEDESC2 ddsd;
+	DD_INIT_STRUCT(ddsd);
+	HRESULT hr = m_lpddsSurface->Lock(NULL, &ddsd, DDLOCK_SURFACEMEMORYPTR | DDLOCK_NOSYSLOCK | DDLOCK_WAIT, NULL);
+
+	if (FAILED(hr))
+	{
+		// Return failed
+		return FALSE;
+	}
+
+	// Obtain the pixel format
+	DDPIXELFORMAT ddpf;
+	DD_INIT_STRUCT(ddpf);
+	m_lpddsSurface->GetPixelFormat(&ddpf);
+
+	if (ddpf.dwRGBBitCount == 32)
+	{
+		// Split the amount into the parts to add and to take away
+		CONST COLORREF crAdd = RGB(r > 0 ? BOUND(r) : 0, g > 0 ? BOUND(g) : 0, b > 0 ? BOUND(b) : 0);
+		CONST COLORREF crSub = RGB(r < 0 ? BOUND(-r) : 0, g < 0 ? BOUND(-g) : 0, b < 0 ? BOUND(-b) : 0);
+
+		// Shade with the fastest kernel the CPU supports
+		bltShade32(
+			reinterpret_cast<LPDWORD>(ddsd.lpSurface), ddsd.lPitch / 4,
+			m_nWidth, m_nHeight,
+			ConvertColorRef(crAdd, &ddpf),
+			ConvertColorRef(crSub, &ddpf)
+		);
+	}
+	else
+	{
+		// Other depths a pixel at a time
+		for (INT y = 0; y < m_nHeight; ++y)
+		{
+			for (INT x = 0; x < m_nWidth; ++x)
+			{
+				CONST LONG rgb = GetRGBPixel(&ddsd, &ddpf, x, y);
+				CONST LONG rr = GetRValue(rgb) + r, gg = GetGValue(rgb) + g, bb = GetBValue(rgb) + b;
+				SetRGBPixel(&ddsd, &ddpf, x, y, RGB(BOUND(rr), BOUND(gg), BOUND(bb)));
+			}
+		}
+	}
+
+	// Unlock the surface
+	m_lpddsSurface->Unlock(NULL);
+
+	return TRUE;
+
+}
+
 //--------------------------------------------------------------------------
 // Convert a DirectX color to RGB
 //--------------------------------------------------------------------------
@@ -2442,6 +2390,17 @@ INLINE DWORD CCanvas::ConvertColorRef(
 
 }
 
+//--------------------------------------------------------------------------
+// Convert a RGB color (or -1 for none) to a key for the blt kernels
+//--------------------------------------------------------------------------
+INLINE DWORD CCanvas::KernelKey(
+	CONST LONG crColor,
+	CONST LPDDPIXELFORMAT pddpf
+		)
+{
+	return (crColor == -1 ? BLT_NO_KEY : ConvertColorRef(crColor, pddpf));
+}
+
 //--------------------------------------------------------------------------
 // Get the number of bits from a mask
 //--------------------------------------------------------------------------
@@ -2751,3 +2710,5 @@ VOID FAST_CALL CCanvas::SetPixels(
 		SetPixelsGDI(p_crPixelArray, x, y, width, height);
 	}
 }
+
+#endif // !TK_SOFTWARE_CANVAS
@@ -47,6 +47,13 @@
 #	pragma once
 #endif
 
+//--------------------------------------------------------------------------
+// Portable software backend (see SoftCanvas.h)
+//--------------------------------------------------------------------------
+#ifdef TK_SOFTWARE_CANVAS
+#	include "SoftCanvas.h"
+#else
+
 //--------------------------------------------------------------------------
 // Inclusions
 //--------------------------------------------------------------------------
@@ -492,6 +499,13 @@ public:
 		CONST INT nPixels
 	);
 
+	// Move the pixels by an offset in place, leaving the uncovered
+	// area as it was.
+	INT FAST_CALL Shift(
+		CONST INT dx,
+		CONST INT dy
+	);
+
 	INT FAST_CALL BltAdditivePart(
 		CONST LPDIRECTDRAWSURFACE7 lpddsSurface,
 		CONST INT x,
@@ -505,6 +519,12 @@ public:
 		CONST LONG crTransparentColor
 	) CONST;
 
+	INT FAST_CALL Shade(
+		CONST INT r,
+		CONST INT g,
+		CONST INT b
+	);
+
 	LPDIRECTDRAWSURFACE7 GetDXSurface(
 		VOID
 	) CONST { return m_lpddsSurface; }
@@ -537,6 +557,11 @@ private:
 		CONST LPDDPIXELFORMAT pddpf
 	);
 
+	STATIC DWORD KernelKey(
+		CONST LONG crColor,
+		CONST LPDDPIXELFORMAT pddpf
+	);
+
 	STATIC WORD GetNumberOfBits(
 		CONST DWORD dwMask
 	);
@@ -587,6 +612,8 @@ private:
 	BOOL m_bInRam;							// In RAM?
 };
 
+#endif // TK_SOFTWARE_CANVAS
+
 //--------------------------------------------------------------------------
 // End of the header
 //--------------------------------------------------------------------------
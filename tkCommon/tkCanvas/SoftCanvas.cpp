@@ -0,0 +1,1263 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2007  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+//--------------------------------------------------------------------------
+// Software canvas backend - see SoftCanvas.h
+//--------------------------------------------------------------------------
+#ifdef TK_SOFTWARE_CANVAS
+
+//--------------------------------------------------------------------------
+// Inclusions
+//--------------------------------------------------------------------------
+#include "SoftCanvas.h"				// Contains stuff for this file
+#include "BltKernels.h"				// SIMD kernels for 32-bit pixels
+#include <string.h>					// memcpy, memmove
+#include <math.h>					// sqrt
+
+//--------------------------------------------------------------------------
+// Blitters, resolved for a pixel format at compile time
+//--------------------------------------------------------------------------
+namespace
+{
+
+	// Raster operations.
+	struct ROP_COPY { template <class P> P operator()(CONST P dest, CONST P src) CONST { return src; } };
+	struct ROP_AND { template <class P> P operator()(CONST P dest, CONST P src) CONST { return dest & src; } };
+	struct ROP_PAINT { template <class P> P operator()(CONST P dest, CONST P src) CONST { return dest | src; } };
+	struct ROP_INVERT { template <class P> P operator()(CONST P dest, CONST P src) CONST { return dest ^ src; } };
+
+	// Bound an INT to [0, 255].
+	INLINE INT bound(CONST INT x)
+	{
+		return (x < 0 ? 0 : (x > 255 ? 255 : x));
+	}
+
+	//
+	// Clip a blt to its source and destination. Returns FALSE
+	// if nothing remains to draw.
+	//
+	BOOL clip(
+		INT &x, INT &y, 
+		INT &xSrc, INT &ySrc, 
+		INT &width, INT &height, 
+		CONST CCanvas &src, 
+		CONST CCanvas &dest)
+	{
+		if (x < 0) { xSrc -= x; width += x; x = 0; }
+		if (y < 0) { ySrc -= y; height += y; y = 0; }
+		if (xSrc < 0) { x -= xSrc; width += xSrc; xSrc = 0; }
+		if (ySrc < 0) { y -= ySrc; height += ySrc; ySrc = 0; }
+		if (x + width > dest.GetWidth()) width = dest.GetWidth() - x;
+		if (y + height > dest.GetHeight()) height = dest.GetHeight() - y;
+		if (xSrc + width > src.GetWidth()) width = src.GetWidth() - xSrc;
+		if (ySrc + height > src.GetHeight()) height = src.GetHeight() - ySrc;
+		return (width > 0 && height > 0 && src.GetPixels() && dest.GetPixels());
+	}
+
+	//
+	// Opaque blt with a raster operation.
+	//
+	template <class F, class OP>
+	VOID bltRop(
+		typename F::PIXEL *pDest, CONST INT destPitch, 
+		CONST typename F::PIXEL *pSrc, CONST INT srcPitch, 
+		CONST INT width, CONST INT height, 
+		CONST OP op)
+	{
+		for (INT yy = 0; yy < height; ++yy, pDest += destPitch, pSrc += srcPitch)
+		{
+			for (INT xx = 0; xx < width; ++xx)
+			{
+				pDest[xx] = op(pDest[xx], pSrc[xx]);
+			}
+		}
+	}
+
+	template <class F>
+	VOID bltOpaque(
+		typename F::PIXEL *pDest, CONST INT destPitch, 
+		CONST typename F::PIXEL *pSrc, CONST INT srcPitch, 
+		CONST INT width, CONST INT height, 
+		CONST LONG lRasterOp)
+	{
+		switch (lRasterOp)
+		{
+			case SRCAND: bltRop<F>(pDest, destPitch, pSrc, srcPitch, width, height, ROP_AND()); break;
+			case SRCPAINT: bltRop<F>(pDest, destPitch, pSrc, srcPitch, width, height, ROP_PAINT()); break;
+			case SRCINVERT: bltRop<F>(pDest, destPitch, pSrc, srcPitch, width, height, ROP_INVERT()); break;
+			default:
+			{
+				// Straight copy. Rows may overlap when blitting a canvas onto itself.
+				for (INT yy = 0; yy < height; ++yy, pDest += destPitch, pSrc += srcPitch)
+				{
+					memmove(pDest, pSrc, width * sizeof(typename F::PIXEL));
+				}
+			}
+		}
+	}
+
+	//
+	// Blt skipping a transparent colour.
+	//
+	template <class F>
+	VOID bltTransparent(
+		typename F::PIXEL *pDest, CONST INT destPitch, 
+		CONST typename F::PIXEL *pSrc, CONST INT srcPitch, 
+		CONST INT width, CONST INT height, 
+		CONST LONG crTransparentColor)
+	{
+		CONST typename F::PIXEL key = F::fromColorRef(crTransparentColor);
+		for (INT yy = 0; yy < height; ++yy, pDest += destPitch, pSrc += srcPitch)
+		{
+			for (INT xx = 0; xx < width; ++xx)
+			{
+				if (!F::equal(pSrc[xx], key)) pDest[xx] = pSrc[xx];
+			}
+		}
+	}
+
+	//
+	// Blend the source over the destination by an intensity in
+	// [0, 1]. Pixels of the unaffected colour are copied directly
+	// and pixels of the transparent colour are skipped (-1 for none).
+	//
+	template <class F>
+	VOID bltTranslucent(
+		typename F::PIXEL *pDest, CONST INT destPitch, 
+		CONST typename F::PIXEL *pSrc, CONST INT srcPitch, 
+		CONST INT width, CONST INT height, 
+		CONST DOUBLE dIntensity,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor)
+	{
+		typedef typename F::PIXEL PIXEL;
+		CONST INT a = INT(dIntensity * 256), b = 256 - a;
+		CONST BOOL bUnaffected = (crUnaffectedColor != -1), bTransparent = (crTransparentColor != -1);
+		CONST PIXEL unaffected = F::fromColorRef(crUnaffectedColor), transparent = F::fromColorRef(crTransparentColor);
+
+		for (INT yy = 0; yy < height; ++yy, pDest += destPitch, pSrc += srcPitch)
+		{
+			for (INT xx = 0; xx < width; ++xx)
+			{
+				CONST PIXEL src = pSrc[xx];
+				if (bUnaffected && F::equal(src, unaffected))
+				{
+					pDest[xx] = src;
+				}
+				else if (!bTransparent || !F::equal(src, transparent))
+				{
+					CONST PIXEL dest = pDest[xx];
+					pDest[xx] = F::fromRGB(
+						(F::red(src) * a + F::red(dest) * b) >> 8,
+						(F::green(src) * a + F::green(dest) * b) >> 8,
+						(F::blue(src) * a + F::blue(dest) * b) >> 8
+					);
+				}
+			}
+		}
+	}
+
+	//
+	// Add a proportion of the source to the destination. Pixels of
+	// the unaffected colour are copied directly and destination pixels
+	// of the transparent colour are left alone (-1 for none).
+	//
+	template <class F>
+	VOID bltAdditive(
+		typename F::PIXEL *pDest, CONST INT destPitch, 
+		CONST typename F::PIXEL *pSrc, CONST INT srcPitch, 
+		CONST INT width, CONST INT height, 
+		CONST DOUBLE percent,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor)
+	{
+		typedef typename F::PIXEL PIXEL;
+		CONST INT a = INT(percent * 256);
+		CONST BOOL bUnaffected = (crUnaffectedColor != -1), bTransparent = (crTransparentColor != -1);
+		CONST PIXEL unaffected = F::fromColorRef(crUnaffectedColor), transparent = F::fromColorRef(crTransparentColor);
+
+		for (INT yy = 0; yy < height; ++yy, pDest += destPitch, pSrc += srcPitch)
+		{
+			for (INT xx = 0; xx < width; ++xx)
+			{
+				CONST PIXEL src = pSrc[xx], dest = pDest[xx];
+				if (bUnaffected && F::equal(src, unaffected))
+				{
+					pDest[xx] = src;
+				}
+				else if (!bTransparent || !F::equal(dest, transparent))
+				{
+					pDest[xx] = F::fromRGB(
+						bound(((F::red(src) * a) >> 8) + F::red(dest)),
+						bound(((F::green(src) * a) >> 8) + F::green(dest)),
+						bound(((F::blue(src) * a) >> 8) + F::blue(dest))
+					);
+				}
+			}
+		}
+	}
+
+	//
+	// Add a signed amount to each channel.
+	//
+	template <class F>
+	VOID shade(
+		typename F::PIXEL *pDest, CONST INT destPitch, 
+		CONST INT width, CONST INT height, 
+		CONST INT r, CONST INT g, CONST INT b)
+	{
+		for (INT yy = 0; yy < height; ++yy, pDest += destPitch)
+		{
+			for (INT xx = 0; xx < width; ++xx)
+			{
+				CONST typename F::PIXEL dest = pDest[xx];
+				pDest[xx] = F::fromRGB(bound(F::red(dest) + r), bound(F::green(dest) + g), bound(F::blue(dest) + b));
+			}
+		}
+	}
+
+	//
+	// 32-bit pixels go through the SIMD kernels. A COLORREF of -1 means
+	// no colour, which the kernels spell BLT_NO_KEY.
+	//
+	INLINE DWORD kernelKey(CONST LONG cr)
+	{
+		return (cr == -1 ? BLT_NO_KEY : CNV_XRGB32::fromColorRef(cr));
+	}
+
+	template <>
+	VOID bltTransparent<CNV_XRGB32>(
+		DWORD *pDest, CONST INT destPitch, 
+		CONST DWORD *pSrc, CONST INT srcPitch, 
+		CONST INT width, CONST INT height, 
+		CONST LONG crTransparentColor)
+	{
+		bltTransparent32(pDest, destPitch, pSrc, srcPitch, width, height, kernelKey(crTransparentColor));
+	}
+
+	template <>
+	VOID bltTranslucent<CNV_XRGB32>(
+		DWORD *pDest, CONST INT destPitch, 
+		CONST DWORD *pSrc, CONST INT srcPitch, 
+		CONST INT width, CONST INT height, 
+		CONST DOUBLE dIntensity,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor)
+	{
+		bltTranslucent32(
+			pDest, destPitch, pSrc, srcPitch, width, height, 
+			bltIntensity(dIntensity), kernelKey(crUnaffectedColor), kernelKey(crTransparentColor)
+		);
+	}
+
+	template <>
+	VOID bltAdditive<CNV_XRGB32>(
+		DWORD *pDest, CONST INT destPitch, 
+		CONST DWORD *pSrc, CONST INT srcPitch, 
+		CONST INT width, CONST INT height, 
+		CONST DOUBLE percent,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor)
+	{
+		bltAdditive32(
+			pDest, destPitch, pSrc, srcPitch, width, height, 
+			bltPercent(percent), kernelKey(crUnaffectedColor), kernelKey(crTransparentColor)
+		);
+	}
+
+	template <>
+	VOID shade<CNV_XRGB32>(
+		DWORD *pDest, CONST INT destPitch, 
+		CONST INT width, CONST INT height, 
+		CONST INT r, CONST INT g, CONST INT b)
+	{
+		bltShade32(
+			pDest, destPitch, width, height,
+			CNV_XRGB32::fromRGB(r > 0 ? bound(r) : 0, g > 0 ? bound(g) : 0, b > 0 ? bound(b) : 0),
+			CNV_XRGB32::fromRGB(r < 0 ? bound(-r) : 0, g < 0 ? bound(-g) : 0, b < 0 ? bound(-b) : 0)
+		);
+	}
+
+	//
+	// Nearest-neighbour stretch with a raster operation. Destination
+	// pixels are clipped; source pixels are assumed to be in bounds.
+	//
+	template <class F, class OP>
+	VOID bltStretch(
+		CONST CCanvas &src, CONST CCanvas &dest,
+		CONST INT x, CONST INT y, 
+		CONST INT xSrc, CONST INT ySrc, 
+		CONST INT width, CONST INT height, 
+		CONST INT newWidth, CONST INT newHeight, 
+		CONST OP op)
+	{
+		typedef typename F::PIXEL PIXEL;
+
+		// Clip the destination.
+		CONST INT left = (x < 0 ? 0 : x), top = (y < 0 ? 0 : y);
+		CONST INT right = (x + newWidth > dest.GetWidth() ? dest.GetWidth() : x + newWidth);
+		CONST INT bottom = (y + newHeight > dest.GetHeight() ? dest.GetHeight() : y + newHeight);
+
+		// 16.16 fixed-point steps through the source.
+		CONST INT dx = (width << 16) / newWidth, dy = (height << 16) / newHeight;
+
+		for (INT yy = top; yy < bottom; ++yy)
+		{
+			CONST INT sy = ySrc + (((yy - y) * dy) >> 16);
+			if (sy < 0 || sy >= src.GetHeight()) continue;
+
+			CONST PIXEL *CONST pSrc = src.GetPixels() + sy * src.GetPitch();
+			PIXEL *CONST pDest = dest.GetPixels() + yy * dest.GetPitch();
+
+			for (INT xx = left; xx < right; ++xx)
+			{
+				CONST INT sx = xSrc + (((xx - x) * dx) >> 16);
+				if (sx < 0 || sx >= src.GetWidth()) continue;
+				pDest[xx] = op(pDest[xx], pSrc[sx]);
+			}
+		}
+	}
+
+	template <class F>
+	VOID bltStretchRop(
+		CONST CCanvas &src, CONST CCanvas &dest,
+		CONST INT x, CONST INT y, 
+		CONST INT xSrc, CONST INT ySrc, 
+		CONST INT width, CONST INT height, 
+		CONST INT newWidth, CONST INT newHeight, 
+		CONST LONG lRasterOp)
+	{
+		switch (lRasterOp)
+		{
+			case SRCAND: bltStretch<F>(src, dest, x, y, xSrc, ySrc, width, height, newWidth, newHeight, ROP_AND()); break;
+			case SRCPAINT: bltStretch<F>(src, dest, x, y, xSrc, ySrc, width, height, newWidth, newHeight, ROP_PAINT()); break;
+			case SRCINVERT: bltStretch<F>(src, dest, x, y, xSrc, ySrc, width, height, newWidth, newHeight, ROP_INVERT()); break;
+			default: bltStretch<F>(src, dest, x, y, xSrc, ySrc, width, height, newWidth, newHeight, ROP_COPY());
+		}
+	}
+
+}
+
+//--------------------------------------------------------------------------
+// Default constructor
+//--------------------------------------------------------------------------
+CCanvas::CCanvas(VOID):
+	m_nWidth(0),
+	m_nHeight(0),
+	m_nPitch(0),
+	m_pPixels(NULL),
+	m_hdcMem(NULL),
+	m_hdcLocked(NULL),
+	m_hBitmap(NULL),
+	m_hOldBitmap(NULL)
+{
+}
+
+//--------------------------------------------------------------------------
+// Copy constructor
+//--------------------------------------------------------------------------
+CCanvas::CCanvas(
+	CONST CCanvas &rhs
+	):
+	m_nWidth(0),
+	m_nHeight(0),
+	m_nPitch(0),
+	m_pPixels(NULL),
+	m_hdcMem(NULL),
+	m_hdcLocked(NULL),
+	m_hBitmap(NULL),
+	m_hOldBitmap(NULL)
+{
+	*this = rhs;
+}
+
+//--------------------------------------------------------------------------
+// Assignment operator
+//--------------------------------------------------------------------------
+CCanvas &CCanvas::operator=(
+	CONST CCanvas &rhs
+		)
+{
+	if (this == &rhs) return *this;
+
+	// Create an equal sized canvas and copy the pixels over
+	CreateBlank(NULL, rhs.m_nWidth, rhs.m_nHeight);
+	if (m_pPixels && rhs.m_pPixels)
+	{
+		bltOpaque<CNV_FORMAT>(m_pPixels, m_nPitch, rhs.m_pPixels, rhs.m_nPitch, m_nWidth, m_nHeight, SRCCOPY);
+	}
+	return *this;
+}
+
+//--------------------------------------------------------------------------
+// Deconstructor
+//--------------------------------------------------------------------------
+CCanvas::~CCanvas(VOID)
+{
+	Destroy();
+}
+
+//--------------------------------------------------------------------------
+// Create a canvas
+//--------------------------------------------------------------------------
+VOID FAST_CALL CCanvas::CreateBlank(
+	CONST HDC hdcCompatible,
+	CONST INT width,
+	CONST INT height,
+	CONST BOOL bDX
+		)
+{
+	// Destroy existing canvas
+	Destroy();
+
+	// Record width and height
+	m_nWidth = width;
+	m_nHeight = height;
+	if (width <= 0 || height <= 0) return;
+
+#ifdef _WIN32
+
+	// A top-down DIB section in the canvas' pixel format, selected
+	// into a DC for GDI text and HDC blts
+	struct
+	{
+		BITMAPINFOHEADER bmiHeader;
+		DWORD masks[3];
+	} bmi;
+	memset(&bmi, 0, sizeof(bmi));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = width;
+	bmi.bmiHeader.biHeight = -height;
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = CNV_FORMAT::BITS;
+	bmi.bmiHeader.biCompression = BI_RGB;
+	if (CNV_FORMAT::BITS == 16)
+	{
+		bmi.bmiHeader.biCompression = BI_BITFIELDS;
+		bmi.masks[0] = 0xf800;
+		bmi.masks[1] = 0x07e0;
+		bmi.masks[2] = 0x001f;
+	}
+
+	LPVOID pBits = NULL;
+	m_hBitmap = CreateDIBSection(hdcCompatible, reinterpret_cast<LPBITMAPINFO>(&bmi), DIB_RGB_COLORS, &pBits, NULL, 0);
+	if (!m_hBitmap) return;
+
+	m_hdcMem = CreateCompatibleDC(hdcCompatible);
+	m_hOldBitmap = HBITMAP(SelectObject(m_hdcMem, m_hBitmap));
+	SetStretchBltMode(m_hdcMem, COLORONCOLOR);
+
+	// DIB rows are DWORD aligned
+	m_pPixels = reinterpret_cast<PIXEL *>(pBits);
+	m_nPitch = ((width * CNV_FORMAT::BITS + 31) / 32) * 4 / sizeof(PIXEL);
+
+#else
+
+	m_nPitch = width;
+	m_pPixels = new PIXEL[m_nPitch * height];
+	memset(m_pPixels, 0, m_nPitch * height * sizeof(PIXEL));
+
+#endif
+}
+
+//--------------------------------------------------------------------------
+// Resize the canvas
+//--------------------------------------------------------------------------
+VOID FAST_CALL CCanvas::Resize(
+	CONST HDC hdcCompatible,
+	CONST INT width,
+	CONST INT height
+		)
+{
+	CreateBlank(hdcCompatible, width, height);
+}
+
+//--------------------------------------------------------------------------
+// Destroy the canvas
+//--------------------------------------------------------------------------
+VOID CCanvas::Destroy(VOID)
+{
+#ifdef _WIN32
+	if (m_hdcMem)
+	{
+		SelectObject(m_hdcMem, m_hOldBitmap);
+		DeleteDC(m_hdcMem);
+	}
+	if (m_hBitmap) DeleteObject(m_hBitmap);
+#else
+	delete [] m_pPixels;
+#endif
+
+	// Clear members
+	m_hdcMem = NULL;
+	m_hBitmap = NULL;
+	m_hOldBitmap = NULL;
+	m_pPixels = NULL;
+	m_nWidth = m_nHeight = m_nPitch = 0;
+}
+
+//--------------------------------------------------------------------------
+// Obtain the canvas' HDC (NULL without Windows)
+//--------------------------------------------------------------------------
+HDC CCanvas::OpenDC(VOID) CONST
+{
+	return (m_hdcLocked ? m_hdcLocked : m_hdcMem);
+}
+
+//--------------------------------------------------------------------------
+// Close the canvas' HDC
+//--------------------------------------------------------------------------
+VOID CCanvas::CloseDC(
+	CONST HDC hdc
+		) CONST
+{
+#ifdef _WIN32
+	// GDI batches its drawing: flush it before the pixels are read
+	if (hdc && !m_hdcLocked) GdiFlush();
+#endif
+}
+
+//--------------------------------------------------------------------------
+// Set a pixel
+//--------------------------------------------------------------------------
+VOID CCanvas::SetPixel(
+	CONST INT x,
+	CONST INT y,
+	CONST LONG crColor
+		)
+{
+	if (x < 0 || y < 0 || x >= m_nWidth || y >= m_nHeight || !m_pPixels) return;
+	m_pPixels[y * m_nPitch + x] = CNV_FORMAT::fromColorRef(crColor);
+}
+
+//--------------------------------------------------------------------------
+// Get a pixel
+//--------------------------------------------------------------------------
+INT FAST_CALL CCanvas::GetPixel(
+	CONST INT x,
+	CONST INT y
+		) CONST
+{
+	if (x < 0 || y < 0 || x >= m_nWidth || y >= m_nHeight || !m_pPixels) return -1;
+	return CNV_FORMAT::toColorRef(m_pPixels[y * m_nPitch + x]);
+}
+
+//--------------------------------------------------------------------------
+// Set a block of pixels from an array of colours
+//--------------------------------------------------------------------------
+VOID FAST_CALL CCanvas::SetPixels(
+	CONST LPLONG p_crPixelArray,
+	CONST INT x,
+	CONST INT y,
+	CONST INT width,
+	CONST INT height
+		)
+{
+	INT arrayPos = 0;
+	for (INT yy = y; yy < y + height; ++yy)
+	{
+		for (INT xx = x; xx < x + width; ++xx)
+		{
+			SetPixel(xx, yy, p_crPixelArray[arrayPos++]);
+		}
+	}
+}
+
+//--------------------------------------------------------------------------
+// Opaque blitter
+//--------------------------------------------------------------------------
+
+//
+// HDC target
+//
+INT FAST_CALL CCanvas::BltPart(
+	CONST HDC hdcTarget,
+	CONST INT x,
+	CONST INT y,
+	CONST INT xSrc,
+	CONST INT ySrc,
+	CONST INT width,
+	CONST INT height,
+	CONST LONG lRasterOp
+		) CONST
+{
+#ifdef _WIN32
+	return BitBlt(hdcTarget, x, y, width, height, m_hdcMem, xSrc, ySrc, lRasterOp);
+#else
+	return FALSE;
+#endif
+}
+
+//
+// Canvas target
+//
+INT FAST_CALL CCanvas::BltPart(
+	CONST CCanvas *pCanvas,
+	INT x,
+	INT y,
+	INT xSrc,
+	INT ySrc,
+	INT width,
+	INT height,
+	CONST LONG lRasterOp
+		) CONST
+{
+	if (!pCanvas || !clip(x, y, xSrc, ySrc, width, height, *this, *pCanvas)) return FALSE;
+
+	bltOpaque<CNV_FORMAT>(
+		pCanvas->m_pPixels + y * pCanvas->m_nPitch + x, pCanvas->m_nPitch,
+		m_pPixels + ySrc * m_nPitch + xSrc, m_nPitch,
+		width, height,
+		lRasterOp
+	);
+	return TRUE;
+}
+
+//
+// Complete blts
+//
+INT FAST_CALL CCanvas::Blt(
+	CONST HDC hdcTarget,
+	CONST INT x,
+	CONST INT y,
+	CONST LONG lRasterOp
+		) CONST
+{
+	return BltPart(hdcTarget, x, y, 0, 0, m_nWidth, m_nHeight, lRasterOp);
+}
+
+INT FAST_CALL CCanvas::Blt(
+	CONST CCanvas *pCanvas,
+	CONST INT x,
+	CONST INT y,
+	CONST LONG lRasterOp
+		) CONST
+{
+	return BltPart(pCanvas, x, y, 0, 0, m_nWidth, m_nHeight, lRasterOp);
+}
+
+//--------------------------------------------------------------------------
+// Transparent blitter
+//--------------------------------------------------------------------------
+
+//
+// HDC target
+//
+INT FAST_CALL CCanvas::BltTransparentPart(
+	CONST HDC hdcTarget,
+	CONST INT x,
+	CONST INT y,
+	CONST INT xSrc,
+	CONST INT ySrc,
+	CONST INT width,
+	CONST INT height,
+	CONST LONG crTransparentColor
+		) CONST
+{
+#ifdef _WIN32
+	return TransparentBlt(hdcTarget, x, y, width, height, m_hdcMem, xSrc, ySrc, width, height, crTransparentColor);
+#else
+	return FALSE;
+#endif
+}
+
+//
+// Canvas target
+//
+INT FAST_CALL CCanvas::BltTransparentPart(
+	CONST CCanvas *pCanvas,
+	INT x,
+	INT y,
+	INT xSrc,
+	INT ySrc,
+	INT width,
+	INT height,
+	CONST LONG crTransparentColor
+		) CONST
+{
+	if (!pCanvas || !clip(x, y, xSrc, ySrc, width, height, *this, *pCanvas)) return FALSE;
+
+	bltTransparent<CNV_FORMAT>(
+		pCanvas->m_pPixels + y * pCanvas->m_nPitch + x, pCanvas->m_nPitch,
+		m_pPixels + ySrc * m_nPitch + xSrc, m_nPitch,
+		width, height,
+		crTransparentColor
+	);
+	return TRUE;
+}
+
+//
+// Complete blts
+//
+INT FAST_CALL CCanvas::BltTransparent(
+	CONST HDC hdcTarget,
+	CONST INT x,
+	CONST INT y,
+	CONST LONG crTransparentColor
+		) CONST
+{
+	return BltTransparentPart(hdcTarget, x, y, 0, 0, m_nWidth, m_nHeight, crTransparentColor);
+}
+
+INT FAST_CALL CCanvas::BltTransparent(
+	CONST CCanvas *pCanvas,
+	CONST INT x,
+	CONST INT y,
+	CONST LONG crTransparentColor
+		) CONST
+{
+	return BltTransparentPart(pCanvas, x, y, 0, 0, m_nWidth, m_nHeight, crTransparentColor);
+}
+
+//--------------------------------------------------------------------------
+// Translucent blitter
+//--------------------------------------------------------------------------
+
+//
+// HDC target - as with GDI canvases, too slow to blend: blt opaquely
+// or transparently instead
+//
+INT FAST_CALL CCanvas::BltTranslucentPart(
+	CONST HDC hdcTarget,
+	CONST INT x,
+	CONST INT y,
+	CONST INT xSrc,
+	CONST INT ySrc,
+	CONST INT width,
+	CONST INT height,
+	CONST DOUBLE dIntensity,
+	CONST LONG crUnaffectedColor,
+	CONST LONG crTransparentColor
+		) CONST
+{
+	if (crTransparentColor == -1)
+	{
+		return BltPart(hdcTarget, x, y, xSrc, ySrc, width, height);
+	}
+	return BltTransparentPart(hdcTarget, x, y, xSrc, ySrc, width, height, crTransparentColor);
+}
+
+//
+// Canvas target
+//
+INT FAST_CALL CCanvas::BltTranslucentPart(
+	CONST CCanvas *pCanvas,
+	INT x,
+	INT y,
+	INT xSrc,
+	INT ySrc,
+	INT width,
+	INT height,
+	CONST DOUBLE dIntensity,
+	CONST LONG crUnaffectedColor,
+	CONST LONG crTransparentColor
+		) CONST
+{
+	if (!pCanvas || !clip(x, y, xSrc, ySrc, width, height, *this, *pCanvas)) return FALSE;
+
+	bltTranslucent<CNV_FORMAT>(
+		pCanvas->m_pPixels + y * pCanvas->m_nPitch + x, pCanvas->m_nPitch,
+		m_pPixels + ySrc * m_nPitch + xSrc, m_nPitch,
+		width, height,
+		dIntensity, crUnaffectedColor, crTransparentColor
+	);
+	return TRUE;
+}
+
+//
+// Complete blts
+//
+INT FAST_CALL CCanvas::BltTranslucent(
+	CONST HDC hdcTarget,
+	CONST INT x,
+	CONST INT y,
+	CONST DOUBLE dIntensity,
+	CONST LONG crUnaffectedColor,
+	CONST LONG crTransparentColor
+		) CONST
+{
+	return BltTranslucentPart(hdcTarget, x, y, 0, 0, m_nWidth, m_nHeight, dIntensity, crUnaffectedColor, crTransparentColor);
+}
+
+INT FAST_CALL CCanvas::BltTranslucent(
+	CONST CCanvas *pCanvas,
+	CONST INT x,
+	CONST INT y,
+	CONST DOUBLE dIntensity,
+	CONST LONG crUnaffectedColor,
+	CONST LONG crTransparentColor
+		) CONST
+{
+	return BltTranslucentPart(pCanvas, x, y, 0, 0, m_nWidth, m_nHeight, dIntensity, crUnaffectedColor, crTransparentColor);
+}
+
+//--------------------------------------------------------------------------
+// Additive blitter
+//--------------------------------------------------------------------------
+INT FAST_CALL CCanvas::BltAdditivePart(
+	CONST CCanvas *pCanvas,
+	INT x,
+	INT y,
+	INT xSrc,
+	INT ySrc,
+	INT width,
+	INT height,
+	CONST DOUBLE percent,
+	CONST LONG crUnaffectedColor,
+	CONST LONG crTransparentColor
+		) CONST
+{
+	if (!pCanvas || !clip(x, y, xSrc, ySrc, width, height, *this, *pCanvas)) return FALSE;
+
+	bltAdditive<CNV_FORMAT>(
+		pCanvas->m_pPixels + y * pCanvas->m_nPitch + x, pCanvas->m_nPitch,
+		m_pPixels + ySrc * m_nPitch + xSrc, m_nPitch,
+		width, height,
+		percent, crUnaffectedColor, crTransparentColor
+	);
+	return TRUE;
+}
+
+//--------------------------------------------------------------------------
+// Add a signed amount to each channel of every pixel
+//--------------------------------------------------------------------------
+INT FAST_CALL CCanvas::Shade(
+	CONST INT r,
+	CONST INT g,
+	CONST INT b)
+{
+	if (!m_pPixels) return FALSE;
+	if (r || g || b) shade<CNV_FORMAT>(m_pPixels, m_nPitch, m_nWidth, m_nHeight, r, g, b);
+	return TRUE;
+}
+
+//--------------------------------------------------------------------------
+// Stretching blitters
+//--------------------------------------------------------------------------
+
+//
+// HDC target
+//
+INT FAST_CALL CCanvas::BltStretch(
+	CONST HDC hdc,
+	CONST INT x,
+	CONST INT y,
+	CONST INT xSrc,
+	CONST INT ySrc,
+	CONST INT width,
+	CONST INT height,
+	CONST INT newWidth,
+	CONST INT newHeight,
+	CONST LONG lRasterOp
+		) CONST
+{
+#ifdef _WIN32
+	return StretchBlt(hdc, x, y, newWidth, newHeight, m_hdcMem, xSrc, ySrc, width, height, lRasterOp);
+#else
+	return FALSE;
+#endif
+}
+
+//
+// Canvas target
+//
+INT FAST_CALL CCanvas::BltStretch(
+	CONST CCanvas *cnv,
+	CONST INT x,
+	CONST INT y,
+	CONST INT xSrc,
+	CONST INT ySrc,
+	CONST INT width,
+	CONST INT height,
+	CONST INT newWidth,
+	CONST INT newHeight,
+	CONST LONG lRasterOp
+		) CONST
+{
+	if (!cnv || !cnv->m_pPixels || !m_pPixels || newWidth <= 0 || newHeight <= 0) return FALSE;
+
+	bltStretchRop<CNV_FORMAT>(*this, *cnv, x, y, xSrc, ySrc, width, height, newWidth, newHeight, lRasterOp);
+	return TRUE;
+}
+
+//
+// Stretch through a mask: the mask is ANDed onto the target, then this
+// canvas is ORed over it
+//
+BOOL FAST_CALL CCanvas::BltStretchMask(
+	CONST CCanvas *cnvMask,
+	CONST CCanvas *cnvTarget,
+	CONST INT x,
+	CONST INT y,
+	CONST INT xSrc,
+	CONST INT ySrc,
+	CONST INT width,
+	CONST INT height,
+	CONST INT newWidth,
+	CONST INT newHeight) CONST
+{
+	cnvMask->BltStretch(cnvTarget, x, y, xSrc, ySrc, width, height, newWidth, newHeight, SRCAND);
+	BltStretch(cnvTarget, x, y, xSrc, ySrc, width, height, newWidth, newHeight, SRCPAINT);
+	return TRUE;
+}
+
+//--------------------------------------------------------------------------
+// Drawing
+//--------------------------------------------------------------------------
+
+//
+// Fill a span of a row, clipped to the canvas
+//
+VOID FAST_CALL CCanvas::FillSpan(
+	INT x1,
+	INT x2,
+	CONST INT y,
+	CONST PIXEL pixel
+		)
+{
+	if (y < 0 || y >= m_nHeight || !m_pPixels) return;
+	if (x1 < 0) x1 = 0;
+	if (x2 >= m_nWidth) x2 = m_nWidth - 1;
+
+	PIXEL *p = m_pPixels + y * m_nPitch;
+	for (INT x = x1; x <= x2; ++x) p[x] = pixel;
+}
+
+//
+// Clear the canvas to a color
+//
+VOID FAST_CALL CCanvas::ClearScreen(CONST LONG crColor)
+{
+	CONST PIXEL pixel = CNV_FORMAT::fromColorRef(crColor);
+	for (INT y = 0; y < m_nHeight; ++y) FillSpan(0, m_nWidth - 1, y, pixel);
+}
+
+//
+// Draw a line. As with GDI, the final point is not drawn.
+//
+BOOL FAST_CALL CCanvas::DrawLine(
+	CONST INT x1,
+	CONST INT y1,
+	CONST INT x2,
+	CONST INT y2,
+	CONST LONG clr
+		)
+{
+	// Bresenham's algorithm
+	CONST INT dx = abs(x2 - x1), dy = -abs(y2 - y1);
+	CONST INT sx = (x1 < x2 ? 1 : -1), sy = (y1 < y2 ? 1 : -1);
+	INT x = x1, y = y1, err = dx + dy;
+
+	while (x != x2 || y != y2)
+	{
+		SetPixel(x, y, clr);
+		CONST INT e2 = 2 * err;
+		if (e2 >= dy) { err += dy; x += sx; }
+		if (e2 <= dx) { err += dx; y += sy; }
+	}
+	return TRUE;
+}
+
+//
+// Draw a rectangle, including its bottom-right corner
+//
+BOOL FAST_CALL CCanvas::DrawRect(
+	CONST INT x1,
+	CONST INT y1,
+	CONST INT x2,
+	CONST INT y2,
+	CONST LONG clr
+		)
+{
+	CONST PIXEL pixel = CNV_FORMAT::fromColorRef(clr);
+	FillSpan(x1, x2, y1, pixel);
+	FillSpan(x1, x2, y2, pixel);
+	for (INT y = y1 + 1; y < y2; ++y)
+	{
+		SetPixel(x1, y, clr);
+		SetPixel(x2, y, clr);
+	}
+	return TRUE;
+}
+
+//
+// Draw a filled rectangle, including its bottom-right corner
+//
+BOOL FAST_CALL CCanvas::DrawFilledRect(
+	CONST INT x1,
+	CONST INT y1,
+	CONST INT x2,
+	CONST INT y2,
+	CONST LONG clr
+		)
+{
+	CONST PIXEL pixel = CNV_FORMAT::fromColorRef(clr);
+	for (INT y = y1; y <= y2; ++y) FillSpan(x1, x2, y, pixel);
+	return TRUE;
+}
+
+//
+// Draw an ellipse within a bounding box. The edge is traced by rows
+// and by columns so that it has no gaps.
+//
+BOOL FAST_CALL CCanvas::DrawEllipse(
+	CONST INT x1,
+	CONST INT y1,
+	CONST INT x2,
+	CONST INT y2,
+	CONST LONG clr
+		)
+{
+	CONST DOUBLE cx = (x1 + x2) / 2.0, cy = (y1 + y2) / 2.0;
+	CONST DOUBLE rx = (x2 - x1) / 2.0, ry = (y2 - y1) / 2.0;
+	if (rx <= 0 || ry <= 0) return DrawFilledRect(x1, y1, x2, y2, clr);
+
+	for (INT y = y1; y <= y2; ++y)
+	{
+		CONST DOUBLE t = (y - cy) / ry;
+		CONST INT w = INT(rx * sqrt(t * t < 1 ? 1 - t * t : 0) + 0.5);
+		SetPixel(INT(cx + 0.5) - w, y, clr);
+		SetPixel(INT(cx) + w, y, clr);
+	}
+	for (INT x = x1; x <= x2; ++x)
+	{
+		CONST DOUBLE t = (x - cx) / rx;
+		CONST INT h = INT(ry * sqrt(t * t < 1 ? 1 - t * t : 0) + 0.5);
+		SetPixel(x, INT(cy + 0.5) - h, clr);
+		SetPixel(x, INT(cy) + h, clr);
+	}
+	return TRUE;
+}
+
+//
+// Draw a filled ellipse within a bounding box
+//
+BOOL FAST_CALL CCanvas::DrawFilledEllipse(
+	CONST INT x1,
+	CONST INT y1,
+	CONST INT x2,
+	CONST INT y2,
+	CONST LONG clr
+		)
+{
+	CONST DOUBLE cx = (x1 + x2) / 2.0, cy = (y1 + y2) / 2.0;
+	CONST DOUBLE rx = (x2 - x1) / 2.0, ry = (y2 - y1) / 2.0;
+	if (rx <= 0 || ry <= 0) return DrawFilledRect(x1, y1, x2, y2, clr);
+
+	CONST PIXEL pixel = CNV_FORMAT::fromColorRef(clr);
+	for (INT y = y1; y <= y2; ++y)
+	{
+		CONST DOUBLE t = (y - cy) / ry;
+		CONST INT w = INT(rx * sqrt(t * t < 1 ? 1 - t * t : 0) + 0.5);
+		FillSpan(INT(cx + 0.5) - w, INT(cx) + w, y, pixel);
+	}
+	return TRUE;
+}
+
+//
+// Draw text (GDI only)
+//
+BOOL FAST_CALL CCanvas::DrawText(
+	CONST INT x,
+	CONST INT y,
+	CONST STRING strText,
+	CONST STRING strTypeFace,
+	CONST INT size,
+	CONST LONG clr,
+	CONST BOOL bold,
+	CONST BOOL italics,
+	CONST BOOL underline,
+	CONST BOOL centered,
+	CONST BOOL outlined
+		)
+{
+#ifdef _WIN32
+	CONST HFONT hFont = CreateFont(
+		size,
+		0,
+		0,
+		0,
+		bold ? FW_BOLD : FW_NORMAL,
+		italics,
+		underline,
+		0,
+		DEFAULT_CHARSET,
+		OUT_DEFAULT_PRECIS,
+		CLIP_DEFAULT_PRECIS,
+		DEFAULT_QUALITY,
+		DEFAULT_PITCH,
+		strTypeFace.c_str()
+	);
+	if (!hFont || !m_hdcMem) return FALSE;
+
+	CONST HDC hdc = OpenDC();
+	SetBkMode(hdc, TRANSPARENT);
+	CONST HGDIOBJ hOld = SelectObject(hdc, hFont);
+	SetTextColor(hdc, clr);
+	SetTextAlign(hdc, centered ? TA_CENTER : TA_LEFT);
+	CONST HGDIOBJ hNewBrush = CreateSolidBrush(clr);
+	CONST HGDIOBJ hOldBrush = SelectObject(hdc, hNewBrush);
+
+	if (outlined)
+	{
+		// Draw the text as a path and outline it
+		BeginPath(hdc);
+		TextOut(hdc, x, y, strText.c_str(), strText.length());
+		EndPath(hdc);
+
+		HPEN hpen = CreatePen(PS_SOLID, 1, RGB(100, 100, 100));
+		CONST HGDIOBJ hOldPen = SelectObject(hdc, hpen);
+		StrokeAndFillPath(hdc);
+		SelectObject(hdc, hOldPen);
+		DeleteObject(hpen);
+	} 
+	else
+	{
+		TextOut(hdc, x, y, strText.c_str(), strText.length());
+	}
+
+	// Restore old objects
+	SelectObject(hdc, hOldBrush);
+	DeleteObject(hNewBrush);
+	SelectObject(hdc, hOld);
+	DeleteObject(hFont);
+	CloseDC(hdc);
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+//
+// Get dimensions of a string (GDI only)
+//
+SIZE FAST_CALL CCanvas::GetTextSize(
+	CONST STRING strText,
+	CONST STRING strTypeFace,
+	CONST INT size,
+	CONST BOOL bold,
+	CONST BOOL italics
+		)
+{
+	SIZE sz = {0, 0};
+#ifdef _WIN32
+	CONST HFONT hFont = CreateFont(
+		size,
+		0,
+		0,
+		0,
+		bold ? FW_BOLD : FW_NORMAL,
+		italics,
+		0,
+		0,
+		DEFAULT_CHARSET,
+		OUT_DEFAULT_PRECIS,
+		CLIP_DEFAULT_PRECIS,
+		DEFAULT_QUALITY,
+		DEFAULT_PITCH,
+		strTypeFace.c_str()
+	);
+	if (hFont && m_hdcMem)
+	{
+		CONST HDC hdc = OpenDC();
+		CONST HGDIOBJ hOld = SelectObject(hdc, hFont);
+		if (!strText.empty())
+		{
+			GetTextExtentPoint32(hdc, strText.c_str(), strText.length(), &sz);
+		}
+		SelectObject(hdc, hOld);
+		CloseDC(hdc);
+	}
+	if (hFont) DeleteObject(hFont);
+#endif
+	return sz;
+}
+
+//--------------------------------------------------------------------------
+// Shifting
+//--------------------------------------------------------------------------
+
+//
+// Move the pixels by an offset. Uncovered pixels are left as they were,
+// as with a GDI self-blt.
+//
+INT FAST_CALL CCanvas::Shift(
+	CONST INT dx,
+	CONST INT dy
+		)
+{
+	if (!m_pPixels) return FALSE;
+
+	CONST INT width = m_nWidth - abs(dx), height = m_nHeight - abs(dy);
+	if (width <= 0 || height <= 0) return TRUE;
+
+	CONST INT xSrc = (dx < 0 ? -dx : 0), xDest = (dx > 0 ? dx : 0);
+	CONST INT ySrc = (dy < 0 ? -dy : 0), yDest = (dy > 0 ? dy : 0);
+
+	// Copy rows in an order that does not overwrite rows still to be read
+	for (INT i = 0; i < height; ++i)
+	{
+		CONST INT row = (dy > 0 ? height - 1 - i : i);
+		memmove(
+			m_pPixels + (yDest + row) * m_nPitch + xDest,
+			m_pPixels + (ySrc + row) * m_nPitch + xSrc,
+			width * sizeof(PIXEL)
+		);
+	}
+	return TRUE;
+}
+
+INT FAST_CALL CCanvas::ShiftLeft(CONST INT nPixels)
+{
+	return Shift(-nPixels, 0);
+}
+
+INT FAST_CALL CCanvas::ShiftRight(CONST INT nPixels)
+{
+	return Shift(nPixels, 0);
+}
+
+INT FAST_CALL CCanvas::ShiftUp(CONST INT nPixels)
+{
+	return Shift(0, -nPixels);
+}
+
+INT FAST_CALL CCanvas::ShiftDown(CONST INT nPixels)
+{
+	return Shift(0, nPixels);
+}
+
+#endif // TK_SOFTWARE_CANVAS
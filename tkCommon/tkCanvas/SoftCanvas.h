@@ -0,0 +1,573 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2007  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+//--------------------------------------------------------------------------
+// A software canvas: pixels are held in a plain memory buffer and every
+// blitter is a template on the pixel format, so colour conversion is
+// resolved at compile time. Define TK_SOFTWARE_CANVAS to build CCanvas
+// on this backend instead of DirectDraw and GDI (see GDICanvas.h), and
+// TK_SOFTWARE_CANVAS_16 to hold 16-bit (5-6-5) rather than 32-bit pixels.
+//
+// On Windows the buffer is a DIB section, so the GDI text and HDC blt
+// functions still work; elsewhere they fail harmlessly, which is enough
+// to render boards and sprites headless.
+//--------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------
+// Protect the header
+//--------------------------------------------------------------------------
+#ifndef _CSOFTCANVAS_H_
+#define _CSOFTCANVAS_H_
+#ifdef _MSC_VER
+#	pragma once
+#endif
+
+//--------------------------------------------------------------------------
+// Inclusions
+//--------------------------------------------------------------------------
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN		// Flag lean version of Windows
+#	include <windows.h>				// The Windows API
+#	include "../strings.h"
+#else
+#	include <string>
+#	include "SoftTypes.h"			// Stand-ins for the Windows types used here
+#endif
+
+//--------------------------------------------------------------------------
+// Definitions
+//--------------------------------------------------------------------------
+#if !defined(INLINE) && !defined(FAST_CALL)
+#	if defined(_MSC_VER)
+#		define INLINE __inline		// VC++ prefers the __inline keyword
+#		define FAST_CALL __fastcall
+#	else
+#		define INLINE inline
+#		define FAST_CALL			// Register (fast) calls are specific to VC++
+#	endif
+#endif
+#if !defined(DOUBLE)
+typedef double DOUBLE;
+#endif
+#if !defined(STATIC)
+#define STATIC static
+#endif
+
+const long TRANSP_COLOR = 16711935;	// Magic pink
+
+//--------------------------------------------------------------------------
+// Pixel formats. Each converts between its pixels and COLORREFs
+// (0x00BBGGRR) and exposes its channels, scaled to eight bits.
+//--------------------------------------------------------------------------
+
+// 32-bit 0x00RRGGBB pixels, as in a 32-bit DIB.
+typedef struct tagCnvXRGB32
+{
+	typedef DWORD PIXEL;
+	enum { BITS = 32 };
+
+	STATIC PIXEL fromColorRef(CONST COLORREF cr)
+	{
+		return ((cr & 0xff) << 16) | (cr & 0xff00) | ((cr >> 16) & 0xff);
+	}
+	STATIC COLORREF toColorRef(CONST PIXEL p)
+	{
+		return ((p & 0xff) << 16) | (p & 0xff00) | ((p >> 16) & 0xff);
+	}
+	STATIC PIXEL fromRGB(CONST INT r, CONST INT g, CONST INT b)
+	{
+		return (r << 16) | (g << 8) | b;
+	}
+	STATIC INT red(CONST PIXEL p) { return (p >> 16) & 0xff; }
+	STATIC INT green(CONST PIXEL p) { return (p >> 8) & 0xff; }
+	STATIC INT blue(CONST PIXEL p) { return p & 0xff; }
+
+	// The top byte is unused (and left as zero by GDI).
+	STATIC BOOL equal(CONST PIXEL a, CONST PIXEL b) { return !((a ^ b) & 0xffffff); }
+
+} CNV_XRGB32;
+
+// 16-bit 5-6-5 pixels.
+typedef struct tagCnvRGB565
+{
+	typedef WORD PIXEL;
+	enum { BITS = 16 };
+
+	STATIC PIXEL fromColorRef(CONST COLORREF cr)
+	{
+		return fromRGB(cr & 0xff, (cr >> 8) & 0xff, (cr >> 16) & 0xff);
+	}
+	STATIC COLORREF toColorRef(CONST PIXEL p)
+	{
+		return red(p) | (green(p) << 8) | (blue(p) << 16);
+	}
+	STATIC PIXEL fromRGB(CONST INT r, CONST INT g, CONST INT b)
+	{
+		return PIXEL(((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3));
+	}
+	STATIC INT red(CONST PIXEL p) { CONST INT r = (p >> 11) & 0x1f; return (r << 3) | (r >> 2); }
+	STATIC INT green(CONST PIXEL p) { CONST INT g = (p >> 5) & 0x3f; return (g << 2) | (g >> 4); }
+	STATIC INT blue(CONST PIXEL p) { CONST INT b = p & 0x1f; return (b << 3) | (b >> 2); }
+	STATIC BOOL equal(CONST PIXEL a, CONST PIXEL b) { return a == b; }
+
+} CNV_RGB565;
+
+#ifdef TK_SOFTWARE_CANVAS_16
+typedef CNV_RGB565 CNV_FORMAT;
+#else
+typedef CNV_XRGB32 CNV_FORMAT;
+#endif
+
+//--------------------------------------------------------------------------
+// Definition of the CCanvas class
+//--------------------------------------------------------------------------
+class CCanvas
+{
+
+//
+// Public visibility
+//
+public:
+
+	typedef CNV_FORMAT::PIXEL PIXEL;
+
+	CCanvas(
+		VOID
+	);
+
+	CCanvas(
+		CONST CCanvas &rhs
+	);
+
+	~CCanvas(
+		VOID
+	);
+
+	CCanvas &operator=(
+		CONST CCanvas &rhs
+	);
+
+	HBITMAP GetHBitmap(
+		VOID
+	) CONST { return m_hBitmap; }
+
+	VOID FAST_CALL CreateBlank(
+		CONST HDC hdcCompatible,
+		CONST INT width,
+		CONST INT height,
+		CONST BOOL bDX = FALSE
+	);
+
+	VOID Destroy(
+		VOID
+	);
+
+	VOID SetPixel(
+		CONST INT x,
+		CONST INT y,
+		CONST LONG crColor
+	);
+
+	INT FAST_CALL GetPixel(
+		CONST INT x,
+		CONST INT y
+	) CONST;
+
+	INT GetWidth(
+		VOID
+	) CONST { return m_nWidth; }
+
+	INT GetHeight(
+		VOID
+	) CONST { return m_nHeight; }
+
+	// Direct access to the pixel rows; the pitch is in pixels.
+	PIXEL *GetPixels(
+		VOID
+	) CONST { return m_pPixels; }
+
+	INT GetPitch(
+		VOID
+	) CONST { return m_nPitch; }
+
+	HDC OpenDC(
+		VOID
+	) CONST;
+
+	VOID CloseDC(
+		HDC hdc
+	) CONST;
+
+	VOID Lock(
+		VOID
+	) { m_hdcLocked = OpenDC(); }
+
+	VOID Unlock(
+		VOID
+	) {	CONST HDC hdc = m_hdcLocked; m_hdcLocked = NULL; CloseDC(hdc); }
+
+	VOID FAST_CALL SetPixels(
+		CONST LPLONG p_crPixelArray,
+		CONST INT x,
+		CONST INT y,
+		CONST INT width,
+		CONST INT height
+	);
+
+	VOID FAST_CALL Resize(
+		CONST HDC hdcCompatible,
+		CONST INT width,
+		CONST INT height
+	);
+
+	VOID SetSrcColorKey(
+		CONST LONG crTransparentColor
+	) CONST { }
+
+	BOOL usingDX(
+		VOID
+	) CONST { return FALSE; }
+
+	INT FAST_CALL Blt(
+		CONST HDC hdcTarget,
+		CONST INT x,
+		CONST INT y,
+		CONST LONG lRasterOp = SRCCOPY
+	) CONST;
+
+	INT FAST_CALL Blt(
+		CONST CCanvas *pCanvas,
+		CONST INT x,
+		CONST INT y,
+		CONST LONG lRasterOp = SRCCOPY
+	) CONST;
+
+	INT FAST_CALL BltPart(
+		CONST HDC hdcTarget,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST LONG lRasterOp = SRCCOPY
+	) CONST;
+
+	INT FAST_CALL BltPart(
+		CONST CCanvas *pCanvas,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST LONG lRasterOp = SRCCOPY
+	) CONST;
+
+	INT FAST_CALL BltTransparent(
+		CONST HDC hdcTarget,
+		CONST INT x,
+		CONST INT y,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL BltTransparent(
+		CONST CCanvas *pCanvas,
+		CONST INT x,
+		CONST INT y,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL BltTransparentPart(
+		CONST HDC hdcTarget,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL BltTransparentPart(
+		CONST CCanvas *pCanvas,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL BltTranslucentPart(
+		CONST CCanvas *pCanvas,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST DOUBLE dIntensity,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL BltTranslucentPart(
+		CONST HDC hdcTarget,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST DOUBLE dIntensity,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL BltTranslucent(
+		CONST HDC hdcTarget,
+		CONST INT x,
+		CONST INT y,
+		CONST DOUBLE dIntensity,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL BltTranslucent(
+		CONST CCanvas *pCanvas,
+		CONST INT x,
+		CONST INT y,
+		CONST DOUBLE dIntensity,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL BltStretch(
+		CONST HDC hdc,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST INT newWidth,
+		CONST INT newHeight,
+		CONST LONG lRasterOp
+	) CONST;
+
+	INT FAST_CALL BltStretch(
+		CONST CCanvas *cnv,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST INT newWidth,
+		CONST INT newHeight,
+		CONST LONG lRasterOp
+	) CONST;
+
+	BOOL FAST_CALL BltStretchMask(
+		CONST CCanvas *cnvMask,
+		CONST CCanvas *cnvTarget,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST INT newWidth,
+		CONST INT newHeight
+	) CONST;
+
+	VOID FAST_CALL ClearScreen(
+		CONST LONG crColor
+	);
+
+	BOOL FAST_CALL DrawText(
+		CONST INT x,
+		CONST INT y,
+		CONST STRING strText,
+		CONST STRING strTypeFace,
+		CONST INT size,
+		CONST LONG clr,
+		CONST BOOL bold = FALSE,
+		CONST BOOL italics = FALSE,
+		CONST BOOL underline = FALSE,
+		CONST BOOL centred = FALSE,
+		CONST BOOL outlined = FALSE
+	);
+
+	SIZE FAST_CALL GetTextSize(
+		CONST STRING strText,
+		CONST STRING strTypeFace,
+		CONST INT size,
+		CONST BOOL bold,
+		CONST BOOL italics
+	);
+
+	BOOL FAST_CALL DrawLine(
+		CONST INT x1,
+		CONST INT y1,
+		CONST INT x2,
+		CONST INT y2,
+		CONST LONG clr
+	);
+
+	BOOL FAST_CALL DrawRect(
+		CONST INT x1,
+		CONST INT y1,
+		CONST INT x2,
+		CONST INT y2,
+		CONST LONG clr
+	);
+
+	BOOL FAST_CALL DrawFilledRect(
+		CONST INT x1,
+		CONST INT y1,
+		CONST INT x2,
+		CONST INT y2,
+		CONST LONG clr
+	);
+
+	BOOL FAST_CALL DrawEllipse(
+		CONST INT x1,
+		CONST INT y1,
+		CONST INT x2,
+		CONST INT y2,
+		CONST LONG clr
+	);
+
+	BOOL FAST_CALL DrawFilledEllipse(
+		CONST INT x1,
+		CONST INT y1,
+		CONST INT x2,
+		CONST INT y2,
+		CONST LONG clr
+	);
+
+	INT FAST_CALL ShiftLeft(
+		CONST INT nPixels
+	);
+
+	INT FAST_CALL ShiftRight(
+		CONST INT nPixels
+	);
+
+	INT FAST_CALL ShiftUp(
+		CONST INT nPixels
+	);
+
+	INT FAST_CALL ShiftDown(
+		CONST INT nPixels
+	);
+
+	// Move the pixels by an offset, leaving the uncovered area as it was.
+	INT FAST_CALL Shift(
+		CONST INT dx,
+		CONST INT dy
+	);
+
+	INT FAST_CALL BltAdditivePart(
+		CONST CCanvas *pCanvas,
+		CONST INT x,
+		CONST INT y,
+		CONST INT xSrc,
+		CONST INT ySrc,
+		CONST INT width,
+		CONST INT height,
+		CONST DOUBLE percent,
+		CONST LONG crUnaffectedColor,
+		CONST LONG crTransparentColor
+	) CONST;
+
+	INT FAST_CALL Shade(
+		CONST INT r,
+		CONST INT g,
+		CONST INT b
+	);
+
+	// There are no surfaces: callers that pass a canvas' surface
+	// to another blitter are handed the canvas itself.
+	CONST CCanvas *GetDXSurface(
+		VOID
+	) CONST { return this; }
+
+	LONG GetSurfaceColor(
+		CONST LONG dxColor
+	) CONST { return CNV_FORMAT::toColorRef(PIXEL(dxColor)); }
+
+	VOID EmulateGamma() { }
+
+	COLORREF FAST_CALL matchColor(
+		CONST COLORREF rgb
+	) CONST { return CNV_FORMAT::fromColorRef(rgb); }
+
+	// Memory is never lost, so there is nothing to restore.
+	BOOL FAST_CALL CheckSurfaces(
+		VOID
+	) CONST { return FALSE; }
+
+//
+// Private visibility
+//
+private:
+
+	// Fill a clipped span of a row.
+	VOID FAST_CALL FillSpan(
+		CONST INT x1,
+		CONST INT x2,
+		CONST INT y,
+		CONST PIXEL pixel
+	);
+
+	INT m_nWidth;							// Width
+	INT m_nHeight;							// Height
+	INT m_nPitch;							// Pixels per row
+	PIXEL *m_pPixels;						// Top-down pixel rows
+	HDC m_hdcMem;							// Memory DC (Windows only)
+	HDC m_hdcLocked;						// Locked hdc
+	HBITMAP m_hBitmap;						// DIB section holding the pixels
+	HBITMAP m_hOldBitmap;					// Old bitmap of the memory DC
+};
+
+//--------------------------------------------------------------------------
+// End of the header
+//--------------------------------------------------------------------------
+#endif
@@ -0,0 +1,99 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2007  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+//--------------------------------------------------------------------------
+// Stand-ins for the Windows types and macros used by the software canvas,
+// for builds without the Windows headers.
+//--------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------
+// Protect the header
+//--------------------------------------------------------------------------
+#ifndef _SOFTTYPES_H_
+#define _SOFTTYPES_H_
+
+#include <string>
+
+#define CONST const
+#define VOID void
+#ifndef NULL
+#	define NULL 0
+#endif
+#ifndef TRUE
+#	define TRUE 1
+#	define FALSE 0
+#endif
+
+typedef int INT;
+typedef unsigned int UINT;
+typedef int BOOL;
+typedef long LONG;
+typedef long *LPLONG;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned int DWORD;
+typedef DWORD COLORREF;
+typedef void *HDC;
+typedef void *HBITMAP;
+typedef char TCHAR;
+
+typedef struct tagRECT
+{
+	LONG left, top, right, bottom;
+} RECT;
+
+typedef struct tagSIZE
+{
+	LONG cx, cy;
+} SIZE;
+
+#if !defined(STRING_DEFINED)
+typedef std::basic_string<TCHAR> STRING;
+#define STRING_DEFINED
+#endif
+
+#define RGB(r, g, b) ((COLORREF)(((BYTE)(r) | ((WORD)((BYTE)(g)) << 8)) | (((DWORD)(BYTE)(b)) << 16)))
+#define GetRValue(rgb) ((BYTE)(rgb))
+#define GetGValue(rgb) ((BYTE)(((WORD)(rgb)) >> 8))
+#define GetBValue(rgb) ((BYTE)((rgb) >> 16))
+
+// Raster operations.
+#define SRCCOPY		0x00CC0020
+#define SRCPAINT	0x00EE0086
+#define SRCAND		0x008800C6
+#define SRCINVERT	0x00660046
+
+#endif
@@ -322,6 +322,7 @@ BOOL CDirectDraw::OffsetGammaRamp(INT r, INT g, INT b)
 BOOL CDirectDraw::Refresh(VOID)
 {
 	CheckSurfaces();
+	++m_dwPresents;
 	return (this->*m_pRefresh)();
 }
 
@@ -340,7 +341,10 @@ VOID FAST_CALL CDirectDraw::CheckSurfaces()
 	if (m_lpddsSecond)
 	{
 		if (m_lpddsSecond->IsLost() == DDERR_SURFACELOST)
+		{
 			m_lpddsSecond->Restore();
+			++m_dwPresents;
+		}
 	}
 }
 
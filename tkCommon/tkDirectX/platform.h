@@ -276,7 +276,11 @@ public:
 		DDGAMMARAMP &ramp
 	) CONST { return m_lpddGammaControl->GetGammaRamp(0, &ramp); }
 
-	CCanvas *getBackBuffer(VOID) { m_pBackBuffer->CheckSurfaces(); return m_pBackBuffer; }
+	CCanvas *getBackBuffer(VOID) { if (m_pBackBuffer->CheckSurfaces()) ++m_dwPresents; return m_pBackBuffer; }
+
+	// Count of refreshes and back buffer restores; while it is unchanged,
+	// the back buffer holds what was drawn to it before the last refresh.
+	DWORD GetPresentCount(VOID) CONST { return m_dwPresents; }
 
 	// Deconstructor
 	~CDirectDraw(
@@ -317,6 +321,7 @@ private:
 	BOOL (FAST_CALL CDirectDraw::*m_pRefresh) (VOID);
 	LPDIRECTDRAWGAMMACONTROL m_lpddGammaControl;		// Gamma control.
 	BOOL m_bGammaEnabled;				// Gamma enabled?
+	DWORD m_dwPresents;					// Refreshes and back buffer restores.
 };
 
 //------------------------------------------------------------------------
@@ -62,12 +62,18 @@ CCanvasPool *CTile::m_pCnvAlphaMaskIso = NULL;
 CCanvasPool *CTile::m_pCnvMaskMaskIso = NULL;
 BOOL CTile::bCTileCreateIsoMaskOnce = FALSE;
 LONG CTile::isoMaskCTile[64][32] = {NULL};
-std::vector<CTile *> CTile::m_tiles;
+CTile::TILE_CACHE CTile::m_tiles;
+std::list<TILE_KEY> CTile::m_lru;
+stdext::hash_map<STRING, UINT> CTile::m_files;
+std::vector<STRING> CTile::m_fileNames;
+TILE_CACHE_STATS CTile::m_stats = {0, 0, 0, 0, 0, TILE_CACHE_BUDGET};
 
 //-------------------------------------------------------------------
 // actkrt3 and trans3 globals
 //-------------------------------------------------------------------
 STRING (*resolve)(const STRING &path) = NULL; // How to resolve tile file names.
+BOOL (*resolveRead)(const STRING &path, CONST LONG offset, LPVOID pData, CONST DWORD bytes) = NULL; // How to read unresolved tile sets.
+CONST TILE_PIXELS *(*resolveTile)(const STRING &file, CONST INT number) = NULL; // Where to find decoded tiles.
 
 //-------------------------------------------------------------------
 // Big DOS palette of doom
@@ -454,6 +460,29 @@ CTile::CTile(CONST INT nCompatibleDC, CONST BOOL bIsometric):
 	memset(m_pnAlphaChannel, 0, sizeof(m_pnAlphaChannel));
 }
 
+//-------------------------------------------------------------------
+// Construct without canvases (for decodeTile)
+//-------------------------------------------------------------------
+CTile::CTile(VOID):
+ m_strFilename(""),
+ m_nDetail(0),
+ m_bIsTransparent(FALSE),
+ m_bIsometric(FALSE),
+ m_nFgIdxIso(-1),
+ m_nAlphaIdxIso(-1),
+ m_nMaskIdxIso(-1),
+ m_nFgIdx(-1),
+ m_nAlphaIdx(-1),
+ m_nMaskIdx(-1),
+ m_nCompatibleDC(0),
+ m_nShadeType(SHADE_UNIFORM)
+
+{
+	m_rgb.r = m_rgb.g = m_rgb.b = 0;
+	memset(m_pnTile, 0, sizeof(m_pnTile));
+	memset(m_pnAlphaChannel, 0, sizeof(m_pnAlphaChannel));
+}
+
 //-------------------------------------------------------------------
 // DeConstructor
 //-------------------------------------------------------------------
@@ -574,15 +603,98 @@ VOID FAST_CALL CTile::open(CONST std::string strFilename, CONST RGBSHADE rgb, CO
 	m_bIsTransparent = FALSE;
 
 	//now do the actual loading. New! openTile returns nSetType, for createShading.
-	INT nSetType = openTile(strFilename);
+	INT nSetType = 0;
+	if (!openDecoded(strFilename, nSetType))
+	{
+		nSetType = openTile(strFilename);
 
-	if (m_nDetail == 2 || m_nDetail == 4 || m_nDetail == 6) 
-		increaseDetail();
+		if (m_nDetail == 2 || m_nDetail == 4 || m_nDetail == 6) 
+			increaseDetail();
+	}
 
 	prepAlpha();
 	createShading(rgb, nShadeType, nSetType);
 }
 
+/////////////////////////////////////////////////
+// CTile::openDecoded
+//
+// Action: load a tile already decoded, from an asset bundle
+//         through resolveTile
+//
+// Params: strFilename - filename, with a number for a tst
+//		   nSetType - receives the tileset type
+//
+// Returns: whether the tile was found
+//
+// Called by: CTile::open only
+////////////////////////////////////////////////
+
+BOOL FAST_CALL CTile::openDecoded(CONST std::string strFilename, INT &nSetType)
+{
+	if (!resolveTile) return FALSE;
+
+	CONST std::string strExt = util::upperCase(util::getExt(strFilename));
+	CONST BOOL bSet = (strExt.compare("TST") == 0 || strExt.compare("ISO") == 0);
+
+	CONST TILE_PIXELS *CONST pTile = bSet ? 
+		resolveTile(util::tilesetFilename(strFilename), util::getTileNum(strFilename)) :
+		resolveTile(strFilename, 0);
+	if (!pTile) return FALSE;
+
+	memcpy(m_pnTile, pTile->pixels, sizeof(m_pnTile));
+	for (INT x = 0; x < 32; x++)
+	{
+		for (INT y = 0; y < 32; y++)
+		{
+			m_pnAlphaChannel[x][y] = pTile->alpha[x][y];
+		}
+	}
+	m_nDetail = pTile->detail;
+	m_bIsTransparent = pTile->bTransparent;
+	nSetType = pTile->setType;
+	return TRUE;
+}
+
+/////////////////////////////////////////////////
+// CTile::decodeTile
+//
+// Action: decode a tile from its file, without drawing it
+//
+// Params: strFilename - filename, with a number for a tst
+//		   tile - receives the tile
+//
+// Returns: whether the tile could be opened
+//
+// Called by: asset bundle builders
+////////////////////////////////////////////////
+
+BOOL CTile::decodeTile(CONST std::string strFilename, TILE_PIXELS &tile)
+{
+	CTile decoder;
+	decoder.m_strFilename = strFilename;
+
+	CONST INT nSetType = decoder.openTile(strFilename);
+	if (nSetType < 0 || decoder.m_nDetail < 0) return FALSE;
+
+	if (decoder.m_nDetail == 2 || decoder.m_nDetail == 4 || decoder.m_nDetail == 6) 
+		decoder.increaseDetail();
+
+	memset(&tile, 0, sizeof(tile));
+	memcpy(tile.pixels, decoder.m_pnTile, sizeof(tile.pixels));
+	for (INT x = 0; x < 32; x++)
+	{
+		for (INT y = 0; y < 32; y++)
+		{
+			tile.alpha[x][y] = BYTE(decoder.m_pnAlphaChannel[x][y]);
+		}
+	}
+	tile.detail = decoder.m_nDetail;
+	tile.setType = nSetType;
+	tile.bTransparent = decoder.m_bIsTransparent;
+	return TRUE;
+}
+
 //-------------------------------------------------------------------
 // CTile::createShading
 //
@@ -955,7 +1067,7 @@ INT FAST_CALL CTile::openTile(CONST std::string strFilename)
 		INT number = util::getTileNum(strFilename);
 		std::string strTstFilename = util::tilesetFilename(strFilename);
 
-		m_nDetail = openFromTileSet(resolve ? resolve(strTstFilename) : strTstFilename, number);
+		m_nDetail = openFromTileSet(strTstFilename, number);
 
 		
 		// Added:
@@ -1189,10 +1301,11 @@ INT FAST_CALL CTile::openFromTileSet(CONST std::string strFilename, CONST INT nu
 	if ((tileset.version == 20) || (tileset.version == 30))
 	{
 
-		FILE *CONST infile = fopen(strFilename.c_str(), "rb");
-		if (!infile) return -1;
+		// Read the whole tile at once.
+		BYTE tile[32 * 32 * 3];
 		CONST LONG np = calcInsertionPoint(tileset.detail,number);
-		fseek(infile, np, 0);
+		if (!readTileset(strFilename, np, tile, tileBytes(tileset.detail))) return -1;
+		CONST BYTE *p = tile;
 
 		// Switch on the detail level
 		switch (detail = tileset.detail) 
@@ -1208,9 +1321,9 @@ INT FAST_CALL CTile::openFromTileSet(CONST std::string strFilename, CONST INT nu
 				{
 					for (yy = 0; yy < 32; yy++) 
 					{
-						fread(&rrr, 1, 1, infile);
-						fread(&ggg, 1, 1, infile);
-						fread(&bbb, 1, 1, infile);
+						rrr = *p++;
+						ggg = *p++;
+						bbb = *p++;
 						if (INT(rrr) == 0 && INT(ggg) == 1 && INT(bbb) == 2) 
 						{
 							m_pnTile[xx][yy] = 0;
@@ -1231,9 +1344,9 @@ INT FAST_CALL CTile::openFromTileSet(CONST std::string strFilename, CONST INT nu
 				{
 					for (yy=0;yy<16;yy++) 
 					{
-						fread(&rrr, 1, 1, infile);
-						fread(&ggg, 1, 1, infile);
-						fread(&bbb, 1, 1, infile);
+						rrr = *p++;
+						ggg = *p++;
+						bbb = *p++;
 						if (INT(rrr) == 0 && INT(ggg) == 1 && INT(bbb) == 2) 
 						{
 							m_pnTile[xx][yy] = 0;
@@ -1256,7 +1369,7 @@ INT FAST_CALL CTile::openFromTileSet(CONST std::string strFilename, CONST INT nu
 				{
 					for (yy = 0; yy < 32; yy++) 
 					{
-						fread(&rrr, 1, 1, infile);
+						rrr = *p++;
 						if (INT(rrr) == 255) 
 						{
 							m_pnTile[xx][yy] = 0;
@@ -1278,7 +1391,7 @@ INT FAST_CALL CTile::openFromTileSet(CONST std::string strFilename, CONST INT nu
 				{
 					for (yy = 0; yy < 16; yy++) 
 					{
-						fread(&rrr, 1, 1, infile);
+						rrr = *p++;
 						if (INT(rrr) == 255) 
 						{
 							m_pnTile[xx][yy] = 0;
@@ -1294,7 +1407,6 @@ INT FAST_CALL CTile::openFromTileSet(CONST std::string strFilename, CONST INT nu
 				}
 				break;
 		}
-		fclose(infile);
 	}
 
 	m_bIsTransparent = bTransparentParts;
@@ -1319,14 +1431,42 @@ INT FAST_CALL CTile::openFromTileSet(CONST std::string strFilename, CONST INT nu
 TS_HEADER FAST_CALL CTile::getTilesetInfo(CONST std::string strFilename) 
 {
 	TS_HEADER header = {0, 0, 0};
+	if (!readTileset(strFilename, 0, &header, 6))
+	{
+		memset(&header, 0, sizeof(header));
+	}
+	return header;
+}
 
-	FILE* file = fopen(strFilename.c_str(), "rb");
-	if (!file) return header;
 
-	fread(&header, 6, 1, file);
+///////////////////////////////////////////////////////
+//
+// CTile::readTileset
+//
+// Parameters: strFilename- the unresolved filename
+//             offset- first byte to read
+//             pData- destination
+//             bytes- number of bytes
+//
+// Action: read part of a tileset, from an archive
+//         through resolveRead if it has the file,
+//         else from the resolved file
+//
+// Returns: whether all the bytes were read
+//
+///////////////////////////////////////////////////////
+BOOL FAST_CALL CTile::readTileset(CONST std::string strFilename, CONST LONG offset, LPVOID pData, CONST DWORD bytes)
+{
+	if (resolveRead && resolveRead(strFilename, offset, pData, bytes)) return TRUE;
+
+	FILE *CONST file = fopen((resolve ? resolve(strFilename) : strFilename).c_str(), "rb");
+	if (!file) return FALSE;
+
+	fseek(file, offset, SEEK_SET);
+	CONST BOOL bRead = (fread(pData, 1, bytes, file) == bytes);
 	fclose(file);
 
-	return header;
+	return bRead;
 }
 
 
@@ -1350,34 +1490,52 @@ TS_HEADER FAST_CALL CTile::getTilesetInfo(CONST std::string strFilename)
 
 LONG FAST_CALL CTile::calcInsertionPoint(CONST INT d, CONST INT number)
 {
-	LONG num = LONG(number);
+	CONST DWORD bytes = tileBytes(d);
+	return bytes ? ((LONG(bytes) * (LONG(number) - 1)) + 6) : 0;
+}
+
+
+///////////////////////////////////////////////////////
+//
+// CTile::tileBytes
+//
+// Parameters: d- detail level
+//
+// Action: calc the size of a tile in a tst
+//
+// Returns: bytes per tile
+//
+///////////////////////////////////////////////////////
+
+DWORD FAST_CALL CTile::tileBytes(CONST INT d)
+{
 	switch (d) 
 	{
 		case ISODETAIL:
 			//Same as for 1: fall through!
 		case 1:
 			//32x32, 16.7 million colors. (32x32x3 bytes each)
-			return ((3072 * (num - 1)) + 6);
+			return 3072;
 
 		case 2:
 			//16x16, 16.7 million colors (16x16x3 bytes)
-			return ((768 * (num - 1)) + 6);
+			return 768;
 
 		case 3:
 			//32x32, 256 colors (32x32x1 bytes)
-			return ((1024 * (num - 1)) + 6);
+			return 1024;
 		
 		case 4:
 			//16x16, 256 colors (16x16x1 bytes)
-			return ((256 * (num - 1)) + 6);
+			return 256;
 		
 		case 5:
 			//32x32, 16 colors (32x32x1 byte)
-			return ((1024 * (num - 1)) + 6);
+			return 1024;
 
 		case 6:
 			//16x16, 16 colors (16x16,1 bytes)
-			return ((256 * (num - 1)) + 6);
+			return 256;
 
 	}
 	return 0;
@@ -1618,6 +1776,31 @@ VOID CTile::drawByBoardCoord(
 	CONST INT pxOffsetX, CONST INT pxOffsetY, 
 	COORD_TYPE coordType,
 	CONST INT brdSizeX)
+{
+	drawByBoardCoord(
+		getHandle(filename), 
+		x, y, 
+		r, g, b, 
+		cnv, 
+		eMaskValue, 
+		pxOffsetX, pxOffsetY, 
+		coordType, 
+		brdSizeX
+	);
+}
+
+//-------------------------------------------------------------------
+// Handle equivalent - draw a tile resolved with getHandle().
+//-------------------------------------------------------------------
+VOID CTile::drawByBoardCoord(
+	CONST UINT handle, 
+	INT x, INT y, 
+	CONST INT r, CONST INT g, CONST INT b, 
+	CCanvas *cnv,
+	CONST INT eMaskValue,
+	CONST INT pxOffsetX, CONST INT pxOffsetY, 
+	COORD_TYPE coordType,
+	CONST INT brdSizeX)
 {
 	// Remove any PX_ABSOLUTE flag - tiles are always given in tile coordinates.
 	coordType = COORD_TYPE(coordType & ~PX_ABSOLUTE);
@@ -1635,7 +1818,7 @@ VOID CTile::drawByBoardCoord(
 
 	CONST RGBSHADE rgb = {r, g, b};
 
-	CTile *CONST pTile = getTile(filename, eMaskValue, rgb, bIsometric, NULL);
+	CTile *CONST pTile = getTile(handle, eMaskValue, rgb, bIsometric, NULL);
 
 	switch (eMaskValue)
 	{
@@ -1698,72 +1881,128 @@ VOID CTile::drawByBoardCoordHdc(
 
 //-------------------------------------------------------------------
 // Get a tile from m_tiles by name. If not found, create new.
+// The returned tile may be evicted by a later call, so callers
+// should not hold on to it.
 //-------------------------------------------------------------------
 CTile *CTile::getTile(CONST STRING filename, CONST INT eMask, CONST RGBSHADE rgb, CONST BOOL bIsometric, CONST HDC hdcCompat)
 {
-	if (m_tiles.size() > TILE_CACHE_SIZE) clearTileCache();
+	return getTile(getHandle(filename), eMask, rgb, bIsometric, hdcCompat);
+}
+
+//-------------------------------------------------------------------
+// Get a tile from m_tiles by handle. If not found, create new.
+//-------------------------------------------------------------------
+CTile *CTile::getTile(CONST UINT handle, CONST INT eMask, CONST RGBSHADE rgb, CONST BOOL bIsometric, CONST HDC hdcCompat)
+{
+	CONST TILE_KEY key = cacheKey(handle, eMask, rgb, bIsometric);
 
 	// Check if this tile has already been drawn.
-	std::vector<CTile*>::iterator i = findCacheMatch(filename, eMask, rgb, bIsometric);
-	
+	TILE_CACHE::iterator i = m_tiles.find(key);
 	if (i != m_tiles.end())
 	{
-		CTile **itrTile = &*i;
-		if (itrTile) return *itrTile;
+		// Move to the front of the recently used list.
+		m_lru.splice(m_lru.begin(), m_lru, i->second.lru);
+		++m_stats.hits;
+		return i->second.pTile;
 	}
+	++m_stats.misses;
 
 	// Load the tile.
-	CTile *CONST pTile = new CTile(INT(hdcCompat), filename, rgb, SHADE_UNIFORM, bIsometric);
+	CTile *CONST pTile = new CTile(INT(hdcCompat), m_fileNames[handle], rgb, SHADE_UNIFORM, bIsometric);
+
+	// Make room for it and file it.
+	evict(pTile->cacheBytes());
+	m_lru.push_front(key);
+	CONST TILE_CACHE_ENTRY entry = {pTile, m_lru.begin()};
+	m_tiles[key] = entry;
 
-	// Push it into the vector.
-	m_tiles.push_back(pTile);
+	++m_stats.tiles;
+	m_stats.bytes += pTile->cacheBytes();
 
 	return pTile;
 }
 
 //-------------------------------------------------------------------
-// Find a tile match in m_tiles by name.
+// Get a stable handle for a tile filename by interning it.
 //-------------------------------------------------------------------
-std::vector<CTile *>::iterator CTile::findCacheMatch(CONST STRING filename, CONST INT eMask, CONST RGBSHADE rgb, CONST BOOL bIsometric)
+UINT CTile::getHandle(CONST STRING filename)
 {
-	for (std::vector<CTile *>::iterator i = m_tiles.begin(); i != m_tiles.end(); ++i)
+	stdext::hash_map<STRING, UINT>::const_iterator i = m_files.find(filename);
+	if (i != m_files.end()) return i->second;
+
+	CONST UINT handle = m_fileNames.size();
+	m_files.insert(std::make_pair(filename, handle));
+	m_fileNames.push_back(filename);
+	return handle;
+}
+
+//-------------------------------------------------------------------
+// Form the cache key for a tile. Masks are drawn from the alpha
+// channel only, so they share one entry whatever the shade.
+//-------------------------------------------------------------------
+TILE_KEY CTile::cacheKey(CONST UINT handle, CONST INT eMask, CONST RGBSHADE rgb, CONST BOOL bIsometric)
+{
+	TILE_KEY key;
+	key.file = handle;
+	key.bMask = (eMask != TM_NONE);
+	key.bIsometric = (bIsometric != FALSE);
+	key.rgb.r = key.bMask ? 0 : rgb.r;
+	key.rgb.g = key.bMask ? 0 : rgb.g;
+	key.rgb.b = key.bMask ? 0 : rgb.b;
+	return key;
+}
+
+//-------------------------------------------------------------------
+// Drop the least recently used tiles until another bytes fit in
+// the budget. The cache always keeps room for one tile.
+//-------------------------------------------------------------------
+VOID CTile::evict(CONST UINT bytes)
+{
+	while (!m_lru.empty() && m_stats.bytes + bytes > m_stats.budget)
 	{
-		CONST STRING strVect = (*i)->getFilename();
-		if (strVect.compare(filename) == 0)
-		{
-			if (eMask || (*i)->isShadedAs(rgb, SHADE_UNIFORM))
-			{
-				// Check isometrics match.
-				if (bIsometric == (*i)->isIsometric())
-				{
-					return i;
-				}
-			}
-		}
+		TILE_CACHE::iterator i = m_tiles.find(m_lru.back());
+		m_stats.bytes -= i->second.pTile->cacheBytes();
+		--m_stats.tiles;
+		++m_stats.evictions;
+
+		delete i->second.pTile;
+		m_tiles.erase(i);
+		m_lru.pop_back();
 	}
-	return m_tiles.end();
 }
 
 //-------------------------------------------------------------------
-// Erase a single tile from the cache, if found.
+// Set the memory available to the tile cache.
 //-------------------------------------------------------------------
-VOID CTile::deleteFromCache(CONST STRING filename)
+VOID CTile::setCacheBudget(CONST UINT bytes)
 {
-	CONST RGBSHADE rgb = {0, 0, 0};
+	m_stats.budget = bytes;
+	evict(0);
+}
 
-	// Standard tile.
-	std::vector<CTile *>::iterator itrTile = findCacheMatch(filename, TM_NONE, rgb, FALSE);
+//-------------------------------------------------------------------
+// Erase every version of a tile from the cache, if found.
+//-------------------------------------------------------------------
+VOID CTile::deleteFromCache(CONST STRING filename)
+{
+	stdext::hash_map<STRING, UINT>::const_iterator file = m_files.find(filename);
+	if (file == m_files.end()) return;
 
-	if (itrTile != m_tiles.end())
+	for (std::list<TILE_KEY>::iterator i = m_lru.begin(); i != m_lru.end(); )
 	{
-		m_tiles.erase(itrTile);
-	}
+		if (i->file != file->second)
+		{
+			++i;
+			continue;
+		}
 
-	// Isometric.
-	itrTile = findCacheMatch(filename, TM_NONE, rgb, TRUE);
-	if (itrTile != m_tiles.end())
-	{
-		m_tiles.erase(itrTile);
+		TILE_CACHE::iterator j = m_tiles.find(*i);
+		m_stats.bytes -= j->second.pTile->cacheBytes();
+		--m_stats.tiles;
+
+		delete j->second.pTile;
+		m_tiles.erase(j);
+		i = m_lru.erase(i);
 	}
 }
 
@@ -1772,11 +2011,13 @@ VOID CTile::deleteFromCache(CONST STRING filename)
 //-------------------------------------------------------------------
 VOID CTile::clearTileCache(VOID)
 {
-	for (std::vector<CTile *>::iterator i = m_tiles.begin(); i != m_tiles.end(); ++i)
+	for (TILE_CACHE::iterator i = m_tiles.begin(); i != m_tiles.end(); ++i)
 	{
-		delete *i;
+		delete i->second.pTile;
 	}
 	m_tiles.clear();
+	m_lru.clear();
+	m_stats.tiles = m_stats.bytes = 0;
 }
 
 //-------------------------------------------------------------------
@@ -50,6 +50,8 @@
 //-------------------------------------------------------------------
 #define CTILE_COMMONCANVAS
 #define TILE_CACHE_SIZE 1024
+#define TILE_NO_HANDLE 0xffffffff
+#define TILE_CACHE_BUDGET (TILE_CACHE_SIZE * (sizeof(CTile) + 32 * 32 * 4 * 3))
 #if !defined(INLINE) && !defined(FAST_CALL)
 #	if defined(_MSC_VER)
 #		define INLINE __inline		// VC++ prefers the __inline keyword
@@ -71,6 +73,8 @@ typedef double DOUBLE;
 //-------------------------------------------------------------------
 #include <string>
 #include <vector>
+#include <list>
+#include <hash_map>
 #include "../../tkCommon/tkCanvas/CCanvasPool.h"
 #include "../board/coords.h"
 
@@ -102,6 +106,77 @@ enum tagTileMaskEnum
 	TM_AND				// Render mask transparently.
 };
 
+//-------------------------------------------------------------------
+// Tile cache key and statistics
+//-------------------------------------------------------------------
+typedef struct tagTileKey
+{
+	UINT file;				// Tile handle (interned filename).
+	RGBSHADE rgb;			// Shade (zero for masks, which ignore shading).
+	BOOL bMask;				// Drawn as a mask?
+	BOOL bIsometric;
+
+	bool operator== (CONST tagTileKey &rhs) CONST
+	{
+		return (file == rhs.file && rgb.r == rhs.rgb.r && rgb.g == rhs.rgb.g &&
+			rgb.b == rhs.rgb.b && bMask == rhs.bMask && bIsometric == rhs.bIsometric);
+	}
+} TILE_KEY;
+
+typedef struct tagTileKeyTraits
+{
+	enum { bucket_size = 4, min_buckets = 8 };
+
+	size_t operator()(CONST TILE_KEY &key) CONST
+	{
+		return (key.file * 2654435761U) ^ (UINT(key.rgb.r) << 20) ^ (UINT(key.rgb.g) << 10) ^
+			UINT(key.rgb.b) ^ (UINT(key.bMask) << 30) ^ (UINT(key.bIsometric) << 31);
+	}
+
+	bool operator()(CONST TILE_KEY &a, CONST TILE_KEY &b) CONST
+	{
+		if (a.file != b.file) return a.file < b.file;
+		if (a.rgb.r != b.rgb.r) return a.rgb.r < b.rgb.r;
+		if (a.rgb.g != b.rgb.g) return a.rgb.g < b.rgb.g;
+		if (a.rgb.b != b.rgb.b) return a.rgb.b < b.rgb.b;
+		if (a.bMask != b.bMask) return a.bMask < b.bMask;
+		return a.bIsometric < b.bIsometric;
+	}
+} TILE_KEY_TRAITS;
+
+typedef struct tagTileCacheStats
+{
+	UINT hits;				// Lookups found in the cache.
+	UINT misses;			// Lookups that loaded a tile.
+	UINT evictions;			// Tiles dropped to stay under budget.
+	UINT tiles;				// Tiles currently cached.
+	UINT bytes;				// Approximate memory held by cached tiles.
+	UINT budget;			// Memory budget in bytes.
+} TILE_CACHE_STATS;
+
+//-------------------------------------------------------------------
+// A tile decoded from its file, ready to be shaded. Asset bundles
+// store tiles in this form, so the layout must not change.
+//-------------------------------------------------------------------
+typedef struct tagTilePixels
+{
+	INT pixels[32][32];		// Colours, as CTile::m_pnTile.
+	BYTE alpha[32][32];		// 255 == opaque part, 0 == transparent part.
+	INT detail;				// Detail level, with low detail increased.
+	INT setType;			// As returned by CTile::openTile.
+	BOOL bTransparent;		// Has transparent parts?
+	INT reserved;
+} TILE_PIXELS;
+
+class CTile;
+
+// A cached tile and its position in the recently-used list.
+typedef struct tagTileCacheEntry
+{
+	CTile *pTile;
+	std::list<TILE_KEY>::iterator lru;
+} TILE_CACHE_ENTRY;
+
 //-------------------------------------------------------------------
 // CTile - a tile
 //-------------------------------------------------------------------
@@ -221,6 +296,12 @@ class CTile
 		// Check if the tile is isometric
 		BOOL isIsometric(VOID) { return m_bIsometric; }
 
+		// Decode a tile without drawing it, for asset bundles
+		STATIC BOOL decodeTile(
+			CONST std::string strFilename,
+			TILE_PIXELS &tile
+		);
+
 		// Get a color from the dos palette of doom
 		STATIC UINT FAST_CALL getDOSColor(
 			CONST UCHAR cColor
@@ -242,6 +323,17 @@ class CTile
 			CONST INT brdSizeX
 		);
 
+		STATIC VOID drawByBoardCoord(
+			CONST UINT handle, 
+			INT x, INT y, 
+			CONST INT r, CONST INT g, CONST INT b, 
+			CCanvas *cnv, 
+			CONST INT eMaskValue,
+			CONST INT pxOffsetX, CONST INT pxOffsetY, 
+			COORD_TYPE coordType, 
+			CONST INT brdSizeX
+		);
+
 		STATIC VOID drawByBoardCoordHdc(
 			CONST STRING filename, 
 			INT x, INT y, 
@@ -261,6 +353,20 @@ class CTile
 			CONST HDC hdcCompat
 		);
 
+		STATIC CTile *getTile(
+			CONST UINT handle, 
+			CONST INT eMask, 
+			CONST RGBSHADE rgb, 
+			CONST BOOL bIsometric,
+			CONST HDC hdcCompat
+		);
+
+		// Get a stable handle for a tile filename. Handles stay
+		// valid when the tile itself is evicted from the cache.
+		STATIC UINT getHandle(
+			CONST STRING filename
+		);
+
 		STATIC VOID clearTileCache(
 			VOID
 		);
@@ -272,6 +378,16 @@ class CTile
 		STATIC VOID deleteFromCache(
 			CONST STRING filename
 		);
+
+		// Set the memory available to the tile cache
+		STATIC VOID setCacheBudget(
+			CONST UINT bytes
+		);
+
+		// Get the tile cache counters
+		STATIC CONST TILE_CACHE_STATS &getCacheStats(
+			VOID
+		) { return m_stats; }
 		
 		STATIC VOID drawBlankHdc(
 			INT x, INT y, 
@@ -283,6 +399,17 @@ class CTile
 		);
 
 	private:
+		// Construct without canvases, to decode a tile
+		CTile(
+			VOID
+		);
+
+		// Open a tile decoded by resolveTile
+		BOOL FAST_CALL openDecoded(
+			CONST std::string strFilename,
+			INT &nSetType
+		);
+
 		// Create an isometric mask
 		VOID FAST_CALL createIsometricMask(
 			VOID
@@ -311,18 +438,43 @@ class CTile
 			CONST INT number
 		);
 
+		// Calculate the size of a tile in a set
+		STATIC DWORD FAST_CALL tileBytes(
+			CONST INT idx
+		);
+
+		// Read part of a tile set
+		STATIC BOOL FAST_CALL readTileset(
+			CONST std::string strFilename,
+			CONST LONG offset,
+			LPVOID pData,
+			CONST DWORD bytes
+		);
+
 		// Increase this tile's detail
 		VOID FAST_CALL increaseDetail(
 			VOID
 		);
 
-		STATIC std::vector<CTile *>::iterator findCacheMatch(
-			CONST STRING filename, 
+		// Form the cache key for a tile
+		STATIC TILE_KEY cacheKey(
+			CONST UINT handle, 
 			CONST INT eMask, 
 			CONST RGBSHADE rgb, 
 			CONST BOOL bIsometric
 		);
 
+		// Drop least recently used tiles until there is room
+		STATIC VOID evict(
+			CONST UINT bytes
+		);
+
+		// Approximate memory held by a cached tile
+		UINT cacheBytes(VOID) CONST 
+		{
+			return sizeof(CTile) + (m_bIsometric ? 64 : 32) * 32 * 4 * 3; 
+		}
+
 		// Filename of the tile
 		std::string m_strFilename;
 
@@ -365,8 +517,14 @@ class CTile
 		INT m_nFgIdx, m_nAlphaIdx, m_nMaskIdx;
 		INT m_nFgIdxIso, m_nAlphaIdxIso, m_nMaskIdxIso;
 
-		// Tile cache.
-		STATIC std::vector<CTile *> m_tiles;
+		// Tile cache, keyed on interned filename, shade, mask and
+		// isometric flag, with the most recently used tile first.
+		typedef stdext::hash_map<TILE_KEY, TILE_CACHE_ENTRY, TILE_KEY_TRAITS> TILE_CACHE;
+		STATIC TILE_CACHE m_tiles;
+		STATIC std::list<TILE_KEY> m_lru;
+		STATIC stdext::hash_map<STRING, UINT> m_files;
+		STATIC std::vector<STRING> m_fileNames;
+		STATIC TILE_CACHE_STATS m_stats;
 };
 
 #endif
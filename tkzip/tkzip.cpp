@@ -44,9 +44,14 @@
 #include "unzip.h"
 #include "tkzip.h"
 #include "zipoperate.h"
+#include "zippack.h"
+
+//size of the blocks compound files are copied in...
+#define COPY_BLOCK 65536
 
 unzFile g_uf;
 zipFile g_zf;
+PACK* g_pack;
 
 int main(int argc, char* argv[])
 {
@@ -82,28 +87,42 @@ int APIENTRY ZIPTest()
 {
 	g_zf = 0;
 	g_uf = 0;
+	g_pack = 0;
 	return 1;
 }
 
 
+//files added are queued, and compressed in parallel
+//when the archive is closed (see zippack.h)...
 int APIENTRY ZIPCreate(char* pstrZipToCreate, int nTackOntoEndYN)
 {
-	g_zf = CreateZip(pstrZipToCreate, nTackOntoEndYN);
+	g_pack = PackCreate(pstrZipToCreate, nTackOntoEndYN);
 	return 1;
 }
 
 
 int APIENTRY ZIPCloseNew()
 {
-	if (g_zf)
-		CloseCreatedZip(g_zf);
-	return 1;
+	int nResult = 1;
+	if (g_pack)
+		nResult = PackClose(g_pack);
+	g_pack = 0;
+	return nResult;
 }
 
 int APIENTRY ZIPAdd(char* pstrToAdd, char* pstrAddAs)
 {
-	if (g_zf)
-		Add(pstrToAdd, pstrAddAs, g_zf);
+	if (g_pack)
+		PackAdd(g_pack, pstrToAdd, pstrAddAs);
+	return 1;
+}
+
+//store files added from now on without deflating them,
+//for media that are already compressed...
+int APIENTRY ZIPSetStoreOnly(int nStoreOnlyYN)
+{
+	if (g_pack)
+		PackSetStoreOnly(g_pack, nStoreOnlyYN != 0);
 	return 1;
 }
 
@@ -178,12 +197,24 @@ int APIENTRY ZIPFileExist(char* pstrFileToCheck)
 }
 
 
+//copy bytes from one file to another in blocks...
+static void CopyBlocks(FILE* from, FILE* to, int nBytes)
+{
+	static unsigned char buffer[COPY_BLOCK];
+	while (nBytes > 0)
+	{
+		int nBlock = (nBytes < COPY_BLOCK) ? nBytes : COPY_BLOCK;
+		int nRead = fread(buffer, 1, nBlock, from);
+		if (nRead <= 0) return;
+		fwrite(buffer, 1, nRead, to);
+		nBytes -= nRead;
+	}
+}
+
+
 //tack a zipfile onto the end of an existing file...
 int APIENTRY ZIPCreateCompoundFile(char* pstrOrigFile, char* pstrExtendedFile)
 {
-	unsigned char buffer[260];
-	int nBufSize = 256;
-
 	FILE* orig = fopen(pstrOrigFile, "ab");
 	FILE* extend = fopen(pstrExtendedFile, "rb");
 	if (orig && extend)
@@ -196,25 +227,8 @@ int APIENTRY ZIPCreateCompoundFile(char* pstrOrigFile, char* pstrExtendedFile)
 		int nELen = ftell(extend);
 		fseek(extend, 0, SEEK_SET);
 
-		//determine how many '256 k' chunks are in extended file...
-		int nExtendChunks = nELen / nBufSize;
-		int nExtendRemain = nELen - (nExtendChunks * nBufSize);
-
-		//copy chunks over...
-		int i=0;
-		for (i=0; i < nExtendChunks; i++)
-		{
-			fread(buffer, nBufSize, sizeof(unsigned char), extend);
-			fwrite(buffer, nBufSize, sizeof(unsigned char), orig);
-		}
-
-		//copy remainder over...
-		for (i=0; i< nExtendRemain; i++)
-		{
-			unsigned char c;
-			fread(&c, 1, sizeof(unsigned char), extend);
-			fwrite(&c, 1, sizeof(unsigned char), orig);
-		}
+		//copy the zipfile over...
+		CopyBlocks(extend, orig, nELen);
 
 		//now write out tail...
 		char strIDString[5];
@@ -274,9 +288,6 @@ int APIENTRY ZIPIsCompoundFile(char* pstrFileToCheck)
 //tack a zipfile onto the end of an existing file...
 int APIENTRY ZIPExtractCompoundFile(char* pstrOrigFile, char* pstrSaveTo)
 {
-	unsigned char buffer[260];
-	int nBufSize = 256;
-
 	FILE* orig = fopen(pstrOrigFile, "rb");
 	FILE* extend = fopen(pstrSaveTo, "wb");
 	if (orig && extend)
@@ -296,29 +307,11 @@ int APIENTRY ZIPExtractCompoundFile(char* pstrOrigFile, char* pstrSaveTo)
 			int nELen;
 			fread(&nOLen, 1, sizeof(int), orig);
 			fread(&nELen, 1, sizeof(int), orig);
-			
-			//determine how many '256 k' chunks are in extended file...
-			int nExtendChunks = nELen / nBufSize;
-			int nExtendRemain = nELen - (nExtendChunks * nBufSize);
 
 			fseek(orig, nOLen, SEEK_SET);
 
-			//copy chunks over...
-			int i=0;
-			for (i=0; i < nExtendChunks; i++)
-			{
-				fread(buffer, nBufSize, sizeof(unsigned char), orig);
-				fwrite(buffer, nBufSize, sizeof(unsigned char), extend);
-			}
-
-			//copy remainder over...
-			for (i=0; i< nExtendRemain; i++)
-			{
-				unsigned char c;
-				fread(&c, 1, sizeof(unsigned char), orig);
-				fwrite(&c, 1, sizeof(unsigned char), extend);
-			}
-
+			//copy the zipfile out...
+			CopyBlocks(orig, extend, nELen);
 
 			fclose(orig);
 			fclose(extend);
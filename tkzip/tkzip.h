@@ -42,6 +42,8 @@ int APIENTRY ZIPCloseNew();
 
 int APIENTRY ZIPAdd(char* pstrToAdd, char* pstrAddAs);
 
+int APIENTRY ZIPSetStoreOnly(int nStoreOnlyYN);
+
 int APIENTRY ZIPOpen(char* pstrZipToOpen);
 
 int APIENTRY ZIPClose();
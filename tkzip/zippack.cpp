@@ -0,0 +1,321 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+//zippack.cpp
+//building zip files in parallel - see zippack.h
+
+#include "stdafx.h"
+#include "zippack.h"
+#include "zlib.h"
+
+#define ZIP_LOCAL_SIGNATURE 0x04034b50
+#define ZIP_DIR_SIGNATURE 0x02014b50
+#define ZIP_END_SIGNATURE 0x06054b50
+#define ZIP_VERSION 20
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+
+//////////////////////////////////
+// Little endian values for the headers.
+static void PutWord(std::vector<unsigned char>& buffer, unsigned long nValue)
+{
+	buffer.push_back((unsigned char)(nValue & 0xff));
+	buffer.push_back((unsigned char)((nValue >> 8) & 0xff));
+}
+
+static void PutDword(std::vector<unsigned char>& buffer, unsigned long nValue)
+{
+	PutWord(buffer, nValue & 0xffff);
+	PutWord(buffer, nValue >> 16);
+}
+
+
+//////////////////////////////////
+// PutHeader
+//
+// Append a local or central directory header.
+static void PutHeader(std::vector<unsigned char>& buffer, const PACK_ENTRY& entry, bool bCentral)
+{
+	PutDword(buffer, bCentral ? ZIP_DIR_SIGNATURE : ZIP_LOCAL_SIGNATURE);
+	if (bCentral) PutWord(buffer, ZIP_VERSION);		//version made by
+	PutWord(buffer, ZIP_VERSION);					//version needed
+	PutWord(buffer, 0);								//flags
+	PutWord(buffer, entry.method);
+	PutDword(buffer, entry.dosTime);
+	PutDword(buffer, entry.crc);
+	PutDword(buffer, entry.data.size());
+	PutDword(buffer, entry.size);
+	PutWord(buffer, entry.strName.length());
+	PutWord(buffer, 0);								//extra field
+	if (bCentral)
+	{
+		PutWord(buffer, 0);							//comment
+		PutWord(buffer, 0);							//disk
+		PutWord(buffer, 0);							//internal attributes
+		PutDword(buffer, 0);						//external attributes
+		PutDword(buffer, entry.offset);
+	}
+	buffer.insert(buffer.end(), entry.strName.begin(), entry.strName.end());
+}
+
+
+//////////////////////////////////
+// Compress
+//
+// Read a file in one block and deflate it, or
+// store it if deflating would not make it smaller.
+static void Compress(PACK_ENTRY& entry)
+{
+	entry.bRead = false;
+	entry.size = entry.crc = entry.dosTime = 0;
+	entry.method = ZIP_STORED;
+
+	HANDLE hFile = CreateFile(entry.strSource.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return;
+
+	FILETIME ft, local;
+	WORD date = 0, time = 0;
+	if (GetFileTime(hFile, NULL, NULL, &ft) && FileTimeToLocalFileTime(&ft, &local))
+	{
+		FileTimeToDosDateTime(&local, &date, &time);
+	}
+	entry.dosTime = ((unsigned long)date << 16) | time;
+
+	std::vector<unsigned char> source(GetFileSize(hFile, NULL));
+	DWORD nRead = 0;
+	bool bRead = (source.empty() || ReadFile(hFile, &source[0], source.size(), &nRead, NULL)) && nRead == source.size();
+	CloseHandle(hFile);
+	if (!bRead) return;
+
+	entry.bRead = true;
+	entry.size = source.size();
+	if (source.empty()) return;
+	entry.crc = crc32(0, &source[0], source.size());
+
+	if (!entry.bStore)
+	{
+		//raw deflate stream, as zip wants...
+		z_stream z;
+		memset(&z, 0, sizeof(z));
+		if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+		{
+			entry.data.resize(deflateBound(&z, source.size()));
+			z.next_in = &source[0];
+			z.avail_in = source.size();
+			z.next_out = &entry.data[0];
+			z.avail_out = entry.data.size();
+
+			int nRes = deflate(&z, Z_FINISH);
+			deflateEnd(&z);
+			if (nRes == Z_STREAM_END && z.total_out < source.size())
+			{
+				entry.data.resize(z.total_out);
+				entry.method = ZIP_DEFLATED;
+				return;
+			}
+		}
+	}
+
+	entry.data.swap(source);
+}
+
+
+//////////////////////////////////
+// Worker
+//
+// Compress entries in turn until none are left,
+// staying within the window of unwritten entries.
+static DWORD WINAPI Worker(LPVOID pParam)
+{
+	PACK* pPack = (PACK*)pParam;
+	for (;;)
+	{
+		WaitForSingleObject(pPack->hWindow, INFINITE);
+		LONG nEntry = InterlockedIncrement(&pPack->nNext) - 1;
+		if (nEntry >= (LONG)pPack->entries.size())
+		{
+			//let the other workers see the end too...
+			ReleaseSemaphore(pPack->hWindow, 1, NULL);
+			return 0;
+		}
+		Compress(pPack->entries[nEntry]);
+		SetEvent(pPack->entries[nEntry].hDone);
+	}
+}
+
+
+PACK* PackCreate(char* pstrZipFile, int nTackOntoEndYN)
+{
+	HANDLE hFile = CreateFile(pstrZipFile, GENERIC_WRITE, 0, NULL, nTackOntoEndYN ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return NULL;
+
+	//offsets are from the start of the file, as minizip...
+	if (nTackOntoEndYN) SetFilePointer(hFile, 0, NULL, FILE_END);
+
+	PACK* pPack = new PACK;
+	pPack->hFile = hFile;
+	pPack->bStoreOnly = false;
+	pPack->nNext = 0;
+	pPack->hWindow = NULL;
+	return pPack;
+}
+
+
+void PackAdd(PACK* pPack, char* pstrFileToAdd, char* pstrAddAs)
+{
+	PACK_ENTRY entry;
+	entry.strSource = pstrFileToAdd;
+	entry.strName = pstrAddAs;
+	entry.bStore = pPack->bStoreOnly;
+	entry.hDone = NULL;
+	entry.offset = 0;
+	pPack->entries.push_back(entry);
+}
+
+
+void PackSetStoreOnly(PACK* pPack, bool bStoreOnly)
+{
+	pPack->bStoreOnly = bStoreOnly;
+}
+
+
+int PackClose(PACK* pPack)
+{
+	std::vector<PACK_ENTRY>& entries = pPack->entries;
+	unsigned int i = 0;
+	for (i = 0; i < entries.size(); i++)
+	{
+		entries[i].hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	}
+
+	//start the workers...
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	int nWorkers = si.dwNumberOfProcessors;
+	if (nWorkers < 1) nWorkers = 1;
+	if (nWorkers > PACK_MAX_WORKERS) nWorkers = PACK_MAX_WORKERS;
+
+	pPack->nNext = 0;
+	pPack->hWindow = CreateSemaphore(NULL, nWorkers * PACK_WINDOW, nWorkers * PACK_WINDOW, NULL);
+
+	std::vector<HANDLE> workers;
+	int n = 0;
+	for (n = 0; n < nWorkers; n++)
+	{
+		DWORD id = 0;
+		HANDLE hThread = CreateThread(NULL, 0, Worker, pPack, 0, &id);
+		if (hThread) workers.push_back(hThread);
+	}
+
+	//write the entries in order as they are done...
+	DWORD nPos = SetFilePointer(pPack->hFile, 0, NULL, FILE_CURRENT);
+	bool bOk = true;
+	std::vector<unsigned char> central;
+	unsigned short nEntries = 0;
+
+	for (i = 0; i < entries.size() && bOk; i++)
+	{
+		PACK_ENTRY& entry = entries[i];
+		if (workers.empty())
+		{
+			//no threads could be started...
+			Compress(entry);
+		}
+		else
+		{
+			WaitForSingleObject(entry.hDone, INFINITE);
+		}
+
+		if (entry.bRead && nEntries == 0xFFFF)
+		{
+			//the directory's count is a word, and there is no zip64...
+			bOk = false;
+		}
+		else if (entry.bRead)
+		{
+			entry.offset = nPos;
+			std::vector<unsigned char> header;
+			PutHeader(header, entry, false);
+
+			DWORD nWritten = 0;
+			bOk = WriteFile(pPack->hFile, &header[0], header.size(), &nWritten, NULL) && nWritten == header.size();
+			if (bOk && !entry.data.empty())
+			{
+				bOk = WriteFile(pPack->hFile, &entry.data[0], entry.data.size(), &nWritten, NULL) && nWritten == entry.data.size();
+			}
+			nPos += header.size() + entry.data.size();
+
+			PutHeader(central, entry, true);
+			nEntries++;
+		}
+
+		//free the entry and let the workers move on...
+		std::vector<unsigned char>().swap(entry.data);
+		ReleaseSemaphore(pPack->hWindow, 1, NULL);
+	}
+
+	//the workers finish once the entries run out...
+	if (!bOk) InterlockedExchange(&pPack->nNext, entries.size());
+	ReleaseSemaphore(pPack->hWindow, 1, NULL);
+	for (n = 0; n < (int)workers.size(); n++)
+	{
+		WaitForSingleObject(workers[n], INFINITE);
+		CloseHandle(workers[n]);
+	}
+
+	//write out the central directory...
+	if (bOk)
+	{
+		unsigned long nCentral = central.size();
+		PutDword(central, ZIP_END_SIGNATURE);
+		PutWord(central, 0);							//this disk
+		PutWord(central, 0);							//disk with the directory
+		PutWord(central, nEntries);
+		PutWord(central, nEntries);
+		PutDword(central, nCentral);
+		PutDword(central, nPos);
+		PutWord(central, 0);							//comment
+
+		DWORD nWritten = 0;
+		bOk = WriteFile(pPack->hFile, &central[0], central.size(), &nWritten, NULL) && nWritten == central.size();
+	}
+
+	for (i = 0; i < entries.size(); i++)
+	{
+		CloseHandle(entries[i].hDone);
+	}
+	CloseHandle(pPack->hWindow);
+	CloseHandle(pPack->hFile);
+	delete pPack;
+	return bOk ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+//zippack.h
+//building zip files in parallel...
+//
+//Files are queued with PackAdd and written by PackClose.
+//Each file is read in one block and deflated by a pool
+//of worker threads; the main thread writes the entries
+//in the order they were added, then the central directory.
+
+#pragma once
+
+#include "stdafx.h"
+#include <string>
+#include <vector>
+
+//files being compressed at once, per worker...
+#define PACK_WINDOW 4
+//most workers to run...
+#define PACK_MAX_WORKERS 16
+
+//////////////////////////////////
+// A file queued for the archive.
+typedef struct tagPackEntry
+{
+	std::string strSource;				//file on disk
+	std::string strName;				//name in the archive
+	bool bStore;						//store without deflating?
+
+	//filled in by a worker...
+	std::vector<unsigned char> data;	//bytes as written
+	unsigned long crc;
+	unsigned long size;					//size before deflating
+	unsigned short method;
+	unsigned long dosTime;
+	bool bRead;							//could the file be read?
+	HANDLE hDone;						//set once compressed
+
+	//filled in as written...
+	unsigned long offset;				//local header offset
+} PACK_ENTRY;
+
+//////////////////////////////////
+// An archive being built.
+typedef struct tagPack
+{
+	HANDLE hFile;
+	std::vector<PACK_ENTRY> entries;
+	bool bStoreOnly;					//store files added from now on?
+
+	//shared with the workers...
+	volatile LONG nNext;				//next entry to compress
+	HANDLE hWindow;						//limits entries in memory
+} PACK;
+
+//////////////////////////////////
+// PackCreate
+//
+// Create an archive.
+//
+// pstrZipFile - archive to create
+// nTackOntoEndYN - write after the file's existing contents?
+// returns the archive, or NULL
+PACK* PackCreate(char* pstrZipFile, int nTackOntoEndYN);
+
+//////////////////////////////////
+// PackAdd
+//
+// Queue a file for the archive.
+//
+// pstrFileToAdd - file on disk
+// pstrAddAs - name in the archive
+void PackAdd(PACK* pPack, char* pstrFileToAdd, char* pstrAddAs);
+
+//////////////////////////////////
+// PackSetStoreOnly
+//
+// Store files added from now on without deflating
+// them (for media that are already compressed).
+void PackSetStoreOnly(PACK* pPack, bool bStoreOnly);
+
+//////////////////////////////////
+// PackClose
+//
+// Compress and write the queued files, and
+// close the archive.
+//
+// returns 1 on success
+int PackClose(PACK* pPack);
@@ -0,0 +1,442 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Recording and replaying input - see replay.h.
+ */
+
+/*
+ * Inclusions.
+ */
+#include "replay.h"
+#include "../input/input.h"
+#include "../common/board.h"
+#include "../movement/CSprite/CSprite.h"
+#include "../rpgcode/CProgram.h"
+#include <stdio.h>
+#include <vector>
+
+/*
+ * Defines.
+ */
+#define REPLAY_HEADER "TK3INPUT"		// First word of a recording.
+#define REPLAY_VERSION 1
+
+typedef enum tagSession
+{
+	SS_NONE,
+	SS_RECORD,
+	SS_REPLAY
+} SESSION;
+
+/*
+ * An input state, from the given read of the state onwards.
+ */
+typedef struct tagReplayState
+{
+	unsigned long read;
+	INPUT_STATE state;
+
+} REPLAY_STATE;
+
+/*
+ * An event, delivered on the given frame.
+ */
+typedef struct tagReplayEvent
+{
+	unsigned long frame;
+	INPUT_EVENT e;
+
+} REPLAY_EVENT;
+
+/*
+ * Locals.
+ */
+static SESSION m_session = SS_NONE;
+static DWORD m_time = 0;						// Virtual clock.
+static unsigned long m_frame = 0;				// Frames counted.
+static unsigned long m_reads = 0;				// Input states read.
+static unsigned int m_seed = 0;					// Random seed.
+static INPUT_STATE m_state;						// Last state recorded or replayed.
+static FILE *m_file = NULL;						// Recording being written.
+static FILE *m_log = NULL;						// Replay's frame log.
+static std::vector<REPLAY_STATE> m_states;		// Replay's input states.
+static std::vector<REPLAY_EVENT> m_events;		// Replay's events.
+static unsigned int m_nextState = 0, m_nextEvent = 0;
+static unsigned long m_lastFrame = 0;			// Frame the replay ends on.
+static bool m_bRender = true;					// Render replayed frames?
+
+/*
+ * The engine's millisecond clock.
+ */
+DWORD engineTime(void)
+{
+	return (m_session == SS_NONE ? GetTickCount() : m_time);
+}
+
+/*
+ * Wait for a number of milliseconds.
+ */
+void engineSleep(const DWORD ms)
+{
+	if (m_session != SS_REPLAY) Sleep(ms);
+	m_time += ms;
+}
+
+/*
+ * Count a frame.
+ */
+void engineFrame(void)
+{
+	++m_frame;
+	m_time += ENGINE_FRAME;
+}
+
+unsigned long engineFrameCount(void)
+{
+	return m_frame;
+}
+
+bool isRecording(void)
+{
+	return (m_session == SS_RECORD);
+}
+
+bool isReplaying(void)
+{
+	return (m_session == SS_REPLAY);
+}
+
+bool isReplayRendering(void)
+{
+	return m_bRender;
+}
+
+/*
+ * Record input to a file.
+ */
+bool beginRecording(const STRING file)
+{
+	m_file = _tfopen(file.c_str(), _T("w"));
+	if (!m_file) return false;
+
+	m_session = SS_RECORD;
+	m_seed = GetTickCount();
+	m_time = GetTickCount();
+	m_frame = m_reads = 0;
+	memset(&m_state, 0, sizeof(m_state));
+
+	fprintf(m_file, "%s %d %u %lu\n", REPLAY_HEADER, REPLAY_VERSION, m_seed, m_time);
+	return true;
+}
+
+/*
+ * Replay input from a file.
+ */
+bool beginReplay(const STRING file, const unsigned long frames, const bool bRender)
+{
+	FILE *p = _tfopen(file.c_str(), _T("r"));
+	if (!p) return false;
+
+	char header[16] = "";
+	int version = 0;
+	unsigned long start = 0;
+	if (fscanf(p, "%15s %d %u %lu", header, &version, &m_seed, &start) != 4 ||
+		strcmp(header, REPLAY_HEADER) || version != REPLAY_VERSION)
+	{
+		fclose(p);
+		return false;
+	}
+
+	m_states.clear();
+	m_events.clear();
+	m_lastFrame = 0;
+
+	char type = 0;
+	while (fscanf(p, " %c", &type) == 1)
+	{
+		if (type == 'S')
+		{
+			// S read button x y count key...
+			REPLAY_STATE s;
+			memset(&s, 0, sizeof(s));
+			int button = 0, count = 0;
+			fscanf(p, "%lu %d %ld %ld %d", &s.read, &button, &s.state.cursor.x, &s.state.cursor.y, &count);
+			s.state.button = BYTE(button);
+			for (int i = 0; i < count; ++i)
+			{
+				int key = 0;
+				fscanf(p, "%d", &key);
+				if (key >= 0 && key < 256) s.state.keys[key] = 0x80;
+			}
+			m_states.push_back(s);
+		}
+		else if (type == 'E')
+		{
+			// E frame - the end of the recording.
+			fscanf(p, "%lu", &m_lastFrame);
+		}
+		else
+		{
+			REPLAY_EVENT r;
+			memset(&r, 0, sizeof(r));
+			r.e.type = INPUT_EVENT_TYPE(type);
+			fscanf(p, "%lu", &r.frame);
+
+			int vir = 0, key = 0, isVirtual = 0, shift = 0;
+			switch (type)
+			{
+				case IE_KEY:
+					fscanf(p, "%d %d %d %d", &vir, &key, &isVirtual, &shift);
+					r.e.vir = UINT(vir);
+					r.e.key = WORD(key);
+					r.e.isVirtual = char(isVirtual);
+					r.e.shift = BYTE(shift);
+					break;
+				case IE_MOVE:
+					fscanf(p, "%ld %ld", &r.e.p.x, &r.e.p.y);
+					break;
+				case IE_CLICK:
+					fscanf(p, "%ld %ld %d", &r.e.p.x, &r.e.p.y, &r.e.button);
+					break;
+				default:
+					// Unknown line: skip it.
+					fscanf(p, "%*[^\n]");
+					continue;
+			}
+			m_events.push_back(r);
+			if (r.frame > m_lastFrame) m_lastFrame = r.frame;
+		}
+	}
+	fclose(p);
+
+	if (frames) m_lastFrame = frames;
+
+	m_log = _tfopen((file + _T(".csv")).c_str(), _T("w"));
+	if (m_log) fprintf(m_log, "frame,time,logic_us,render_us,state\n");
+
+	m_session = SS_REPLAY;
+	m_time = start;
+	m_frame = m_reads = 0;
+	m_nextState = m_nextEvent = 0;
+	m_bRender = bRender;
+	memset(&m_state, 0, sizeof(m_state));
+	return true;
+}
+
+/*
+ * Close the recording or replay.
+ */
+void endSession(void)
+{
+	if (m_file)
+	{
+		fprintf(m_file, "E %lu\n", m_frame);
+		fclose(m_file);
+		m_file = NULL;
+	}
+	if (m_log)
+	{
+		fclose(m_log);
+		m_log = NULL;
+	}
+	m_states.clear();
+	m_events.clear();
+	m_session = SS_NONE;
+}
+
+/*
+ * Has the replay run out of input (or frames)?
+ */
+bool isReplayFinished(void)
+{
+	return (m_session == SS_REPLAY && m_frame >= m_lastFrame);
+}
+
+/*
+ * Seed for the random number generator.
+ */
+unsigned int getRandomSeed(void)
+{
+	return (m_session == SS_NONE ? GetTickCount() : m_seed);
+}
+
+/*
+ * Record the input state read this frame.
+ */
+void recordInputState(const INPUT_STATE &state)
+{
+	if (!m_file) return;
+
+	const unsigned long read = m_reads++;
+	if (!memcmp(&state, &m_state, sizeof(state))) return;
+	m_state = state;
+
+	int count = 0;
+	for (int i = 0; i != 256; ++i)
+	{
+		if (state.keys[i] & 0x80) ++count;
+	}
+
+	fprintf(m_file, "S %lu %d %ld %ld %d", read, int(state.button), state.cursor.x, state.cursor.y, count);
+	for (int i = 0; i != 256; ++i)
+	{
+		if (state.keys[i] & 0x80) fprintf(m_file, " %d", i);
+	}
+	fprintf(m_file, "\n");
+}
+
+/*
+ * Get the input state for this frame from a replay.
+ */
+bool replayInputState(INPUT_STATE &state)
+{
+	if (m_session != SS_REPLAY) return false;
+
+	const unsigned long read = m_reads++;
+	while (m_nextState < m_states.size() && m_states[m_nextState].read <= read)
+	{
+		m_state = m_states[m_nextState++].state;
+	}
+	state = m_state;
+	return true;
+}
+
+/*
+ * Record an event from the window.
+ */
+void recordInputEvent(const INPUT_EVENT &e)
+{
+	if (!m_file) return;
+
+	switch (e.type)
+	{
+		case IE_KEY:
+			fprintf(m_file, "K %lu %u %u %d %d\n", m_frame, e.vir, UINT(e.key), int(e.isVirtual), int(e.shift));
+			break;
+		case IE_MOVE:
+			fprintf(m_file, "M %lu %ld %ld\n", m_frame, e.p.x, e.p.y);
+			break;
+		case IE_CLICK:
+			fprintf(m_file, "C %lu %ld %ld %d\n", m_frame, e.p.x, e.p.y, e.button);
+			break;
+	}
+}
+
+/*
+ * Deliver the replay's events stamped up to this frame.
+ */
+void replayInputEvents(void)
+{
+	while (m_session == SS_REPLAY && m_nextEvent < m_events.size() && m_events[m_nextEvent].frame <= m_frame)
+	{
+		inputEvent(m_events[m_nextEvent++].e);
+	}
+}
+
+/*
+ * FNV-1a hash of some bytes.
+ */
+static void hashBytes(unsigned long &hash, const void *p, const unsigned int bytes)
+{
+	const unsigned char *c = static_cast<const unsigned char *>(p);
+	for (unsigned int i = 0; i != bytes; ++i)
+	{
+		hash = (hash ^ c[i]) * 16777619UL;
+	}
+}
+
+static void hashString(unsigned long &hash, const STRING &str)
+{
+	hashBytes(hash, str.c_str(), str.length() * sizeof(TCHAR));
+}
+
+/*
+ * Hash the state of the game: the game state, the board, the view,
+ * the sprites' positions and frames, and RPGCode's globals.
+ */
+static unsigned long stateHash(void)
+{
+	extern GAME_STATE g_gameState;
+	extern LPBOARD g_pBoard;
+	extern RECT g_screen;
+	extern ZO_VECTOR g_sprites;
+
+	unsigned long hash = 2166136261UL;
+
+	hashBytes(hash, &g_gameState, sizeof(g_gameState));
+	if (g_pBoard) hashString(hash, g_pBoard->filename);
+	hashBytes(hash, &g_screen, sizeof(g_screen));
+
+	for (std::vector<CSprite *>::const_iterator i = g_sprites.v.begin(); i != g_sprites.v.end(); ++i)
+	{
+		const SPRITE_POSITION p = (*i)->getPosition();
+		hashBytes(hash, &p.x, sizeof(p.x));
+		hashBytes(hash, &p.y, sizeof(p.y));
+		hashBytes(hash, &p.l, sizeof(p.l));
+		hashBytes(hash, &p.frame, sizeof(p.frame));
+		hashBytes(hash, &p.loopFrame, sizeof(p.loopFrame));
+	}
+
+	// Globals, in name order, as the state is saved.
+	std::vector<CArray::ENTRY> vars;
+	HEAP_ENUM heap = CProgram::enumerateGlobals();
+	for (HEAP_ENUM::ITR itr = heap.begin(); itr != heap.end(); ++itr)
+	{
+		vars.push_back(CArray::ENTRY(itr->first, const_cast<CArray::ELEMENT *>(&itr->second)));
+	}
+	ARRAY_ENUM arrays = CProgram::enumerateArrays();
+	for (ARRAY_ENUM::ITR arr = arrays.begin(); arr != arrays.end(); ++arr)
+	{
+		arr->second.enumerate(vars, arr->first);
+	}
+
+	for (std::vector<CArray::ENTRY>::const_iterator j = vars.begin(); j != vars.end(); ++j)
+	{
+		const STACK_FRAME &var = **j->second;
+		hashString(hash, j->first);
+		hashBytes(hash, &var.udt, sizeof(var.udt));
+		if (var.udt & UDT_LIT) hashString(hash, var.lit);
+		else hashBytes(hash, &var.num, sizeof(var.num));
+	}
+
+	return hash;
+}
+
+/*
+ * Write a frame's timings and state hash to the replay's log.
+ */
+void logReplayFrame(const double logic, const double render)
+{
+	if (!m_log) return;
+	fprintf(m_log, "%lu,%lu,%.1f,%.1f,%08lx\n", m_frame, m_time, logic, render, stateHash());
+}
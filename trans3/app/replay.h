@@ -0,0 +1,188 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Recording and replaying input, and the engine clock.
+ *
+ * Started from the command line:
+ *
+ *		trans3 main.gam -record input.rec
+ *		trans3 main.gam -replay input.rec [frames] [-norender]
+ *
+ * While recording or replaying, the engine runs on a virtual clock that
+ * advances a fixed amount each frame, and every input the game logic
+ * reads (the keyboard and mouse state, and typed keys and clicks) is
+ * stamped with the frame it was read in. A replay feeds the same input
+ * back on the same frames, without a visible window and as fast as the
+ * game can run, and writes each frame's timings and a hash of the
+ * game's state to <recording>.csv, so runs can be compared.
+ */
+
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+/*
+ * Inclusions.
+ */
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "../../tkCommon/strings.h"
+
+/*
+ * Defines.
+ */
+#define ENGINE_FRAME 8			// Milliseconds of virtual time per frame.
+
+/*
+ * The state of the keyboard and mouse.
+ */
+typedef struct tagInputState
+{
+	BYTE keys[256];				// DirectInput keyboard state.
+	BYTE button;				// Left mouse button (0x80 if down).
+	POINT cursor;				// Cursor position in the window.
+
+} INPUT_STATE;
+
+/*
+ * A key or mouse event from the window.
+ */
+typedef enum tagInputEventType
+{
+	IE_KEY = _T('K'),
+	IE_MOVE = _T('M'),
+	IE_CLICK = _T('C')
+} INPUT_EVENT_TYPE;
+
+typedef struct tagInputEvent
+{
+	INPUT_EVENT_TYPE type;
+	UINT vir;					// Virtual key (IE_KEY).
+	WORD key;					// Character, or vir if isVirtual.
+	char isVirtual;
+	BYTE shift;					// State of the shift key.
+	POINT p;					// Cursor position (IE_MOVE, IE_CLICK).
+	int button;					// 1 = left, 2 = right (IE_CLICK).
+
+} INPUT_EVENT;
+
+/*
+ * The engine's millisecond clock: GetTickCount(), or the
+ * virtual clock while recording or replaying.
+ */
+DWORD engineTime(void);
+
+/*
+ * Wait for a number of milliseconds. A replay only
+ * advances the virtual clock.
+ */
+void engineSleep(const DWORD ms);
+
+/*
+ * Count a frame, advancing the virtual clock.
+ */
+void engineFrame(void);
+
+/*
+ * Frames counted since the session started.
+ */
+unsigned long engineFrameCount(void);
+
+/*
+ * Record input to a file.
+ *
+ * file (in) - recording to create
+ * return (out) - success?
+ */
+bool beginRecording(const STRING file);
+
+/*
+ * Replay input from a file.
+ *
+ * file (in) - recording to replay
+ * frames (in) - frames to run, or 0 to run to the end of the recording
+ * bRender (in) - render each frame?
+ * return (out) - success?
+ */
+bool beginReplay(const STRING file, const unsigned long frames, const bool bRender);
+
+/*
+ * Close the recording or replay.
+ */
+void endSession(void);
+
+bool isRecording(void);
+bool isReplaying(void);
+bool isReplayRendering(void);
+
+/*
+ * Has the replay run out of input (or frames)?
+ */
+bool isReplayFinished(void);
+
+/*
+ * Seed for the random number generator: the seed in a
+ * recording when replaying, else a new (recorded) seed.
+ */
+unsigned int getRandomSeed(void);
+
+/*
+ * Record the input state read this frame, if recording.
+ */
+void recordInputState(const INPUT_STATE &state);
+
+/*
+ * Get the input state for this frame from a replay.
+ *
+ * return (out) - false if not replaying
+ */
+bool replayInputState(INPUT_STATE &state);
+
+/*
+ * Record an event from the window, if recording.
+ */
+void recordInputEvent(const INPUT_EVENT &e);
+
+/*
+ * Deliver the replay's events stamped up to this frame.
+ */
+void replayInputEvents(void);
+
+/*
+ * Write a frame's timings and state hash to the replay's log.
+ *
+ * logic (in) - microseconds of game logic
+ * render (in) - microseconds of rendering
+ */
+void logReplayFrame(const double logic, const double render);
+
+#endif
@@ -36,6 +36,8 @@
 #include "../../tkCommon/strings.h"
 #include "../rpgcode/CProgram.h"
 #include "../rpgcode/CGarbageCollector.h"
+#include "../rpgcode/CProgramProfiler.h"
+#include "../rpgcode/CProgramCache.h"
 #include "../rpgcode/virtualvar.h"
 #include "../plugins/plugins.h"
 #include "../common/paths.h"
@@ -47,16 +49,19 @@
 #include "../common/CAnimation.h"
 #include "../common/board.h"
 #include "../common/CFile.h"
+#include "../common/bundle.h"
 #include "../render/render.h"
 #include "../movement/CPlayer/CPlayer.h"
 #include "../movement/CItem/CItem.h"
 #include "../movement/movement.h"
 #include "../input/input.h"
 #include "../misc/misc.h"
+#include "../misc/profiler.h"
 #include "../audio/CAudioSegment.h"
 #include "../../tkCommon/images/FreeImage.h"
 #include "../resource.h"
 #include "winmain.h"
+#include "replay.h"
 //#define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <commdlg.h>
@@ -98,6 +103,8 @@ IPlugin *g_pMenuPlugin = NULL;			// The menu plugin.
 double m_renderCount = 0.0;				// Count of GS_MOVEMENT state loops.
 double m_renderTime = 0.0;				// Millisecond cumulative GS_MOVEMENT state loop time.
 bool m_testingProgram = false;			// Has trans3 been passed a program to test?
+bool m_bakingBundle = false;			// Has trans3 been asked to bake the asset bundle?
+bool m_compilingPrograms = false;		// Has trans3 been asked to compile the programs?
 
 /*
  * Defines.
@@ -302,6 +309,14 @@ void setUpGame()
 	m_renderCount = 100;
 	m_renderTime *= m_renderCount;
 
+	if (isRecording() || isReplaying())
+	{
+		// Recordings and replays run at a fixed frame rate so
+		// that movement and threads advance identically.
+		m_renderTime = ENGINE_FRAME;
+		m_renderCount = 1;
+	}
+
 	// Create and load start player.
 	for (std::vector<CPlayer *>::const_iterator j = g_players.begin(); j != g_players.end(); ++j)
 	{
@@ -357,7 +372,7 @@ void saveSettings(void)
 	// Average time taken per frame, in seconds.
 	const double avgTime = m_renderTime / (m_renderCount * MILLISECONDS);
 
-    if (!m_testingProgram && avgTime > 0)
+    if (!m_testingProgram && !isRecording() && !isReplaying() && avgTime > 0)
 	{
 		if (!g_mainFile.extendToFullScreen)
 		{
@@ -402,10 +417,33 @@ void openSystems()
 	registerFonts(true);
 	initPluginSystem();
 	FreeImage_Initialise();
-	srand(GetTickCount());
+	openBundle();
+	srand(getRandomSeed());
 	initGraphics();
 	CProgram::initialize();
 	initRpgCode();
+
+	// Programs run as bytecode unless switched off in the registry.
+	double bytecode = -1;
+	getSetting(_T("bRpgCodeBytecode"), bytecode);
+	CProgram::setBytecodeEnabled(bytecode != 0.0);
+
+	// Compiled programs are cached on disk unless switched off.
+	double cache = -1;
+	getSetting(_T("bRpgCodeCache"), cache);
+	CProgramCache::setEnabled(cache != 0.0);
+
+#ifdef ENABLE_MUMU_DBG
+	// Programs are profiled in debug builds unless switched off.
+#ifdef _DEBUG
+	double profiler = -1;
+#else
+	double profiler = 0;
+#endif
+	getSetting(_T("bRpgCodeProfiler"), profiler);
+	CProgramProfiler::getInstance().setEnabled(profiler != 0.0);
+#endif
+
 	CAudioSegment::initLoader();
 	g_bkgMusic = g_music.allocate();
 	g_pBoard = g_boards.allocate();
@@ -489,10 +527,18 @@ void closeSystems()
 
 	saveSettings();
 
+#ifdef ENABLE_MUMU_DBG
+	// Write the programs' profile to the _MUMU folder.
+	if (CProgramProfiler::isEnabled()) CProgramProfiler::getInstance().write();
+#endif
+
+	closeBundle();
 	uninitialisePakFile();
 
 	// Unregister fonts.
 	registerFonts(false);
+	// Finish any recording or replay.
+	endSession();
 }
 
 /*
@@ -512,12 +558,59 @@ STRING getMainFileName(const STRING cmdLine)
 	std::vector<STRING> parts;
 	split(cmdLine, _T(" "), parts);
 
-	if (parts.size() == 2)
+	if (parts.size() >= 4 && (parts[2] == _T("-record") || parts[2] == _T("-replay")))
+	{
+		// Record input to, or replay input from, a file:
+		// trans3 main.gam -record input.rec
+		// trans3 main.gam -replay input.rec [frames] [-norender]
+		const STRING main = GAM_PATH + parts[1];
+		if (!CFile::fileExists(main)) return _T("");
+
+		// The working directory changes once the game is opened.
+		TCHAR file[MAX_PATH];
+		if (!_tfullpath(file, parts[3].c_str(), MAX_PATH)) return _T("");
+
+		if (parts[2] == _T("-record"))
+		{
+			if (!beginRecording(file)) return _T("");
+		}
+		else
+		{
+			unsigned long frames = 0;
+			bool bRender = true;
+			for (unsigned int i = 4; i < parts.size(); ++i)
+			{
+				if (parts[i] == _T("-norender")) bRender = false;
+				else frames = _ttol(parts[i].c_str());
+			}
+			if (!beginReplay(file, frames, bRender)) return _T("");
+		}
+		return main;
+	}
+	else if (parts.size() == 2)
 	{
 		// Main game file passed on command line.
 		const STRING ret = GAM_PATH + parts[1];
 		if (CFile::fileExists(ret)) return ret;
 	}
+	else if (parts.size() == 3 && parts[2] == _T("-bake"))
+	{
+		// Decode the game's tiles and images into its asset bundle:
+		// trans3 main.gam -bake
+		const STRING main = GAM_PATH + parts[1];
+		if (!CFile::fileExists(main)) return _T("");
+		m_bakingBundle = true;
+		return main;
+	}
+	else if (parts.size() == 3 && parts[2] == _T("-compile"))
+	{
+		// Compile the game's programs into the program cache:
+		// trans3 main.gam -compile
+		const STRING main = GAM_PATH + parts[1];
+		if (!CFile::fileExists(main)) return _T("");
+		m_compilingPrograms = true;
+		return main;
+	}
 	else if (parts.size() == 3)
 	{
 		// Run program.
@@ -599,6 +692,9 @@ STRING getMainFileName(const STRING cmdLine)
  */
 GAME_STATE gameLogic()
 {
+	PROFILE_FRAME();
+	PROFILE("frame");
+
 	switch (g_gameState)
 	{
 		case GS_IDLE:
@@ -621,6 +717,12 @@ g_mainFile.bFpsInTitleBar = 1;//~TEMP
 					<< _T(" FPS");
 #if _DEBUG
 				ss << _T(", ") << g_allocated << _T(" bytes");
+				const GARBAGE_STATS &gc = CGarbageCollector::getInstance().getStats();
+				ss << _T(", GC ") << gc.reclaimed << _T("/") << gc.totalReclaimed
+					<< _T(" freed, ") << gc.lastPause << _T("/") << gc.maxPause << _T(" ms");
+				const TILE_CACHE_STATS &tc = CTile::getCacheStats();
+				ss << _T(", tiles ") << tc.hits << _T("/") << tc.misses << _T("/") << tc.evictions
+					<< _T(" hit/miss/evict, ") << (tc.bytes >> 10) << _T(" KB");
 #endif
 				SetWindowText(g_hHostWnd, ss.str().c_str());
 			}
@@ -641,32 +743,44 @@ g_mainFile.bFpsInTitleBar = 1;//~TEMP
 			//unsigned int units = HALF_FPS_CAP / fps;
 
 			unsigned int units = fps / (HALF_FPS_CAP / 2);
-			CThread::multitask((units < 1) ? 10 : ((units > 8) ? 80 : units*10));
+			{
+				PROFILE("multitask");
+				CThread::multitask((units < 1) ? 10 : ((units > 8) ? 80 : units*10));
+			}
 
 			// Movement.
 			//std::vector<CSprite *>::const_iterator i = g_sprites.v.begin();
 			// Remember the vector size, so we'll know if it has been tampered with from within the move function
 			int s = g_sprites.v.size(), i;
-			//for (; i != g_sprites.v.end();)
-			for (i = 0; i < s; ++i)
 			{
-				//(*i)->move(g_pSelectedPlayer, false);
-				g_sprites.v[i]->move(g_pSelectedPlayer, false);
-//				if (s == g_sprites.v.size())
-//					++i;
-//				else
-//					s = g_sprites.v.size();
+				PROFILE("move");
+				//for (; i != g_sprites.v.end();)
+				for (i = 0; i < s; ++i)
+				{
+					//(*i)->move(g_pSelectedPlayer, false);
+					g_sprites.v[i]->move(g_pSelectedPlayer, false);
+//					if (s == g_sprites.v.size())
+//						++i;
+//					else
+//						s = g_sprites.v.size();
+				}
+
+				// Re-sort the sprites that have moved.
+				g_sprites.sort();
 			}
 
 			// Run programs outside of the above loop for the cases
 			// when sprites may be removed from the vector.
-			if (!g_pSelectedPlayer->doBoardEdges())
 			{
-				g_pSelectedPlayer->playerDoneMove();
+				PROFILE("boardEdges");
+				if (!g_pSelectedPlayer->doBoardEdges())
+				{
+					g_pSelectedPlayer->playerDoneMove();
+				}
 			}
 
-			// Render.
-			renderNow();
+			// Render; replayLoop() renders separately to time it.
+			if (!isReplaying()) renderNow();
 		} break;
 
 		case GS_PAUSE:
@@ -728,10 +842,14 @@ int mainEventLoop()
 			if (gameLogic() != GS_PAUSE)
 			{
 				// Count this loop if not in Paused state
+				engineFrame();
 
 				// Sleep for any remaining time
 				while ((GetTickCount() - dwTimeNow) < dwOneFrame);
 
+				// Recordings keep the fixed frame rate from setUpGame().
+				if (isRecording()) continue;
+
 				// Update length rendering took
 				dwTimeNow = GetTickCount() - dwTimeNow;
 
@@ -756,6 +874,64 @@ int mainEventLoop()
 	return message.wParam;
 }
 
+/*
+ * Replay loop: run recorded input as fast as possible, without
+ * waiting on the frame cap, and log the time spent per frame.
+ */
+int replayLoop()
+{
+	LARGE_INTEGER freq, start, logic, render;
+	QueryPerformanceFrequency(&freq);
+	const double toMicro = 1000000.0 / double(freq.QuadPart);
+
+	MSG message;
+	message.wParam = 0;
+
+	while (!isReplayFinished() && g_gameState != GS_QUIT)
+	{
+		// Keep the (hidden) window serviced, but take input only
+		// from the recording.
+		bool quit = false;
+		while (PeekMessage(&message, NULL, 0, 0, PM_REMOVE))
+		{
+			if (message.message == WM_QUIT)
+			{
+				quit = true;
+				break;
+			}
+			if ((message.message >= WM_KEYFIRST && message.message <= WM_KEYLAST) ||
+				(message.message >= WM_MOUSEFIRST && message.message <= WM_MOUSELAST))
+			{
+				continue;
+			}
+			DispatchMessage(&message);
+		}
+		if (quit) break;
+
+		replayInputEvents();
+
+		QueryPerformanceCounter(&start);
+		const GAME_STATE state = gameLogic();
+		QueryPerformanceCounter(&logic);
+
+		// As in mainEventLoop(), a paused frame is not counted.
+		if (state == GS_PAUSE) continue;
+
+		double renderTime = 0.0;
+		if (isReplayRendering())
+		{
+			renderNow();
+			QueryPerformanceCounter(&render);
+			renderTime = double(render.QuadPart - logic.QuadPart) * toMicro;
+		}
+
+		logReplayFrame(double(logic.QuadPart - start.QuadPart) * toMicro, renderTime);
+		engineFrame();
+	}
+
+	return message.wParam;
+}
+
 #include <direct.h>
 
 /*
@@ -813,6 +989,26 @@ int mainEntry(const HINSTANCE hInstance, const HINSTANCE /*hPrevInstance*/, cons
 
 	if (!g_mainFile.open(fileName)) return EXIT_SUCCESS;
 
+	if (m_bakingBundle)
+	{
+		FreeImage_Initialise();
+		if (!bakeBundle()) messageBox(_T("The asset bundle could not be written."));
+		FreeImage_DeInitialise();
+		uninitialisePakFile();
+		return EXIT_SUCCESS;
+	}
+
+	if (m_compilingPrograms)
+	{
+		// Only the functions are needed to compile programs.
+		extern void initRpgCode();
+		CProgram::initialize();
+		initRpgCode();
+		CProgramCache::compileProject();
+		uninitialisePakFile();
+		return EXIT_SUCCESS;
+	}
+
     // Initialize GDI+.
     GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
 
@@ -820,7 +1016,7 @@ int mainEntry(const HINSTANCE hInstance, const HINSTANCE /*hPrevInstance*/, cons
 	try
 	{
 		openSystems();
-		const int toRet = mainEventLoop();
+		const int toRet = (isReplaying() ? replayLoop() : mainEventLoop());
 		closeSystems();
 		return toRet;
 	}
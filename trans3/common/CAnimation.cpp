@@ -35,6 +35,7 @@
  */
 #include "CAnimation.h"
 #include "CFile.h"
+#include "bundle.h"
 #include "../../tkCommon/images/FreeImage.h"
 #include "../movement/movement.h"
 #include "../rpgcode/parser/parser.h"
@@ -128,7 +129,7 @@ void CAnimation::animate(const int x, const int y)
 		// Play the frame's sound.
 		playFrameSound(i - start);
 
-		Sleep(DWORD(m_data.delay * MILLISECONDS));
+		engineSleep(DWORD(m_data.delay * MILLISECONDS));
 
 		// Replace g_cnvRpgCode with the original.
 		cnvScr.BltPart(
@@ -220,12 +221,9 @@ bool CAnimation::renderAnmFrame(CCanvas *cnv, unsigned int frame)
 	}
 	else
 	{
-		// Image file.
-		const STRING strFile = resolve(g_projectPath + BMP_PATH + frameFile);
-		FIBITMAP *bmp = FreeImage_Load(
-			FreeImage_GetFileType(getAsciiString(strFile).c_str(), 16), 
-			getAsciiString(strFile).c_str()
-		);
+		// Image file, from the asset bundle if baked.
+		IMAGE image;
+		if (!openImage(g_projectPath + BMP_PATH + frameFile, image)) return false;
 
         CCanvas cnvImg;
 		cnvImg.CreateBlank(NULL, m_data.pxWidth, m_data.pxHeight, TRUE);
@@ -236,26 +234,16 @@ bool CAnimation::renderAnmFrame(CCanvas *cnv, unsigned int frame)
 			0, 0, 
 			m_data.pxWidth, m_data.pxHeight, 
 			0, 0, 
-			FreeImage_GetWidth(bmp), 
-			FreeImage_GetHeight(bmp), 
-			FreeImage_GetBits(bmp), 
-			FreeImage_GetInfo(bmp), 
+			image.width, 
+			image.height, 
+			image.bits, 
+			image.getInfo(), 
 			DIB_RGB_COLORS, 
 			SRCCOPY
 		);
-		FreeImage_Unload(bmp);
+		closeImage(image);
 		cnvImg.CloseDC(hdc);
 
-		// Apply ambient level.
-		extern AMBIENT_LEVEL g_ambientLevel;
-		if (g_ambientLevel.color)
-		{
-			CCanvas cnvAl;
-			cnvAl.CreateBlank(NULL, m_data.pxWidth, m_data.pxHeight, TRUE);
-			cnvAl.ClearScreen(g_ambientLevel.color);
-			cnvAl.BltAdditivePart(cnvImg.GetDXSurface(), 0, 0, 0, 0, m_data.pxWidth, m_data.pxHeight, g_ambientLevel.sgn, -1, m_data.transpColors[frame]);
-		}
-
 		cnvImg.BltTransparent(cnv, 0, 0, m_data.transpColors[frame]);
 
     } // if (ext == TBM)
@@ -412,20 +400,25 @@ bool CThreadAnimation::running(const STRING file, const int x, const int y)
 }
 
 /*
- * Render the current frames of all animations to a canvas.
+ * Render the current frames of all animations to a canvas, passing
+ * back the areas drawn.
  */
-void CThreadAnimation::renderAll(CCanvas *cnv)
+void CThreadAnimation::renderAll(CCanvas *cnv, std::vector<RECT> &rects)
 {
 	std::set<CThreadAnimation *>::iterator i = m_threads.begin();
-	for(; i != m_threads.end(); ++i)
+	while (i != m_threads.end())
 	{
 		// Render frame.
-		if (!(*i)->renderFrame(cnv))
+		RECT r = {0, 0, 0, 0};
+		if (!(*i)->renderFrame(cnv, r))
 		{
 			// Animation finished.
 			delete *i;
-			m_threads.erase(i);
+			m_threads.erase(i++);
+			continue;
 		}
+		rects.push_back(r);
+		++i;
 	}
 }
 
@@ -433,11 +426,11 @@ void CThreadAnimation::renderAll(CCanvas *cnv)
  * Get the current frame, increment if necessary.
  * Return false if the thread is finished and pass back the pointer.
  */
-bool CThreadAnimation::renderFrame(CCanvas *cnv)
+bool CThreadAnimation::renderFrame(CCanvas *cnv, RECT &r)
 {
 	// Increment frame.
 	const LPANIMATION p = m_pAnm->data();
-	if (GetTickCount() - m_timer > p->delay)
+	if (engineTime() - m_timer > p->delay)
 	{
 		m_timer = 0;
 		++m_frame;
@@ -450,7 +443,11 @@ bool CThreadAnimation::renderFrame(CCanvas *cnv)
 		// Play sounnd on transition.
 		m_pAnm->playFrameSound(m_frame);
 	}
-	m_pAnm->getFrame(m_frame)->BltTransparent(cnv, m_x, m_y, TRANSP_COLOR);
+	const CCanvas *const pFrame = m_pAnm->getFrame(m_frame);
+	pFrame->BltTransparent(cnv, m_x, m_y, TRANSP_COLOR);
+
+	const RECT frame = {m_x, m_y, m_x + pFrame->GetWidth(), m_y + pFrame->GetHeight()};
+	r = frame;
 	return true;
 }
 
@@ -472,22 +469,21 @@ bool CAnimation::renderFileFrame(CCanvas *, unsigned int)
 
     if (m_data.filename.empty()) return false;
 
-	const STRING file = resolve(g_projectPath + MISC_PATH + m_data.filename);
+	// Use the pages in the asset bundle, if baked.
+	const STRING unresolved = g_projectPath + MISC_PATH + m_data.filename;
+	IMAGE image;
+	FIMULTIBITMAP *mbmp = NULL;
 
-	FIMULTIBITMAP *mbmp = FreeImage_OpenMultiBitmap(
-		FreeImage_GetFileType(getAsciiString(file).c_str(), 16), 
-		getAsciiString(file).c_str(), 
-		FALSE, TRUE, TRUE
-	);
-	if (!mbmp) return false;
-
-	// Create ambient level canvas.
-	extern AMBIENT_LEVEL g_ambientLevel;
-	CCanvas cnvAl;
-	if (g_ambientLevel.color)
+	if (!openBundledImage(unresolved, 0, image))
 	{
-		cnvAl.CreateBlank(NULL, m_data.pxWidth, m_data.pxHeight, TRUE);
-		cnvAl.ClearScreen(g_ambientLevel.color);
+		const STRING file = resolve(unresolved);
+
+		mbmp = FreeImage_OpenMultiBitmap(
+			FreeImage_GetFileType(getAsciiString(file).c_str(), 16), 
+			getAsciiString(file).c_str(), 
+			FALSE, TRUE, TRUE
+		);
+		if (!mbmp) return false;
 	}
 
 	// Intermediate canvas.
@@ -499,16 +495,27 @@ bool CAnimation::renderFileFrame(CCanvas *, unsigned int)
 	for (int i = 0; i != m_data.frameCount; ++i)
 	{
 		CONST HDC hdc = cnv.OpenDC();
-		FIBITMAP *bmp = FreeImage_LockPage(mbmp, i);
+		FIBITMAP *bmp = NULL;
+
+		if (mbmp)
+		{
+			bmp = FreeImage_LockPage(mbmp, i);
+			image.height = FreeImage_GetHeight(bmp);
+			image.bits = FreeImage_GetBits(bmp);
+		}
+		else if (!openBundledImage(unresolved, i, image))
+		{
+			image.height = 0;
+		}
 
 		SetDIBitsToDevice(
 			hdc,
 			0, 0,   
 			m_data.pxWidth, m_data.pxHeight, 
 			0, 0,
-			0, FreeImage_GetHeight(bmp), 
-			FreeImage_GetBits(bmp),   
-			FreeImage_GetInfo(bmp), 
+			0, image.height, 
+			image.bits,   
+			bmp ? FreeImage_GetInfo(bmp) : image.getInfo(), 
 			DIB_RGB_COLORS
 		); 
 
@@ -524,15 +531,9 @@ bool CAnimation::renderFileFrame(CCanvas *, unsigned int)
 			DIB_RGB_COLORS, SRCCOPY
 		);*/
 
-		FreeImage_UnlockPage(mbmp, bmp, FALSE);
+		if (bmp) FreeImage_UnlockPage(mbmp, bmp, FALSE);
 		cnv.CloseDC(hdc);
 
-		// Apply ambient level.
-		if (g_ambientLevel.color)
-		{
-			cnvAl.BltAdditivePart(cnv.GetDXSurface(), 0, 0, 0, 0, m_data.pxWidth, m_data.pxHeight, g_ambientLevel.sgn, -1, m_data.transpColors[i]);
-		}
-
 		// Blt to the member canvas.
 		CCanvas *pCnv = new CCanvas();
 		pCnv->CreateBlank(NULL, m_data.pxWidth, m_data.pxHeight, TRUE);
@@ -541,7 +542,7 @@ bool CAnimation::renderFileFrame(CCanvas *, unsigned int)
 
 		m_canvases.push_back(pCnv);
 	}
-	FreeImage_CloseMultiBitmap(mbmp, 0);
+	if (mbmp) FreeImage_CloseMultiBitmap(mbmp, 0);
 	return true;
 }
 
@@ -561,6 +562,29 @@ bool CAnimation::renderFileFrame(CCanvas *cnv, unsigned int frame)
 
     if (m_data.filename.empty()) return false;
 
+    CCanvas cnvImg;
+	cnvImg.CreateBlank(NULL, m_data.pxWidth, m_data.pxHeight, TRUE);
+
+	// Use the page in the asset bundle, if baked.
+	IMAGE image;
+	if (openBundledImage(g_projectPath + MISC_PATH + m_data.filename, frame, image))
+	{
+		CONST HDC hdc = cnvImg.OpenDC();
+		SetDIBitsToDevice(
+			hdc,
+			0, 0,   
+			m_data.pxWidth, m_data.pxHeight, 
+			0, 0,
+			0, image.height, 
+			image.bits,   
+			image.getInfo(), 
+			DIB_RGB_COLORS
+		); 
+		cnvImg.CloseDC(hdc);
+		cnvImg.BltTransparent(cnv, 0, 0, m_data.transpColors[frame]);
+		return true;
+	}
+
 	const STRING file = resolve(g_projectPath + MISC_PATH + m_data.filename);
 
 	FIMULTIBITMAP *mbmp = FreeImage_OpenMultiBitmap(
@@ -570,9 +594,6 @@ bool CAnimation::renderFileFrame(CCanvas *cnv, unsigned int frame)
 	);
 	if (!mbmp) return false;
 
-    CCanvas cnvImg;
-	cnvImg.CreateBlank(NULL, m_data.pxWidth, m_data.pxHeight, TRUE);
-
 	const int pageCount = FreeImage_GetPageCount(mbmp);
 	if (frame < pageCount)
 	{
@@ -608,16 +629,6 @@ bool CAnimation::renderFileFrame(CCanvas *cnv, unsigned int frame)
 	}
 	FreeImage_CloseMultiBitmap(mbmp, 0);
 
-	// Apply ambient level.
-	extern AMBIENT_LEVEL g_ambientLevel;
-	if (g_ambientLevel.color)
-	{
-		CCanvas cnvAl;
-		cnvAl.CreateBlank(NULL, m_data.pxWidth, m_data.pxHeight, TRUE);
-		cnvAl.ClearScreen(g_ambientLevel.color);
-		cnvAl.BltAdditivePart(cnvImg.GetDXSurface(), 0, 0, 0, 0, m_data.pxWidth, m_data.pxHeight, g_ambientLevel.sgn, -1, m_data.transpColors[frame]);
-	}
-
 	cnvImg.BltTransparent(cnv, 0, 0, m_data.transpColors[frame]);
 
 	return true;
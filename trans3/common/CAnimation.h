@@ -161,7 +161,8 @@ public:
 
 	static CThreadAnimation *create(const STRING file, const int x, const int y, const int width, const int height, const bool bPersist);
 	static bool running(const STRING file, const int x, const int y);
-	static void renderAll(CCanvas *cnv);
+	static void renderAll(CCanvas *cnv, std::vector<RECT> &rects);
+	static bool empty(void) { return m_threads.empty(); }
 	static void destroy(CThreadAnimation *p);
 	static void destroyAll(void)
 	{
@@ -172,7 +173,7 @@ public:
 private:
 	CThreadAnimation(CThreadAnimation &rhs);
 	CThreadAnimation &operator= (CThreadAnimation &rhs);
-	bool renderFrame(CCanvas *cnv);
+	bool renderFrame(CCanvas *cnv, RECT &r);
 
 	const int m_x, m_y;
 	const bool m_persist;
@@ -43,18 +43,32 @@
  * fileName (in) - file to open
  */
 CFile::CFile(const STRING &fileName, CONST UINT mode)
-:	m_hFile(HFILE_ERROR)
+:	m_hFile(HFILE_ERROR),
+	m_pPak(NULL),
+	m_hMapping(NULL),
+	m_pData(NULL),
+	m_size(0),
+	m_pos(0),
+	m_bufferPos(0),
+	m_mode(mode)
 {
 	open(fileName, mode);
 }
 
 void CFile::open(const STRING &fileName, CONST UINT mode)
 {
-	if (m_hFile != HFILE_ERROR)
+	close();
+	m_filename = fileName;
+	m_mode = mode;
+	m_pos = 0;
+
+	// Read files in the pak file from its cache.
+	if (!(mode & (OF_WRITE | OF_CREATE)) && (m_pPak = pakAcquire(fileName)))
 	{
-		CloseHandle(HANDLE(m_hFile));
+		m_size = m_pPak->data.size();
+		m_pData = m_size ? &m_pPak->data[0] : NULL;
+		return;
 	}
-	m_filename = fileName;
 
 	DWORD access = GENERIC_READ;
 	if (mode & OF_WRITE) access |= GENERIC_WRITE;
@@ -68,8 +82,170 @@ void CFile::open(const STRING &fileName, CONST UINT mode)
 		creation,
 		FILE_ATTRIBUTE_NORMAL,
 		NULL);        
+}
+
+/*
+ * Flush any writes and close the file.
+ */
+VOID CFile::close(VOID)
+{
+	if (m_pPak)
+	{
+		pakRelease(m_pPak);
+		m_pPak = NULL;
+		m_pData = NULL;
+		m_size = 0;
+		return;
+	}
+	if (m_hFile == HFILE_ERROR) return;
+
+	flush();
+	if (m_pData) UnmapViewOfFile(m_pData);
+	if (m_hMapping) CloseHandle(m_hMapping);
+	CloseHandle(HANDLE(m_hFile));
+
+	m_hFile = HFILE_ERROR;
+	m_hMapping = NULL;
+	m_pData = NULL;
+	m_size = 0;
+}
+
+/*
+ * Map a view of a file opened for reading, if not yet mapped.
+ *
+ * return (out) - whether the file is mapped
+ */
+BOOL CFile::map(VOID)
+{
+	if (m_pData) return TRUE;
+	if (m_hFile == HFILE_ERROR || (m_mode & OF_WRITE)) return FALSE;
+
+	// Empty files cannot be mapped.
+	m_size = GetFileSize(HANDLE(m_hFile), NULL);
+	if (!m_size || m_size == INVALID_FILE_SIZE)
+	{
+		m_size = 0;
+		return FALSE;
+	}
+
+	m_hMapping = CreateFileMapping(HANDLE(m_hFile), NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_hMapping) return FALSE;
+
+	m_pData = (CONST BYTE *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	return (m_pData != NULL);
+}
+
+/*
+ * Determine whether a file exists, without opening it; files in the
+ * pak file are looked up rather than inflated.
+ */
+BOOL CFile::fileExists(CONST STRING &file)
+{
+	if (pakExists(file)) return TRUE;
+
+	const DWORD attributes = GetFileAttributes(resolve(file).c_str());
+	return (attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY));
+}
+
+/*
+ * Get the size of the file, including buffered writes.
+ */
+DWORD CFile::size(VOID) CONST
+{
+	if (m_pData || m_pPak) return m_size;
+	CONST DWORD size = GetFileSize(HANDLE(m_hFile), NULL);
+	CONST DWORD end = m_bufferPos + m_buffer.size();
+	return (!m_buffer.empty() && end > size) ? end : size;
+}
+
+/*
+ * Read bytes at the current position. Bytes beyond the
+ * end of the file are left unchanged.
+ *
+ * pData (out) - destination
+ * bytes (in) - number of bytes
+ */
+VOID CFile::read(LPVOID pData, CONST DWORD bytes)
+{
+	if (map())
+	{
+		if (m_pos < m_size)
+		{
+			memcpy(pData, m_pData + m_pos, (bytes < m_size - m_pos) ? bytes : m_size - m_pos);
+		}
+	}
+	else
+	{
+		// Files open for writing, or that could not be mapped.
+		flush();
+		OVERLAPPED ptr;
+		memset(&ptr, 0, sizeof(ptr));
+		ptr.Offset = m_pos;
+		DWORD read = 0;
+		ReadFile(HANDLE(m_hFile), pData, bytes, &read, &ptr);
+	}
+	m_pos += bytes;
+}
+
+/*
+ * Read a character.
+ *
+ * return (out) - the character, or -1 at the end of the file
+ */
+INT CFile::readChar(VOID)
+{
+	if (map())
+	{
+		if (m_pos >= m_size) return -1;
+		return m_pData[m_pos++];
+	}
+
+	flush();
+	OVERLAPPED ptr;
+	memset(&ptr, 0, sizeof(ptr));
+	ptr.Offset = m_pos;
+	BYTE chr = 0;
+	DWORD read = 0;
+	if (!ReadFile(HANDLE(m_hFile), &chr, sizeof(chr), &read, &ptr) || !read) return -1;
+	++m_pos;
+	return chr;
+}
+
+/*
+ * Write bytes at the current position.
+ *
+ * pData (in) - source
+ * bytes (in) - number of bytes
+ */
+VOID CFile::write(LPCVOID pData, CONST DWORD bytes)
+{
+	// The buffer holds a single run of bytes.
+	if (!m_buffer.empty() && m_pos != m_bufferPos + m_buffer.size()) flush();
+	if (m_buffer.empty()) m_bufferPos = m_pos;
+
+	CONST BYTE *CONST p = (CONST BYTE *)pData;
+	m_buffer.insert(m_buffer.end(), p, p + bytes);
+	m_pos += bytes;
 
-	memset(&m_ptr, 0, sizeof(m_ptr));
+	if (m_buffer.size() >= CFILE_BUFFER) flush();
+}
+
+/*
+ * Write out buffered writes.
+ */
+VOID CFile::flush(VOID)
+{
+	if (m_buffer.empty()) return;
+
+	if (isOpen())
+	{
+		OVERLAPPED ptr;
+		memset(&ptr, 0, sizeof(ptr));
+		ptr.Offset = m_bufferPos;
+		DWORD write = 0;
+		WriteFile(HANDLE(m_hFile), &m_buffer[0], m_buffer.size(), &write, &ptr);
+	}
+	m_buffer.clear();
 }
 
 /*
@@ -105,54 +281,10 @@ CFile &CFile::operator<<(CONST SystemFont data)
 	return *this;
 }
 
-CFile &CFile::operator<<(CONST BYTE data)
-{
-	DWORD write = 0;
-	WriteFile(HANDLE(m_hFile), &data, sizeof(data), &write, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator<<(CONST CHAR data)
-{
-	DWORD write = 0;
-	WriteFile(HANDLE(m_hFile), &data, sizeof(data), &write, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator<<(CONST SHORT data)
-{
-	DWORD write = 0;
-	WriteFile(HANDLE(m_hFile), &data, sizeof(data), &write, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator<<(CONST INT data)
-{
-	DWORD write = 0;
-	WriteFile(HANDLE(m_hFile), &data, sizeof(data), &write, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator<<(CONST UINT data)
-{
-	DWORD write = 0;
-	WriteFile(HANDLE(m_hFile), &data, sizeof(data), &write, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator<<(CONST double data)
-{
-	DWORD write = 0;
-	WriteFile(HANDLE(m_hFile), &data, sizeof(data), &write, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
 CFile &CFile::operator<<(CONST STRING &data)
 {
-	DWORD write = 0;
-	CONST INT len = data.length() + 1;
-	WriteFile(HANDLE(m_hFile), getAsciiString(data).c_str(), len, &write, &m_ptr);
-	m_ptr.Offset += len;
+	CONST std::string str = getAsciiString(data);
+	write(str.c_str(), str.length() + 1);
 	return *this;
 }
 
@@ -187,69 +319,37 @@ CFile &CFile::operator>>(SystemFont &data)
 	data.bOutline = b;
 	return *this;
 }
-CFile &CFile::operator>>(BYTE &data)
-{
-	DWORD read = 0;
-	!ReadFile(HANDLE(m_hFile), &data, sizeof(data), &read, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator>>(CHAR &data)
-{
-	DWORD read = 0;
-	!ReadFile(HANDLE(m_hFile), &data, sizeof(data), &read, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator>>(SHORT &data)
-{
-	DWORD read = 0;
-	!ReadFile(HANDLE(m_hFile), &data, sizeof(data), &read, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator>>(INT &data)
-{
-	DWORD read = 0;
-	!ReadFile(HANDLE(m_hFile), &data, sizeof(data), &read, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator>>(UINT &data)
-{
-	DWORD read = 0;
-	!ReadFile(HANDLE(m_hFile), &data, sizeof(data), &read, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
-CFile &CFile::operator>>(double &data)
-{
-	DWORD read = 0;
-	!ReadFile(HANDLE(m_hFile), &data, sizeof(data), &read, &m_ptr);
-	m_ptr.Offset += sizeof(data);
-	return *this;
-}
+
 CFile &CFile::operator>>(STRING &data)
 {
 	std::string toRet;
-	while (TRUE)
+	if (map())
 	{
-		CHAR chr;
-		DWORD read;
-		if (!ReadFile(HANDLE(m_hFile), &chr, sizeof(chr), &read, &m_ptr))
-		{
-			toRet = "";
-			break;
-		}
-		m_ptr.Offset++;
-		if (chr == '\0')
+		// Find the terminator in the view. An unterminated
+		// string at the end of the file reads as empty.
+		if (m_pos < m_size)
 		{
-			break;
+			CONST CHAR *CONST p = (CONST CHAR *)m_pData + m_pos;
+			CONST CHAR *CONST end = (CONST CHAR *)memchr(p, '\0', m_size - m_pos);
+			if (end)
+			{
+				toRet.assign(p, end);
+				m_pos += (end - p) + 1;
+			}
+			else
+			{
+				m_pos = m_size;
+			}
 		}
-		else
+	}
+	else
+	{
+		INT chr;
+		while ((chr = readChar()) > 0)
 		{
-			toRet += chr;
+			toRet += CHAR(chr);
 		}
+		if (chr < 0) toRet = "";
 	}
 #ifdef _UNICODE
 	data = getUnicodeString(toRet);
@@ -267,26 +367,16 @@ CFile &CFile::operator>>(STRING &data)
 STRING CFile::line()
 {
 	std::string toRet;
-	while (TRUE)
+	INT chr;
+	while ((chr = readChar()) >= 0 && chr != '\n')
 	{
-		char chr;
-		DWORD read;
-		if (!ReadFile(HANDLE(m_hFile), &chr, sizeof(chr), &read, &m_ptr))
-		{
-			break;
-		}
-		m_ptr.Offset++;
-		if (chr == '\n')
-		{
-			break;
-		}
-		else
-		{
-			toRet += chr;
-		}
+		toRet += CHAR(chr);
+	}
+	if (!toRet.empty())
+	{
+		CONST UINT len = toRet.length() - 1;
+		if (toRet[len] == '\r') toRet[len] = '\0';
 	}
-	CONST UINT len = toRet.length() - 1;
-	if (toRet[len] == '\r') toRet[len] = '\0';
 #ifndef _UNICODE
 	return toRet;
 #else
@@ -299,5 +389,5 @@ STRING CFile::line()
  */
 CFile::~CFile()
 {
-	CloseHandle(HANDLE(m_hFile));
+	close();
 }
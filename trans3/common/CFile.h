@@ -39,51 +39,79 @@
 #include "../../tkCommon/strings.h"
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <vector>
 #include "../SystemFont.h"
+#include "pakfs.h"
 
+/*
+ * Size at which buffered writes are flushed.
+ */
+#define CFILE_BUFFER 65536
+
+/*
+ * A binary file. Files opened for reading are read from a view of
+ * the whole file, mapped on the first read, or straight from the
+ * pak file's cache if the file is in the pak file; writes are
+ * buffered until flush(), a seek away from the end of the buffer,
+ * or the file being closed.
+ */
 class CFile
 {
 
 public:
-	CFile(): m_hFile(HFILE_ERROR) { }
+	CFile(): m_hFile(HFILE_ERROR), m_pPak(NULL), m_hMapping(NULL), m_pData(NULL), m_size(0), m_pos(0), m_bufferPos(0), m_mode(OF_READ) { }
 	void open(const STRING &fileName, CONST UINT mode = OF_READ);
 	CFile(const STRING &fileName, CONST UINT mode = OF_READ);
 	//
 	// Write.
 	//
-	CFile &operator<<(CONST BYTE data);
-	CFile &operator<<(CONST CHAR data);
-	CFile &operator<<(CONST SHORT data);
-	CFile &operator<<(CONST INT data);
-	CFile &operator<<(CONST UINT data);
-	CFile &operator<<(CONST double data);
+	CFile &operator<<(CONST BYTE data) { write(&data, sizeof(data)); return *this; }
+	CFile &operator<<(CONST CHAR data) { write(&data, sizeof(data)); return *this; }
+	CFile &operator<<(CONST SHORT data) { write(&data, sizeof(data)); return *this; }
+	CFile &operator<<(CONST INT data) { write(&data, sizeof(data)); return *this; }
+	CFile &operator<<(CONST UINT data) { write(&data, sizeof(data)); return *this; }
+	CFile &operator<<(CONST double data) { write(&data, sizeof(data)); return *this; }
 	CFile &operator<<(CONST STRING &data);
 	CFile &operator<<(CONST SystemFont data);
+	VOID flush(VOID);
 	//
 	// Read.
 	//
-	CFile &operator>>(BYTE &data);
-	CFile &operator>>(CHAR &data);
-	CFile &operator>>(SHORT &data);
-	CFile &operator>>(INT &data);
-	CFile &operator>>(UINT &data);
-	CFile &operator>>(double &data);
+	CFile &operator>>(BYTE &data) { read(&data, sizeof(data)); return *this; }
+	CFile &operator>>(CHAR &data) { read(&data, sizeof(data)); return *this; }
+	CFile &operator>>(SHORT &data) { read(&data, sizeof(data)); return *this; }
+	CFile &operator>>(INT &data) { read(&data, sizeof(data)); return *this; }
+	CFile &operator>>(UINT &data) { read(&data, sizeof(data)); return *this; }
+	CFile &operator>>(double &data) { read(&data, sizeof(data)); return *this; }
 	CFile &operator>>(STRING &data);
 	CFile &operator>>(SystemFont &data);
 	STRING line(VOID);
 	//
 	// Misc.
 	//
-	VOID seek(CONST INT pos) { m_ptr.Offset = pos; }
-	BOOL isEof(VOID) CONST { return m_ptr.Offset >= size(); }
-	BOOL isOpen(VOID) CONST { return (m_hFile != HFILE_ERROR); }
-	DWORD size(VOID) CONST { return GetFileSize(HANDLE(m_hFile), NULL); }
-	static BOOL fileExists(CONST STRING &file) { return CFile(file).isOpen(); }
+	VOID seek(CONST INT pos) { m_pos = pos; }
+	BOOL isEof(VOID) CONST { return m_pos >= size(); }
+	BOOL isOpen(VOID) CONST { return (m_hFile != HFILE_ERROR || m_pPak); }
+	DWORD size(VOID) CONST;
+	static BOOL fileExists(CONST STRING &file);
 	~CFile(VOID);
 
 private:
+	BOOL map(VOID);
+	VOID close(VOID);
+	VOID read(LPVOID pData, CONST DWORD bytes);
+	VOID write(LPCVOID pData, CONST DWORD bytes);
+	INT readChar(VOID);
+
 	HFILE m_hFile;
-	OVERLAPPED m_ptr;
+	PAK_FILE *m_pPak;				// File read from the pak file.
+	HANDLE m_hMapping;				// Mapping of a file opened for reading.
+	CONST BYTE *m_pData;			// View of the whole file, once mapped.
+	DWORD m_size;					// Size of the view.
+	DWORD m_pos;					// Position of the next read or write.
+	std::vector<BYTE> m_buffer;		// Writes not yet flushed,
+	DWORD m_bufferPos;				// which begin at this position.
+	UINT m_mode;
 	STRING m_filename;
 };
 
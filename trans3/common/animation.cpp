@@ -40,6 +40,7 @@
 #include "animation.h"
 #include "paths.h"
 #include "CFile.h"
+#include "bundle.h"
 #include "../rpgcode/parser/parser.h"
 #include "../movement/movement.h"
 #include "../../tkCommon/images/FreeImage.h"
@@ -244,7 +245,7 @@ void drawImage(const STRING &strFile, const HDC hdc, const int x, const int y, c
 		const int fullWidth = tbm.width * 32, fullHeight = tbm.height * 32;
 		cnvInt.CreateBlank(NULL, fullWidth, fullHeight, TRUE);
 		cnvMask.CreateBlank(NULL, fullWidth, fullHeight, TRUE);
-		tbm.draw(&cnvInt, &cnvMask, 0, 0);
+		tbm.draw(&cnvInt, &cnvMask, 0, 0, true);
 		const HDC hdcMask = cnvMask.OpenDC();
 		const HDC hdcSource = cnvInt.OpenDC();
 		StretchBlt(hdc, x, y, width, height, hdcMask, 0, 0, fullWidth, fullHeight, SRCAND);
@@ -254,11 +255,10 @@ void drawImage(const STRING &strFile, const HDC hdc, const int x, const int y, c
 		return;
 	}
 
-	STRING prFile = getAsciiString(resolve(strFile)).c_str();
-	FIBITMAP *bmp = FreeImage_Load(FreeImage_GetFileType(prFile.c_str(), 16), prFile.c_str());
-	int bmpWidth = FreeImage_GetWidth(bmp);
-	int bmpHeight = FreeImage_GetHeight(bmp);
+	// From the asset bundle, if baked.
+	IMAGE image;
+	if (!openImage(strFile, image)) return;
 
-	StretchDIBits(hdc, x, y, (width != -1) ? width : FreeImage_GetWidth(bmp), (height != -1) ? height : FreeImage_GetHeight(bmp), 0, 0, FreeImage_GetWidth(bmp), FreeImage_GetHeight(bmp), FreeImage_GetBits(bmp), FreeImage_GetInfo(bmp), DIB_RGB_COLORS, SRCCOPY);
-	FreeImage_Unload(bmp);
+	StretchDIBits(hdc, x, y, (width != -1) ? width : image.width, (height != -1) ? height : image.height, 0, 0, image.width, image.height, image.bits, image.getInfo(), DIB_RGB_COLORS, SRCCOPY);
+	closeImage(image);
 }
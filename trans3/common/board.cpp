@@ -37,13 +37,17 @@
 #include "sprite.h"
 #include "paths.h"
 #include "CFile.h"
+#include "bundle.h"
 #include "mbox.h"
 #include "mainfile.h"
 #include "../movement/CItem/CItem.h"
 #include "../rpgcode/CProgram.h"
+#include "../rpgcode/parser/parser.h"
 #include "../misc/misc.h"
 #include "../../tkCommon/images/FreeImage.h"
 #include "../../tkCommon/tkgfx/CTile.h"
+#include <algorithm>
+#include <math.h>
 
 /*
  * "Ambient effect" definitions.
@@ -133,6 +137,8 @@ vVersion:
 		short lutSize;
 		file >> lutSize;
 		tileIndex.clear();
+		tileHandles.clear();
+		tileLut.clear();
 		animatedTiles.clear();
 
 		// Temporarily to hold animated tile indices.
@@ -558,19 +564,15 @@ layerEnd:
 		{
 			// Required only for the active board.
 
-			// setAmbientLevel calls g_pBoard->createImageCanvases().
-			if (bUpdate) 
-			{
-				setAmbientLevel();
-			}
-			else
-			{
-				createImageCanvases();
-			}
+			if (bUpdate) setAmbientLevel();
+			createImageCanvases();
 			createVectorCanvases();
 
 		}
 
+		resolveTiles();
+		indexVectors();
+		indexPrograms();
 		return true;
 	}
 pvVersion:
@@ -604,6 +606,8 @@ pvVersion:
 		short lutSize;
 		file >> lutSize;
 		tileIndex.clear();
+		tileHandles.clear();
+		tileLut.clear();
 		animatedTiles.clear();
 
 		// Temporarily to hold animated tile indices.
@@ -912,8 +916,8 @@ lutEndB:
 		{
 			// Required only for the active board.
 
-			// setAmbientLevel calls g_pBoard->renderImageCanvases().
 			setAmbientLevel();
+			createImageCanvases();
 
 			// Upgrade tile lighting before setting under vectors.
 			freeShading();
@@ -973,6 +977,10 @@ lutEndB:
 		} // if (this == g_pBoard) 
 
 	} // pvVersion
+
+	resolveTiles();
+	indexVectors();
+	indexPrograms();
 	return true;
 }
 
@@ -1046,6 +1054,7 @@ void tagBoard::vectorize(const unsigned int layer)
 
 		delete *i;
 	}
+	vectorIndex.dirty = true;
 }
 
 /*
@@ -1189,18 +1198,17 @@ void tagBoardImage::createCanvas(BOARD &board)
 
 	const int resX = g_screen.right - g_screen.left, resY = g_screen.bottom - g_screen.top;
 
-	// Load the image.
-	const STRING path = resolve(g_projectPath + BMP_PATH + file);
-	FIBITMAP *bmp = FreeImage_Load (FreeImage_GetFileType(path.c_str(), 16), path.c_str());
-	if (bmp)
+	// Load the image, from the asset bundle if baked.
+	IMAGE image;
+	if (openImage(g_projectPath + BMP_PATH + file, image))
 	{
 		// Remove unnecessary drawing types.
-		if ((board.pxWidth() == FreeImage_GetWidth(bmp)) && (board.pxHeight() == FreeImage_GetHeight(bmp)))
+		if ((board.pxWidth() == image.width) && (board.pxHeight() == image.height))
 			type = BI_NORMAL;
 
 		// Successfully loaded. Size the canvas to the image size.
-		const DWORD width  = (type == BI_STRETCH) ? board.pxWidth() : FreeImage_GetWidth(bmp),
-					height = (type == BI_STRETCH) ? board.pxHeight() : FreeImage_GetHeight(bmp);
+		const DWORD width  = (type == BI_STRETCH) ? board.pxWidth() : image.width,
+					height = (type == BI_STRETCH) ? board.pxHeight() : image.height;
 
 		if (pCnv) delete pCnv;
 		pCnv = new CCanvas();
@@ -1214,27 +1222,17 @@ void tagBoardImage::createCanvas(BOARD &board)
 			0, 0,
 			width, height,
 			0, 0,
-			FreeImage_GetWidth(bmp),
-			FreeImage_GetHeight(bmp),
-			FreeImage_GetBits(bmp),
-			FreeImage_GetInfo(bmp), 
+			image.width,
+			image.height,
+			image.bits,
+			image.getInfo(), 
 			DIB_RGB_COLORS,
 			SRCCOPY
 		);
 
 		// Clean up.
 		pCnv->CloseDC(hdc);
-		FreeImage_Unload(bmp);
-
-		// Apply ambient level.
-		extern AMBIENT_LEVEL g_ambientLevel;
-		if (g_ambientLevel.color)
-		{
-			CCanvas cnv;
-			cnv.CreateBlank(NULL, width, height, TRUE);
-			cnv.ClearScreen(g_ambientLevel.color);
-			cnv.BltAdditivePart(pCnv->GetDXSurface(), 0, 0, 0, 0, width, height, g_ambientLevel.sgn, -1, transpColor);
-		}
+		closeImage(image);
 
 		r.right = r.left + width;
 		r.bottom = r.top + height;
@@ -1286,10 +1284,6 @@ void tagBoard::render(
 	int width, 			// pixel dimensions to draw. 
 	int height)
 {
-	extern STRING g_projectPath;
-	extern AMBIENT_LEVEL g_ambientLevel;
-	const RGBSHADE al = g_ambientLevel.rgb;
-
 	const RECT bounds = { topX, topY, topX + width, topY + height };
 
 	// Number of tiles to draw in each dimension.
@@ -1334,8 +1328,8 @@ void tagBoard::render(
 
 					if (board[i][k][j])
 					{
-						const STRING tile = tileIndex[board[i][k][j]];
-						if (!tile.empty())
+						const UINT tile = tileHandles[board[i][k][j]];
+						if (tile != TILE_NO_HANDLE)
 						{
 							// Single layer lighting implementation.
 							RGB_SHORT shade = {0, 0, 0};
@@ -1343,18 +1337,18 @@ void tagBoard::render(
 
 							// Tile exists at this location.
 							CTile::drawByBoardCoord(
-								g_projectPath + TILE_PATH + tile,
+								tile,
 								j, k, 
-								shade.r + al.r,
-								shade.g + al.g,
-								shade.b + al.b,
+								shade.r,
+								shade.g,
+								shade.b,
 								cnv, 
 								TM_NONE,
 								destX - topX, destY - topY,
 								coordType,
 								sizeX
 							);
-						} // if (!strTile.empty())
+						} // if (tile != TILE_NO_HANDLE)
 					} // if (board[i][k][j])
 				} // for k
 			} // for j
@@ -1524,6 +1518,7 @@ void tagBoard::freeVectors(const int layer)
 		}
 		vectors.clear();
 	}
+	vectorIndex.dirty = true;
 }
 
 /*
@@ -1536,6 +1531,7 @@ void tagBoard::freePrograms()
 		delete *i;
 	}
 	programs.clear();
+	programIndex.dirty = true;
 }
 
 /*
@@ -1740,6 +1736,153 @@ LPBRD_PROGRAM tagBoard::getProgram(const unsigned int index)
 	return NULL;
 }
 
+/*
+ * File every vector in the vector index.
+ */
+void tagBoard::indexVectors()
+{
+	vectorIndex.clear();
+	for (unsigned int i = 0; i != vectors.size(); ++i)
+	{
+		if (vectors[i].pV) vectorIndex.insert(i, vectors[i].pV->getBounds(), vectors[i].layer);
+	}
+	vectorIndex.dirty = false;
+}
+
+/*
+ * File every program in the program index.
+ */
+void tagBoard::indexPrograms()
+{
+	programIndex.clear();
+	for (unsigned int i = 0; i != programs.size(); ++i)
+	{
+		if (programs[i]) programIndex.insert(i, programs[i]->vBase.getBounds(), programs[i]->layer);
+	}
+	programIndex.dirty = false;
+}
+
+/*
+ * Re-file a single vector after its points or layer have changed.
+ */
+void tagBoard::indexVector(const unsigned int index)
+{
+	if (vectorIndex.dirty || index >= vectors.size()) return;
+
+	vectorIndex.remove(index);
+	if (vectors[index].pV) vectorIndex.insert(index, vectors[index].pV->getBounds(), vectors[index].layer);
+}
+
+/*
+ * Find the indices of the vectors near an area of a layer.
+ */
+void tagBoard::vectorsNear(const RECT &bounds, const int layer, std::vector<int> &items)
+{
+	if (vectorIndex.dirty) indexVectors();
+	vectorIndex.query(bounds, layer, items);
+}
+
+/*
+ * Find the indices of the programs near an area of a layer.
+ */
+void tagBoard::programsNear(const RECT &bounds, const int layer, std::vector<int> &items)
+{
+	if (programIndex.dirty) indexPrograms();
+	programIndex.query(bounds, layer, items);
+}
+
+/*
+ * Empty the index.
+ */
+void tagBoardIndex::clear()
+{
+	m_grid.clear();
+	m_cells.clear();
+	dirty = true;
+}
+
+/*
+ * Find the cells covered by an area of a layer.
+ */
+tagBoardIndex::CELLS tagBoardIndex::cellRange(const RECT &bounds, const int layer)
+{
+	// Floor division, allowing a pixel for rounding.
+	const CELLS cells = {
+		layer, {
+			int(floor((bounds.left - 1) / double(BRD_CELL_SIZE))),
+			int(floor((bounds.top - 1) / double(BRD_CELL_SIZE))),
+			int(floor((bounds.right + 1) / double(BRD_CELL_SIZE))),
+			int(floor((bounds.bottom + 1) / double(BRD_CELL_SIZE)))
+		}
+	};
+	return cells;
+}
+
+/*
+ * File an object's bounds on a layer.
+ */
+void tagBoardIndex::insert(const int item, const RECT &bounds, const int layer)
+{
+	const CELLS cells = cellRange(bounds, layer);
+	for (int x = cells.cells.left; x <= cells.cells.right; ++x)
+	{
+		for (int y = cells.cells.top; y <= cells.cells.bottom; ++y)
+		{
+			m_grid[cellKey(layer, x, y)].push_back(item);
+		}
+	}
+	if (m_cells.size() <= (unsigned int)item)
+	{
+		// Unfiled objects cover an empty range.
+		const CELLS none = {0, {0, 0, -1, -1}};
+		m_cells.resize(item + 1, none);
+	}
+	m_cells[item] = cells;
+}
+
+/*
+ * Remove an object from the grid.
+ */
+void tagBoardIndex::remove(const int item)
+{
+	if (m_cells.size() <= (unsigned int)item) return;
+
+	CELLS &cells = m_cells[item];
+	for (int x = cells.cells.left; x <= cells.cells.right; ++x)
+	{
+		for (int y = cells.cells.top; y <= cells.cells.bottom; ++y)
+		{
+			std::vector<int> &cell = m_grid[cellKey(cells.layer, x, y)];
+			cell.erase(std::remove(cell.begin(), cell.end(), item), cell.end());
+		}
+	}
+	cells.cells.right = cells.cells.left - 1;
+}
+
+/*
+ * Find the objects filed near an area of a layer. The indices are
+ * returned in ascending order so that callers visit the objects in
+ * the same order as a full loop would.
+ */
+void tagBoardIndex::query(const RECT &bounds, const int layer, std::vector<int> &items) const
+{
+	items.clear();
+
+	const CELLS cells = cellRange(bounds, layer);
+	for (int x = cells.cells.left; x <= cells.cells.right; ++x)
+	{
+		for (int y = cells.cells.top; y <= cells.cells.bottom; ++y)
+		{
+			stdext::hash_map<unsigned int, std::vector<int> >::const_iterator i = m_grid.find(cellKey(layer, x, y));
+			if (i != m_grid.end()) items.insert(items.end(), i->second.begin(), i->second.end());
+		}
+	}
+
+	// Objects covering several cells are only returned once.
+	std::sort(items.begin(), items.end());
+	items.erase(std::unique(items.begin(), items.end()), items.end());
+}
+
 /*
  * Determine whether the board has a given program on it.
  */
@@ -1777,24 +1920,40 @@ bool tagBoard::insertTile(const STRING tile, const int x, const int y, const int
  */
 int tagBoard::lutIndex(const STRING tile)
 {
-	int index = 0;
 	// Search the table for the tile.
-	std::vector<STRING>::iterator i = tileIndex.begin(), j = i;
-	for (; i != tileIndex.end(); ++i)
+	resolveTiles();
+	stdext::hash_map<STRING, int>::const_iterator i = tileLut.find(parser::uppercase(tile));
+	if (i != tileLut.end()) return i->second;
+
+	// Insert it onto the end.
+	const int index = tileIndex.size();
+	tileIndex.push_back(tile);
+	resolveTiles();
+	return index;
+}
+
+/*
+ * Resolve new look-up table entries into tile handles, so that the
+ * renderer neither builds paths nor searches the tile cache by name.
+ */
+void tagBoard::resolveTiles()
+{
+	extern STRING g_projectPath;
+
+	while (tileHandles.size() < tileIndex.size())
 	{
-		if (_ftcsicmp(tile.c_str(), i->c_str()) == 0)
+		const int index = tileHandles.size();
+		const STRING &tile = tileIndex[index];
+		if (tile.empty())
 		{
-			index = i - j;
-			break;
+			tileHandles.push_back(TILE_NO_HANDLE);
+			continue;
 		}
+
+		// The first of any duplicate entries is kept.
+		tileLut.insert(std::make_pair(parser::uppercase(tile), index));
+		tileHandles.push_back(CTile::getHandle(g_projectPath + TILE_PATH + tile));
 	}
-	if (!index)
-	{
-		// Insert it onto the end.
-		index = tileIndex.size();
-		tileIndex.push_back(tile);
-	}
-	return index;
 }
 
 void tagBoard::renderAnimatedTiles(SCROLL_CACHE &scrollCache)
@@ -1805,10 +1964,10 @@ void tagBoard::renderAnimatedTiles(SCROLL_CACHE &scrollCache)
 		TILEANIM &tan = i->tile;
 		const int x = i->x, y = i->y, z = i->z;
 
-		if (GetTickCount() - tan.frameTime > tan.frameDelay)
+		if (engineTime() - tan.frameTime > tan.frameDelay)
 		{
 			(++tan.currentFrame) %= tan.frames.size();
-			tan.frameTime = GetTickCount();
+			tan.frameTime = engineTime();
 
 			// Change the LUT index to point to a TST.
 			board[z][y][x] = i->lutIndices[tan.currentFrame];
@@ -1839,16 +1998,39 @@ void tagBoard::renderStack(
 		py -= 16;
 	}
 	const RECT bounds = {px, py, px + tileWidth(), py + tileHeight()};
+
+	// The tile changes on the screen.
+	extern DAMAGE g_damage;
+	g_damage.add(bounds);
 	
+	// The stack may wrap around the edges of the scrollcache's canvases,
+	// so it is drawn over a copy of the cached graphics on the scratch
+	// canvas, and copied back.
+	CCanvas &scratch = scrollCache.strip;
+	const int width = bounds.right - bounds.left, height = bounds.bottom - bounds.top;
+	if (scratch.GetWidth() < width || scratch.GetHeight() < height)
+	{
+		scratch.CreateBlank(
+			NULL, 
+			max(width, scratch.GetWidth()), 
+			max(height, scratch.GetHeight()), 
+			TRUE
+		);
+	}
+
 	// Draw the whole tile stack onto the scrollcache.
-	renderStack(
-		&scrollCache.cnv,
-		bounds.left - scrollCache.r.left,
-		bounds.top - scrollCache.r.top,
-		lLower, lUpper,
-		x, y,
-		bounds
-	);
+	scrollCache.get(scrollCache.cnv, &scratch, bounds.left, bounds.top, bounds);
+	renderStack(&scratch, 0, 0, lLower, lUpper, x, y, bounds, bkgColor);
+	scrollCache.put(&scrollCache.cnv, scratch, bounds.left, bounds.top, bounds);
+
+	// Draw each layer onto its own canvas, if it has one.
+	for (int i = max(lLower, 2); i <= lUpper && i < int(scrollCache.layers.size()); ++i)
+	{
+		if (!scrollCache.layers[i]) continue;
+		scrollCache.get(*scrollCache.layers[i], &scratch, bounds.left, bounds.top, bounds);
+		renderStack(&scratch, 0, 0, i, i, x, y, bounds, TRANSP_COLOR);
+		scrollCache.put(scrollCache.layers[i], scratch, bounds.left, bounds.top, bounds);
+	}
 }
 
 /*
@@ -1862,12 +2044,10 @@ void tagBoard::renderStack(
 	const int lUpper,
 	const int x,		// tile location on board to draw. 
 	const int y,
-	const RECT bounds)
+	const RECT bounds,
+	const int blank)		// colour of the blank tile.
 {
-	extern STRING g_projectPath;
 	extern RECT g_screen;
-	extern AMBIENT_LEVEL g_ambientLevel;
-	const RGBSHADE al = g_ambientLevel.rgb;
 
 	// Skip tan if off screen.
 	RECT dest = {0, 0, 0, 0};
@@ -1878,7 +2058,7 @@ void tagBoard::renderStack(
 	CTile::drawBlankHdc(
 		x, y, 
 		hdc, 
-		bkgColor,
+		blank,
 		destX - bounds.left, 
 		destY - bounds.top,
 		coordType,
@@ -1890,8 +2070,8 @@ void tagBoard::renderStack(
 	{
 		if ((bLayerOccupied[i] & LO_TILES) && board[i][y][x])
 		{
-			const STRING tile = tileIndex[board[i][y][x]];
-			if (!tile.empty())
+			const UINT tile = tileHandles[board[i][y][x]];
+			if (tile != TILE_NO_HANDLE)
 			{
 				// Tile exists at this location.
 						
@@ -1900,11 +2080,11 @@ void tagBoard::renderStack(
 				if (tileShading[0]->layer >= i) shade = tileShading[0]->shades[x][y];
 				
 				CTile::drawByBoardCoord(
-					g_projectPath + TILE_PATH + tile,
+					tile,
 					x, y, 
-					shade.r + al.r,
-					shade.g + al.g,
-					shade.b + al.b,
+					shade.r,
+					shade.g,
+					shade.b,
 					cnv, 
 					TM_NONE,
 					destX - bounds.left, 
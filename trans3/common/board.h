@@ -47,6 +47,7 @@ typedef struct tagStackFrame STACK_FRAME, *LPSTACK_FRAME;
 #include "../movement/movement.h"
 #include <string>
 #include <vector>
+#include <hash_map>
 
 /*
  * A board-set program.
@@ -188,6 +189,53 @@ typedef struct tagBoardTileAnim
 
 } BOARD_TILEANIM, *LPBOARD_TILEANIM;
 
+// Pixel size of the cells board vectors and programs are filed in.
+#define BRD_CELL_SIZE 64
+
+/*
+ * A grid over the bounds of a board's vectors or programs, so that
+ * collision tests only visit the objects near a sprite. Objects are
+ * filed by their index in the board's vector, which must be rebuilt
+ * (or the index marked dirty) when objects are inserted or erased.
+ */
+typedef struct tagBoardIndex
+{
+	bool dirty;							// Rebuild before the next query.
+
+	void clear();
+
+	// File an object's bounds on a layer.
+	void insert(const int item, const RECT &bounds, const int layer);
+
+	// Remove an object from the grid.
+	void remove(const int item);
+
+	// Find the objects filed near an area of a layer, in index order.
+	void query(const RECT &bounds, const int layer, std::vector<int> &items) const;
+
+	tagBoardIndex(): dirty(true) { }
+
+private:
+	// An inclusive range of cells on a layer.
+	typedef struct tagCells
+	{
+		int layer;
+		RECT cells;
+	} CELLS;
+
+	// Cell key for a layer and cell co-ordinate.
+	static unsigned int cellKey(const int layer, const int x, const int y)
+	{
+		return ((layer & 0xff) << 24) | ((x & 0xfff) << 12) | (y & 0xfff);
+	}
+
+	static CELLS cellRange(const RECT &bounds, const int layer);
+
+	stdext::hash_map<unsigned int, std::vector<int> > m_grid;	// Objects in each cell.
+	std::vector<CELLS> m_cells;									// Cells of each filed object.
+
+} BRD_INDEX;
+
 // Struct to temporarily hold locations for old items, programs.
 typedef struct tagObjPosition
 {
@@ -211,6 +259,7 @@ typedef struct tagBoard
 	COORD_TYPE coordType;							// Co-ordinate system type.
 
 	std::vector<STRING> tileIndex;					// Lookup table for tiles.
+	std::vector<UINT> tileHandles;					// Tile cache handles of tileIndex entries.
 	VECTOR_SHORT3D board;							// Board tiles indices.
 	
 	std::vector<LPLAYER_SHADE> tileShading;			// Tile shading array (old ambientRed, -Green, -Blue arrays)							
@@ -252,6 +301,10 @@ typedef struct tagBoard
 	/* Volatile data */
 
 	std::vector<int> bLayerOccupied;				// Do layers contain tiles or images? (see LO_ENUM)
+
+	BRD_INDEX vectorIndex;							// Grid over the vectors' bounds.
+	BRD_INDEX programIndex;							// Grid over the programs' bounds.
+	stdext::hash_map<STRING, int> tileLut;			// Uppercase tile names to tileIndex entries.
 	
 	std::vector<BOARD_TILEANIM> animatedTiles;		// Animated tiles associated with this board.
 
@@ -282,6 +335,9 @@ typedef struct tagBoard
 	const BRD_VECTOR *getVectorFromTile(const int x, const int y, const int z) const;
 	LPBRD_VECTOR getVector(const LPSTACK_FRAME pParam);
 	LPBRD_PROGRAM getProgram(const unsigned int index);
+	void indexVector(const unsigned int index);
+	void vectorsNear(const RECT &bounds, const int layer, std::vector<int> &items);
+	void programsNear(const RECT &bounds, const int layer, std::vector<int> &items);
 
 	void render(
 		CCanvas *const cnv,
@@ -310,6 +366,9 @@ typedef struct tagBoard
 private:
 	tagBoard &operator=(tagBoard &rhs);
 	tagBoard(tagBoard &rhs);
+	void indexVectors();
+	void indexPrograms();
+	void resolveTiles();
 	LPBOARD_TILEANIM addAnimTile(const STRING fileName, const int x, const int y, const int z);
 	int lutIndex(const STRING tile);
 	void setSize(const int width, const int height, const int depth, const bool createTiletypeArray);
@@ -330,7 +389,8 @@ private:
 		const int lUpper,
 		const int x,		// tile location on board to draw. 
 		const int y,
-		const RECT bounds
+		const RECT bounds,
+		const int blank		// colour of the blank tile.
 	);
 
 } BOARD, *LPBOARD;
@@ -0,0 +1,563 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Asset bundles - see bundle.h.
+ */
+
+/*
+ * Inclusions.
+ */
+#include "bundle.h"
+#include "paths.h"
+#include "pakfs.h"
+#include "../../tkCommon/tkGfx/CTile.h"
+#include <stdio.h>
+#include <vector>
+#include <hash_map>
+
+/*
+ * Locals.
+ */
+static HANDLE m_hFile = INVALID_HANDLE_VALUE;	// Loose bundle, mapped...
+static HANDLE m_hMapping = NULL;
+static PAK_FILE *m_pPak = NULL;					// ...or bundle in the pak file.
+static const BYTE *m_pData = NULL;				// The whole bundle.
+static DWORD m_size = 0;
+static const BUNDLE_SOURCE *m_pSources = NULL;
+static const BUNDLE_ENTRY *m_pEntries = NULL;
+static const char *m_pNames = NULL;
+static stdext::hash_map<std::string, DWORD> m_index;	// First entry for each name.
+static std::vector<char> m_current;				// Per source: unchecked (0), current (1) or changed (-1).
+static bool m_bCheckSources = false;			// Check loose files for changes?
+
+/*
+ * Form the key for a file: lower case, relative to
+ * the project, with backslashes as the separator.
+ */
+static std::string bundleKey(const STRING &file)
+{
+	extern STRING g_projectPath;
+
+	std::string key = getAsciiString(file);
+	for (std::string::iterator i = key.begin(); i != key.end(); ++i)
+	{
+		*i = (*i == '/') ? '\\' : char(tolower((unsigned char)*i));
+	}
+
+	const std::string project = getAsciiString(g_projectPath);
+	if (!project.empty() && key.length() > project.length() && _strnicmp(key.c_str(), project.c_str(), project.length()) == 0)
+	{
+		key.erase(0, project.length());
+	}
+	return key;
+}
+
+/*
+ * Has a baked file changed since? A file that is missing has not: a
+ * game may be shipped with the bundle in place of its loose files.
+ */
+static bool isSourceCurrent(const DWORD source)
+{
+	extern STRING g_projectPath;
+
+	if (!m_bCheckSources) return true;
+
+	// Each file is checked once a session.
+	if (!m_current[source])
+	{
+		const BUNDLE_SOURCE &src = m_pSources[source];
+		WIN32_FILE_ATTRIBUTE_DATA fad;
+		bool bCurrent = false;
+		if (GetFileAttributesEx((g_projectPath + (m_pNames + src.name)).c_str(), GetFileExInfoStandard, &fad))
+		{
+			bCurrent = (fad.nFileSizeLow == src.size && !fad.nFileSizeHigh &&
+				CompareFileTime(&fad.ftLastWriteTime, &src.time) == 0);
+		}
+		else
+		{
+			const DWORD error = GetLastError();
+			bCurrent = (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND);
+		}
+		m_current[source] = bCurrent ? 1 : -1;
+	}
+	return (m_current[source] > 0);
+}
+
+/*
+ * Find a page of a file in the bundle.
+ */
+static const BUNDLE_ENTRY *findEntry(const STRING &file, const DWORD page, const BUNDLE_TYPE type)
+{
+	if (!m_pData) return NULL;
+
+	stdext::hash_map<std::string, DWORD>::const_iterator i = m_index.find(bundleKey(file));
+	if (i == m_index.end()) return NULL;
+
+	// The pages of a file are together and in order.
+	const BUNDLE_ENTRY *const pFirst = &m_pEntries[i->second];
+	if (page < pFirst->page) return NULL;
+
+	const DWORD entry = i->second + (page - pFirst->page);
+	const BUNDLE_HEADER *const pHeader = (const BUNDLE_HEADER *)m_pData;
+	if (entry >= pHeader->entries) return NULL;
+
+	const BUNDLE_ENTRY *const pEntry = &m_pEntries[entry];
+	if (pEntry->name != pFirst->name || pEntry->page != page || pEntry->type != DWORD(type)) return NULL;
+
+	return isSourceCurrent(pEntry->source) ? pEntry : NULL;
+}
+
+/*
+ * Find a decoded tile (for CTile's resolveTile).
+ */
+static const TILE_PIXELS *bundledTile(const STRING &file, const INT number)
+{
+	const BUNDLE_ENTRY *const pEntry = findEntry(file, number, BT_TILE);
+	if (!pEntry || pEntry->bytes != sizeof(TILE_PIXELS)) return NULL;
+	return (const TILE_PIXELS *)(m_pData + pEntry->offset);
+}
+
+/*
+ * Check the bundle's header and tables lie within it.
+ */
+static bool isBundleValid(void)
+{
+	if (m_size < sizeof(BUNDLE_HEADER)) return false;
+
+	const BUNDLE_HEADER *const pHeader = (const BUNDLE_HEADER *)m_pData;
+	if (pHeader->magic != BUNDLE_MAGIC || pHeader->version != BUNDLE_VERSION) return false;
+
+	const unsigned __int64 tables = (unsigned __int64)pHeader->tables +
+		(unsigned __int64)pHeader->sources * sizeof(BUNDLE_SOURCE) +
+		(unsigned __int64)pHeader->entries * sizeof(BUNDLE_ENTRY);
+	if (tables > pHeader->names || pHeader->names >= m_size) return false;
+
+	// The names must end within the bundle.
+	if (m_pData[m_size - 1] != '\0') return false;
+
+	m_pSources = (const BUNDLE_SOURCE *)(m_pData + pHeader->tables);
+	m_pEntries = (const BUNDLE_ENTRY *)(m_pSources + pHeader->sources);
+	m_pNames = (const char *)(m_pData + pHeader->names);
+
+	for (DWORD i = 0; i < pHeader->entries; ++i)
+	{
+		const BUNDLE_ENTRY &entry = m_pEntries[i];
+		if (entry.source >= pHeader->sources || entry.name >= m_size - pHeader->names) return false;
+		if (entry.offset > pHeader->tables || entry.bytes > pHeader->tables - entry.offset) return false;
+		if (entry.type == BT_IMAGE && (unsigned __int64)entry.width * entry.height * 4 != entry.bytes) return false;
+	}
+	for (DWORD i = 0; i < pHeader->sources; ++i)
+	{
+		if (m_pSources[i].name >= m_size - pHeader->names) return false;
+	}
+	return true;
+}
+
+/*
+ * Map the project's bundle, if it has one.
+ */
+void openBundle(void)
+{
+	extern STRING g_projectPath;
+	extern const TILE_PIXELS *(*resolveTile)(const STRING &file, const INT number);
+
+	closeBundle();
+
+	const STRING file = g_projectPath + BUNDLE_FILE;
+	if (m_pPak = pakAcquire(file))
+	{
+		// Files in the pak file cannot change.
+		m_size = m_pPak->data.size();
+		m_pData = m_size ? &m_pPak->data[0] : NULL;
+		m_bCheckSources = false;
+
+		// Keep room for other files alongside the bundle.
+		pakSetCacheBudget(PAK_CACHE_BUDGET + m_size);
+	}
+	else
+	{
+		m_hFile = CreateFile(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_hFile == INVALID_HANDLE_VALUE) return;
+
+		m_size = GetFileSize(m_hFile, NULL);
+		if (m_size && m_size != INVALID_FILE_SIZE)
+		{
+			m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (m_hMapping) m_pData = (const BYTE *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+		}
+		m_bCheckSources = true;
+	}
+
+	if (!m_pData || !isBundleValid())
+	{
+		closeBundle();
+		return;
+	}
+
+	const BUNDLE_HEADER *const pHeader = (const BUNDLE_HEADER *)m_pData;
+	for (DWORD i = 0; i < pHeader->entries; ++i)
+	{
+		m_index.insert(std::make_pair(std::string(m_pNames + m_pEntries[i].name), i));
+	}
+	m_current.assign(pHeader->sources, 0);
+
+	resolveTile = bundledTile;
+}
+
+/*
+ * Unmap the bundle.
+ */
+void closeBundle(void)
+{
+	extern const TILE_PIXELS *(*resolveTile)(const STRING &file, const INT number);
+	resolveTile = NULL;
+
+	m_index.clear();
+	m_current.clear();
+	m_pSources = NULL;
+	m_pEntries = NULL;
+	m_pNames = NULL;
+
+	if (m_pPak)
+	{
+		pakRelease(m_pPak);
+		pakSetCacheBudget(PAK_CACHE_BUDGET);
+		m_pPak = NULL;
+	}
+	else if (m_pData)
+	{
+		UnmapViewOfFile(m_pData);
+	}
+	if (m_hMapping) CloseHandle(m_hMapping);
+	if (m_hFile != INVALID_HANDLE_VALUE) CloseHandle(m_hFile);
+
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_pData = NULL;
+	m_size = 0;
+}
+
+/*
+ * Set up an image of bundled pixels.
+ */
+static void setImage(const BUNDLE_ENTRY &entry, IMAGE &image)
+{
+	image.width = entry.width;
+	image.height = entry.height;
+	image.bits = m_pData + entry.offset;
+	image.bmp = NULL;
+
+	memset(&image.info, 0, sizeof(image.info));
+	image.info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	image.info.bmiHeader.biWidth = entry.width;
+	image.info.bmiHeader.biHeight = entry.height;		// Bottom-up.
+	image.info.bmiHeader.biPlanes = 1;
+	image.info.bmiHeader.biBitCount = 32;
+	image.info.bmiHeader.biCompression = BI_RGB;
+}
+
+/*
+ * Open an image, from the bundle if it holds the image.
+ */
+bool openImage(const STRING &file, IMAGE &image)
+{
+	if (openBundledImage(file, 0, image)) return true;
+
+	const std::string path = getAsciiString(resolve(file));
+	image.bmp = FreeImage_Load(FreeImage_GetFileType(path.c_str(), 16), path.c_str());
+	if (!image.bmp) return false;
+
+	image.width = FreeImage_GetWidth(image.bmp);
+	image.height = FreeImage_GetHeight(image.bmp);
+	image.bits = FreeImage_GetBits(image.bmp);
+	return true;
+}
+
+/*
+ * Get a page of an image from the bundle.
+ */
+bool openBundledImage(const STRING &file, const unsigned int page, IMAGE &image)
+{
+	image.bmp = NULL;
+	const BUNDLE_ENTRY *const pEntry = findEntry(file, page, BT_IMAGE);
+	if (!pEntry) return false;
+
+	setImage(*pEntry, image);
+	return true;
+}
+
+/*
+ * Close an image.
+ */
+void closeImage(IMAGE &image)
+{
+	if (image.bmp) FreeImage_Unload(image.bmp);
+	image.bmp = NULL;
+	image.bits = NULL;
+}
+
+/*
+ * A bundle being baked.
+ */
+typedef struct tagBundleBake
+{
+	FILE *file;
+	DWORD pos;								// End of the data so far.
+	std::vector<BUNDLE_SOURCE> sources;
+	std::vector<BUNDLE_ENTRY> entries;
+	std::string names;
+
+} BUNDLE_BAKE;
+
+/*
+ * Add a file being baked.
+ *
+ * file (in) - file relative to the project
+ * return (out) - index of the source
+ */
+static DWORD addSource(BUNDLE_BAKE &bake, const STRING &file)
+{
+	extern STRING g_projectPath;
+
+	BUNDLE_SOURCE source;
+	memset(&source, 0, sizeof(source));
+
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if (GetFileAttributesEx((g_projectPath + file).c_str(), GetFileExInfoStandard, &fad))
+	{
+		source.size = fad.nFileSizeLow;
+		source.time = fad.ftLastWriteTime;
+	}
+
+	source.name = bake.names.length();
+	bake.names += bundleKey(file);
+	bake.names += '\0';
+
+	bake.sources.push_back(source);
+	return bake.sources.size() - 1;
+}
+
+/*
+ * Write an entry's data, aligned.
+ */
+static void addEntry(BUNDLE_BAKE &bake, const DWORD source, const BUNDLE_TYPE type, const DWORD page, const DWORD width, const DWORD height, const void *pData, const DWORD bytes)
+{
+	static const BYTE padding[BUNDLE_ALIGN] = {0};
+	const DWORD pad = (BUNDLE_ALIGN - bake.pos % BUNDLE_ALIGN) % BUNDLE_ALIGN;
+	fwrite(padding, 1, pad, bake.file);
+	bake.pos += pad;
+
+	BUNDLE_ENTRY entry;
+	entry.name = bake.sources[source].name;
+	entry.source = source;
+	entry.type = type;
+	entry.page = page;
+	entry.width = width;
+	entry.height = height;
+	entry.offset = bake.pos;
+	entry.bytes = bytes;
+	bake.entries.push_back(entry);
+
+	fwrite(pData, 1, bytes, bake.file);
+	bake.pos += bytes;
+}
+
+/*
+ * Add an image's pixels, as a 32 bit DIB.
+ */
+static void addImage(BUNDLE_BAKE &bake, const DWORD source, const DWORD page, FIBITMAP *bmp)
+{
+	FIBITMAP *const bmp32 = FreeImage_ConvertTo32Bits(bmp);
+	if (!bmp32) return;
+
+	// 32 bit rows need no padding.
+	const DWORD width = FreeImage_GetWidth(bmp32), height = FreeImage_GetHeight(bmp32);
+	if (FreeImage_GetPitch(bmp32) == width * 4)
+	{
+		addEntry(bake, source, BT_IMAGE, page, width, height, FreeImage_GetBits(bmp32), width * height * 4);
+	}
+	FreeImage_Unload(bmp32);
+}
+
+/*
+ * List the files in a folder of the project and its subfolders.
+ *
+ * folder (in) - folder relative to the project, with a trailing \
+ * files (out) - files relative to the project
+ */
+static void findFiles(const STRING &folder, std::vector<STRING> &files)
+{
+	extern STRING g_projectPath;
+
+	WIN32_FIND_DATA fd;
+	HANDLE hSearch = FindFirstFile((g_projectPath + folder + _T("*")).c_str(), &fd);
+	if (hSearch == INVALID_HANDLE_VALUE) return;
+	do
+	{
+		const STRING strFile = fd.cFileName;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if ((strFile != _T(".")) && (strFile != _T("..")))
+			{
+				findFiles(folder + strFile + _T("\\"), files);
+			}
+		}
+		else
+		{
+			files.push_back(folder + strFile);
+		}
+	} while (FindNextFile(hSearch, &fd));
+	FindClose(hSearch);
+}
+
+/*
+ * Decode the project's tiles and images into a new bundle.
+ */
+bool bakeBundle(void)
+{
+	extern STRING g_projectPath, g_pakTempPath;
+
+	// Bake loose projects only.
+	if (!g_pakTempPath.empty()) return false;
+
+	closeBundle();
+
+	BUNDLE_BAKE bake;
+	bake.file = fopen((g_projectPath + BUNDLE_FILE).c_str(), _T("wb"));
+	if (!bake.file) return false;
+
+	// Leave room for the header.
+	BUNDLE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	fwrite(&header, sizeof(header), 1, bake.file);
+	bake.pos = sizeof(header);
+
+	std::vector<STRING> files;
+	std::vector<STRING>::const_iterator i;
+
+	// Every tile in each tile set, and .gph tiles.
+	findFiles(TILE_PATH, files);
+	for (i = files.begin(); i != files.end(); ++i)
+	{
+		const STRING ext = getExtension(*i);
+		const STRING path = g_projectPath + *i;
+		TILE_PIXELS tile;
+
+		if (_ftcsicmp(ext.c_str(), _T("TST")) == 0 || _ftcsicmp(ext.c_str(), _T("ISO")) == 0)
+		{
+			const TS_HEADER tileset = CTile::getTilesetInfo(path);
+			if (!tileset.tilesInSet) continue;
+
+			const DWORD source = addSource(bake, *i);
+			for (int j = 1; j <= tileset.tilesInSet; ++j)
+			{
+				TCHAR number[16];
+				_itot(j, number, 10);
+				if (CTile::decodeTile(path + number, tile))
+				{
+					addEntry(bake, source, BT_TILE, j, 0, 0, &tile, sizeof(tile));
+				}
+			}
+		}
+		else if (_ftcsicmp(ext.c_str(), _T("GPH")) == 0)
+		{
+			if (CTile::decodeTile(path, tile))
+			{
+				addEntry(bake, addSource(bake, *i), BT_TILE, 0, 0, 0, &tile, sizeof(tile));
+			}
+		}
+	}
+
+	// Images, as drawImage() and board images open them.
+	files.clear();
+	findFiles(BMP_PATH, files);
+	for (i = files.begin(); i != files.end(); ++i)
+	{
+		const std::string path = getAsciiString(g_projectPath + *i);
+		const FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(path.c_str(), 16);
+		if (fif == FIF_UNKNOWN) continue;
+
+		FIBITMAP *const bmp = FreeImage_Load(fif, path.c_str());
+		if (!bmp) continue;
+
+		addImage(bake, addSource(bake, *i), 0, bmp);
+		FreeImage_Unload(bmp);
+	}
+
+	// Every page of the animated gifs in Misc\, as CAnimation opens them.
+	files.clear();
+	findFiles(MISC_PATH, files);
+	for (i = files.begin(); i != files.end(); ++i)
+	{
+		if (_ftcsicmp(getExtension(*i).c_str(), _T("GIF")) != 0) continue;
+
+		const std::string path = getAsciiString(g_projectPath + *i);
+		FIMULTIBITMAP *const mbmp = FreeImage_OpenMultiBitmap(FIF_GIF, path.c_str(), FALSE, TRUE, TRUE);
+		if (!mbmp) continue;
+
+		const DWORD source = addSource(bake, *i);
+		const int pages = FreeImage_GetPageCount(mbmp);
+		for (int j = 0; j < pages; ++j)
+		{
+			FIBITMAP *const bmp = FreeImage_LockPage(mbmp, j);
+			if (!bmp) break;
+			addImage(bake, source, j, bmp);
+			FreeImage_UnlockPage(mbmp, bmp, FALSE);
+		}
+		FreeImage_CloseMultiBitmap(mbmp, 0);
+	}
+
+	// Write the tables and names, then the header.
+	static const BYTE padding[sizeof(DWORD)] = {0};
+	const DWORD pad = (sizeof(DWORD) - bake.pos % sizeof(DWORD)) % sizeof(DWORD);
+	fwrite(padding, 1, pad, bake.file);
+	bake.pos += pad;
+
+	header.magic = BUNDLE_MAGIC;
+	header.version = BUNDLE_VERSION;
+	header.sources = bake.sources.size();
+	header.entries = bake.entries.size();
+	header.tables = bake.pos;
+	header.names = header.tables + header.sources * sizeof(BUNDLE_SOURCE) + header.entries * sizeof(BUNDLE_ENTRY);
+
+	if (!bake.sources.empty()) fwrite(&bake.sources[0], sizeof(BUNDLE_SOURCE), bake.sources.size(), bake.file);
+	if (!bake.entries.empty()) fwrite(&bake.entries[0], sizeof(BUNDLE_ENTRY), bake.entries.size(), bake.file);
+	fwrite(bake.names.c_str(), 1, bake.names.length() + 1, bake.file);
+
+	fseek(bake.file, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, bake.file);
+
+	const bool bWritten = !ferror(bake.file);
+	fclose(bake.file);
+	return bWritten;
+}
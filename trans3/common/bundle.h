@@ -0,0 +1,167 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Asset bundles: a project's tiles and images, decoded ahead of time.
+ *
+ * Baking a project (trans3 main.gam -bake) decodes every tile in its
+ * tile sets and .gph files, every image in Bitmap\ and every page of
+ * the animated gifs in Misc\, and writes them to one file, assets.tkb,
+ * in the project's folder (or a pak file's root):
+ *
+ *		header
+ *		data		- TILE_PIXELS, or 32 bit bottom-up DIB pixels,
+ *					  each aligned to BUNDLE_ALIGN
+ *		sources		- the files baked, with their sizes and times
+ *		entries		- the decoded tiles and images, by name, with
+ *					  the pages of a file together and in order
+ *		names		- lower case names relative to the project
+ *
+ * The bundle is mapped whole while the game runs, and tiles and images
+ * found in it are drawn straight from the mapping. Loose files changed
+ * since baking are decoded as before; loose files that are missing are
+ * taken from the bundle, so a game need not ship them.
+ */
+
+#ifndef _BUNDLE_H_
+#define _BUNDLE_H_
+
+/*
+ * Inclusions.
+ */
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "../../tkCommon/strings.h"
+#include "../../tkCommon/images/FreeImage.h"
+
+/*
+ * Defines.
+ */
+#define BUNDLE_FILE _T("assets.tkb")		// In the project's folder.
+#define BUNDLE_MAGIC 0x31424b54				// "TKB1"
+#define BUNDLE_VERSION 1
+#define BUNDLE_ALIGN 16
+
+typedef enum tagBundleType
+{
+	BT_TILE,						// TILE_PIXELS.
+	BT_IMAGE						// 32 bit DIB pixels.
+} BUNDLE_TYPE;
+
+typedef struct tagBundleHeader
+{
+	DWORD magic;
+	DWORD version;
+	DWORD sources;					// Number of sources.
+	DWORD entries;					// Number of entries.
+	DWORD tables;					// Offset of the sources, then entries.
+	DWORD names;					// Offset of the names.
+
+} BUNDLE_HEADER;
+
+typedef struct tagBundleSource
+{
+	DWORD name;						// Offset of the name in the names.
+	DWORD size;						// Size of the file when baked.
+	FILETIME time;					// Last written when baked.
+
+} BUNDLE_SOURCE;
+
+typedef struct tagBundleEntry
+{
+	DWORD name;						// Offset of the name in the names.
+	DWORD source;					// Index of the source.
+	DWORD type;						// BUNDLE_TYPE.
+	DWORD page;						// Tile number, or page of an image.
+	DWORD width;					// Images only.
+	DWORD height;
+	DWORD offset;					// Offset of the data in the file.
+	DWORD bytes;
+
+} BUNDLE_ENTRY;
+
+/*
+ * An image, from the bundle or else loaded with FreeImage.
+ */
+typedef struct tagImage
+{
+	int width;
+	int height;
+	const void *bits;				// Pixels, for StretchDIBits().
+	FIBITMAP *bmp;					// FreeImage's bitmap, if not bundled.
+	BITMAPINFO info;				// Header of bundled pixels.
+
+	const BITMAPINFO *getInfo(void) const
+	{
+		return bmp ? FreeImage_GetInfo(bmp) : &info;
+	}
+
+} IMAGE;
+
+/*
+ * Map the project's bundle, if it has one.
+ */
+void openBundle(void);
+
+/*
+ * Unmap the bundle.
+ */
+void closeBundle(void);
+
+/*
+ * Decode the project's tiles and images into a new bundle.
+ *
+ * return (out) - success?
+ */
+bool bakeBundle(void);
+
+/*
+ * Open an image, from the bundle if it holds the image.
+ *
+ * file (in) - unresolved file name, e.g. g_projectPath + BMP_PATH + x
+ * image (out) - the image, to be closed with closeImage()
+ * return (out) - success?
+ */
+bool openImage(const STRING &file, IMAGE &image);
+
+/*
+ * Get a page of an image from the bundle, without falling
+ * back to FreeImage (for multi-page files).
+ */
+bool openBundledImage(const STRING &file, const unsigned int page, IMAGE &image);
+
+/*
+ * Close an image.
+ */
+void closeImage(IMAGE &image);
+
+#endif
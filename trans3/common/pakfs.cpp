@@ -0,0 +1,422 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Reading files straight from the pak file - see pakfs.h.
+ */
+
+/*
+ * Inclusions.
+ */
+#include "pakfs.h"
+#include "../../tkzip/zlib.h"
+#include <hash_map>
+
+/*
+ * Defines.
+ */
+#define ZIP_END_SIGNATURE 0x06054b50		// End of central directory record.
+#define ZIP_DIR_SIGNATURE 0x02014b50		// Central directory file header.
+#define ZIP_LOCAL_SIGNATURE 0x04034b50		// Local file header.
+#define ZIP_END_SIZE 22
+#define ZIP_DIR_SIZE 46
+#define ZIP_LOCAL_SIZE 30
+#define ZIP_MAX_COMMENT 0xffff
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+/*
+ * A file in the central directory.
+ */
+typedef struct tagPakEntry
+{
+	DWORD offset;					// Offset of the local header.
+	DWORD compressed;				// Size in the archive.
+	DWORD size;						// Size once inflated.
+	DWORD crc;
+	WORD method;
+	PAK_FILE *pFile;				// Inflated file, if cached.
+
+} PAK_ENTRY;
+
+typedef stdext::hash_map<std::string, PAK_ENTRY> PAK_INDEX;
+
+/*
+ * Locals.
+ */
+static HANDLE m_hFile = INVALID_HANDLE_VALUE;	// The archive.
+static PAK_INDEX m_index;						// Central directory by name.
+static std::list<PAK_ENTRY *> m_lru;			// Cached files, most recent first.
+static unsigned long m_bytes = 0;				// Bytes of cached files.
+static unsigned long m_budget = PAK_CACHE_BUDGET;
+
+/*
+ * Read little endian values from the archive's headers.
+ */
+static inline WORD getWord(const BYTE *p)
+{
+	return WORD(p[0] | (p[1] << 8));
+}
+
+static inline DWORD getDword(const BYTE *p)
+{
+	return DWORD(p[0]) | (DWORD(p[1]) << 8) | (DWORD(p[2]) << 16) | (DWORD(p[3]) << 24);
+}
+
+/*
+ * Read bytes from the archive at an offset.
+ */
+static bool readArchive(const DWORD offset, LPVOID pData, const DWORD bytes)
+{
+	OVERLAPPED ptr;
+	memset(&ptr, 0, sizeof(ptr));
+	ptr.Offset = offset;
+	DWORD read = 0;
+	return (ReadFile(m_hFile, pData, bytes, &read, &ptr) && read == bytes);
+}
+
+/*
+ * Form the index key for a file name: lower case, with
+ * backslashes as the separator.
+ */
+static std::string pakKey(const STRING &path)
+{
+	std::string key = getAsciiString(path);
+	for (std::string::iterator i = key.begin(); i != key.end(); ++i)
+	{
+		*i = (*i == '/') ? '\\' : char(tolower((unsigned char)*i));
+	}
+	return key;
+}
+
+/*
+ * Find a file in the index.
+ */
+static PAK_ENTRY *findEntry(const STRING &path)
+{
+	if (m_index.empty()) return NULL;
+
+	const std::string key = pakKey(path);
+
+	// Saved games are never read from the pak file (as resolvePakFile()).
+	if (key.compare(0, 6, "saved\\") == 0) return NULL;
+
+	PAK_INDEX::iterator i = m_index.find(key);
+	return (i != m_index.end()) ? &i->second : NULL;
+}
+
+/*
+ * Inflate a file from the archive.
+ *
+ * entry (in) - the file
+ * data (out) - the file's contents
+ * return (out) - success?
+ */
+static bool inflateEntry(const PAK_ENTRY &entry, std::vector<BYTE> &data)
+{
+	// The local header's name and extra field may differ in
+	// length from the central directory's.
+	BYTE local[ZIP_LOCAL_SIZE];
+	if (!readArchive(entry.offset, local, ZIP_LOCAL_SIZE)) return false;
+	if (getDword(local) != ZIP_LOCAL_SIGNATURE) return false;
+
+	const DWORD start = entry.offset + ZIP_LOCAL_SIZE + getWord(local + 26) + getWord(local + 28);
+
+	data.resize(entry.size);
+	if (!entry.size) return true;
+
+	if (entry.method == ZIP_STORED)
+	{
+		if (entry.compressed != entry.size) return false;
+		if (!readArchive(start, &data[0], entry.size)) return false;
+	}
+	else if (entry.method == ZIP_DEFLATED)
+	{
+		std::vector<BYTE> compressed(entry.compressed);
+		if (!entry.compressed || !readArchive(start, &compressed[0], entry.compressed)) return false;
+
+		z_stream z;
+		memset(&z, 0, sizeof(z));
+		// Negative window bits: a raw deflate stream, without a zlib header.
+		if (inflateInit2(&z, -MAX_WBITS) != Z_OK) return false;
+
+		z.next_in = &compressed[0];
+		z.avail_in = entry.compressed;
+		z.next_out = &data[0];
+		z.avail_out = entry.size;
+
+		const int res = inflate(&z, Z_FINISH);
+		inflateEnd(&z);
+		if (res != Z_STREAM_END || z.total_out != entry.size) return false;
+	}
+	else
+	{
+		return false;
+	}
+
+	return (crc32(0, &data[0], entry.size) == entry.crc);
+}
+
+/*
+ * Drop the least recently used files that no reader holds
+ * until another bytes fit in the budget.
+ */
+static void evict(const unsigned long bytes)
+{
+	std::list<PAK_ENTRY *>::iterator i = m_lru.end();
+	while (i != m_lru.begin() && m_bytes + bytes > m_budget)
+	{
+		--i;
+		PAK_FILE *const pFile = (*i)->pFile;
+		if (pFile->refs) continue;
+
+		m_bytes -= pFile->data.size();
+		(*i)->pFile = NULL;
+		delete pFile;
+		i = m_lru.erase(i);
+	}
+}
+
+/*
+ * Open the pak file and index its central directory.
+ */
+bool pakOpen(const STRING &file)
+{
+	pakClose();
+
+	m_hFile = CreateFile(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE) return false;
+
+	const DWORD size = GetFileSize(m_hFile, NULL);
+	if (size == INVALID_FILE_SIZE || size < ZIP_END_SIZE)
+	{
+		pakClose();
+		return false;
+	}
+
+	// The end of central directory record is followed
+	// only by the archive's comment.
+	const DWORD tail = (size < ZIP_END_SIZE + ZIP_MAX_COMMENT) ? size : ZIP_END_SIZE + ZIP_MAX_COMMENT;
+	std::vector<BYTE> buffer(tail);
+	if (!readArchive(size - tail, &buffer[0], tail))
+	{
+		pakClose();
+		return false;
+	}
+
+	const BYTE *end = NULL;
+	for (int i = tail - ZIP_END_SIZE; i >= 0; --i)
+	{
+		if (getDword(&buffer[i]) == ZIP_END_SIGNATURE)
+		{
+			end = &buffer[i];
+			break;
+		}
+	}
+	if (!end)
+	{
+		pakClose();
+		return false;
+	}
+
+	const DWORD endPos = size - tail + (end - &buffer[0]);
+	const WORD entries = getWord(end + 10);
+	const DWORD dirSize = getDword(end + 12);
+	const DWORD dirOffset = getDword(end + 16);
+
+	// An archive tacked onto another file records its offsets
+	// from its own start (as minizip).
+	if (dirOffset + dirSize > endPos)
+	{
+		pakClose();
+		return false;
+	}
+	const DWORD before = endPos - (dirOffset + dirSize);
+
+	std::vector<BYTE> dir(dirSize + 1);
+	if (!readArchive(before + dirOffset, &dir[0], dirSize))
+	{
+		pakClose();
+		return false;
+	}
+
+	DWORD pos = 0;
+	for (WORD i = 0; i < entries && pos + ZIP_DIR_SIZE <= dirSize; ++i)
+	{
+		const BYTE *const p = &dir[pos];
+		if (getDword(p) != ZIP_DIR_SIGNATURE) break;
+
+		const WORD nameLength = getWord(p + 28);
+		const DWORD next = pos + ZIP_DIR_SIZE + nameLength + getWord(p + 30) + getWord(p + 32);
+		if (next > dirSize) break;
+
+		const std::string name((const char *)p + ZIP_DIR_SIZE, nameLength);
+		pos = next;
+
+		// Skip directories.
+		if (name.empty() || name[name.length() - 1] == '/' || name[name.length() - 1] == '\\') continue;
+
+		PAK_ENTRY entry;
+		entry.method = getWord(p + 10);
+		entry.crc = getDword(p + 16);
+		entry.compressed = getDword(p + 20);
+		entry.size = getDword(p + 24);
+		entry.offset = before + getDword(p + 42);
+		entry.pFile = NULL;
+		m_index.insert(std::make_pair(pakKey(name), entry));
+	}
+
+	// The index is not altered again until the pak file is closed,
+	// so the cache may hold pointers to its entries.
+	return true;
+}
+
+/*
+ * Close the pak file and free the cache.
+ */
+void pakClose(void)
+{
+	for (std::list<PAK_ENTRY *>::iterator i = m_lru.begin(); i != m_lru.end(); ++i)
+	{
+		delete (*i)->pFile;
+	}
+	m_lru.clear();
+	m_bytes = 0;
+	m_index.clear();
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+/*
+ * Is a file in the pak file?
+ */
+bool pakExists(const STRING &path)
+{
+	return (findEntry(path) != NULL);
+}
+
+/*
+ * Get a file from the pak file, inflating it if not cached.
+ */
+PAK_FILE *pakAcquire(const STRING &path)
+{
+	PAK_ENTRY *const pEntry = findEntry(path);
+	if (!pEntry) return NULL;
+
+	if (pEntry->pFile)
+	{
+		// Move to the front of the recently used list.
+		m_lru.splice(m_lru.begin(), m_lru, pEntry->pFile->lru);
+		++pEntry->pFile->refs;
+		return pEntry->pFile;
+	}
+
+	PAK_FILE *const pFile = new PAK_FILE();
+	if (!inflateEntry(*pEntry, pFile->data))
+	{
+		delete pFile;
+		return NULL;
+	}
+
+	// Make room for it and file it.
+	evict(pEntry->size);
+	m_lru.push_front(pEntry);
+	pFile->lru = m_lru.begin();
+	pFile->refs = 1;
+	pEntry->pFile = pFile;
+	m_bytes += pEntry->size;
+
+	return pFile;
+}
+
+/*
+ * Release a file got with pakAcquire().
+ */
+void pakRelease(PAK_FILE *pFile)
+{
+	if (!pFile) return;
+	--pFile->refs;
+
+	// A file larger than the budget is dropped once released.
+	evict(0);
+}
+
+/*
+ * Read a range of a file from the pak file.
+ */
+BOOL pakRead(const STRING &path, const LONG offset, LPVOID pData, const DWORD bytes)
+{
+	PAK_FILE *const pFile = pakAcquire(path);
+	if (!pFile) return FALSE;
+
+	const bool bRead = (offset >= 0 && DWORD(offset) + bytes <= pFile->data.size());
+	if (bRead && bytes) memcpy(pData, &pFile->data[offset], bytes);
+
+	pakRelease(pFile);
+	return bRead;
+}
+
+/*
+ * Write a file from the pak file to disk.
+ */
+bool pakExtract(const STRING &path, const STRING &file)
+{
+	PAK_ENTRY *const pEntry = findEntry(path);
+	if (!pEntry) return false;
+
+	// Use the cached copy if there is one, without caching
+	// files that are only ever extracted.
+	std::vector<BYTE> data;
+	if (!pEntry->pFile && !inflateEntry(*pEntry, data)) return false;
+	const std::vector<BYTE> &contents = pEntry->pFile ? pEntry->pFile->data : data;
+
+	const HANDLE hFile = CreateFile(file.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) return false;
+
+	DWORD written = 0;
+	const bool bWritten = (contents.empty() || WriteFile(hFile, &contents[0], contents.size(), &written, NULL)) && written == contents.size();
+	CloseHandle(hFile);
+	return bWritten;
+}
+
+/*
+ * Set the memory available to the cache.
+ */
+void pakSetCacheBudget(const unsigned long bytes)
+{
+	m_budget = bytes;
+	evict(0);
+}
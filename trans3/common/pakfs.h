@@ -0,0 +1,134 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Reading files straight from the pak file.
+ *
+ * The archive's central directory is read once, when the pak file is
+ * opened, into a hash table of entries keyed by their lower case names.
+ * A file is then found without searching the archive, and is inflated
+ * into memory when first read. Inflated files are kept, most recently
+ * used first, until they no longer fit in the cache's budget; a file
+ * is only dropped once every reader has released it.
+ */
+
+#ifndef _PAKFS_H_
+#define _PAKFS_H_
+
+/*
+ * Inclusions.
+ */
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <vector>
+#include <list>
+#include "../../tkCommon/strings.h"
+
+/*
+ * Defines.
+ */
+#define PAK_CACHE_BUDGET (16 * 1024 * 1024)	// Bytes of inflated files to keep.
+
+struct tagPakEntry;
+
+/*
+ * A file inflated from the pak file.
+ */
+typedef struct tagPakFile
+{
+	std::vector<BYTE> data;						// The file's contents.
+	UINT refs;									// Readers holding the file.
+	std::list<struct tagPakEntry *>::iterator lru;
+
+} PAK_FILE;
+
+/*
+ * Open the pak file and index its central directory.
+ *
+ * file (in) - the archive
+ * return (out) - success?
+ */
+bool pakOpen(const STRING &file);
+
+/*
+ * Close the pak file and free the cache.
+ */
+void pakClose(void);
+
+/*
+ * Is a file in the pak file?
+ *
+ * path (in) - unresolved file name, e.g. Boards\start.brd
+ */
+bool pakExists(const STRING &path);
+
+/*
+ * Get a file from the pak file, inflating it if not cached.
+ * Every file acquired must be released.
+ *
+ * path (in) - unresolved file name
+ * return (out) - the file, or NULL if not in the pak file
+ */
+PAK_FILE *pakAcquire(const STRING &path);
+
+/*
+ * Release a file got with pakAcquire().
+ */
+void pakRelease(PAK_FILE *pFile);
+
+/*
+ * Read a range of a file from the pak file.
+ *
+ * path (in) - unresolved file name
+ * offset (in) - first byte to read
+ * pData (out) - destination
+ * bytes (in) - number of bytes
+ * return (out) - whether all of the bytes were read
+ */
+BOOL pakRead(const STRING &path, const LONG offset, LPVOID pData, const DWORD bytes);
+
+/*
+ * Write a file from the pak file to disk, for readers that
+ * need a real file. The file is not kept in the cache.
+ *
+ * path (in) - unresolved file name
+ * file (in) - file to create
+ * return (out) - success?
+ */
+bool pakExtract(const STRING &path, const STRING &file);
+
+/*
+ * Set the memory available to the cache.
+ */
+void pakSetCacheBudget(const unsigned long bytes);
+
+#endif
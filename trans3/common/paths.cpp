@@ -36,6 +36,7 @@
 #include "paths.h"
 #include "CFile.h"
 #include "mbox.h"
+#include "pakfs.h"
 #include "../../tkzip/tkzip.h"
 
 /*
@@ -84,9 +85,13 @@ STRING resolvePakFile(const STRING &path)
 	resolve = resolveNonPakFile;
 	if (!CFile::fileExists(file))
 	{
-		// Extract the file from the pak file or this executable.
+		// Extract the file from the pak file or this executable,
+		// for readers that cannot read from the pak file directly.
 		// (Assume the zip is open!)
-		ZIPExtract(const_cast<char *>(path.c_str()), const_cast<char *>(file.c_str()));
+		if (!pakExtract(path, file))
+		{
+			ZIPExtract(const_cast<char *>(path.c_str()), const_cast<char *>(file.c_str()));
+		}
 	}
 	resolve = resolvePakFile;
 	return file;
@@ -95,6 +100,7 @@ STRING resolvePakFile(const STRING &path)
 void setResolve(const bool bPak)
 {
 	resolve = bPak ? resolvePakFile : resolveNonPakFile;
+	resolveRead = bPak ? pakRead : NULL;
 }
 
 bool initialisePakFile(const STRING &file)
@@ -128,6 +134,9 @@ bool initialisePakFile(const STRING &file)
 		MessageBox(NULL, _T("The PAK file or executable could not be successfully opened and is probably invalid."), _T("Invalid PAK File"), 0);
 	}
 
+	// Index the archive to read files straight from it.
+	pakOpen(file);
+
 	g_pakFile = file;
 //	MessageBox(NULL, _T("Set Pak File"),_T("Just Checking"),0);
 	setResolve(true);
@@ -200,6 +209,7 @@ void uninitialisePakFile()
 	if (g_pakTempPath.empty()) return;
 
 	deleteTree(g_pakTempPath);
+	pakClose();
 	ZIPClose();
 
 	// If we are a standalone game, also delete the tag on archive.
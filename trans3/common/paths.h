@@ -99,6 +99,10 @@ inline STRING addExtension(const STRING &file, const STRING ext)
 // Resolve a file name.
 extern STRING (*resolve)(const STRING &path);
 
+// Read part of a file without resolving it, from the pak file
+// (tile sets). NULL, or FALSE returned, if the file should be resolved.
+extern BOOL (*resolveRead)(const STRING &path, const LONG offset, LPVOID pData, const DWORD bytes);
+
 // Toggle file resolution.
 // MUST be set at least once, lest trans3 should crash.
 void setResolve(const bool bPak);
@@ -609,26 +609,41 @@ void saveSaveState(const STRING fileName)
 		HEAP_ENUM heap = CProgram::enumerateGlobals();
 		HEAP_ENUM::ITR itr = heap.begin();
 
+		// Array elements are saved by name, as "array[key]", so the
+		// file format is the same as when they were held in the heap.
+		std::vector<CArray::ENTRY> vars;
+		for (; itr != heap.end(); ++itr)
+		{
+			vars.push_back(CArray::ENTRY(itr->first, const_cast<CArray::ELEMENT *>(&itr->second)));
+		}
+
+		ARRAY_ENUM arrays = CProgram::enumerateArrays();
+		ARRAY_ENUM::ITR arr = arrays.begin();
+		for (; arr != arrays.end(); ++arr)
+		{
+			arr->second.enumerate(vars, arr->first);
+		}
+
 		// We are going to sort the globals into numerical and literal.
 		// This will keep the file format the same size, even though
 		// it takes a little bit of effort when saving, so it's worth it.
-		std::vector<HEAP_ENUM::ITR> lits, nums, objs;
-		std::vector<HEAP_ENUM::ITR>::const_iterator j;
+		std::vector<CArray::ENTRY> lits, nums, objs;
+		std::vector<CArray::ENTRY>::const_iterator j;
 
-		for (; itr != heap.end(); ++itr)
+		for (j = vars.begin(); j != vars.end(); ++j)
 		{
-			UNIT_DATA_TYPE udt = itr->second->udt;
+			UNIT_DATA_TYPE udt = (*j->second)->udt;
 			if (udt & UDT_LIT)
 			{
-				lits.push_back(itr);
+				lits.push_back(*j);
 			}
 			else if (udt & UDT_OBJ)
 			{
-				objs.push_back(itr);
+				objs.push_back(*j);
 			}
 			else
 			{
-				nums.push_back(itr);
+				nums.push_back(*j);
 			}
 		}
 
@@ -636,21 +651,21 @@ void saveSaveState(const STRING fileName)
 		file << int(nums.size());
 		for (j = nums.begin(); j != nums.end(); ++j)
 		{
-			file << (*j)->first << (*j)->second->num;
+			file << j->first << (*j->second)->num;
 		}
 
 		// Write object globals.
 		file << int(objs.size());
 		for (j = objs.begin(); j != objs.end(); ++j)
 		{
-			file << (*j)->first << (*j)->second->num;
+			file << j->first << (*j->second)->num;
 		}
 
 		// Write literal globals.
 		file << int(lits.size());
 		for (j = lits.begin(); j != lits.end(); ++j)
 		{
-			file << (*j)->first << (*j)->second->lit;
+			file << j->first << (*j->second)->lit;
 		}
 	}
 
@@ -153,16 +153,20 @@ void tagTileBitmap::resize(const int width, const int height)
 
 /*
  * Draw a tile bitmap, including tst.
- * Called when rendering sprite frames.
+ * Called when rendering sprite frames, which are lit with the rest of
+ * the scene, and by drawImage(), whose targets are drawn over the lit
+ * scene and so are given the ambient level here (bAmbient).
  */
 bool tagTileBitmap::draw(CCanvas *cnv, 
 						 CCanvas *cnvMask, 
 						 const int x, 
-						 const int y)
+						 const int y,
+						 const bool bAmbient)
 {
 	extern STRING g_projectPath;
 	extern AMBIENT_LEVEL g_ambientLevel;
-	const RGBSHADE al = g_ambientLevel.rgb;
+	RGBSHADE al = {0, 0, 0};
+	if (bAmbient) al = g_ambientLevel.rgb;
 
     const int xx = x / 32 + 1, yy = y / 32 + 1;
 
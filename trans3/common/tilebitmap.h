@@ -63,7 +63,8 @@ typedef struct tagTileBitmap
 	bool draw(CCanvas *cnv, 
 			  CCanvas *cnvMask, 
 			  const int x, 
-			  const int y);
+			  const int y,
+			  const bool bAmbient = false);
 } TILE_BITMAP;
 
 #endif
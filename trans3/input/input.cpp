@@ -43,6 +43,7 @@
 #include "../plugins/constants.h"
 #include "../movement/CPlayer/CPlayer.h"
 #include "../rpgcode/CProgram.h"
+#include "../misc/profiler.h"
 
 /*
  * Globals.
@@ -52,6 +53,7 @@ std::vector<TCHAR> g_vkeys;
 IDirectInput8A *g_lpdi = NULL;
 IDirectInputDevice8A *g_lpdiKeyboard = NULL;
 IDirectInputDevice8A *g_lpdiMouse = NULL;
+bool g_bQuitting = false;			// Leave modal loops (see isQuitting()).
 struct tagMOUSE
 {
 	POINT move;
@@ -63,6 +65,25 @@ struct tagMOUSE
  */
 void processEvent()
 {
+	if (isRecording() || isReplaying())
+	{
+		// Each event processed is a frame of a modal loop: run these
+		// at the frame rate so that they can be replayed.
+		if (isReplaying())
+		{
+			// At the end of the replay, leave the loop and let
+			// replayLoop() close the session. The clock still runs
+			// for loops that wait on it.
+			if (isReplayFinished()) g_bQuitting = true;
+			else replayInputEvents();
+		}
+		else
+		{
+			Sleep(ENGINE_FRAME);
+		}
+		engineFrame();
+	}
+
 	MSG message;
 	if (PeekMessage(&message, NULL, 0, 0, PM_REMOVE))
 	{
@@ -84,6 +105,14 @@ void processEvent()
 	}
 }
 
+/*
+ * Should modal loops return?
+ */
+bool isQuitting()
+{
+	return g_bQuitting;
+}
+
 /*
  * Transform a char to an STRING, converting
  * common characters to string representations.
@@ -141,6 +170,7 @@ STRING waitForKey(const bool bCapital)
 	while (g_keys.size() == 0)
 	{
 		processEvent();
+		if (g_bQuitting) return STRING();
 	}
 	const char chr = g_keys.front();
 	const char isVirtual = g_vkeys.front(); 
@@ -158,7 +188,7 @@ POINT getMouseClick(const bool bWait)
 	if (bWait)
 	{
 		g_mouse.click.x = -1;
-		while (g_mouse.click.x == -1)
+		while (g_mouse.click.x == -1 && !g_bQuitting)
 		{
 			processEvent();
 		}
@@ -175,7 +205,7 @@ POINT getMouseMove(const bool bWait)
 
 	if (bWait)
 	{
-		while (g_mouse.move.x == x && y == g_mouse.move.y)
+		while (g_mouse.move.x == x && y == g_mouse.move.y && !g_bQuitting)
 		{
 			processEvent();
 		}
@@ -250,9 +280,9 @@ void scanKeys()
 	extern STRING g_projectPath;
 	extern LPBOARD g_pBoard;
 
-	BYTE keys[256];
-	if (FAILED(g_lpdiKeyboard->GetDeviceState(256, keys))) return;
-	#define SCAN_KEY_DOWN(x) (keys[x] & 0x80)
+	INPUT_STATE state;
+	if (!getInputState(state)) return;
+	#define SCAN_KEY_DOWN(x) (state.keys[x] & 0x80)
 
 	// General activation key.
 	if (SCAN_KEY_DOWN(g_mainFile.key))
@@ -268,7 +298,7 @@ void scanKeys()
 		renderNow(NULL, true);
 
 		// Delay to prevent the menu from immediately reopening.
-		Sleep(75);
+		engineSleep(75);
 		return;
 	}
 
@@ -339,37 +369,95 @@ void scanKeys()
 	if (g_mainFile.movementControls & MF_USE_MOUSE)
 	{
 		// Process mouse-driven movement.
-		// Use DI to get the status of the mousebuttons at this point.
 		extern RECT g_screen;
-		extern HWND g_hHostWnd;
-
-		DIMOUSESTATE dims;
-		memset(&dims, 0, sizeof(dims));
-		if (FAILED(g_lpdiMouse->GetDeviceState(sizeof(dims), &dims))) return;
 
-		if (dims.rgbButtons[0] & 0x80)
+		if (state.button & 0x80)
 		{
 			// Left button.
-			// Use the API to get the location to avoid having to deal with
-			// DI's relative co-ordinates.
-			POINT p = {0, 0};
-			if (GetCursorPos(&p))
+			const POINT p = state.cursor;
+			if (p.x > 0 && p.y > 0)
 			{
-				ScreenToClient(g_hHostWnd, &p);
-				if (p.x > 0 && p.y > 0)
+				// No flags - walk up to any sprite that blocks the goal.
+				PF_PATH pf = g_pSelectedPlayer->pathFind(p.x + g_screen.left, p.y + g_screen.top, PF_PREVIOUS, 0);
+				if (pf.size())
 				{
-					// No flags - walk up to any sprite that blocks the goal.
-					PF_PATH pf = g_pSelectedPlayer->pathFind(p.x + g_screen.left, p.y + g_screen.top, PF_PREVIOUS, 0);
-					if (pf.size())
-					{
-						g_pSelectedPlayer->setQueuedPath(pf, true);
-					}
+					g_pSelectedPlayer->setQueuedPath(pf, true);
 				}
 			}
 		}
 	} // if (using mouse)
 }
 
+/*
+ * Get the state of the keyboard and mouse.
+ */
+bool getInputState(INPUT_STATE &state)
+{
+	extern HWND g_hHostWnd;
+
+	if (replayInputState(state)) return true;
+
+	memset(&state, 0, sizeof(state));
+	if (!g_lpdiKeyboard || FAILED(g_lpdiKeyboard->GetDeviceState(256, state.keys))) return false;
+
+	// Use DI to get the status of the mouse buttons.
+	DIMOUSESTATE dims;
+	memset(&dims, 0, sizeof(dims));
+	if (g_lpdiMouse && SUCCEEDED(g_lpdiMouse->GetDeviceState(sizeof(dims), &dims)))
+	{
+		state.button = dims.rgbButtons[0];
+	}
+
+	// Use the API to get the location to avoid having to deal with
+	// DI's relative co-ordinates.
+	if (GetCursorPos(&state.cursor)) ScreenToClient(g_hHostWnd, &state.cursor);
+	else state.cursor.x = state.cursor.y = 0;
+
+	recordInputState(state);
+	return true;
+}
+
+/*
+ * Is a key down?
+ */
+bool isKeyDown(const int key)
+{
+	INPUT_STATE state;
+	return (getInputState(state) && (state.keys[key] & 0x80));
+}
+
+/*
+ * Handle a key or mouse event from the window (or a replay).
+ */
+void inputEvent(const INPUT_EVENT &e)
+{
+	recordInputEvent(e);
+
+	switch (e.type)
+	{
+		case IE_KEY:
+		{
+			// Queue the character.
+			g_keys.push_back(e.key);
+			g_vkeys.push_back(e.isVirtual);
+			// Pass the virtual key to the plugin.
+			const STRING strKey = getName(e.key, e.isVirtual, true);
+			informPluginEvent(e.vir, -1, -1, -1, e.shift, strKey, INPUT_KB);
+		} break;
+
+		case IE_MOVE:
+		{
+			g_mouse.move = e.p;
+		} break;
+
+		case IE_CLICK:
+		{
+			if (e.button == 1) g_mouse.click = e.p;
+			informPluginEvent(-1, e.p.x, e.p.y, e.button, /*shift*/0, _T(""), INPUT_MOUSEDOWN);
+		} break;
+	}
+}
+
 /*
  * Host window event processor.
  *
@@ -426,64 +514,78 @@ LRESULT CALLBACK eventProcessor(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
 			BYTE state[256];
 			GetKeyboardState(state);
 
+#ifdef ENABLE_PROFILER
+			// Ctrl+F12 writes the profile of the recent frames.
+			if (vir == VK_F12 && (state[VK_CONTROL] & 0x80))
+			{
+				profileDump();
+				break;
+			}
+#endif
+
 			// Get an ASCII representation of the key.
-			WORD key = 0;
-			char isVirtual = 0;
-			if ((vir != VK_SHIFT) && !ToAscii(vir, scan, state, &key, 0))
+			INPUT_EVENT e = {IE_KEY, vir, 0, 0, state[VK_SHIFT]};
+			if ((vir != VK_SHIFT) && !ToAscii(vir, scan, state, &e.key, 0))
 			{
 				// If ToAscii() failed, use the virtual code.
-				key = vir;
-				isVirtual = 1;
+				e.key = vir;
+				e.isVirtual = 1;
 			}
 
 			// Queue the character.
-			g_keys.push_back(key);
-            g_vkeys.push_back(isVirtual);
-			// Pass the virtual key to the plugin.
-			const STRING strKey = getName(key, isVirtual, true);
-			informPluginEvent(vir, -1, -1, -1, state[VK_SHIFT], strKey, INPUT_KB);
+			inputEvent(e);
 		} break;
 
 		// Mouse moved.
 		case WM_MOUSEMOVE:
 		{
 			// Handle the mouse move event.
-			g_mouse.move.x = LOWORD(lParam);
-			g_mouse.move.y = HIWORD(lParam);
-
+			INPUT_EVENT e = {IE_MOVE};
+			e.p.x = LOWORD(lParam);
+			e.p.y = HIWORD(lParam);
+			inputEvent(e);
 		} break;
 
 		// Left mouse button clicked.
 		case WM_LBUTTONDOWN:
 		{
-			g_mouse.click.x = LOWORD(lParam);
-			g_mouse.click.y = HIWORD(lParam);
-
-			informPluginEvent(-1, g_mouse.click.x, g_mouse.click.y, 1, /*shift*/0, _T(""), INPUT_MOUSEDOWN);
+			INPUT_EVENT e = {IE_CLICK};
+			e.p.x = LOWORD(lParam);
+			e.p.y = HIWORD(lParam);
+			e.button = 1;
+			inputEvent(e);
 		} break;
 
 		// Right mouse button clicked.
 		case WM_RBUTTONDOWN:
 		{
-			const int x = LOWORD(lParam), y = HIWORD(lParam);
-			informPluginEvent(-1, x, y, 2, /*shift*/0, _T(""), INPUT_MOUSEDOWN);
+			INPUT_EVENT e = {IE_CLICK};
+			e.p.x = LOWORD(lParam);
+			e.p.y = HIWORD(lParam);
+			e.button = 2;
+			inputEvent(e);
 		} break;
 
 		// Window activated/deactivated.
 		case WM_ACTIVATE:
 		{
 			extern GAME_STATE g_gameState;
+
+			// Pausing would change the game's state outside of the
+			// recorded input.
+			const bool bSession = (isRecording() || isReplaying());
+
 			if (wParam != WA_INACTIVE)
 			{
 				// Window is being activated,
 				if (g_lpdiKeyboard) g_lpdiKeyboard->Acquire();
 				if (g_lpdiMouse) g_lpdiMouse->Acquire();
-				g_gameState = GS_IDLE;
+				if (!bSession) g_gameState = GS_IDLE;
 			}
 			else
 			{
 				// Window is being deactivated.
-				g_gameState = GS_PAUSE;
+				if (!bSession) g_gameState = GS_PAUSE;
 			}
 		} break;
 
@@ -41,6 +41,7 @@
 #define DIRECTINPUT_VERSION DIRECTINPUT_HEADER_VERSION
 #include <dinput.h>
 #include "../../tkCommon/strings.h"
+#include "../app/replay.h"
 
 /*
  * Transform a char to an STRING, converting
@@ -79,9 +80,35 @@ LRESULT CALLBACK eventProcessor(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lPara
  */
 void scanKeys();
 
+/*
+ * Get the state of the keyboard and mouse (from the replay, if replaying).
+ *
+ * state (out) - the state
+ * return (out) - could the keyboard be read?
+ */
+bool getInputState(INPUT_STATE &state);
+
+/*
+ * Is a key down?
+ *
+ * key (in) - DirectInput key code
+ */
+bool isKeyDown(const int key);
+
+/*
+ * Handle a key or mouse event from the window (or a replay).
+ */
+void inputEvent(const INPUT_EVENT &e);
+
 /*
  * Process an event from the message queue.
  */
 void processEvent();
 
+/*
+ * Should modal loops return? Set when a replay ends, so that the loops
+ * unwind to replayLoop() rather than the engine exiting from within one.
+ */
+bool isQuitting();
+
 #endif
@@ -54,8 +54,8 @@
  */
 typedef struct tagGameTime
 {
-	void reset(const int gameTime) { startTime = (GetTickCount() / MILLISECONDS); runTime = gameTime; }
-	int gameTime(void) const { return (runTime + (GetTickCount() / MILLISECONDS) - startTime); }
+	void reset(const int gameTime) { startTime = (engineTime() / MILLISECONDS); runTime = gameTime; }
+	int gameTime(void) const { return (runTime + (engineTime() / MILLISECONDS) - startTime); }
 
 	int startTime;			// Seconds at start of session.
 	int runTime;				// Total seconds of this game or save file prior to this session.
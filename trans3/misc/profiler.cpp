@@ -0,0 +1,163 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Frame profiler - see profiler.h.
+ */
+
+/*
+ * Inclusions.
+ */
+#include "profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include <stdio.h>
+#include <intrin.h>
+
+#pragma intrinsic(_ReadWriteBarrier)
+
+/*
+ * A timed scope.
+ */
+typedef struct tagProfileSample
+{
+	const char *name;			// NULL while being written.
+	LONGLONG start;				// Performance counter at entry and exit.
+	LONGLONG end;
+	long frame;					// Frame the scope ended in.
+	DWORD thread;
+
+} PROFILE_SAMPLE;
+
+/*
+ * Locals.
+ */
+static PROFILE_SAMPLE m_samples[PROFILE_SAMPLES];
+static volatile LONG m_next = 0;				// Next sample to write.
+static volatile LONG m_frame = 0;				// Current frame.
+
+/*
+ * Record a timed scope. Writers claim a slot with an atomic
+ * increment, so any thread may record without a lock.
+ */
+void profileSample(const char *name, const LONGLONG start, const LONGLONG end)
+{
+	const LONG i = InterlockedIncrement(&m_next) - 1;
+	PROFILE_SAMPLE &s = m_samples[i & (PROFILE_SAMPLES - 1)];
+	s.name = NULL;
+	_ReadWriteBarrier();
+	s.start = start;
+	s.end = end;
+	s.frame = m_frame;
+	s.thread = GetCurrentThreadId();
+	_ReadWriteBarrier();
+	s.name = name;
+}
+
+/*
+ * Begin a new frame.
+ */
+void profileFrame(void)
+{
+	InterlockedIncrement(&m_frame);
+}
+
+/*
+ * Write the samples of the last frames as Chrome trace_event JSON.
+ */
+STRING profileDump(const unsigned int frames, const STRING file)
+{
+	extern STRING g_projectPath;
+	const STRING path = file.empty() ? g_projectPath + _T("profile.json") : file;
+
+	FILE *p = _tfopen(path.c_str(), _T("w"));
+	if (!p) return STRING();
+
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	const double toMicro = 1000000.0 / double(freq.QuadPart);
+
+	// Walk back from the newest sample until the frames are covered
+	// or the ring has been read once.
+	const LONG last = m_next, first = m_frame - LONG(frames);
+	LONG i = last, oldest = last;
+	LONGLONG base = 0;
+	for (; i != last - PROFILE_SAMPLES && i != 0; --i)
+	{
+		const PROFILE_SAMPLE &s = m_samples[(i - 1) & (PROFILE_SAMPLES - 1)];
+		if (!s.name) continue;
+		if (s.frame <= first) break;
+		oldest = i - 1;
+		base = s.start;
+	}
+	// Scopes end inner-first, so find the earliest start.
+	for (i = oldest; i != last; ++i)
+	{
+		const PROFILE_SAMPLE &s = m_samples[i & (PROFILE_SAMPLES - 1)];
+		if (s.name && s.start < base) base = s.start;
+	}
+
+	fprintf(p, "{\"traceEvents\":[");
+	const char *delim = "\n";
+	for (i = oldest; i != last; ++i)
+	{
+		const PROFILE_SAMPLE &s = m_samples[i & (PROFILE_SAMPLES - 1)];
+		if (!s.name) continue;
+		fprintf(p,
+			"%s{\"name\":\"%s\",\"cat\":\"trans3\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%lu,\"args\":{\"frame\":%ld}}",
+			delim,
+			s.name,
+			double(s.start - base) * toMicro,
+			double(s.end - s.start) * toMicro,
+			s.thread,
+			s.frame
+		);
+		delim = ",\n";
+	}
+	fprintf(p, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(p);
+
+	return path;
+}
+
+#else
+
+/*
+ * Profiling is compiled out.
+ */
+STRING profileDump(const unsigned int, const STRING)
+{
+	return STRING();
+}
+
+#endif
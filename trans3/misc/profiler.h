@@ -0,0 +1,121 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Frame profiler.
+ *
+ * Build with ENABLE_PROFILER defined to time the engine's subsystems.
+ * The Debug configuration defines it, and so does Profile, which is
+ * Release otherwise, for timings of optimised code.
+ * PROFILE(name) times the rest of the enclosing scope; the samples are
+ * kept in a ring buffer, and those of the last frames can be written as
+ * a Chrome trace (open it in chrome://tracing) by pressing Ctrl+F12 or
+ * calling profileDump() from RPGCode. Without ENABLE_PROFILER the macros
+ * expand to nothing.
+ */
+
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+/*
+ * Inclusions.
+ */
+#include "../../tkCommon/strings.h"
+
+/*
+ * Defines.
+ */
+#define PROFILE_SAMPLES 16384			// Ring size; must be a power of two.
+#define PROFILE_FRAMES 120				// Frames dumped by default.
+
+#ifdef ENABLE_PROFILER
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+/*
+ * Record a timed scope. name must be a string literal.
+ */
+void profileSample(const char *name, const LONGLONG start, const LONGLONG end);
+
+/*
+ * Begin a new frame.
+ */
+void profileFrame(void);
+
+/*
+ * Times its lifetime.
+ */
+class CProfileScope
+{
+public:
+	explicit CProfileScope(const char *name): m_name(name)
+	{
+		QueryPerformanceCounter(&m_start);
+	}
+	~CProfileScope()
+	{
+		LARGE_INTEGER end;
+		QueryPerformanceCounter(&end);
+		profileSample(m_name, m_start.QuadPart, end.QuadPart);
+	}
+
+private:
+	CProfileScope(const CProfileScope &);
+	CProfileScope &operator=(const CProfileScope &);
+
+	const char *const m_name;
+	LARGE_INTEGER m_start;
+};
+
+#define PROFILE_JOIN(a, b) a##b
+#define PROFILE_SCOPE(line) PROFILE_JOIN(profileScope, line)
+#define PROFILE(name) CProfileScope PROFILE_SCOPE(__LINE__)(name)
+#define PROFILE_FRAME() profileFrame()
+
+#else
+
+#define PROFILE(name)
+#define PROFILE_FRAME()
+
+#endif
+
+/*
+ * Write the samples of the last frames as Chrome trace_event JSON.
+ *
+ * frames (in) - number of frames to write
+ * file (in) - file to write, or empty for profile.json in the project folder
+ * return (out) - the file written, or empty if nothing was written
+ */
+STRING profileDump(const unsigned int frames = PROFILE_FRAMES, const STRING file = STRING());
+
+#endif
@@ -147,11 +147,23 @@ bool CItemThread::execute(const unsigned int units)
 	g_target.type = g_source.type = ET_ITEM;
 
 	unsigned int i = 0;
-	while ((i++ < units) && (m_i != m_units.end()) && m_pItem->isActive() && !isSleeping())
+	if (isCompiled())
 	{
-		m_i->execute(this);
-		++m_i;
-	} 
+		unsigned int pc = m_i - m_units.begin();
+		while ((i++ < units) && (pc < m_bytecode.size()) && m_pItem->isActive() && !isSleeping())
+		{
+			pc = executeInstruction(pc) + 1;
+		}
+		m_i = m_units.begin() + pc;
+	}
+	else
+	{
+		while ((i++ < units) && (m_i != m_units.end()) && m_pItem->isActive() && !isSleeping())
+		{
+			m_i->execute(this);
+			++m_i;
+		}
+	}
 	g_target = t; g_source = s;
 
 	return true;
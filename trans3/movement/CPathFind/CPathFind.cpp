@@ -45,7 +45,11 @@
 #include "../../common/board.h"
 #include "../../../tkCommon/board/coords.h"
 #include "../../common/mainfile.h"
+#include "../../misc/profiler.h"
 #include <math.h>
+#include <limits.h>
+#include <queue>
+#include <algorithm>
 
 /*
  * Defines
@@ -56,28 +60,104 @@ const int PF_GRID_SIZE = 32;		// Grid size for non-vector movement (= 32 for til
 									// to accept an arbitrary grid size.
 const int PF_HALF_SIZE = PF_GRID_SIZE / 2;
 const double PF_TILE_RATIO = 32.0 / PF_GRID_SIZE;
+const int PF_CLUSTER_SIZE = 10;		// Width of a cluster in grid points, for hierarchical searches.
+const int PF_ENTRANCE_RUN = 6;		// Longest entrance to give a single pair of nodes.
+const int PF_VISIBILITY_MAX = 4096;	// Most board nodes to cache the visibility of.
 
 int CPathFind::m_isIso = 0;			// g_pBoard->isIsometric().
+
+// A movement across the border of two clusters, for CTilePathFind::buildGraph().
+typedef struct tagPfCrossing
+{
+	int i, j;						// Matrix coordinates of the point moved from.
+	DB_POINT from, to;
+
+	bool operator< (const tagPfCrossing &rhs) const
+	{
+		return (i < rhs.i || (i == rhs.i && j < rhs.j));
+	}
+
+} PF_CROSSING;
 CTilePathFind::PF_TILE_MAP CTilePathFind::m_boardPoints;
 CTilePathFind::PF_SWEEP_MAP CTilePathFind::m_sweeps;
+CTilePathFind::PF_GRAPH_MAP CTilePathFind::m_graphs;
 CVectorPathFind::PF_VECTOR_MAP CVectorPathFind::m_boardVectors;
+CVectorPathFind::PF_VISIBILITY_MAP CVectorPathFind::m_visibility;
+
+/*
+ * Remove and return the open node with the lowest f-value.
+ */
+NODE CPathFind::popOpenNode(void)
+{
+	const NODE best = m_openNodes.front();
+	m_openIndex.erase(best.pos);
+
+	// Move the last node to the top and let it sink.
+	m_openNodes.front() = m_openNodes.back();
+	m_openNodes.pop_back();
+	if (!m_openNodes.empty())
+	{
+		m_openIndex[m_openNodes.front().pos] = 0;
+		siftDown(0);
+	}
+	return best;
+}
+
+/*
+ * Add a node to the open nodes.
+ */
+void CPathFind::pushOpenNode(const NODE &node)
+{
+	m_openNodes.push_back(node);
+	const int i = m_openNodes.size() - 1;
+	m_openIndex[node.pos] = i;
+	siftUp(i);
+}
+
+/*
+ * Move a node towards the top of the heap while its f-value
+ * is lower than its parent's.
+ */
+void CPathFind::siftUp(int i)
+{
+	const NODE node = m_openNodes[i];
+	const int f = node.fValue();
+	while (i > 0)
+	{
+		const int up = (i - 1) / 2;
+		if (m_openNodes[up].fValue() <= f) break;
+		m_openNodes[i] = m_openNodes[up];
+		m_openIndex[m_openNodes[i].pos] = i;
+		i = up;
+	}
+	m_openNodes[i] = node;
+	m_openIndex[node.pos] = i;
+}
 
 /*
- * Find the node with the lowest f-value.
+ * Move a node towards the bottom of the heap while its f-value
+ * is higher than either of its children's.
  */
-std::vector<NODE>::iterator CPathFind::bestOpenNode()
+void CPathFind::siftDown(int i)
 {
-	NODE *best = &*m_openNodes.begin();
-	std::vector<NODE>::iterator ret = m_openNodes.begin();
-	for (NV_ITR i = m_openNodes.begin(); i != m_openNodes.end(); ++i)
+	const NODE node = m_openNodes[i];
+	const int f = node.fValue();
+	const int size = m_openNodes.size();
+	while (true)
 	{
-		if (i->fValue() < best->fValue())
+		int down = 2 * i + 1;
+		if (down >= size) break;
+		if (down + 1 < size && m_openNodes[down + 1].fValue() < m_openNodes[down].fValue())
 		{
-			ret = i;
+			++down;
 		}
+		if (m_openNodes[down].fValue() >= f) break;
+		m_openNodes[i] = m_openNodes[down];
+		m_openIndex[m_openNodes[i].pos] = i;
+		i = down;
 	}
-	
-	return ret;
+	m_openNodes[i] = node;
+	m_openIndex[node.pos] = i;
 }
 
 /*
@@ -129,6 +209,8 @@ PF_PATH CPathFind::pathFind(
 	const CSprite *pSprite,		// Pointer to the calling sprite.
 	const int flags)
 {
+	PROFILE("pathFind");
+
 	PF_HEURISTIC heuristic = PF_HEURISTIC(mode);
 	CPathFind *p = *ppPf;
 
@@ -173,25 +255,37 @@ PF_PATH CPathFind::pathFind(const CSprite *pSprite)
 	// Quit if the reset fails or the goal is the start point.
 	if (m_start.pos == m_goal.pos) return PF_PATH();
 
+	if (search())
+	{
+		// Construct the path.
+		return constructPath(m_closedNodes.back(), pSprite);
+	}
+	return PF_PATH();
+}
+
+/*
+ * Run A* from m_start to m_goal.
+ */
+bool CPathFind::search(void)
+{
 	// Distance estimate for start node.
 	m_start.dist = distance(m_start, m_goal);
 	m_steps = 0;
 
 	m_openNodes.clear();
 	m_closedNodes.clear();
-	m_openNodes.push_back(m_start);
+	m_openIndex.clear();
+	m_closedIndex.clear();
+	pushOpenNode(m_start);
 
 	while (!m_openNodes.empty())
 	{
 		// Explore all open nodes until there are none left.
 		++m_steps;
-		std::vector<NODE>::iterator pos;
 		// Remove the best open node and add it to the closed nodes.
-		pos = bestOpenNode();
-		NODE *parent = &*pos;
-		m_closedNodes.push_back(*parent);
-		m_openNodes.erase(pos);
-		parent = &m_closedNodes.back();
+		m_closedNodes.push_back(popOpenNode());
+		NODE *parent = &m_closedNodes.back();
+		m_closedIndex[parent->pos] = m_closedNodes.size() - 1;
 
 		// Check if the goal has been reached.
 		if (parent->pos == m_goal.pos || m_steps > PF_MAX_STEPS) break;
@@ -215,52 +309,43 @@ PF_PATH CPathFind::pathFind(const CSprite *pSprite)
 
 			// Check if the node has been closed via a different route,
 			// and if so, whether this is a more efficient route.
-			NV_ITR k;
-			for (k = m_closedNodes.begin(); k != m_closedNodes.end(); ++k)
+			PF_NODE_INDEX::const_iterator k = m_closedIndex.find(child.pos);
+			if (k != m_closedIndex.end())
 			{
-				if (k->pos == child.pos)
+				NODE &closed = m_closedNodes[k->second];
+				if (closed.cost > child.cost)
 				{
-					if(k->cost > child.cost)
-					{
-						// Replace the closed node.
-						*k = child;
-					}
-					break;
+					// Replace the closed node.
+					closed = child;
 				}
+				// If the child was closed, nothing else needs doing.
+				continue;
 			}
-			// If the child was closed, nothing else needs doing.
-			if (k != m_closedNodes.end()) continue;
 	
 			// Check if the node has been opened via a different route,
 			// and if so, whether this is a more efficient route.
-			for (k = m_openNodes.begin(); k != m_openNodes.end(); ++k)
+			k = m_openIndex.find(child.pos);
+			if (k != m_openIndex.end())
 			{
-				if (k->pos == child.pos)
+				const int i = k->second;
+				if (m_openNodes[i].fValue() > child.fValue())
 				{
-					if (k->fValue() > child.fValue())
-					{
-						// Replace the opened node. 
-						*k = child;
-					}
-					break;
+					// Replace the opened node; its f-value can only
+					// have decreased.
+					m_openNodes[i] = child;
+					siftUp(i);
 				}
+				continue;
 			}
-			if (k != m_openNodes.end()) continue;
 
 			// If child is not open or closed, open it.
-			m_openNodes.push_back(child);
+			pushOpenNode(child);
 
 		} // for (all points)
 
 	} // while (!open.empty())
 
-	if (m_closedNodes.back().pos == m_goal.pos)
-	{
-		// Construct the path.
-		return constructPath(m_closedNodes.back(), pSprite);
-	}
-	return PF_PATH();
-		
+	return (m_closedNodes.back().pos == m_goal.pos);
 }
 
 /*
@@ -269,6 +354,124 @@ PF_PATH CPathFind::pathFind(const CSprite *pSprite)
  ********************************************************************
  */
 
+/*
+ * Search the abstract graph from m_start to m_goal and then refine
+ * each step of the result with a short A* search, joining the pieces
+ * in m_closedNodes as though found by a single search.
+ */
+bool CTilePathFind::abstractSearch(void)
+{
+	if (!m_pGraph || m_pGraph->nodes.empty()) return false;
+
+	// Searches within a cluster are left to plain A*.
+	const int startCluster = cluster(m_start.pos), goalCluster = cluster(m_goal.pos);
+	if (startCluster == goalCluster) return false;
+
+	const PF_GRAPH &graph = *m_pGraph;
+
+	// Temporarily connect the start and goal to the nodes in their clusters.
+	PF_NODE_INDEX fromStart, toGoal;
+	clusterCosts(m_start.pos, startCluster, fromStart, false);
+	clusterCosts(m_goal.pos, goalCluster, toGoal, false);
+
+	// The goal is given the index after the last node.
+	const int goal = graph.nodes.size();
+	std::vector<int> costs(goal + 1, INT_MAX), parents(goal + 1, -1);
+	std::vector<bool> closed(goal + 1, false);
+
+	// Open nodes, by negated f-value.
+	std::priority_queue<std::pair<int, int> > open;
+
+	std::map<int, std::vector<int> >::const_iterator c = graph.clusters.find(startCluster);
+	if (c != graph.clusters.end())
+	{
+		for (std::vector<int>::const_iterator i = c->second.begin(); i != c->second.end(); ++i)
+		{
+			PF_NODE_INDEX::const_iterator j = fromStart.find(graph.nodes[*i].pos);
+			if (j == fromStart.end()) continue;
+			costs[*i] = j->second;
+			open.push(std::make_pair(-(j->second + distance(NODE(graph.nodes[*i].pos), m_goal)), *i));
+		}
+	}
+
+	while (!open.empty())
+	{
+		const int n = open.top().second;
+		open.pop();
+		if (n == goal) break;
+		if (closed[n]) continue;
+		closed[n] = true;
+
+		const PF_GRAPH_NODE &node = graph.nodes[n];
+		for (std::vector<PF_EDGE>::const_iterator i = node.edges.begin(); i != node.edges.end(); ++i)
+		{
+			const int cost = costs[n] + i->cost;
+			if (cost >= costs[i->node]) continue;
+			costs[i->node] = cost;
+			parents[i->node] = n;
+			open.push(std::make_pair(-(cost + distance(NODE(graph.nodes[i->node].pos), m_goal)), i->node));
+		}
+		if (node.cluster == goalCluster)
+		{
+			PF_NODE_INDEX::const_iterator i = toGoal.find(node.pos);
+			if (i != toGoal.end() && costs[n] + i->second < costs[goal])
+			{
+				costs[goal] = costs[n] + i->second;
+				parents[goal] = n;
+				open.push(std::make_pair(-costs[goal], goal));
+			}
+		}
+	}
+
+	// No abstract route: leave the verdict to a flat search, which
+	// does not depend on where the entrances were placed.
+	if (costs[goal] == INT_MAX) return false;
+
+	const NODE start = m_start, end = m_goal;
+
+	// The points to pass through, from the start.
+	std::vector<DB_POINT> points(1, end.pos);
+	for (int i = parents[goal]; i != -1; i = parents[i])
+	{
+		points.push_back(graph.nodes[i].pos);
+	}
+	points.push_back(start.pos);
+	std::reverse(points.begin(), points.end());
+
+	// Refine each step, chaining the resulting nodes by their parents.
+	std::vector<NODE> chain(1, start);
+	for (std::vector<DB_POINT>::const_iterator i = points.begin(); i != points.end() - 1; ++i)
+	{
+		if (*i == *(i + 1)) continue;
+
+		m_start = NODE(*i);
+		m_goal = NODE(*(i + 1));
+		if (!search())
+		{
+			// Blocked by a sprite.
+			m_start = start;
+			m_goal = end;
+			return false;
+		}
+
+		std::vector<NODE> nodes;
+		for (NODE node = m_closedNodes.back(); node.pos != m_start.pos; node = m_closedNodes[node.parent])
+		{
+			nodes.push_back(node);
+		}
+		for (std::vector<NODE>::reverse_iterator j = nodes.rbegin(); j != nodes.rend(); ++j)
+		{
+			j->parent = chain.size() - 1;
+			chain.push_back(*j);
+		}
+	}
+
+	m_closedNodes.swap(chain);
+	m_start = start;
+	m_goal = end;
+	return true;
+}
+
 /*
  * Add a vector to the collision matrix.
  */
@@ -350,6 +553,215 @@ void CTilePathFind::addVector(CVector &vector, PF_SWEEPS &sweeps, PF_MATRIX &poi
 	} // for (x)
 }
 
+/*
+ * Create the abstract graph for the board matrix. Entrances are runs
+ * of grid points along the border of two clusters that allow movement
+ * across it; each gives a pair of nodes at its middle, or at its ends
+ * if it is long.
+ */
+void CTilePathFind::buildGraph(PF_GRAPH &graph) const
+{
+	extern LPBOARD g_pBoard;
+
+	graph.nodes.clear();
+	graph.clusters.clear();
+	graph.index.clear();
+
+	// Movement across borders, by cluster pair and direction.
+	typedef std::map<std::pair<std::pair<int, int>, int>, std::vector<PF_CROSSING> > PF_CROSSINGS;
+	PF_CROSSINGS crossings;
+
+	const COORD_TYPE coord = m_isIso ? ISO_ROTATED : TILE_NORMAL;
+	const int first = (m_heuristic == PF_AXIAL && m_isIso ? MV_SE : MV_E);
+	const int inc = (m_heuristic == PF_AXIAL ? 2 : 1);
+
+	// Visit each grid point, as addVector() does.
+	long left = 0, top = 0;
+	coords::roundToTile(left, top, m_isIso, true);
+
+	int dy = 0;
+	for (int x = left; x <= g_pBoard->pxWidth(); x += 32)
+	{
+		for (int y = top + dy; y <= g_pBoard->pxHeight(); y += 32)
+		{
+			NODE from;
+			from.pos.x = x;
+			from.pos.y = y;
+			const int c = cluster(from.pos);
+
+			for (int k = first; k <= MV_NE; k += inc)
+			{
+				NODE to;
+				to.pos.x = g_directions[m_isIso][k][0] * PF_GRID_SIZE + x;
+				to.pos.y = g_directions[m_isIso][k][1] * PF_GRID_SIZE + y;
+				to.direction = MV_ENUM(k);
+
+				const int d = cluster(to.pos);
+				if (d == c || !canMove(to, from, false)) continue;
+
+				PF_CROSSING crossing;
+				crossing.i = x;
+				crossing.j = y;
+				coords::pixelToTile(crossing.i, crossing.j, coord, false, g_pBoard->sizeX);
+				crossing.from = from.pos;
+				crossing.to = to.pos;
+				crossings[std::make_pair(std::make_pair(c, d), k)].push_back(crossing);
+			}
+		}
+		// Ensure isometric columns are vertically offset correctly.
+		if (m_isIso) dy = abs(dy - 16);
+	}
+
+	// Place nodes at the entrances.
+	for (PF_CROSSINGS::iterator i = crossings.begin(); i != crossings.end(); ++i)
+	{
+		std::vector<PF_CROSSING> &v = i->second;
+		std::sort(v.begin(), v.end());
+
+		std::vector<PF_CROSSING>::const_iterator run = v.begin();
+		for (std::vector<PF_CROSSING>::const_iterator j = v.begin(); j != v.end(); ++j)
+		{
+			// Continue the run while the points are adjacent and movement
+			// along the border between them is not blocked; a run split by
+			// a vector may lie in parts that cannot reach each other.
+			if (j + 1 != v.end() && 
+				abs((j + 1)->i - j->i) + abs((j + 1)->j - j->j) == 1 &&
+				canStep(j->from, (j + 1)->from) && canStep(j->to, (j + 1)->to)) continue;
+
+			std::vector<PF_CROSSING>::const_iterator entrances[2] = {run + (j - run) / 2, j};
+			if (j - run + 1 > PF_ENTRANCE_RUN) entrances[0] = run;
+			const int count = (j - run + 1 > PF_ENTRANCE_RUN ? 2 : 1);
+
+			for (int k = 0; k != count; ++k)
+			{
+				int nodes[2] = {0, 0};
+				const DB_POINT pts[2] = {entrances[k]->from, entrances[k]->to};
+				for (int m = 0; m != 2; ++m)
+				{
+					PF_NODE_INDEX::const_iterator n = graph.index.find(pts[m]);
+					if (n != graph.index.end())
+					{
+						nodes[m] = n->second;
+						continue;
+					}
+					PF_GRAPH_NODE node;
+					node.pos = pts[m];
+					node.cluster = cluster(pts[m]);
+					nodes[m] = graph.nodes.size();
+					graph.nodes.push_back(node);
+					graph.index[pts[m]] = nodes[m];
+					graph.clusters[node.cluster].push_back(nodes[m]);
+				}
+				const PF_EDGE edge = {nodes[1], distance(NODE(pts[0]), NODE(pts[1]))};
+				graph.nodes[nodes[0]].edges.push_back(edge);
+			}
+			run = j + 1;
+		}
+	}
+
+	// Join the nodes within each cluster.
+	PF_NODE_INDEX costs;
+	for (std::map<int, std::vector<int> >::const_iterator i = graph.clusters.begin(); i != graph.clusters.end(); ++i)
+	{
+		for (std::vector<int>::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
+		{
+			clusterCosts(graph.nodes[*j].pos, i->first, costs, false);
+			for (std::vector<int>::const_iterator k = i->second.begin(); k != i->second.end(); ++k)
+			{
+				if (k == j) continue;
+				PF_NODE_INDEX::const_iterator m = costs.find(graph.nodes[*k].pos);
+				if (m == costs.end()) continue;
+				const PF_EDGE edge = {*k, m->second};
+				graph.nodes[*j].edges.push_back(edge);
+			}
+		}
+	}
+}
+
+/*
+ * Determine if two neighbouring grid points can each be reached from
+ * the other in a single step, ignoring sprites.
+ */
+bool CTilePathFind::canStep(const DB_POINT &a, const DB_POINT &b) const
+{
+	const int first = (m_heuristic == PF_AXIAL && m_isIso ? MV_SE : MV_E);
+	const int inc = (m_heuristic == PF_AXIAL ? 2 : 1);
+
+	for (int k = first; k <= MV_NE; k += inc)
+	{
+		NODE to;
+		to.pos.x = g_directions[m_isIso][k][0] * PF_GRID_SIZE + a.x;
+		to.pos.y = g_directions[m_isIso][k][1] * PF_GRID_SIZE + a.y;
+		if (to.pos != b) continue;
+
+		// The step back is in the opposite direction.
+		to.direction = MV_ENUM(k);
+		NODE from(a);
+		from.direction = MV_ENUM((k + 3) % 8 + 1);
+		return canMove(to, NODE(a), false) && canMove(from, to, false);
+	}
+	return false;
+}
+
+/*
+ * Cluster containing a grid point.
+ */
+int CTilePathFind::cluster(const DB_POINT &pt) const
+{
+	extern LPBOARD g_pBoard;
+
+	int i = int(pt.x), j = int(pt.y);
+	coords::pixelToTile(i, j, m_isIso ? ISO_ROTATED : TILE_NORMAL, false, g_pBoard->sizeX);
+
+	// Keep points outside the board apart from those inside it.
+	if (i < 0 || j < 0) return -1;
+	return (i / PF_CLUSTER_SIZE) * 0x10000 + (j / PF_CLUSTER_SIZE);
+}
+
+/*
+ * Find the cost of reaching each point of a cluster from a point in it
+ * (Dijkstra's algorithm, limited to the cluster).
+ */
+void CTilePathFind::clusterCosts(const DB_POINT &from, const int cluster, PF_NODE_INDEX &costs, const bool bSprites) const
+{
+	const int first = (m_heuristic == PF_AXIAL && m_isIso ? MV_SE : MV_E);
+	const int inc = (m_heuristic == PF_AXIAL ? 2 : 1);
+
+	// Points reached, and the open points by negated cost.
+	std::vector<DB_POINT> points(1, from);
+	std::priority_queue<std::pair<int, int> > open;
+
+	costs.clear();
+	costs[from] = 0;
+	open.push(std::make_pair(0, 0));
+
+	while (!open.empty())
+	{
+		const int cost = -open.top().first;
+		const NODE parent(points[open.top().second]);
+		open.pop();
+		if (costs[parent.pos] < cost) continue;
+
+		for (int k = first; k <= MV_NE; k += inc)
+		{
+			NODE child;
+			child.pos.x = g_directions[m_isIso][k][0] * PF_GRID_SIZE + parent.pos.x;
+			child.pos.y = g_directions[m_isIso][k][1] * PF_GRID_SIZE + parent.pos.y;
+			child.direction = MV_ENUM(k);
+
+			if (this->cluster(child.pos) != cluster || !canMove(child, parent, bSprites)) continue;
+
+			const int c = cost + distance(parent, child);
+			PF_NODE_INDEX::iterator i = costs.find(child.pos);
+			if (i != costs.end() && i->second <= c) continue;
+
+			costs[child.pos] = c;
+			points.push_back(child.pos);
+			open.push(std::make_pair(-c, int(points.size() - 1)));
+		}
+	}
+}
+
 /*
  * Make the path by tracing parents through m_closedNodes.
  */
@@ -455,6 +867,8 @@ void CTilePathFind::initialize(const CSprite *pSprite)
 		// If m_boardPoints[cpfv] exists, then m_sweeps[cv] will also
 		// exist, since they are both created below.
 		m_pSweeps = &m_sweeps[cvBase];
+		m_pGraph = &m_graphs[std::make_pair(cpfvBase, int(m_heuristic))];
+		if (m_pGraph->nodes.empty()) buildGraph(*m_pGraph);
 		return;
 	}
 
@@ -499,12 +913,16 @@ void CTilePathFind::initialize(const CSprite *pSprite)
 	// isn't important if the static data are cleared when the board changes.
 	m_boardPoints[cpfvBase] = points;
 	m_pBoardPoints = &m_boardPoints[cpfvBase];
+
+	// Build the abstract graph now, rather than on the first long search.
+	m_pGraph = &m_graphs[std::make_pair(cpfvBase, int(m_heuristic))];
+	buildGraph(*m_pGraph);
 }
 
 /*
- * Determine if a node can be directly reached from another node
+ * Determine if a node can be directly reached from another node.
  */
-bool CTilePathFind::isChild(const NODE &child, const NODE &parent) const
+bool CTilePathFind::canMove(const NODE &child, const NODE &parent, const bool bSprites) const
 {
 	extern LPBOARD g_pBoard;
 
@@ -519,11 +937,28 @@ bool CTilePathFind::isChild(const NODE &child, const NODE &parent) const
 	if (i < pts.size() && j < pts[0].size())
 	{
 		const PF_MATRIX_ELEMENT dir = 1 << (child.direction - 1);
-		if ((pts[i][j] & dir) || (m_spritePoints[i][j] & dir)) return false;
+		if ((pts[i][j] & dir) || (bSprites && (m_spritePoints[i][j] & dir))) return false;
 	}
 	return true;
 }
 
+/*
+ * Main function - search hierarchically, or plainly over short
+ * distances or if sprites block the way.
+ */
+PF_PATH CTilePathFind::pathFind(const CSprite *pSprite)
+{
+	if (m_start.pos == m_goal.pos) return PF_PATH();
+
+	if (!abstractSearch()) return CPathFind::pathFind(pSprite);
+
+	if (m_closedNodes.back().pos == m_goal.pos)
+	{
+		return constructPath(m_closedNodes.back(), pSprite);
+	}
+	return PF_PATH();
+}
+
 /*
  * Reset the points at the start of a search.
  */
@@ -821,6 +1256,7 @@ int CVectorPathFind::distance(const NODE &a, const NODE &b) const
 void CVectorPathFind::freeData(void) 
 { 
 	m_pBoardVectors = NULL; 
+	m_pVisibility = NULL;
 	for (PF_VECTOR_OBS::iterator i = m_spriteVectors.begin(); i != m_spriteVectors.end(); ++i)
 	{
 		delete *i;
@@ -837,6 +1273,7 @@ void CVectorPathFind::freeStatics(void)
 		}
 	}
 	m_boardVectors.clear();
+	m_visibility.clear();
 }
 
 /*
@@ -850,6 +1287,7 @@ bool CVectorPathFind::getChild(NODE &child, NODE &parent)
 		return false;
 	}
 	child.pos = *m_nextPoint;
+	m_childIndex = m_nextPoint - m_points.begin();
 	++m_nextPoint;
 	return true;
 }
@@ -880,6 +1318,7 @@ void CVectorPathFind::initialize(const CSprite *pSprite)
 		// Tracking users will prove too complicated and isn't important
 		// if the static data are cleared when the board changes.
 		m_pBoardVectors = &i->second;
+		m_pVisibility = &m_visibility[cpfvBase];
 		return;
 	}
 
@@ -903,6 +1342,7 @@ void CVectorPathFind::initialize(const CSprite *pSprite)
 	// isn't important if the static data are cleared when the board changes.
 	m_boardVectors[cpfvBase] = obs;
 	m_pBoardVectors = &m_boardVectors[cpfvBase];	
+	m_pVisibility = &m_visibility[cpfvBase];
 }
 
 /*
@@ -917,11 +1357,36 @@ bool CVectorPathFind::isChild(const NODE &child, const NODE &parent) const
 	v.push_back(child.pos);
 	v.close(false);
 
+	// Board nodes follow the start and goal in m_points. The board
+	// does not change between searches, so whether two board nodes
+	// can see each other is remembered.
+	char *pVisible = NULL;
+	const int size = m_pVisibility ? m_pVisibility->size() : 0;
+	PF_NODE_INDEX::const_iterator j = m_pointIndex.find(parent.pos);
+	if (j != m_pointIndex.end() && j->second >= 2 && j->second < size + 2 && m_childIndex >= 2 && m_childIndex < size + 2)
+	{
+		pVisible = &(*m_pVisibility)[j->second - 2][m_childIndex - 2];
+		if (*pVisible == PF_HIDDEN) return false;
+	}
+
 	// Check for board collisions along the path.
 	PF_VECTOR_OBS::const_iterator i;
-	for (i = m_pBoardVectors->begin(); i != m_pBoardVectors->end(); ++i)
+	if (!pVisible || *pVisible == PF_UNKNOWN)
 	{
-		if ((*i) && (*i)->contains(v)) return false;		
+		char visible = PF_VISIBLE;
+		for (i = m_pBoardVectors->begin(); i != m_pBoardVectors->end(); ++i)
+		{
+			if ((*i) && (*i)->contains(v))
+			{
+				visible = PF_HIDDEN;
+				break;
+			}
+		}
+		if (pVisible)
+		{
+			*pVisible = (*m_pVisibility)[m_childIndex - 2][j->second - 2] = visible;
+		}
+		if (visible == PF_HIDDEN) return false;
 	}
 	// Check for sprite collisions.
 	for (i = m_spriteVectors.begin(); i != m_spriteVectors.end(); ++i)
@@ -991,6 +1456,13 @@ bool CVectorPathFind::reset(
 		}
 	}
 
+	// Board nodes are the same on every search (see isChild()).
+	const int nodes = m_points.size() - 2;
+	if (m_pVisibility->size() != nodes && nodes <= PF_VISIBILITY_MAX)
+	{
+		m_pVisibility->assign(nodes, std::vector<char>(nodes, PF_UNKNOWN));
+	}
+
 	// Generate sprite bases each time, since sprites will have moved.
 	for (i = m_spriteVectors.begin(); i != m_spriteVectors.end(); ++i)
 	{
@@ -1056,6 +1528,12 @@ bool CVectorPathFind::reset(
 	*(m_points.begin() + 1) = goal;
 	m_nextPoint = m_points.begin();
 
+	m_pointIndex.clear();
+	for (DB_ITR j = m_points.begin(); j != m_points.end(); ++j)
+	{
+		m_pointIndex.insert(std::make_pair(*j, int(j - m_points.begin())));
+	}
+
 	m_goal = NODE(goal);
 	m_start = NODE(start);
 
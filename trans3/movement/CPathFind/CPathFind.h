@@ -43,6 +43,7 @@
 #include "../CVector/CVector.h"
 #include "../../common/sprite.h"
 #include <vector>
+#include <hash_map>
 
 /*
  * Defines
@@ -85,6 +86,25 @@ typedef struct tagNode
 typedef std::vector<NODE>::iterator NV_ITR;
 typedef std::vector<DB_POINT> PF_PATH;
 
+// Hash traits for looking nodes up by position.
+typedef struct tagPfPointTraits
+{
+	enum { bucket_size = 4, min_buckets = 64 };
+
+	size_t operator()(const DB_POINT &p) const
+	{
+		return size_t(int(p.x) * 73856093) ^ size_t(int(p.y) * 19349663);
+	}
+	bool operator()(const DB_POINT &a, const DB_POINT &b) const
+	{
+		return (a.x < b.x || (a.x == b.x && a.y < b.y));
+	}
+
+} PF_POINT_TRAITS;
+
+// Offset of a node in m_openNodes or m_closedNodes, by position.
+typedef stdext::hash_map<DB_POINT, int, PF_POINT_TRAITS> PF_NODE_INDEX;
+
 class CSprite;
 class CPathFind
 {
@@ -116,8 +136,15 @@ protected:
 	CPathFind (CPathFind &rhs);
 	CPathFind &operator= (CPathFind &rhs);
 
-	// Find the node with the lowest f-value.
-	std::vector<NODE>::iterator bestOpenNode (void);
+	// Remove and return the open node with the lowest f-value.
+	NODE popOpenNode(void);
+
+	// Add a node to the open nodes.
+	void pushOpenNode(const NODE &node);
+
+	// Restore the heap order of m_openNodes about a node.
+	void siftUp(int i);
+	void siftDown(int i);
 
 	// Make the path by tracing parents through m_closedNodes.
 	virtual PF_PATH constructPath(NODE node, const CSprite *pSprite) const { return PF_PATH(); }
@@ -135,7 +162,11 @@ protected:
 	virtual bool isChild(const NODE &child, const NODE &parent) const { return false; }
 
 	// Main function - apply the algorithm to the input points.
-	PF_PATH pathFind(const CSprite *pSprite);
+	virtual PF_PATH pathFind(const CSprite *pSprite);
+
+	// Run A* from m_start to m_goal, leaving the explored nodes in
+	// m_closedNodes. Returns whether the goal was reached.
+	bool search(void);
 
 	// Reset the points at the start of a search.
 	virtual bool reset(
@@ -146,8 +177,10 @@ protected:
 		const int flags
 	) { return false; }
 
-	std::vector<NODE> m_openNodes;
+	std::vector<NODE> m_openNodes;		// Binary heap on f-value.
 	std::vector<NODE> m_closedNodes;
+	PF_NODE_INDEX m_openIndex;			// Position of each node in m_openNodes.
+	PF_NODE_INDEX m_closedIndex;		// Position of each node in m_closedNodes.
 	NODE m_start;
 	NODE m_goal;
 	bool m_movedStart;
@@ -163,9 +196,9 @@ protected:
 class CTilePathFind: public CPathFind
 {
 public:
-	CTilePathFind(): m_nextDir(MV_E), m_pBoardPoints(NULL), m_pSweeps(NULL) {}
-	void freeData(void) { m_pBoardPoints = NULL; m_pSweeps = NULL; }
-	static void freeStatics(void) { m_boardPoints.clear(); m_sweeps.clear(); }
+	CTilePathFind(): m_nextDir(MV_E), m_pBoardPoints(NULL), m_pSweeps(NULL), m_pGraph(NULL) {}
+	void freeData(void) { m_pBoardPoints = NULL; m_pSweeps = NULL; m_pGraph = NULL; }
+	static void freeStatics(void) { m_boardPoints.clear(); m_sweeps.clear(); m_graphs.clear(); }
 
 	typedef unsigned char PF_MATRIX_ELEMENT;
 	typedef std::vector<std::vector<PF_MATRIX_ELEMENT> > PF_MATRIX;
@@ -176,30 +209,80 @@ public:
 	typedef PF_SWEEPS *LPPF_SWEEPS;
 	typedef std::map<CVector, PF_SWEEPS> PF_SWEEP_MAP;
 
+	// Abstract graph of the board for hierarchical searches. The board
+	// is divided into square clusters of grid points; nodes are placed
+	// either side of the entrances between clusters and joined by the
+	// cost of the shortest route between them within a cluster.
+	typedef struct tagPfEdge
+	{
+		int node;						// Target node in PF_GRAPH::nodes.
+		int cost;						// Cost of the route to the target.
+	} PF_EDGE;
+
+	typedef struct tagPfGraphNode
+	{
+		DB_POINT pos;
+		int cluster;
+		std::vector<PF_EDGE> edges;
+	} PF_GRAPH_NODE;
+
+	typedef struct tagPfGraph
+	{
+		std::vector<PF_GRAPH_NODE> nodes;
+		std::map<int, std::vector<int> > clusters;	// Nodes in each cluster.
+		PF_NODE_INDEX index;						// Node at each position.
+	} PF_GRAPH;
+	typedef PF_GRAPH *LPPF_GRAPH;
+	typedef std::map<std::pair<CPfVector, int>, PF_GRAPH> PF_GRAPH_MAP;
+
 private:
 	PF_PATH constructPath(NODE node, const CSprite *) const;
 	int distance(const NODE &a, const NODE &b) const;
 	void initialize(const CSprite *pSprite);
-	bool isChild(const NODE &child, const NODE &parent) const;
+	bool isChild(const NODE &child, const NODE &parent) const { return canMove(child, parent, true); }
 	bool getChild(NODE &child, NODE &parent);
+	PF_PATH pathFind(const CSprite *pSprite);
 	bool reset(DB_POINT start, DB_POINT goal, const int layer, const CSprite *pSprite,	const int flags);	
 
 	// Unique.
 	void addVector(CVector &vector, PF_SWEEPS &sweeps, PF_MATRIX &points);
 	void sizeMatrix(PF_MATRIX &points);
 
+	// Determine if a node can be reached from a neighbouring node, optionally
+	// ignoring sprites.
+	bool canMove(const NODE &child, const NODE &parent, const bool bSprites) const;
+
+	// Determine if two neighbouring grid points can each be reached from
+	// the other, ignoring sprites.
+	bool canStep(const DB_POINT &a, const DB_POINT &b) const;
+
+	// Cluster containing a grid point.
+	int cluster(const DB_POINT &pt) const;
+
+	// Find the cost of reaching the points of a cluster from a point in it.
+	void clusterCosts(const DB_POINT &from, const int cluster, PF_NODE_INDEX &costs, const bool bSprites) const;
+
+	// Create the abstract graph for the board matrix.
+	void buildGraph(PF_GRAPH &graph) const;
+
+	// Search the abstract graph and refine the result into m_closedNodes.
+	// Returns false if a flat search should be made instead.
+	bool abstractSearch(void);
+
 	static PF_TILE_MAP m_boardPoints;	// Board collision vector matrices for unique sprite bases.
 	static PF_SWEEP_MAP m_sweeps;		// Sweep set associated with the unique sprite bases.
+	static PF_GRAPH_MAP m_graphs;		// Abstract graphs of m_boardPoints, by heuristic.
 	PF_MATRIX m_spritePoints;			// Position of sprite collision bases at time of execution.
 	LPPF_MATRIX m_pBoardPoints;			// Pointer into m_boardPoints.
 	LPPF_SWEEPS m_pSweeps;				// Pointer into m_sweeps;
+	LPPF_GRAPH m_pGraph;				// Pointer into m_graphs.
 	int m_nextDir;						// Next neighbour (one of MV_ENUM).
 };
 
 class CVectorPathFind: public CPathFind
 {
 public:
-	CVectorPathFind(): m_nextPoint(), m_growSize(0), m_pBoardVectors() {}
+	CVectorPathFind(): m_nextPoint(), m_growSize(0), m_pBoardVectors(), m_pVisibility(NULL), m_childIndex(0) {}
 	void freeData(void);
 	static void freeStatics(void);
 
@@ -207,6 +290,13 @@ public:
 	typedef PF_VECTOR_OBS *LPPF_VECTOR_OBS;
 	typedef std::map<CPfVector, PF_VECTOR_OBS> PF_VECTOR_MAP;
 
+	// Whether each pair of board nodes can see each other past the
+	// board vectors - one of PF_VISIBLE_ENUM, filled in as required.
+	typedef std::vector<std::vector<char> > PF_VISIBILITY;
+	typedef PF_VISIBILITY *LPPF_VISIBILITY;
+	typedef std::map<CPfVector, PF_VISIBILITY> PF_VISIBILITY_MAP;
+	enum PF_VISIBLE_ENUM { PF_UNKNOWN, PF_VISIBLE, PF_HIDDEN };
+
 private:
 	PF_PATH constructPath(NODE node, const CSprite *pSprite) const;
 	int distance(const NODE &a, const NODE &b) const;
@@ -221,6 +311,11 @@ private:
 	static PF_VECTOR_MAP m_boardVectors;
 	LPPF_VECTOR_OBS m_pBoardVectors;
 
+	static PF_VISIBILITY_MAP m_visibility;		// Visibility of board nodes, by sprite base.
+	LPPF_VISIBILITY m_pVisibility;				// Pointer into m_visibility.
+	PF_NODE_INDEX m_pointIndex;					// First offset of each point in m_points.
+	int m_childIndex;							// Offset of the last child in m_points.
+
 	DB_ITR m_nextPoint;							// Currently selected point in "points".
 	int m_growSize;								// Pixel value to expand collision vectors by.
 };
@@ -47,8 +47,10 @@
 #include "../../fight/fight.h"
 #include "../../audio/CAudioSegment.h"
 #include "../../rpgcode/CProgram.h"
+#include "../../input/input.h"
 #include <math.h>
 #include <vector>
+#include <algorithm>
 
 bool CSprite::m_bDoneMove = false;
 int CSprite::m_loopOffset = 0;
@@ -96,7 +98,7 @@ bool CSprite::move(const CSprite *selectedPlayer, const bool bRunningProgram)
 	if (m_pos.loopFrame == LOOP_FREEZE)
 	{
 		// Return true because sprite will resume movement.
-		if (GetTickCount() - m_pos.timer.frameTime < m_pos.timer.idleTime) return true;
+		if (engineTime() - m_pos.timer.frameTime < m_pos.timer.idleTime) return true;
 
 		m_pos.loopFrame = LOOP_WAIT;
 		m_pos.timer.idleTime = m_pos.timer.frameTime = 0;
@@ -205,14 +207,18 @@ bool CSprite::move(const CSprite *selectedPlayer, const bool bRunningProgram)
 				CVector sprBase = m_attr.vBase + pt;
 				
 				int dest = m_pos.l;
-				for (std::vector<BRD_VECTOR>::const_iterator i = g_pBoard->vectors.begin(); i != g_pBoard->vectors.end(); ++i)
+				std::vector<int> nearby;
+				g_pBoard->vectorsNear(sprBase.getBounds(), m_pos.l, nearby);
+				for (std::vector<int>::const_iterator n = nearby.begin(); n != nearby.end(); ++n)
 				{
-					if ((i->type & TT_STAIRS) && (i->layer == m_pos.l) && i->pV->contains(sprBase, pt))
+					const BRD_VECTOR &v = g_pBoard->vectors[*n];
+					if ((v.type & TT_STAIRS) && (v.layer == m_pos.l) && v.pV->contains(sprBase, pt))
 					{
-						dest = i->attributes;
+						dest = v.attributes;
 					}
 				}
 				m_pos.l = dest;
+				g_sprites.update(this);
 			
 				CSprite *pSprite = NULL;
 				if (spriteCollisions(pSprite) & TT_SOLID)
@@ -235,10 +241,10 @@ bool CSprite::move(const CSprite *selectedPlayer, const bool bRunningProgram)
 				// Increment the user's frame always to indicate user input.
 				++m_pos.loopFrame;				// Count of this movement's renders.
 			
-				if (GetTickCount() - m_pos.timer.frameTime >= m_pos.timer.frameDelay)
+				if (engineTime() - m_pos.timer.frameTime >= m_pos.timer.frameDelay)
 				{
 					++m_pos.frame;				// Animation frames.
-					m_pos.timer.frameTime = GetTickCount();			
+					m_pos.timer.frameTime = engineTime();			
 				}
 			}
 		}
@@ -247,10 +253,10 @@ bool CSprite::move(const CSprite *selectedPlayer, const bool bRunningProgram)
 			// Push the sprite only when the tiletype is passable.
 			push(isUser);
 			++m_pos.loopFrame;
-			if (GetTickCount() - m_pos.timer.frameTime >= m_pos.timer.frameDelay)
+			if (engineTime() - m_pos.timer.frameTime >= m_pos.timer.frameDelay)
 			{
 				++m_pos.frame;
-				m_pos.timer.frameTime = GetTickCount();			
+				m_pos.timer.frameTime = engineTime();			
 			}
 		}
 
@@ -281,10 +287,11 @@ bool CSprite::move(const CSprite *selectedPlayer, const bool bRunningProgram)
 			{
 				m_pos.x = m_pos.target.x;
 				m_pos.y = m_pos.target.y;
+				g_sprites.update(this);
 			}
 
 			// Start the idle timer.
-			m_pos.timer.idleTime = GetTickCount();
+			m_pos.timer.idleTime = engineTime();
 
 			// Set the state to LOOP_DONE so as to immediately
 			// increment the frame when movement starts again
@@ -347,6 +354,9 @@ bool CSprite::push(const bool bScroll)
 	m_pos.x += stepSize * m_v.x;
 	m_pos.y += stepSize * m_v.y;
 
+	extern ZO_VECTOR g_sprites;
+	g_sprites.update(this);
+
 	scx += round(m_pos.x); scy += round(m_pos.y);
 
 	// Scroll the board for players. Either set for all players, or only selected player
@@ -528,7 +538,7 @@ bool CSprite::handleCollision(CSprite &sprite)
 		{
 			sprite.m_pos.loopFrame = LOOP_FREEZE;
 			sprite.m_pos.timer.idleTime = freeze;
-			sprite.m_pos.timer.frameTime = GetTickCount();
+			sprite.m_pos.timer.frameTime = engineTime();
 		}
 		return result;
 	}
@@ -539,7 +549,7 @@ bool CSprite::handleCollision(CSprite &sprite)
 	{
 		m_pos.loopFrame = LOOP_FREEZE;
 		m_pos.timer.idleTime = freeze;
-		m_pos.timer.frameTime = GetTickCount();
+		m_pos.timer.frameTime = engineTime();
 	}
 
 	// Return true because sprite will resume movement.
@@ -763,12 +773,12 @@ void CSprite::runQueuedMovements(void)
 
 	while (move(g_pSelectedPlayer, true))
 	{
-		DWORD t = GetTickCount();
+		DWORD t = engineTime();
 		renderNow(g_cnvRpgCode, true);
 		renderRpgCodeScreen();
 		processEvent();
 
-		DWORD reframe = GetTickCount();
+		DWORD reframe = engineTime();
 		DWORD remaining = reframe - t - frame;
 		reframe = reframe - t;
 
@@ -880,6 +890,9 @@ void CSprite::setPosition(int x, int y, const int l, const COORD_TYPE coord)
 	m_pos.target.y = m_pos.y = y;
 	m_pos.l = l;
 
+	extern ZO_VECTOR g_sprites;
+	g_sprites.update(this);
+
 	// Take this command to mean movement has halted.
 	m_pos.path.clear();
 	m_pos.loopFrame = LOOP_DONE;
@@ -966,9 +979,12 @@ TILE_TYPE CSprite::boardCollisions(LPBOARD board, const bool recursing)
 	CVector sprBase = m_attr.vBase + p;
 	int layer = m_pos.l;				// Destination layer.
 
-	// Loop over the board CVectors and check for intersections.
-	for (std::vector<BRD_VECTOR>::iterator i = board->vectors.begin(); i != board->vectors.end(); ++i)
+	// Loop over the board CVectors near the sprite and check for intersections.
+	std::vector<int> nearby;
+	board->vectorsNear(sprBase.getBounds(), m_pos.l, nearby);
+	for (std::vector<int>::const_iterator n = nearby.begin(); n != nearby.end(); ++n)
 	{
+		const LPBRD_VECTOR i = &board->vectors[*n];
 		if (i->type == TT_UNDER || i->layer != m_pos.l) continue;
 
 		TILE_TYPE tt = TT_NORMAL;
@@ -1098,115 +1114,55 @@ TILE_TYPE CSprite::boardCollisions(LPBOARD board, const bool recursing)
 	// Move the player to the target layer (if stairs were encountered).
 	m_pos.l = layer;
 
+	extern ZO_VECTOR g_sprites;
+	g_sprites.update(this);
+
 	return tileTypes;
 }
 
 /*
  * Check for collisions with other sprite base vectors. Currently only
  * returns TT_SOLID or TT_NORMAL, as all sprites default to solid.
- * Also, z-order sprites.
  */
 TILE_TYPE CSprite::spriteCollisions(CSprite *&pSprite)
 {
 	extern ZO_VECTOR g_sprites;
-	extern LPBOARD g_pBoard;
 
 	/*
-	 * Check for collisions against all sprites and return the tiletype
+	 * Check for collisions against nearby sprites and return the tiletype
 	 * (currently only solid or normal, but sprites could be given their
-	 * own tiletypes).
-	 * Also z-order sprites as we search for collisions:
-	 * z-ordered (ZO) sprite pointers are stored in g_sprites.
-	 * Upon board loading, the initial ZO is calculated for all sprites.
-	 * We only need to alter that order when a sprite moves, and then
-	 * we only need to recalculate that sprite's ZO - the others' are preserved.
-	 * Hence we remove the pointer from g_sprites, make the checks
-	 * and reinsert afterwards.
-	 * The position to insert will be the in front of the first pointer
-	 * we find that is below this sprite.
+	 * own tiletypes). Z-ordering is left to ZO_VECTOR::sort().
 	 */
 
-	// Find this sprite's iterator in the z-ordered vector.
-	ZO_ITR i = g_sprites.find(this), pos;
-
-	// Remove the pointer from the vector if it was found.
-	if (i != g_sprites.v.end())
-		i = g_sprites.v.erase(i);
-
-	TILE_TYPE result = TT_NORMAL;			// To return.
-
 	// Create this sprite's vector base at the *target* location.
 	CVector sprBase = m_attr.vBase + getTarget();
 	const RECT bounds = sprBase.getBounds();
 
-	pos = g_sprites.v.end();
-	for (i = g_sprites.v.begin(); i != g_sprites.v.end(); ++i)
-	{
-		if (m_pos.l > (*i)->m_pos.l)
-		{
-			// *i is on a lower layer and is drawn before this.
-			// We want to insert this somewhere after *i.
-			// Also, we haven't collided with it.
-			continue;
-		}
-		if (m_pos.l < (*i)->m_pos.l)
-		{
-			// *i is on a higher layer, so we want to insert this somewhere
-			// before *i. If this is the *first* encounter of a sprite
-			// that is due to be drawn after this sprite, then we want
-			// to insert this before *i. pos is the iterator position
-			// we are going to insert this in front of.
-			if (pos == g_sprites.v.end()) pos = i;
-
-			// Also, we haven't collided with it.
-			continue;
-		}
+	// Only sprites filed in the cells around the target can collide.
+	std::vector<CSprite *> sprites;
+	g_sprites.nearby(bounds, m_pos.l, sprites);
 
-		// Compare target bases.
+	for (std::vector<CSprite *>::iterator i = sprites.begin(); i != sprites.end(); ++i)
+	{
+		if (*i == this || (*i)->m_pos.l != m_pos.l) continue;
 
 		// Compare this sprite's target to others' current positions.
+		// Allow a pixel for rounding.
+		const RECT r = (*i)->getBaseBounds();
+		if (r.right + 1 < bounds.left || r.left - 1 > bounds.right || r.bottom + 1 < bounds.top || r.top - 1 > bounds.bottom) continue;
+
 		const DB_POINT pt = {(*i)->m_pos.x, (*i)->m_pos.y};
 		CVector tarBase = (*i)->m_attr.vBase + pt;
-		const RECT tBounds = tarBase.getBounds();
-
-		const ZO_ENUM zo = tarBase.contains(sprBase);
-
-		if (!zo && pos == g_sprites.v.end())
-		{
-			// No rect intersect - compare on bounding box bottom-left
-			// corner position.
-			if ((bounds.bottom * g_pBoard->pxWidth() + bounds.left) <
-				(tBounds.bottom * g_pBoard->pxWidth() + tBounds.left))
-				pos = i;
-		}
-		else if (!(zo & ZO_ABOVE) && pos == g_sprites.v.end())
-		{
-			// If below sprite, we want to insert before i, but only
-			// if we don't have an insertion point already.
-			pos = i;
-		}
 
-		if (zo & ZO_COLLIDE)
+		if (tarBase.contains(sprBase) & ZO_COLLIDE)
 		{
 			// Hit another player.
-			// Record result and continue, to determine z-ordering
-			// against all sprites.
-			result = TT_SOLID;
 			pSprite = *i;
-
-			// If we already have an insertion point, no need to continue.
-			if (pos != g_sprites.v.end()) break;
+			return TT_SOLID;
 		}
-
-		// Compare origins? Merge origins and targets? (how?)
 	}
 
-	if (pos == g_sprites.v.end())
-		g_sprites.v.push_back(this);
-	else
-		g_sprites.v.insert(pos, this);
-
-	return result;
+	return TT_NORMAL;
 }
 
 /*
@@ -1405,7 +1361,8 @@ bool CSprite::programTest(const bool keypressOnly)
 	extern LPBOARD g_pBoard;
 	extern STRING g_projectPath;
 
-	CONST HKL hkl = GetKeyboardLayout(0);
+	// General activation key.
+	const bool bKeyDown = isKeyDown(g_mainFile.key);
 
 	// Create the sprite's vector base at the *target* location (for the
 	// case of pressing against an item, etc.)
@@ -1485,10 +1442,8 @@ bool CSprite::programTest(const bool keypressOnly)
 
 			if (pItm->m_brdData.activationType & SPR_KEYPRESS)
 			{
-				// General activation key. GetAsyncKeyState is
-				// negative if key is currently down.
-				const short state = GetAsyncKeyState(MapVirtualKeyEx(g_mainFile.key, 1, hkl));
-				if (state >= 0) continue;
+				// General activation key.
+				if (!bKeyDown) continue;
 			}
 			else if (keypressOnly) continue;
 
@@ -1566,20 +1521,28 @@ bool CSprite::programTest(const bool keypressOnly)
 	std::vector<LPBRD_PROGRAM>::iterator k = g_pBoard->programs.begin();
 	LPBRD_PROGRAM prg = NULL;
 
+	// Only the programs filed near the player can contain it.
+	std::vector<int> nearby;
+	g_pBoard->programsNear(sprBase.getBounds(), m_pos.l, nearby);
+	std::vector<int>::const_iterator n = nearby.begin();
+
 	for (; k != g_pBoard->programs.end(); ++k)
 	{
 		if (!*k) continue;
 
-		// Local copy of the program to avoid derefencing.
-		const BRD_PROGRAM bp = **k;
+		const BRD_PROGRAM &bp = **k;
 		double &distance = (*k)->distance;
 
 		if (bp.layer != m_pos.l) continue;
 
+		// Indices are in ascending order: skip to this program's.
+		const int index = k - g_pBoard->programs.begin();
+		while (n != nearby.end() && *n < index) ++n;
+
 		// Check that the board vector contains the player.
-		// We check *every* vector, in order to reset the 
+		// We visit *every* vector, in order to reset the 
 		// distance of those we have left.
-		if (!bp.vBase.contains(sprBase, p))
+		if (n == nearby.end() || *n != index || !bp.vBase.contains(sprBase, p))
 		{
 			// Not inside this vector. Set the distance to the 
 			// value to trigger program when we re-enter.
@@ -1620,8 +1583,7 @@ bool CSprite::programTest(const bool keypressOnly)
 			if (bp.activationType & PRG_KEYPRESS)
 			{
 				// General activation key - if not pressed, continue.
-				const short state = GetAsyncKeyState(MapVirtualKeyEx(g_mainFile.key, 1, hkl));
-				if (state >= 0) continue;
+				if (!bKeyDown) continue;
 			}
 			else if (keypressOnly) continue;
 
@@ -1825,25 +1787,161 @@ void tagZOrderedSprites::zOrder(void)
 
 	// Clear the current contents and re-insert the players and items.
 	v.clear();
+	m_grid.clear();
+	m_cells.clear();
 	// Reserve extra space for possible AddPlayers()/CreateItems().
 	v.reserve(g_players.size() + g_pBoard->items.size() + 16);
 
-	// Push one sprite onto the vector to start the process.
-	v.push_back(g_players.front());
+	// The first player is always included.
+	if (!g_players.empty()) file(g_players.front());
 
-	// Run spriteCollisions for every player and item, inserting them
-	// into v.
-	CSprite *pUnused = NULL;
 	for (std::vector<CPlayer *>::iterator i = g_players.begin(); i != g_players.end(); ++i)
 	{
-		if ((*i)->isActive()) (*i)->spriteCollisions(pUnused);
+		if ((*i)->isActive() && find(*i) == v.end()) file(*i);
 	}
 
 	for (std::vector<CItem *>::iterator j = g_pBoard->items.begin(); j != g_pBoard->items.end(); ++j)
 	{
 		// Some item entries may be NULL since users
 		// can insert items at any slot number.
-		if (*j && (*j)->isActive()) (*j)->spriteCollisions(pUnused);
+		if (*j && (*j)->isActive()) file(*j);
+	}
+
+	sort();
+}
+
+/*
+ * Restore the z-order after sprites have moved.
+ */
+void tagZOrderedSprites::sort(void)
+{
+	for (ZO_ITR i = v.begin(); i != v.end(); ++i)
+	{
+		// Move the sprite back until it is not below the one before.
+		CSprite *const p = *i;
+		ZO_ITR j = i;
+		for (; j != v.begin() && below(p, *(j - 1)); --j)
+		{
+			*j = *(j - 1);
+		}
+		*j = p;
+	}
+}
+
+/*
+ * Whether sprite a should be drawn before sprite b.
+ */
+bool tagZOrderedSprites::below(const CSprite *a, const CSprite *b)
+{
+	extern LPBOARD g_pBoard;
+
+	// Sprites on lower layers are drawn first.
+	if (a->getLayer() != b->getLayer()) return (a->getLayer() < b->getLayer());
+
+	const RECT ra = a->getBaseBounds(), rb = b->getBaseBounds();
+	if (ra.right + 1 >= rb.left && ra.left - 1 <= rb.right && ra.bottom + 1 >= rb.top && ra.top - 1 <= rb.bottom)
+	{
+		// The bases may overlap: compare the vectors.
+		const ZO_ENUM zo = b->getVectorBase(true).contains(a->getVectorBase(true));
+		if (zo) return !(zo & ZO_ABOVE);
+	}
+
+	// No intersect - compare on bounding box bottom-left corner position.
+	return ((ra.bottom * g_pBoard->pxWidth() + ra.left) < (rb.bottom * g_pBoard->pxWidth() + rb.left));
+}
+
+/*
+ * Find the cells covered by an area of a layer.
+ */
+ZO_CELLS tagZOrderedSprites::cellRange(const RECT &bounds, const int layer)
+{
+	// Floor division, allowing a pixel for rounding.
+	const ZO_CELLS cells = {
+		layer, {
+			int(floor((bounds.left - 1) / double(ZO_CELL_SIZE))),
+			int(floor((bounds.top - 1) / double(ZO_CELL_SIZE))),
+			int(floor((bounds.right + 1) / double(ZO_CELL_SIZE))),
+			int(floor((bounds.bottom + 1) / double(ZO_CELL_SIZE)))
+		}
+	};
+	return cells;
+}
+
+/*
+ * Add a sprite to the vector and the grid.
+ */
+void tagZOrderedSprites::file(CSprite *p)
+{
+	const ZO_CELLS cells = cellRange(p->getBaseBounds(), p->getLayer());
+	for (int x = cells.cells.left; x <= cells.cells.right; ++x)
+	{
+		for (int y = cells.cells.top; y <= cells.cells.bottom; ++y)
+		{
+			m_grid[cellKey(cells.layer, x, y)].push_back(p);
+		}
+	}
+	m_cells[p] = cells;
+	if (find(p) == v.end()) v.push_back(p);
+}
+
+/*
+ * Remove a sprite from the grid.
+ */
+void tagZOrderedSprites::unfile(const CSprite *p)
+{
+	std::map<const CSprite *, ZO_CELLS>::iterator i = m_cells.find(p);
+	if (i == m_cells.end()) return;
+
+	const ZO_CELLS &cells = i->second;
+	for (int x = cells.cells.left; x <= cells.cells.right; ++x)
+	{
+		for (int y = cells.cells.top; y <= cells.cells.bottom; ++y)
+		{
+			std::vector<CSprite *> &cell = m_grid[cellKey(cells.layer, x, y)];
+			cell.erase(std::remove(cell.begin(), cell.end(), p), cell.end());
+		}
+	}
+	m_cells.erase(i);
+}
+
+/*
+ * Re-file a sprite in the grid after it has moved. Sprites that are
+ * not in the vector are ignored.
+ */
+void tagZOrderedSprites::update(CSprite *p)
+{
+	std::map<const CSprite *, ZO_CELLS>::const_iterator i = m_cells.find(p);
+	if (i == m_cells.end()) return;
+
+	const ZO_CELLS cells = cellRange(p->getBaseBounds(), p->getLayer());
+	if (cells.layer == i->second.layer && EqualRect(&cells.cells, &i->second.cells)) return;
+
+	unfile(p);
+	file(p);
+}
+
+/*
+ * Find the sprites filed near an area of a layer.
+ */
+void tagZOrderedSprites::nearby(const RECT &bounds, const int layer, std::vector<CSprite *> &sprites) const
+{
+	const ZO_CELLS cells = cellRange(bounds, layer);
+	for (int x = cells.cells.left; x <= cells.cells.right; ++x)
+	{
+		for (int y = cells.cells.top; y <= cells.cells.bottom; ++y)
+		{
+			stdext::hash_map<unsigned int, std::vector<CSprite *> >::const_iterator i = m_grid.find(cellKey(layer, x, y));
+			if (i == m_grid.end()) continue;
+
+			// Sprites covering several cells are only returned once.
+			for (std::vector<CSprite *>::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
+			{
+				if (std::find(sprites.begin(), sprites.end(), *j) == sprites.end())
+				{
+					sprites.push_back(*j);
+				}
+			}
+		}
 	}
 }
 
@@ -1934,7 +2032,7 @@ void CSprite::customStance(const STRING stance, const CProgram *prg, const bool
 	
 	// Set .idleTime to hold the *number of frames this will run for*.
 	m_pos.timer.idleTime = m_pos.pAnm->data()->frameCount;
-	m_pos.timer.frameTime = GetTickCount();
+	m_pos.timer.frameTime = engineTime();
 
 	m_pos.loopFrame = LOOP_STANCE;
 	m_pos.frame = 0;				// Ensure that custom animations start at the first frame.
@@ -1993,7 +2091,7 @@ void CSprite::checkIdling(void)
 {
 	if (m_pos.loopFrame < LOOP_MOVE)
 	{
-		if ((m_pos.loopFrame == LOOP_WAIT) && m_pos.path.empty() && (GetTickCount() - m_pos.timer.idleTime >= m_attr.idleTime))
+		if ((m_pos.loopFrame == LOOP_WAIT) && m_pos.path.empty() && (engineTime() - m_pos.timer.idleTime >= m_attr.idleTime))
 		{
 			// Push into idle graphics if not already.
 
@@ -2011,7 +2109,7 @@ void CSprite::checkIdling(void)
 				m_pos.frame = 0;
 
 				// Set the timer for idleness.
-				m_pos.timer.frameTime = GetTickCount();
+				m_pos.timer.frameTime = engineTime();
 
 				// Frame delay for the idle animation.
 				m_pos.timer.frameDelay = m_pos.pAnm->data()->delay * MILLISECONDS;
@@ -2022,10 +2120,10 @@ void CSprite::checkIdling(void)
 		// the idle object.
 		if (m_pos.loopFrame == LOOP_IDLE || m_pos.loopFrame == LOOP_STANCE)
 		{
-			if (GetTickCount() - m_pos.timer.frameTime >= m_pos.timer.frameDelay)
+			if (engineTime() - m_pos.timer.frameTime >= m_pos.timer.frameDelay)
 			{
 				// Start the timer for this frame.
-				m_pos.timer.frameTime = GetTickCount();
+				m_pos.timer.frameTime = engineTime();
 
 				// End custom stances. idle.time stores the number of frames
 				// to run for, rather than time in stance instances!
@@ -2035,7 +2133,7 @@ void CSprite::checkIdling(void)
 					// last frame of the stance until it is interrupted
 					// by movement or another stance command.
 					m_pos.loopFrame = LOOP_STANCE_END;
-					m_pos.timer.idleTime = GetTickCount();
+					m_pos.timer.idleTime = engineTime();
 
 					// Free any thread that is waiting for the custom
 					// animation to finish.
@@ -2057,79 +2155,84 @@ void CSprite::checkIdling(void)
 }
 
 /*
- * Calculate sprite location and place on destination canvas.
+ * Bounds of the current frame on the board.
+ * Referencing with m_pos at the bottom-centre of the tile for
+ * 2D, in the centre of the tile for isometric. 
+ * Vertically offset iso sprites by 8 pixels, 2D sprites by 1 pixel.
+ * Latter is correction for BASE_POINT_Y not equal to 32.
  */
-bool CSprite::render(CCanvas *const cnv, const int layer, RECT &rect)
+RECT CSprite::frameBounds(void) const
 {
 	extern LPBOARD g_pBoard;
-	extern RECT g_screen;
-	extern double g_spriteTranslucency;
-
-	if (!m_pos.l) return false;
 
-	// If we're rendering the top layer, draw the translucent sprite.
-	if (layer != m_pos.l && 
-		(layer != g_pBoard->sizeL || !g_spriteTranslucency)
-		) return false;
-
-	// Screen location on board.
-	// Referencing with m_pos at the bottom-centre of the tile for
-	// 2D, in the centre of the tile for isometric. 
-	// Vertically offset iso sprites by 8 pixels, 2D sprites by 1 pixel.
-	// Latter is correction for BASE_POINT_Y not equal to 32.
 	const int centreX = round(m_pos.x),
 			  centreY = round(m_pos.y) + (g_pBoard->isIsometric() ? 8 : 1);
 
-	// Sprite location on screen and board.
-	RECT screen = {0}, board = {0};
-	bool bCheckIntersection = false;
+	const int left = centreX - (m_pCanvas->GetWidth() >> 1);
+	const RECT board = {left, centreY - m_pCanvas->GetHeight(), centreX - (left - centreX), centreY};
+	return board;
+}
+
+/*
+ * Advance the sprite's animation and get the frame to draw. Called
+ * once a frame, before rendering. Sprites off the screen are not
+ * animated.
+ *
+ * rect (out) - bounds of the frame on the board
+ * return (out) - is the frame on the screen?
+ */
+bool CSprite::prepareFrame(RECT &rect)
+{
+	extern RECT g_screen;
+
+	if (!m_pos.l) return false;
+
+	RECT screen = {0};
 	if (m_pCanvas)
 	{
-		// Frame has been loaded - can determine whether this sprite
-		// is on the board or not.
-		board.left = centreX - (m_pCanvas->GetWidth() >> 1);
-		board.top = centreY - m_pCanvas->GetHeight();
-		board.right = centreX - (board.left - centreX);
-		board.bottom = centreY;
-
-		// Off the screen!
+		const RECT board = frameBounds();
 		if (!IntersectRect(&screen, &board, &g_screen)) return false;
 	}
-	else
-	{
-		// Make sure the above check is performed when a canvas is acquired.
-		bCheckIntersection = true;
-	}
 
-	// Render the frame here (but not when rendering translucently).
-	if (m_pos.l == layer)
-	{
-		// Update idle and custom animations.
-		checkIdling();
-	
-		// Get the canvas for the current frame.
-		if (m_pos.pAnm)
-		{
-			CCanvas *p = m_pos.pAnm->getFrame(m_pos.frame);
-			if (p != m_pCanvas) m_pos.pAnm->playFrameSound(m_pos.frame);
-			m_pCanvas = p;
-		}
-		else 
-		{
-			m_pCanvas = NULL;
-			return false;
-		}
-	}
-	else if (!m_pCanvas) return false;
+	// Update idle and custom animations.
+	checkIdling();
 
-	if (bCheckIntersection)
+	// Get the canvas for the current frame.
+	if (m_pos.pAnm)
 	{
-		board.left = centreX - (m_pCanvas->GetWidth() >> 1);
-		board.top = centreY - m_pCanvas->GetHeight();
-		board.right = centreX - (board.left - centreX);
-		board.bottom = centreY;
-		if (!IntersectRect(&screen, &board, &g_screen)) return false;
+		CCanvas *p = m_pos.pAnm->getFrame(m_pos.frame);
+		if (p != m_pCanvas) m_pos.pAnm->playFrameSound(m_pos.frame);
+		m_pCanvas = p;
 	}
+	else m_pCanvas = NULL;
+
+	if (!m_pCanvas) return false;
+
+	rect = frameBounds();
+	return (IntersectRect(&screen, &rect, &g_screen) != FALSE);
+}
+
+/*
+ * Calculate sprite location and place on destination canvas.
+ */
+bool CSprite::render(CCanvas *const cnv, const int layer, RECT &rect)
+{
+	extern LPBOARD g_pBoard;
+	extern RECT g_screen;
+	extern double g_spriteTranslucency;
+
+	// The frame is obtained by prepareFrame().
+	if (!m_pos.l || !m_pCanvas) return false;
+
+	// If we're rendering the top layer, draw the translucent sprite.
+	if (layer != m_pos.l && 
+		(layer != g_pBoard->sizeL || !g_spriteTranslucency)
+		) return false;
+
+	// Sprite location on screen and board.
+	RECT screen = {0};
+	const RECT board = frameBounds();
+	if (!IntersectRect(&screen, &board, &g_screen)) return false;
 
 	// screen holds the portion of the frame we need to draw.
 	// Put the board co-ordinates into rect.
@@ -43,6 +43,7 @@
 #include "../../common/sprite.h"
 #include "../CVector/CVector.h"
 #include "../CPathFind/CPathFind.h"
+#include <hash_map>
 
 /*
  * Rpgcode flags.
@@ -107,6 +108,7 @@ public:
 		const LONG color);		
 	void drawVector(CCanvas *const cnv);	// Draw the sprite's base vector.
 
+	bool prepareFrame(RECT &rect);			// Advance the animation and get the frame's bounds.
 	bool render( 							// Render frame to canvas.
 		CCanvas *const cnv,
 		const int layer,
@@ -118,6 +120,7 @@ public:
 		const bool bPauseThread);
 	
 	void nullCanvas(void) { m_pCanvas = NULL; } // Free the pointer (when dangling).
+	const CCanvas *getCanvas(void) const { return m_pCanvas; }
 
 	bool move(								// Evaluate the current movement state.
 		const CSprite *selectedPlayer,
@@ -134,6 +137,7 @@ public:
 		const bool bAllowNegatives);
 	void getDestination(DB_POINT &p) const;
 	SPRITE_POSITION getPosition(void) const { return m_pos; }
+	int getLayer(void) const { return m_pos.l; }
 	bool isActive(void) const { return m_bActive; }
 	void setActive(const bool bActive) { m_bActive = bActive; }
 	void setPosition(int x, int y, const int l, const COORD_TYPE coord);
@@ -148,6 +152,15 @@ public:
 		const DB_POINT p = { m_pos.x, m_pos.y };
 		return (CVector(m_attr.vBase) + p);
 	}
+	// Bounds of the sprite's base at its location.
+	RECT getBaseBounds(void) const
+	{
+		RECT r = m_attr.vBase.getBounds();
+		const LONG x = LONG(m_pos.x), y = LONG(m_pos.y);
+		r.left += x; r.right += x;
+		r.top += y; r.bottom += y;
+		return r;
+	}
 
 	// Return the number of pixels for the whole move (e.g. 32, 1, 2).
 	int moveSize(void) const
@@ -210,6 +223,7 @@ private:
 	
 	TILE_TYPE checkBoardEdges(void);		// Tests for movement at the board edges.
 	void checkIdling(void);					// Update idle and custom animations.
+	RECT frameBounds(void) const;			// Bounds of the current frame on the board.
 	DB_POINT getTarget(void) const;			// Get the next position co-ordinates.
 	bool push(const bool bScroll);			// Complete a single frame's movement of the sprite.
 	void setPathTarget(void);				// Insert target co-ordinates from the path.
@@ -233,6 +247,16 @@ private:
  */
 typedef std::vector<CSprite *>::iterator ZO_ITR;
 
+// Pixel size of the cells sprites are filed in for collision tests.
+#define ZO_CELL_SIZE 128
+
+// The cells covered by a sprite's base.
+typedef struct tagZOCells
+{
+	int layer;
+	RECT cells;								// Inclusive range of cell co-ordinates.
+} ZO_CELLS;
+
 typedef struct tagZOrderedSprites
 {
 	std::vector<CSprite *> v;
@@ -240,9 +264,20 @@ typedef struct tagZOrderedSprites
 	// Form v into a z-ordered vector from g_players and g_items.
 	void zOrder();
 
+	// Restore the z-order of v after sprites have moved. Since sprites
+	// move only a little between frames, this is an insertion sort.
+	void sort();
+
+	// Re-file a sprite in the grid after it has moved.
+	void update(CSprite *p);
+
+	// Find the sprites filed near an area of a layer.
+	void nearby(const RECT &bounds, const int layer, std::vector<CSprite *> &sprites) const;
+
 	// Remove a pointer from the vector.
 	void remove(CSprite *p)
 	{
+		unfile(p);
 		for (ZO_ITR i = v.begin(); i != v.end(); ++i)
 		{
 			if (*i == p) 
@@ -273,6 +308,26 @@ typedef struct tagZOrderedSprites
  	  	}
 	 }
 
+private:
+	// Whether a should be drawn before b.
+	static bool below(const CSprite *a, const CSprite *b);
+
+	// Cell key for a layer and cell co-ordinate.
+	static unsigned int cellKey(const int layer, const int x, const int y)
+	{
+		return ((layer & 0xff) << 24) | ((x & 0xfff) << 12) | (y & 0xfff);
+	}
+
+	// Find the cells covered by a layer's area.
+	static ZO_CELLS cellRange(const RECT &bounds, const int layer);
+
+	// Add or remove a sprite from the grid.
+	void file(CSprite *p);
+	void unfile(const CSprite *p);
+
+	stdext::hash_map<unsigned int, std::vector<CSprite *> > m_grid;	// Sprites in each cell.
+	std::map<const CSprite *, ZO_CELLS> m_cells;					// Cells of each filed sprite.
+
 } ZO_VECTOR;
 
 #endif
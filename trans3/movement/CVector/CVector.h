@@ -73,7 +73,8 @@ typedef enum tagDrawVectors
 	CV_DRAW_PATH = 4,				// Sprite paths.
 	CV_DRAW_DEST_CIRCLE = 8,		// Sprite destination circles.
 	CV_DRAW_SP_PATH = 16,			// Selected player path.
-	CV_DRAW_SP_DEST_CIRCLE = 32		// Selected player circle.
+	CV_DRAW_SP_DEST_CIRCLE = 32,	// Selected player circle.
+	CV_DRAW_DAMAGE = 64				// Screen areas recomposed each frame.
 
 } CV_DRAW_VECTORS;
 
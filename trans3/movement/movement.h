@@ -43,6 +43,7 @@
 #include <deque>
 #include <math.h>
 #include "../common/sprite.h"
+#include "../app/replay.h"
 
 /*
  * Definitions.
@@ -96,7 +97,7 @@ typedef struct tagFrameTimer
 	tagFrameTimer(void): 
 		frameTime(0), 
 		frameDelay(0), 
-		idleTime(GetTickCount()) {};
+		idleTime(engineTime()) {};
 
 } FRAME_TIMER;
 
@@ -2101,9 +2101,11 @@ STDMETHODIMP CCallbacks::CBSetBoardNum(int infoCode, int arrayPos1, int arrayPos
 				(infoCode == BRD_PRG_X ? x = nValue : y = nValue);
 				coords::tileToPixel(x, y, g_pBoard->coordType, false, g_pBoard->sizeX);
 				pPrg->vBase.move(x, y);
+				g_pBoard->programIndex.dirty = true;
 			} break;
 		case BRD_PRG_LAYER:
 			if (pPrg) pPrg->layer = short(nValue);
+			g_pBoard->programIndex.dirty = true;
 			break;
 		case BRD_PRG_ACTIVATION:
 			if (pPrg) pPrg->activate = short(nValue);
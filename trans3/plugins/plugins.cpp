@@ -42,6 +42,7 @@ static ICallbacks *g_pCallbacks = NULL;
 #include <set>
 #include "../common/mbox.h"
 #include "../common/paths.h"
+#include "../misc/profiler.h"
 
 // A plugin that accepts input using the special methods.
 interface IPluginInput
@@ -261,6 +262,8 @@ IPlugin *loadPlugin(const STRING path)
  */
 void informPluginEvent(const int keyCode, const int x, const int y, const int button, const int shift, const STRING key, const int type)
 {
+	PROFILE("pluginEvent");
+
 	std::set<IPluginInput *>::iterator i = g_inputPlugins.begin();
 	for (; i != g_inputPlugins.end(); ++i)
 	{
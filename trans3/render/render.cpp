@@ -49,11 +49,13 @@
 #include "../common/paths.h"
 #include "../common/board.h"
 #include "../input/input.h"
+#include "../misc/profiler.h"
 #include "../resource.h"
 #include "../../tkCommon/images/FreeImage.h"
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <vector>
+#include <map>
 
 #define CLASS_NAME _T("TK WindowX")
 
@@ -74,6 +76,25 @@ RECT g_screen = {0, 0, 0, 0};				// = {g_topX, g_topY, g_resX + g_topX, g_resY +
 SCROLL_CACHE g_scrollCache;					// The scroll cache.
 AMBIENT_LEVEL g_ambientLevel;
 MESSAGE_WINDOW g_mwin;
+DAMAGE g_damage;							// Areas of the screen to recompose.
+
+/*
+ * The board and sprites as last composed by renderNow(). Everything
+ * drawn over them is drawn afresh each frame; when nothing was, only
+ * the recomposed areas are copied to the back buffer.
+ */
+typedef struct tagSceneSprite
+{
+	RECT r;						// Bounds of the frame (board co-ords).
+	const CCanvas *pCnv;		// The frame.
+	int layer;
+
+} SCENE_SPRITE;
+
+static SCENE g_scene;						// The composed scene.
+static std::map<const CSprite *, SCENE_SPRITE> g_sceneSprites;
+static bool g_bSceneOnBuffer = false;		// Does the back buffer hold only the scene and its overlays?
+static DWORD g_scenePresent = 0;			// GetPresentCount() when it last did.
 
 /*
  * Render the RPGCode screen.
@@ -367,7 +388,8 @@ void showScreen(const int width, const int height)
 		}
 	}
 
-	ShowWindow(g_hHostWnd, SW_SHOW);
+	// Replays run without a visible window.
+	ShowWindow(g_hHostWnd, isReplaying() ? SW_HIDE : SW_SHOW);
 	g_pDirectDraw->Refresh();
 
 	extern void initInput();
@@ -379,88 +401,83 @@ void showScreen(const int width, const int height)
 	//splashScreen();
 }
 
+/*
+ * The board, as held in the scroll cache.
+ */
+class CBoardScrollSource: public CScrollSource
+{
+public:
+	CBoardScrollSource(tagBoard &board): m_board(board) { }
+
+	int pxWidth(void) const { return m_board.pxWidth(); }
+	int pxHeight(void) const { return m_board.pxHeight(); }
+	int layers(void) const { return m_board.sizeL; }
+	bool isLayerCached(const int layer) const
+	{
+		return (layer < int(m_board.bLayerOccupied.size()) && m_board.bLayerOccupied[layer]);
+	}
+	bool isIsometric(void) const { return m_board.isIsometric(); }
+
+	void render(
+		CCanvas *const cnv,
+		const int destX, const int destY,
+		const int lLower, const int lUpper,
+		const int x, const int y,
+		const int width, const int height)
+	{
+		m_board.render(cnv, destX, destY, lLower, lUpper, x, y, width, height);
+	}
+
+private:
+	tagBoard &m_board;
+};
+
 /*
  * Check and render the scrollcache.
  */
 void tagScrollCache::render(const bool bForceRedraw)
 {
 	extern LPBOARD g_pBoard;
-	extern CPlayer *g_pSelectedPlayer;
 	extern MAIN_FILE g_mainFile;
 
-	// Reduce cache size if the board is smaller than the maximum.
-	if (bForceRedraw)
-	{
-		const int w = (g_pBoard->pxWidth() < maxWidth ? g_pBoard->pxWidth() : maxWidth);
-		const int h = (g_pBoard->pxHeight() < maxHeight ? g_pBoard->pxHeight() : maxHeight);
-		if (w != cnv.GetWidth() || h != cnv.GetHeight())
-		{
-			cnv.Resize(NULL, w, h);
-		}
-		r.left = r.top = 0;
-		r.right = w;
-		r.bottom = h;
-
-		// Use ForceRedraw to update the vector canvases (e.g. to ensure
-		// ambient level changes are applied to under vectors or that
-		// tiles placed on the board are added to under vectors.
-		g_pBoard->createVectorCanvases();
-	}
+	// Use ForceRedraw to update the vector canvases (e.g. to ensure
+	// ambient level changes are applied to under vectors or that
+	// tiles placed on the board are added to under vectors.
+	if (bForceRedraw) g_pBoard->createVectorCanvases();
 
-	if ((g_screen.left >= 0 && g_screen.left < r.left) || 
-		(g_screen.top >= 0 && g_screen.top < r.top) ||
-		(g_screen.left >= 0 && g_screen.right > r.right) ||	
-		(g_screen.top >= 0 && g_screen.bottom > r.bottom) ||
-		bForceRedraw)
-	{
-		// The screen is off the scrollcache area.
-		// (>= 0 for caches smaller than the screen.)
-		const int width = r.right - r.left, height = r.bottom - r.top;
-
-		// Align to player.
-		g_pSelectedPlayer->alignBoard(r, true);
-
-		// Align to the grid (always % 32 on r.left).
-		r.left -= r.left % 32;
-		r.top -= r.top % (g_pBoard->isIsometric() ? 16 : 32);
-		r.right = r.left + width;
-		r.bottom = r.top + height;
-
-		cnv.ClearScreen(TRANSP_COLOR);
-
-		g_pBoard->render(
-			&cnv, 
-			0, 0, 
-			1, g_pBoard->sizeL,
-			r.left, 
-			r.top, 
-			width, 
-			height
-		);
+	// Board vectors are drawn over the whole cache, so redraw fully.
+	const bool bVectors = ((g_mainFile.drawVectors & CV_DRAW_BRD_VECTORS) != 0);
 
-#ifdef DEBUG_VECTORS
-		if (g_mainFile.drawVectors & CV_DRAW_BRD_VECTORS)
-		{
-			// Draw program and tile vectors.
-			cnv.Lock();
+	CBoardScrollSource source(*g_pBoard);
+	if (!scroll(source, g_screen, bForceRedraw, bVectors)) return;
 
-			for (std::vector<LPBRD_PROGRAM>::iterator b = g_pBoard->programs.begin(); b != g_pBoard->programs.end(); ++b)
-			{
-				if (*b) (*b)->vBase.draw(RGB(255, 255, 0), true, r.left, r.top, &cnv);
-			}
+	// Areas newly cached by a step lie off the screen; anything else
+	// that redraws the cache changes what is on it.
+	if (bForceRedraw || bVectors) g_damage.invalidate();
 
-			for (std::vector<BRD_VECTOR>::iterator c = g_pBoard->vectors.begin(); c != g_pBoard->vectors.end(); ++c)
-			{
-				const int color = c->type == TT_SOLID ? RGB(255, 255, 255) : RGB(0, 255, 0);
-				c->pV->draw(color, true, r.left, r.top, &cnv);
-				//RECT r = c->pV->getBounds();
-				//cnv.DrawRect(r.left, r.top, r.right, r.bottom, RGB(255, 255, 255));
-			}
+#ifdef DEBUG_VECTORS
+	if (bVectors)
+	{
+		// Draw program and tile vectors (the cache was redrawn in full,
+		// with its top left at the canvas's).
+		cnv.Lock();
 
-			cnv.Unlock();
+		for (std::vector<LPBRD_PROGRAM>::iterator b = g_pBoard->programs.begin(); b != g_pBoard->programs.end(); ++b)
+		{
+			if (*b) (*b)->vBase.draw(RGB(255, 255, 0), true, r.left, r.top, &cnv);
 		}
+
+		for (std::vector<BRD_VECTOR>::iterator c = g_pBoard->vectors.begin(); c != g_pBoard->vectors.end(); ++c)
+		{
+			const int color = c->type == TT_SOLID ? RGB(255, 255, 255) : RGB(0, 255, 0);
+			c->pV->draw(color, true, r.left, r.top, &cnv);
+			//RECT r = c->pV->getBounds();
+			//cnv.DrawRect(r.left, r.top, r.right, r.bottom, RGB(255, 255, 255));
+		}
+
+		cnv.Unlock();
+	}
 #endif
-	} // if (redrawing)
 }
 
 /*
@@ -469,7 +486,6 @@ void tagScrollCache::render(const bool bForceRedraw)
 void setAmbientLevel(void)
 {
 	extern LPBOARD g_pBoard;
-	extern ZO_VECTOR g_sprites;
 	const RGB_SHORT bae = g_pBoard->ambientEffect;
 	const RGBSHADE al = 
 	{
@@ -485,74 +501,108 @@ void setAmbientLevel(void)
 	}
 
 	// If we're not in full screen mode, we can't use the
-	// gamma controller, so we need to do something else here.
-	// A translucent blt each frame is out of the question, so tiles
-	// are redrawn with the ambient rgb additively applied. This requires
-	// a g_scrollCache.render(true) call to force a redraw.
-	// In order to apply the level to sprites, the animation cache is cleared,
-	// forcing sprites to redraw their frames as and when each is required.
-	// No mechanism currently exists to apply the levels to non-tile images
-	// in windowed mode.
+	// gamma controller, so renderNow() shades the composed scene
+	// with the level instead. The cached tiles, sprite frames and
+	// images are left as they are, so nothing needs redrawing.
+	// A tile's own shading is therefore clamped before the level is
+	// added, where the two used to be summed and clamped once, and
+	// animation frames drawn over the scene (e.g. by RPGCode) are unlit.
 	g_ambientLevel.rgb = al;
-	g_ambientLevel.color = RGB(abs(al.r), abs(al.g), abs(al.b));
-	g_ambientLevel.sgn = DOUBLE(sgn(double(al.r)));
+}
+
+/*
+ * Advance sprites' animations and damage the areas of those that
+ * moved, changed frame, appeared or disappeared.
+ */
+static void damageSprites(void)
+{
+	extern ZO_VECTOR g_sprites;
+
+	std::map<const CSprite *, SCENE_SPRITE> sprites;
+	for (std::vector<CSprite *>::const_iterator i = g_sprites.v.begin(); i != g_sprites.v.end(); ++i)
+	{
+		SCENE_SPRITE ss = {{0, 0, 0, 0}, NULL, 0};
+		if ((*i)->prepareFrame(ss.r))
+		{
+			ss.pCnv = (*i)->getCanvas();
+			ss.layer = (*i)->getPosition().l;
+		}
+		else
+		{
+			SetRectEmpty(&ss.r);
+		}
+		sprites[*i] = ss;
 
-	g_sprites.nullCanvases();
-	CSharedAnimation::freeAllCanvases();
-	g_pBoard->createImageCanvases();
+		std::map<const CSprite *, SCENE_SPRITE>::iterator old = g_sceneSprites.find(*i);
+		if (old == g_sceneSprites.end())
+		{
+			g_damage.add(ss.r);
+			continue;
+		}
+		const SCENE_SPRITE &os = old->second;
+		if (!EqualRect(&os.r, &ss.r) || os.pCnv != ss.pCnv || os.layer != ss.layer)
+		{
+			g_damage.add(os.r);
+			g_damage.add(ss.r);
+		}
+		g_sceneSprites.erase(old);
+	}
+
+	// Sprites that have gone.
+	for (std::map<const CSprite *, SCENE_SPRITE>::const_iterator j = g_sceneSprites.begin(); j != g_sceneSprites.end(); ++j)
+	{
+		g_damage.add(j->second.r);
+	}
+	g_sceneSprites.swap(sprites);
 }
 
 /*
- * Render the scene now.
+ * Draw the board and sprites within g_screen.
  *
- * cnv (in) - canvas to render to (NULL is screen)
- * bForce (in) - force the render?
- * return (out) - did a render occur?
+ * cnv (in) - canvas to render to, at least the size of g_screen
+ * pBkg (in) - background for the screen, with its origin at
+ *			   screen (NULL to draw it here)
+ * screen (in) - the screen pBkg was drawn for
  */
-void renderNow(CCanvas *cnv, const bool bForce)
+static void renderScene(CCanvas *const cnv, const CCanvas *const pBkg, const RECT &screen)
 {
 	extern ZO_VECTOR g_sprites;
 	extern LPBOARD g_pBoard;
 
-	const bool bScreen = (cnv == NULL);
-	if (!cnv) cnv = g_pDirectDraw->getBackBuffer();
+	if (pBkg)
+	{
+		pBkg->BltPart(
+			cnv,
+			0, 0,
+			g_screen.left - screen.left,
+			g_screen.top - screen.top,
+			g_screen.right - g_screen.left,
+			g_screen.bottom - g_screen.top
+		);
+	}
+	else
+	{
+		cnv->ClearScreen(g_pBoard->bkgColor);
 
-	cnv->ClearScreen(g_pBoard->bkgColor);
+		// Draw the background (parallaxed or otherwise).
+		g_pBoard->renderBackground(cnv, g_screen);
+	}
 
 	// Set of RECTs covering the sprites.
 	std::vector<RECT> rects;		
 
-	g_pBoard->checkRestore();
-	// Draw the background (parallaxed or otherwise).
-	g_pBoard->renderBackground(cnv, g_screen);
-
-	// Render the flattened board if it exists ([0] represents any layer occupied).
+	// Draw the flattened layers.
 	if (g_pBoard->bLayerOccupied[0])
 	{		
-		// Check if we need to re-render the scroll cache.
-		g_scrollCache.render(g_scrollCache.cnv.CheckSurfaces());
-
-		// Advance animated tiles and update the scroll cache.
-		g_pBoard->renderAnimatedTiles(g_scrollCache);
-
-		// Draw flattened layers.
-		g_scrollCache.cnv.BltTransparentPart(
-			cnv, 
-			g_scrollCache.r.left - g_screen.left,
-			g_scrollCache.r.top - g_screen.top,
-			0, 0, 
-			g_scrollCache.r.right - g_scrollCache.r.left, 
-			g_scrollCache.r.bottom - g_scrollCache.r.top,
-			TRANSP_COLOR
-		);
+		g_scrollCache.drawLayer(cnv, 0, g_screen, g_screen.left, g_screen.top);
 	}
 
 	/*
 	 * Loop over layers. Draw sprites, recording the portion of their
 	 * frame on the screen in a RECT vector. 
 	 * Draw any under vectors over sprites that are standing on them.
-	 * Draw tiles on higher layers over the sprites: draw tiles directly
-	 * rather than using any intermediate canvas.
+	 * Draw tiles on higher layers over the sprites from the layers'
+	 * canvases in the scrollcache, or directly if they are not cached.
 	 */
 	for (int layer = 1; layer <= g_pBoard->sizeL; ++layer)
 	{
@@ -568,6 +618,9 @@ void renderNow(CCanvas *cnv, const bool bForce)
 
 				// If this rect is occupied, draw all the tiles on this layer
 				// it totally or partially contains, covering the sprite.
+				// Use the layer's flattened canvas if there is one.
+				if (g_scrollCache.drawLayer(cnv, layer, rAligned, g_screen.left, g_screen.top)) continue;
+
 				g_pBoard->render(
 					cnv,
 					rAligned.left - g_screen.left,
@@ -609,9 +662,16 @@ void renderNow(CCanvas *cnv, const bool bForce)
 			const CVector v = (*j)->getVectorBase(true);
 			RECT sr = v.getBounds();
 
-			// Draw any "under" vectors this sprite is standing on.
-			for (std::vector<BRD_VECTOR>::const_iterator k = g_pBoard->vectors.begin(); k != g_pBoard->vectors.end(); ++k)
+			// Draw any "under" vectors near this sprite's frame or base.
+			RECT rNear = {0, 0, 0, 0};
+			UnionRect(&rNear, &rect, &sr);
+			std::vector<int> nearby;
+			g_pBoard->vectorsNear(rNear, layer, nearby);
+
+			for (std::vector<int>::const_iterator n = nearby.begin(); n != nearby.end(); ++n)
 			{
+				const BRD_VECTOR *k = &g_pBoard->vectors[*n];
+
 				// Check if this is an "under" vector, is on the same layer and has a canvas.
 				if (!k->pCnv || k->layer != layer || k->type & ~TT_UNDER) 
 					continue;
@@ -647,16 +707,149 @@ void renderNow(CCanvas *cnv, const bool bForce)
 		} // for (sprites)
 
 	} // for (layer)
+}
+
+/*
+ * The board and sprites, as the composed scene draws them.
+ */
+class CBoardSceneSource: public CSceneSource
+{
+public:
+	void renderBackground(CCanvas *const cnv, const RECT &screen)
+	{
+		extern LPBOARD g_pBoard;
+		cnv->ClearScreen(g_pBoard->bkgColor);
+		g_pBoard->renderBackground(cnv, screen);
+	}
+
+	void render(CCanvas *const cnv, const CCanvas &bkg, const RECT &screen, const RECT &area)
+	{
+		// Render the area as though it were the screen.
+		const RECT s = g_screen;
+		g_screen = area;
+		renderScene(cnv, &bkg, screen);
+		g_screen = s;
+	}
+};
+
+/*
+ * Bring the composed scene up to date, recomposing only damaged areas
+ * unless the screen has scrolled or something affecting all of it has
+ * changed.
+ */
+static void composeScene(void)
+{
+	extern LPBOARD g_pBoard;
+	extern MAIN_FILE g_mainFile;
+	extern double g_spriteTranslucency;
+	static LPBOARD pBoard = NULL;
+	static LONG bkgColor = 0;
+	static double translucency = 0.0;
+
+	// Debug vectors are drawn with the sprites and board, but outside their frames.
+	const bool bInvalid = (pBoard != g_pBoard ||
+		bkgColor != g_pBoard->bkgColor ||
+		translucency != g_spriteTranslucency ||
+		(g_mainFile.drawVectors & ~CV_DRAW_DAMAGE));
+	pBoard = g_pBoard;
+	bkgColor = g_pBoard->bkgColor;
+	translucency = g_spriteTranslucency;
+
+	CBoardSceneSource source;
+	g_scene.compose(source, g_damage, g_screen, bInvalid);
+}
+
+/*
+ * Render the scene now.
+ *
+ * cnv (in) - canvas to render to (NULL is screen)
+ * bForce (in) - force the render?
+ * return (out) - did a render occur?
+ */
+void renderNow(CCanvas *cnv, const bool bForce)
+{
+	extern LPBOARD g_pBoard;
+	extern MAIN_FILE g_mainFile;
+
+	PROFILE("renderNow");
+
+	const bool bScreen = (cnv == NULL);
+	if (!cnv) cnv = g_pDirectDraw->getBackBuffer();
 
-	// Render multitasking animations.
-	CThreadAnimation::renderAll(cnv);
+	g_pBoard->checkRestore();
+
+	// Render the flattened board if it exists ([0] represents any layer occupied).
+	if (g_pBoard->bLayerOccupied[0])
+	{		
+		PROFILE("scrollCache");
+
+		// Check if we need to re-render the scroll cache.
+		g_scrollCache.render(g_scrollCache.cnv.CheckSurfaces());
+
+		// Advance animated tiles and update the scroll cache.
+		g_pBoard->renderAnimatedTiles(g_scrollCache);
+	}
+
+	{
+		PROFILE("composeScene");
+
+		// Advance sprites' animations, damaging those that changed.
+		damageSprites();
+
+		if (bScreen && !bForce)
+		{
+			composeScene();
+
+			// If nothing but overlays has been drawn over last frame's scene,
+			// present only them and the areas recomposed since.
+			g_scene.present(cnv, g_bSceneOnBuffer && g_scenePresent == g_pDirectDraw->GetPresentCount());
+		}
+		else
+		{
+			// Draw directly; the composed scene misses this frame's changes.
+			renderScene(cnv, NULL, g_screen);
+			g_damage.invalidate();
+		}
+	}
+
+	// Anything drawn from here over the scene must be recorded as an
+	// overlay, to be erased next frame, or clear g_bSceneOnBuffer.
+	if (bScreen) g_bSceneOnBuffer = !bForce;
+
+	{
+		PROFILE("animations");
+
+		// Render multitasking animations.
+		std::vector<RECT> rects;
+		CThreadAnimation::renderAll(cnv, rects);
+		for (std::vector<RECT>::const_iterator i = rects.begin(); i != rects.end() && bScreen; ++i)
+		{
+			g_scene.overlay(*i);
+		}
+	}
+
+	// Apply the ambient level in windowed mode (see setAmbientLevel()).
+	const RGBSHADE al = g_ambientLevel.rgb;
+	if (al.r || al.g || al.b)
+	{
+		PROFILE("ambient");
+		cnv->Shade(al.r, al.g, al.b);
+		g_bSceneOnBuffer = false;
+	}
 
 	// Render the 'renderNow' overlay.
-	if (g_renderNow.draw) g_renderNow.cnv->BltTransparent(cnv, 0, 0, g_renderNow.transp);
+	if (g_renderNow.draw)
+	{
+		g_renderNow.cnv->BltTransparent(cnv, 0, 0, g_renderNow.transp);
+		const RECT r = {0, 0, g_renderNow.cnv->GetWidth(), g_renderNow.cnv->GetHeight()};
+		if (bScreen) g_scene.overlay(r);
+	}
 	
 	if (g_mwin.threadVisible)
 	{
 		const int x = (g_resX - g_mwin.width) >> 1;
+		const RECT r = {x, 0, x + g_mwin.cnvBkg->GetWidth(), g_mwin.cnvBkg->GetHeight()};
+		g_scene.overlay(r);
 		if (g_mwin.translucency != 1.0)
 		{
 			g_pDirectDraw->DrawCanvasTranslucent(g_mwin.cnvBkg, x, 0, g_mwin.translucency, -1, -1);
@@ -668,8 +861,29 @@ void renderNow(CCanvas *cnv, const bool bForce)
 		g_pDirectDraw->DrawCanvasTransparent(g_mwin.cnvText, x, 0, g_mwin.color);
 	}
 
+	// Outline the areas recomposed this frame.
+	if (bScreen && !bForce && (g_mainFile.drawVectors & CV_DRAW_DAMAGE))
+	{
+		g_bSceneOnBuffer = false;
+		for (std::vector<RECT>::const_iterator i = g_scene.damaged.begin(); i != g_scene.damaged.end(); ++i)
+		{
+			cnv->DrawRect(
+				i->left - g_screen.left, 
+				i->top - g_screen.top, 
+				i->right - g_screen.left - 1, 
+				i->bottom - g_screen.top - 1, 
+				RGB(255, 0, 0)
+			);
+		}
+	}
+
 	// Render the cursor
-	if (bScreen) g_pDirectDraw->Refresh();
+	if (bScreen && !isReplaying())
+	{
+		PROFILE("flip");
+		g_pDirectDraw->Refresh();
+	}
+	if (bScreen) g_scenePresent = g_pDirectDraw->GetPresentCount();
 }
 
 /*
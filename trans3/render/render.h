@@ -40,6 +40,9 @@
 #include "../../tkCommon/board/coords.h"
 #include "../../tkCommon/tkDirectX/platform.h"
 #include "../../tkCommon/tkGfx/CTile.h"
+#include "scrollcache.h"
+#include "scene.h"
+#include <vector>
 
 // Uncomment to show debug vectors.
 #define DEBUG_VECTORS
@@ -47,36 +50,11 @@
 /*
  * Typedefs.
  */
-typedef struct tagScrollCache
-{
-	CCanvas cnv;				// Canvas for all layers.
-	RECT r;						// Bounds of graphics (board co-ords).
-	int maxWidth, maxHeight;	// Maximum size of cache.
-
-	tagScrollCache(): cnv()
-	{ r.top = r.bottom = r.left = r.right = 0; };
-
-	void render(const bool bForceRedraw);
-	void createCanvas(int w, int h)
-	{
-		// Ensure canvas has tile-integral width/height.
-		w = (w / 32) * 32;
-		h = (h / 32) * 32;
-
-		cnv.CreateBlank(NULL, w, h, TRUE);
-		cnv.ClearScreen(0);
-		maxWidth = r.right = w;
-		maxHeight = r.bottom = h;
-	}
-
-} SCROLL_CACHE;
 
 typedef struct tagAmbientLevel
 {
 	RGBSHADE rgb;
-	LONG color;
-	DOUBLE sgn;
-	tagAmbientLevel(): color(0), sgn(0.0) { rgb.r = rgb.g = rgb.b = 0; }
+	tagAmbientLevel() { rgb.r = rgb.g = rgb.b = 0; }
 
 } AMBIENT_LEVEL;
 
@@ -0,0 +1,207 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Inclusions.
+ */
+#include "scene.h"
+
+/*
+ * Intersect two RECTs, returning whether they overlap (IntersectRect()
+ * is not available to the software canvas).
+ */
+static bool intersect(RECT &dest, const RECT &a, const RECT &b)
+{
+	dest.left = (a.left > b.left ? a.left : b.left);
+	dest.top = (a.top > b.top ? a.top : b.top);
+	dest.right = (a.right < b.right ? a.right : b.right);
+	dest.bottom = (a.bottom < b.bottom ? a.bottom : b.bottom);
+	return (dest.left < dest.right && dest.top < dest.bottom);
+}
+
+/*
+ * Align a damaged area to the grid, as sprites' areas are in renderScene().
+ */
+void tagDamage::add(const RECT &rect)
+{
+	if (full || rect.right <= rect.left || rect.bottom <= rect.top) return;
+
+	const RECT r = {
+		rect.left - ((rect.left % 32) + 32) % 32,
+		rect.top - ((rect.top % 32) + 32) % 32,
+		rect.right - ((rect.right % 32) + 32) % 32 + 32,
+		rect.bottom - ((rect.bottom % 32) + 32) % 32 + 32
+	};
+	rects.push_back(r);
+}
+
+/*
+ * Bring the scene up to date, recomposing only damaged areas unless
+ * the screen has moved or something affecting all of it has changed.
+ */
+void tagScene::compose(CSceneSource &source, DAMAGE &damage, const RECT &newScreen, const bool bInvalid)
+{
+	const int width = newScreen.right - newScreen.left, height = newScreen.bottom - newScreen.top;
+	if (cnv.GetWidth() != width || cnv.GetHeight() != height)
+	{
+		cnv.CreateBlank(NULL, width, height, TRUE);
+		bkg.CreateBlank(NULL, width, height, TRUE);
+		damage.invalidate();
+	}
+
+	if (bInvalid || cnv.CheckSurfaces() || bkg.CheckSurfaces() ||
+		screen.left != newScreen.left || screen.top != newScreen.top ||
+		screen.right != newScreen.right || screen.bottom != newScreen.bottom)
+	{
+		damage.invalidate();
+	}
+	screen = newScreen;
+
+	damaged.clear();
+
+	if (!damage.full)
+	{
+		// Join overlapping areas and clip them to the screen.
+		std::vector<RECT> &rects = damage.rects;
+		for (bool bMerged = true; bMerged; )
+		{
+			bMerged = false;
+			for (std::vector<RECT>::iterator i = rects.begin(); i != rects.end() && !bMerged; ++i)
+			{
+				for (std::vector<RECT>::iterator j = i + 1; j != rects.end(); ++j)
+				{
+					RECT r = {0, 0, 0, 0};
+					if (intersect(r, *i, *j))
+					{
+						i->left = (i->left < j->left ? i->left : j->left);
+						i->top = (i->top < j->top ? i->top : j->top);
+						i->right = (i->right > j->right ? i->right : j->right);
+						i->bottom = (i->bottom > j->bottom ? i->bottom : j->bottom);
+						rects.erase(j);
+						bMerged = true;
+						break;
+					}
+				}
+			}
+		}
+
+		int area = 0;
+		for (std::vector<RECT>::const_iterator i = rects.begin(); i != rects.end(); ++i)
+		{
+			RECT r = {0, 0, 0, 0};
+			if (intersect(r, *i, screen))
+			{
+				damaged.push_back(r);
+				area += (r.right - r.left) * (r.bottom - r.top);
+			}
+		}
+
+		// Past half the screen, the whole is as quick to compose.
+		if (area > (width * height) / 2) damage.invalidate();
+	}
+
+	if (damage.full)
+	{
+		source.renderBackground(&bkg, screen);
+		source.render(&cnv, bkg, screen, screen);
+
+		damaged.clear();
+		damaged.push_back(screen);
+	}
+	else
+	{
+		for (std::vector<RECT>::const_iterator i = damaged.begin(); i != damaged.end(); ++i)
+		{
+			const int w = i->right - i->left, h = i->bottom - i->top;
+			if (part.GetWidth() < w || part.GetHeight() < h)
+			{
+				part.CreateBlank(
+					NULL, 
+					(w > part.GetWidth() ? w : part.GetWidth()), 
+					(h > part.GetHeight() ? h : part.GetHeight()), 
+					TRUE
+				);
+			}
+
+			// Render the area as though it were the screen.
+			source.render(&part, bkg, screen, *i);
+			part.BltPart(&cnv, i->left - screen.left, i->top - screen.top, 0, 0, w, h);
+		}
+	}
+
+	damage.clear();
+}
+
+/*
+ * Copy the scene to a canvas, restoring it under last frame's overlays.
+ */
+void tagScene::present(CCanvas *const target, const bool bCurrent)
+{
+	if (bCurrent)
+	{
+		for (std::vector<RECT>::const_iterator i = damaged.begin(); i != damaged.end(); ++i)
+		{
+			cnv.BltPart(
+				target, 
+				i->left - screen.left, 
+				i->top - screen.top, 
+				i->left - screen.left, 
+				i->top - screen.top, 
+				i->right - i->left, 
+				i->bottom - i->top
+			);
+		}
+		for (std::vector<RECT>::const_iterator j = overlays.begin(); j != overlays.end(); ++j)
+		{
+			cnv.BltPart(target, j->left, j->top, j->left, j->top, j->right - j->left, j->bottom - j->top);
+		}
+	}
+	else
+	{
+		cnv.Blt(target, 0, 0);
+	}
+	overlays.clear();
+}
+
+/*
+ * Record an area drawn over the scene, clipped to it.
+ */
+void tagScene::overlay(const RECT &rect)
+{
+	const RECT bounds = {0, 0, cnv.GetWidth(), cnv.GetHeight()};
+	RECT r = {0, 0, 0, 0};
+	if (intersect(r, rect, bounds)) overlays.push_back(r);
+}
@@ -0,0 +1,119 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * The composed scene: the board and sprites within the screen, kept
+ * from frame to frame so that only the areas that changed (the damage)
+ * are composed again, and only they are copied to the back buffer
+ * while it still holds the last frame's scene.
+ *
+ * Whatever is drawn over the scene on the back buffer (animations,
+ * overlays, the message window) is recorded as an overlay, and the
+ * scene is copied back over it before the next frame is drawn.
+ */
+
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+/*
+ * Inclusions.
+ */
+#include "../../tkCommon/tkCanvas/GDICanvas.h"
+#include <vector>
+
+/*
+ * Areas of the screen that changed since the last frame, recomposed
+ * by renderNow() rather than the whole screen.
+ */
+typedef struct tagDamage
+{
+	std::vector<RECT> rects;	// Damaged areas (board co-ords).
+	bool full;					// Recompose the whole screen.
+
+	tagDamage(): full(true) {};
+
+	void add(const RECT &rect);
+	void invalidate(void) { full = true; }
+	void clear(void) { rects.clear(); full = false; }
+
+} DAMAGE;
+
+/*
+ * What the scene is composed of: the board and sprites (or, in tests,
+ * other graphics).
+ */
+class CSceneSource
+{
+public:
+	virtual ~CSceneSource() { }
+
+	// Draw the background of the screen (board co-ords) onto a
+	// canvas the size of the screen.
+	virtual void renderBackground(CCanvas *const cnv, const RECT &screen) = 0;
+
+	// Draw an area of the board onto a canvas at (0, 0), over the
+	// background drawn for the screen.
+	virtual void render(CCanvas *const cnv, const CCanvas &bkg, const RECT &screen, const RECT &area) = 0;
+};
+
+typedef struct tagScene
+{
+	CCanvas cnv;				// The composed scene.
+	CCanvas bkg;				// Background of the scene.
+	CCanvas part;				// Scratch canvas for damaged areas.
+	RECT screen;				// Screen when the scene was composed (board co-ords).
+	std::vector<RECT> damaged;	// Areas composed last (board co-ords).
+	std::vector<RECT> overlays;	// Areas drawn over the scene since it was
+								// presented (co-ords of the target).
+
+	tagScene(): cnv(), bkg(), part()
+	{ screen.top = screen.bottom = screen.left = screen.right = 0; };
+
+	// Bring the scene up to date for the screen, composing only the
+	// damage unless bInvalid or the screen has moved. Clears the damage.
+	void compose(CSceneSource &source, DAMAGE &damage, const RECT &newScreen, const bool bInvalid);
+
+	// Copy the scene to a canvas at (0, 0). If bCurrent, the canvas
+	// holds the scene as last presented, with only the overlays drawn
+	// over it, and only they and the areas composed since are copied.
+	void present(CCanvas *const target, const bool bCurrent);
+
+	// Record an area of the target drawn over the presented scene.
+	void overlay(const RECT &rect);
+
+} SCENE;
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Inclusions.
+ */
+#include "scrollcache.h"
+
+/*
+ * Intersect two RECTs, returning whether they overlap (IntersectRect()
+ * is not available to the software canvas).
+ */
+static bool intersect(RECT &dest, const RECT &a, const RECT &b)
+{
+	dest.left = (a.left > b.left ? a.left : b.left);
+	dest.top = (a.top > b.top ? a.top : b.top);
+	dest.right = (a.right < b.right ? a.right : b.right);
+	dest.bottom = (a.bottom < b.bottom ? a.bottom : b.bottom);
+	return (dest.left < dest.right && dest.top < dest.bottom);
+}
+
+/*
+ * Limit a value to a range.
+ */
+static int clamp(const int value, const int lower, const int upper)
+{
+	return (value < lower ? lower : (value > upper ? upper : value));
+}
+
+/*
+ * Move the cache towards the screen.
+ */
+bool tagScrollCache::scroll(CScrollSource &source, const RECT &screen, const bool bRedraw, const bool bWhole)
+{
+	if (bRedraw)
+	{
+		// Reduce cache size if the board is smaller than the maximum.
+		const int w = (source.pxWidth() < maxWidth ? source.pxWidth() : maxWidth);
+		const int h = (source.pxHeight() < maxHeight ? source.pxHeight() : maxHeight);
+		if (w != cnv.GetWidth() || h != cnv.GetHeight())
+		{
+			cnv.Resize(NULL, w, h);
+		}
+		r.left = r.top = 0;
+		r.right = w;
+		r.bottom = h;
+
+		// The board's layers may have changed.
+		createLayers(source);
+
+		// Size the scratch canvas for the longest strip now, rather
+		// than growing it in the middle of a scroll.
+		const int tx = (source.isIsometric() ? 256 : 32), ty = (source.isIsometric() ? 128 : 32);
+		if (strip.GetWidth() < w + tx || strip.GetHeight() < h + ty)
+		{
+			strip.CreateBlank(NULL, w + tx, h + ty, TRUE);
+		}
+	}
+
+	const int width = r.right - r.left, height = r.bottom - r.top;
+	const int tileY = (source.isIsometric() ? 16 : 32);
+	if (width <= 0 || height <= 0) return false;
+
+	// Centred on the screen, within the board, aligned to the grid.
+	RECT target = r;
+	target.left = clamp((screen.left + screen.right - width) / 2, 0, clamp(source.pxWidth() - width, 0, source.pxWidth()));
+	target.top = clamp((screen.top + screen.bottom - height) / 2, 0, clamp(source.pxHeight() - height, 0, source.pxHeight()));
+	target.left -= target.left % 32;
+	target.top -= target.top % tileY;
+	target.right = target.left + width;
+	target.bottom = target.top + height;
+
+	// The part of the screen on the board must be cached (caches
+	// smaller than the screen hold the whole board).
+	const RECT board = {0, 0, source.pxWidth(), source.pxHeight()};
+	RECT visible = {0, 0, 0, 0}, covered = {0, 0, 0, 0};
+	const bool bVisible = intersect(visible, screen, board);
+
+	RECT next = r;
+	if (bRedraw)
+	{
+		next = target;
+	}
+	else
+	{
+		if (!bWhole)
+		{
+			// A tile at a time, towards the centre.
+			next.left += clamp(target.left - r.left, -32, 32);
+			next.top += clamp(target.top - r.top, -tileY, tileY);
+			next.right = next.left + width;
+			next.bottom = next.top + height;
+		}
+		// Catch up at once if the screen would leave the cache.
+		if (bVisible && (!intersect(covered, visible, next) ||
+			covered.left != visible.left || covered.top != visible.top ||
+			covered.right != visible.right || covered.bottom != visible.bottom))
+		{
+			next = target;
+		}
+		if (next.left == r.left && next.top == r.top) return false;
+	}
+
+	// If the new area overlaps the old, the cached graphics stay where
+	// they are on the canvases, and only the area newly covered is drawn.
+	RECT kept = {0, 0, 0, 0};
+	if (!bRedraw && !bWhole && intersect(kept, r, next))
+	{
+		originX = ((originX + next.left - r.left) % width + width) % width;
+		originY = ((originY + next.top - r.top) % height + height) % height;
+		r = next;
+
+		// Newly covered columns at full height, then rows between them.
+		const RECT left = {r.left, r.top, kept.left, r.bottom},
+			right = {kept.right, r.top, r.right, r.bottom},
+			top = {kept.left, r.top, kept.right, kept.top},
+			bottom = {kept.left, kept.bottom, kept.right, r.bottom};
+		renderStrip(source, left);
+		renderStrip(source, right);
+		renderStrip(source, top);
+		renderStrip(source, bottom);
+		return true;
+	}
+
+	// Redraw in full, with the canvases' top left at r's.
+	r = next;
+	originX = originY = 0;
+
+	cnv.ClearScreen(TRANSP_COLOR);
+	source.render(&cnv, 0, 0, 1, source.layers(), r.left, r.top, width, height);
+
+	for (unsigned int i = 0; i < layers.size(); ++i)
+	{
+		if (!layers[i]) continue;
+		layers[i]->ClearScreen(TRANSP_COLOR);
+		source.render(layers[i], 0, 0, i, i, r.left, r.top, width, height);
+	}
+	return true;
+}
+
+/*
+ * Render an area of the board (board co-ords), on the flattened
+ * canvas and on each layer's.
+ */
+void tagScrollCache::renderStrip(CScrollSource &source, const RECT &rect)
+{
+	if (rect.right <= rect.left || rect.bottom <= rect.top) return;
+
+	renderStrip(source, &cnv, rect, 1, source.layers());
+	for (unsigned int i = 0; i < layers.size(); ++i)
+	{
+		if (layers[i]) renderStrip(source, layers[i], rect, i, i);
+	}
+}
+
+/*
+ * Render an area of one of the scrollcache's canvases.
+ * tagBoard::render() draws whole tiles around its bounds, which would
+ * overwrite the graphics kept from higher layers, so the strip is drawn
+ * on a scratch canvas with a margin and only the strip copied over.
+ */
+void tagScrollCache::renderStrip(CScrollSource &source, CCanvas *const target, const RECT &rect, const int lLower, const int lUpper)
+{
+	if (rect.right <= rect.left || rect.bottom <= rect.top) return;
+
+	// A margin of two tile widths picks up every isometric tile that
+	// overlaps the strip, as a render of the whole cache would. Other
+	// tiles keep to their squares, and strips are aligned to them.
+	const int tx = (source.isIsometric() ? 128 : 0), ty = (source.isIsometric() ? 64 : 0);
+	const int mx = (rect.left < tx ? rect.left : tx), my = (rect.top < ty ? rect.top : ty);
+	const int width = rect.right - rect.left + mx + tx,
+			  height = rect.bottom - rect.top + my + ty;
+
+	if (strip.GetWidth() < width || strip.GetHeight() < height)
+	{
+		strip.CreateBlank(
+			NULL, 
+			(width > strip.GetWidth() ? width : strip.GetWidth()), 
+			(height > strip.GetHeight() ? height : strip.GetHeight()), 
+			TRUE
+		);
+	}
+	// Only the part in use: the canvas grows to fit both the tall
+	// column strips and the wide row strips.
+	strip.DrawFilledRect(0, 0, width - 1, height - 1, TRANSP_COLOR);
+
+	source.render(&strip, 0, 0, lLower, lUpper, rect.left - mx, rect.top - my, width, height);
+
+	// Copy the strip, transparent pixels included.
+	put(target, strip, rect.left - mx, rect.top - my, rect);
+}
+
+/*
+ * Split an area of the cache (board co-ords) where it wraps around the
+ * edges of the canvases, giving the parts and their places on the
+ * canvases. Returns the number of parts.
+ */
+int tagScrollCache::split(const RECT &rect, RECT parts[4], int destX[4], int destY[4]) const
+{
+	RECT area = {0, 0, 0, 0};
+	if (!intersect(area, rect, r)) return 0;
+
+	const int width = r.right - r.left, height = r.bottom - r.top;
+	const int x = (originX + area.left - r.left) % width, y = (originY + area.top - r.top) % height;
+
+	// The board's column and row at the canvases' right and bottom edges.
+	const int seamX = area.left + width - x, seamY = area.top + height - y;
+
+	int n = 0;
+	for (int i = 0; i < 2; ++i)
+	{
+		for (int j = 0; j < 2; ++j)
+		{
+			const RECT part = {
+				(i ? (seamX > area.left ? seamX : area.left) : area.left),
+				(j ? (seamY > area.top ? seamY : area.top) : area.top),
+				(i ? area.right : (seamX < area.right ? seamX : area.right)),
+				(j ? area.bottom : (seamY < area.bottom ? seamY : area.bottom))
+			};
+			if (part.right <= part.left || part.bottom <= part.top) continue;
+
+			parts[n] = part;
+			destX[n] = (i ? 0 : x);
+			destY[n] = (j ? 0 : y);
+			++n;
+		}
+	}
+	return n;
+}
+
+/*
+ * Copy an area of the board from another canvas onto one of the cache's.
+ */
+void tagScrollCache::put(CCanvas *const target, const CCanvas &src, const int x, const int y, const RECT &rect) const
+{
+	RECT parts[4];
+	int destX[4], destY[4];
+	const int n = split(rect, parts, destX, destY);
+	for (int i = 0; i < n; ++i)
+	{
+		src.BltPart(
+			target, 
+			destX[i], destY[i], 
+			parts[i].left - x, parts[i].top - y, 
+			parts[i].right - parts[i].left, 
+			parts[i].bottom - parts[i].top
+		);
+	}
+}
+
+/*
+ * Copy an area of the board from one of the cache's canvases onto another.
+ */
+void tagScrollCache::get(const CCanvas &cache, CCanvas *const target, const int x, const int y, const RECT &rect) const
+{
+	RECT parts[4];
+	int destX[4], destY[4];
+	const int n = split(rect, parts, destX, destY);
+	for (int i = 0; i < n; ++i)
+	{
+		cache.BltPart(
+			target, 
+			parts[i].left - x, parts[i].top - y, 
+			destX[i], destY[i], 
+			parts[i].right - parts[i].left, 
+			parts[i].bottom - parts[i].top
+		);
+	}
+}
+
+/*
+ * Draw the part of a layer within a RECT (board co-ords) onto a canvas
+ * from the cache. Returns false if the layer is not cached.
+ */
+bool tagScrollCache::drawLayer(CCanvas *const target, const int layer, const RECT &rect, const int x, const int y) const
+{
+	if (layer < 0 || layer >= int(layers.size()) || (layer && !layers[layer])) return false;
+	const CCanvas *const p = (layer ? layers[layer] : &cnv);
+
+	// The cache holds all of the board on the screen.
+	RECT parts[4];
+	int destX[4], destY[4];
+	const int n = split(rect, parts, destX, destY);
+	for (int i = 0; i < n; ++i)
+	{
+		p->BltTransparentPart(
+			target,
+			parts[i].left - x,
+			parts[i].top - y,
+			destX[i], destY[i],
+			parts[i].right - parts[i].left,
+			parts[i].bottom - parts[i].top,
+			TRANSP_COLOR
+		);
+	}
+	return true;
+}
+
+/*
+ * Create a canvas for each cached layer above the first, the size
+ * of the scrollcache, and free those of other layers.
+ */
+void tagScrollCache::createLayers(CScrollSource &source)
+{
+	for (unsigned int i = source.layers() + 1; i < layers.size(); ++i) delete layers[i];
+	layers.resize(source.layers() + 1, NULL);
+
+	for (unsigned int i = 0; i < layers.size(); ++i)
+	{
+		if (i < 2 || !source.isLayerCached(i))
+		{
+			delete layers[i];
+			layers[i] = NULL;
+			continue;
+		}
+		if (!layers[i]) layers[i] = new CCanvas();
+		if (layers[i]->GetWidth() != cnv.GetWidth() || layers[i]->GetHeight() != cnv.GetHeight())
+		{
+			layers[i]->CreateBlank(NULL, cnv.GetWidth(), cnv.GetHeight(), TRUE);
+		}
+	}
+}
+
+/*
+ * Free the layers' canvases.
+ */
+void tagScrollCache::freeLayers(void)
+{
+	for (std::vector<CCanvas *>::iterator i = layers.begin(); i != layers.end(); ++i)
+	{
+		delete *i;
+	}
+	layers.clear();
+}
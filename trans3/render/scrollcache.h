@@ -0,0 +1,146 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ *
+ * Contributors:
+ *    - Colin James Fitzpatrick
+ *    - Jonathan D. Hughes
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * The scroll cache: the board around the screen, drawn once and kept
+ * on canvases twice the size of the screen.
+ *
+ * The canvases wrap around at their edges, as a torus, so the cache
+ * moves without its graphics being moved: a board position's place on
+ * the canvases never changes while it is cached. Each frame the cache
+ * steps at most a tile towards being centred on the screen, drawing
+ * only the column and row of tiles it newly covers, so no one frame
+ * redraws or moves the whole cache.
+ */
+
+#ifndef _SCROLL_CACHE_H_
+#define _SCROLL_CACHE_H_
+
+/*
+ * Inclusions.
+ */
+#include "../../tkCommon/tkCanvas/GDICanvas.h"
+#include <vector>
+
+/*
+ * What the scroll cache holds: the board's layers (or, in tests,
+ * other tiled graphics).
+ */
+class CScrollSource
+{
+public:
+	virtual ~CScrollSource() { }
+
+	// Size of the board in pixels.
+	virtual int pxWidth(void) const = 0;
+	virtual int pxHeight(void) const = 0;
+
+	// Number of layers, and whether a layer above the first has
+	// its own canvas, for drawing over sprites.
+	virtual int layers(void) const = 0;
+	virtual bool isLayerCached(const int layer) const = 0;
+
+	virtual bool isIsometric(void) const = 0;
+
+	// Draw the whole tiles of layers lLower to lUpper that overlap an
+	// area of the board, as tagBoard::render().
+	virtual void render(
+		CCanvas *const cnv,
+		const int destX, const int destY,
+		const int lLower, const int lUpper,
+		const int x, const int y,
+		const int width, const int height) = 0;
+};
+
+typedef struct tagScrollCache
+{
+	CCanvas cnv;				// Canvas for all layers.
+	CCanvas strip;				// Scratch canvas for newly exposed strips.
+	std::vector<CCanvas *> layers;	// Each layer above the first on its own, for
+								// drawing over sprites (NULL if unoccupied).
+	RECT r;						// Bounds of graphics (board co-ords).
+	int originX, originY;		// Place of r's top left on the canvases.
+	int maxWidth, maxHeight;	// Maximum size of cache.
+
+	tagScrollCache(): cnv(), strip(), originX(0), originY(0), maxWidth(0), maxHeight(0)
+	{ r.top = r.bottom = r.left = r.right = 0; };
+	~tagScrollCache() { freeLayers(); }
+
+	// Check and render the cache for the board (render.cpp).
+	void render(const bool bForceRedraw);
+
+	// Move the cache towards the screen (board co-ords), redrawing it
+	// in full if bRedraw; with bWhole, the cache is redrawn in full
+	// whenever it moves, and only moves when the screen leaves it.
+	// Returns whether anything was drawn.
+	bool scroll(CScrollSource &source, const RECT &screen, const bool bRedraw, const bool bWhole);
+
+	// Render an area of the board (board co-ords) onto the canvases.
+	void renderStrip(CScrollSource &source, const RECT &rect);
+	void renderStrip(CScrollSource &source, CCanvas *const target, const RECT &rect, const int lLower, const int lUpper);
+
+	// Copy an area of the board (board co-ords) between one of the
+	// canvases and another canvas, whose top left is at (x, y) on the board.
+	void put(CCanvas *const target, const CCanvas &src, const int x, const int y, const RECT &rect) const;
+	void get(const CCanvas &cache, CCanvas *const target, const int x, const int y, const RECT &rect) const;
+
+	// Draw the part of a layer (0 for all layers) within an area of the
+	// board onto a canvas whose top left is at (x, y) on the board.
+	// Returns false if the layer is not cached.
+	bool drawLayer(CCanvas *const target, const int layer, const RECT &rect, const int x, const int y) const;
+
+	void createLayers(CScrollSource &source);
+	void freeLayers(void);
+	void createCanvas(int w, int h)
+	{
+		// Ensure canvas has tile-integral width/height.
+		w = (w / 32) * 32;
+		h = (h / 32) * 32;
+
+		cnv.CreateBlank(NULL, w, h, TRUE);
+		cnv.ClearScreen(0);
+		maxWidth = r.right = w;
+		maxHeight = r.bottom = h;
+		r.left = r.top = 0;
+		originX = originY = 0;
+	}
+
+private:
+	int split(const RECT &rect, RECT parts[4], int destX[4], int destY[4]) const;
+
+} SCROLL_CACHE;
+
+#endif
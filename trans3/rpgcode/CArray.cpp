@@ -0,0 +1,311 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * RPGCode arrays.
+ */
+
+#include "CProgram.h"
+
+unsigned int CArray::m_counter = 0;
+unsigned int CArray::m_destroyed = 0;
+
+// Copy an array. Generations are not copied.
+CArray::CArray(const CArray &rhs): m_count(0), m_generation(0), m_bReferenced(false)
+{
+	*this = rhs;
+}
+
+// Destroy an array, invalidating every generation given out if this
+// array gave any.
+CArray::~CArray()
+{
+	clear();
+	if (m_bReferenced)
+	{
+		m_destroyed = ++m_counter;
+	}
+}
+
+// Get a generation for pointers to this array's elements.
+unsigned int CArray::reference() const
+{
+	if (m_generation <= m_destroyed)
+	{
+		m_generation = ++m_counter;
+	}
+	m_bReferenced = true;
+	return m_generation;
+}
+
+// Assign an array, copying its elements.
+CArray &CArray::operator=(const CArray &rhs)
+{
+	if (this == &rhs) return *this;
+	clear();
+
+	m_items.resize(rhs.m_items.size(), NULL);
+	for (unsigned int i = 0; i < rhs.m_items.size(); ++i)
+	{
+		if (rhs.m_items[i]) m_items[i] = new ELEMENT(*rhs.m_items[i]);
+	}
+
+	stdext::hash_map<STRING, ELEMENT *>::const_iterator j = rhs.m_keys.begin();
+	for (; j != rhs.m_keys.end(); ++j)
+	{
+		m_keys[j->first] = new ELEMENT(*j->second);
+	}
+
+	m_count = rhs.m_count;
+	return *this;
+}
+
+// Find an element, or NULL if it does not exist.
+CArray::ELEMENT *CArray::find(const STRING &key) const
+{
+	unsigned int idx = 0;
+	if (isIndex(key, idx) && (idx < m_items.size()))
+	{
+		return m_items[idx];
+	}
+	stdext::hash_map<STRING, ELEMENT *>::const_iterator i = m_keys.find(key);
+	return ((i != m_keys.end()) ? i->second : NULL);
+}
+
+// Get an element, creating it if needed.
+CArray::ELEMENT &CArray::operator[](const STRING &key)
+{
+	unsigned int idx = 0;
+	if (isIndex(key, idx))
+	{
+		return at(idx);
+	}
+
+	ELEMENT *&p = m_keys[key];
+	if (!p)
+	{
+		p = new ELEMENT();
+		++m_count;
+	}
+	return *p;
+}
+
+// Find an element by index, or NULL if it does not exist.
+CArray::ELEMENT *CArray::find(const unsigned int idx) const
+{
+	if (idx < m_items.size())
+	{
+		return m_items[idx];
+	}
+
+	// An index beyond the contiguous elements is held by its key.
+	TCHAR str[33];
+	_itot(idx, str, 10);
+	stdext::hash_map<STRING, ELEMENT *>::const_iterator i = m_keys.find(str);
+	return ((i != m_keys.end()) ? i->second : NULL);
+}
+
+// Get an element by index, creating it if needed.
+CArray::ELEMENT &CArray::at(const unsigned int idx)
+{
+	// Grow the contiguous elements when the index is close enough
+	// to them that the gap will not waste much space.
+	if ((idx >= m_items.size()) && (idx < m_items.size() * 2 + 16))
+	{
+		grow(idx + 1);
+	}
+	if (idx < m_items.size())
+	{
+		ELEMENT *&p = m_items[idx];
+		if (!p)
+		{
+			p = new ELEMENT();
+			++m_count;
+		}
+		return *p;
+	}
+
+	TCHAR str[33];
+	_itot(idx, str, 10);
+	ELEMENT *&p = m_keys[str];
+	if (!p)
+	{
+		p = new ELEMENT();
+		++m_count;
+	}
+	return *p;
+}
+
+// Erase an element.
+bool CArray::erase(const STRING &key)
+{
+	unsigned int idx = 0;
+	if (isIndex(key, idx) && (idx < m_items.size()))
+	{
+		if (!m_items[idx]) return false;
+		delete m_items[idx];
+		m_items[idx] = NULL;
+		--m_count;
+		m_generation = 0;
+		return true;
+	}
+
+	stdext::hash_map<STRING, ELEMENT *>::iterator i = m_keys.find(key);
+	if (i == m_keys.end()) return false;
+	delete i->second;
+	m_keys.erase(i);
+	--m_count;
+	m_generation = 0;
+	return true;
+}
+
+// Erase every element.
+void CArray::clear()
+{
+	if (m_count) m_generation = 0;
+
+	std::vector<ELEMENT *>::iterator i = m_items.begin();
+	for (; i != m_items.end(); ++i)
+	{
+		delete *i;
+	}
+	stdext::hash_map<STRING, ELEMENT *>::iterator j = m_keys.begin();
+	for (; j != m_keys.end(); ++j)
+	{
+		delete j->second;
+	}
+	m_items.clear();
+	m_keys.clear();
+	m_count = 0;
+}
+
+// Append every element to a vector, with its key or full name.
+void CArray::enumerate(std::vector<ENTRY> &elements, const STRING &array) const
+{
+	for (unsigned int i = 0; i < m_items.size(); ++i)
+	{
+		if (!m_items[i]) continue;
+		TCHAR str[33];
+		_itot(i, str, 10);
+		elements.push_back(ENTRY(array.empty() ? STRING(str) : (array + _T('[') + str + _T(']')), m_items[i]));
+	}
+	stdext::hash_map<STRING, ELEMENT *>::const_iterator j = m_keys.begin();
+	for (; j != m_keys.end(); ++j)
+	{
+		elements.push_back(ENTRY(array.empty() ? j->first : (array + _T('[') + j->first + _T(']')), j->second));
+	}
+}
+
+// Split the name of an element into its array and key.
+bool CArray::split(const STRING &name, STRING &array, STRING &key)
+{
+	const STRING::size_type len = name.length();
+	if ((len < 3) || (name[len - 1] != _T(']')))
+	{
+		return false;
+	}
+
+	// Find the bracket matching the final one.
+	int depth = 0;
+	for (STRING::size_type i = len - 1; i > 0; --i)
+	{
+		if (name[i] == _T(']'))
+		{
+			++depth;
+		}
+		else if ((name[i] == _T('[')) && !--depth)
+		{
+			array = name.substr(0, i);
+			key = name.substr(i + 1, len - i - 2);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Get the index a number addresses. A number is formatted with six
+// significant digits (see tagStackFrame::getLit()), so larger numbers
+// are left to be found by their keys.
+bool CArray::toIndex(const double num, unsigned int &idx)
+{
+	if ((num < 0.0) || (num >= 1000000.0))
+	{
+		return false;
+	}
+	idx = (unsigned int)num;
+	return (double(idx) == num);
+}
+
+// Determine whether a key is an index, as the string form of a small
+// non-negative integer (so that "1" is an index but "01" is not).
+bool CArray::isIndex(const STRING &key, unsigned int &idx)
+{
+	const STRING::size_type len = key.length();
+	if (!len || (len > 9) || ((len > 1) && (key[0] == _T('0'))))
+	{
+		return false;
+	}
+
+	idx = 0;
+	for (STRING::size_type i = 0; i < len; ++i)
+	{
+		if ((key[i] < _T('0')) || (key[i] > _T('9'))) return false;
+		idx = idx * 10 + (key[i] - _T('0'));
+	}
+	return true;
+}
+
+// Extend the contiguous elements, moving in any hashed elements whose
+// keys are indices in the new range.
+void CArray::grow(const unsigned int size)
+{
+	const unsigned int first = m_items.size();
+	m_items.resize(size, NULL);
+
+	std::vector<STRING> moved;
+	stdext::hash_map<STRING, ELEMENT *>::const_iterator i = m_keys.begin();
+	for (; i != m_keys.end(); ++i)
+	{
+		unsigned int idx = 0;
+		if (isIndex(i->first, idx) && (idx >= first) && (idx < size))
+		{
+			m_items[idx] = i->second;
+			moved.push_back(i->first);
+		}
+	}
+
+	std::vector<STRING>::const_iterator j = moved.begin();
+	for (; j != moved.end(); ++j)
+	{
+		m_keys.erase(*j);
+	}
+}
@@ -0,0 +1,153 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * RPGCode bytecode compiler.
+ *
+ * Lowers a program's machine units, once they have been parsed,
+ * optimised and resolved, into the flat instruction array run by
+ * CProgram::executeInstruction(). Everything tagMachineUnit::execute()
+ * works out at runtime from the shape of the surrounding units (which
+ * block a closing brace belongs to, where a loop restarts, whether an
+ * elseif follows) is worked out here instead.
+ */
+
+#include "CProgram.h"
+
+// Compile a program's units.
+void CBytecode::compile(const MACHINE_UNITS &units)
+{
+	extern void multiRunBegin(CALL_DATA &params);
+
+	m_code.clear();
+	m_pool.clear();
+	m_code.reserve(units.size());
+	m_depth = 0;
+
+	// Dense indices of the variable slots used, by slot.
+	std::map<unsigned int, unsigned int> locals;
+
+	int depth = 0;
+	for (CONST_POS i = units.begin(); i != units.end(); ++i)
+	{
+		INSTRUCTION ins;
+		ins.op = OP_NOP;
+		ins.bLine = ((i->udt & UDT_LINE) != 0);
+		ins.params = 0;
+		ins.operand = 0;
+		ins.func = NULL;
+
+		if (i->udt & UDT_FUNC)
+		{
+			ins.op = OP_CALL;
+			ins.func = i->func;
+			ins.params = i->params;
+
+			// The parameters are replaced by the return value.
+			depth -= i->params - 1;
+		}
+		else if (i->udt & UDT_CLOSE)
+		{
+			ins.op = OP_CLOSE;
+
+			// See tagMachineUnit::execute() for the layout of num.
+			const unsigned long *const pLines = (const unsigned long *)&i->num;
+			const CONST_POS open = units.begin() + pLines[0];
+			if ((open != units.begin()) && (open != units.end()) && ((open - 1)->udt & UDT_FUNC))
+			{
+				const MACHINE_FUNC func = (open - 1)->func;
+				if ((func == CProgram::whileLoop) || (func == CProgram::forLoop) || (func == CProgram::untilLoop))
+				{
+					ins.op = OP_LOOP;
+					ins.operand = (pLines[1] > 0 ? pLines[1] : 1) - 1;
+				}
+				else if (func == CProgram::skipMethod)
+				{
+					ins.op = OP_RETURN;
+				}
+				else if ((func == CProgram::conditional) || (func == CProgram::elseIf))
+				{
+					// Find the next statement; if it is an elseif, it
+					// has to be skipped along with its block.
+					CONST_POS j = i;
+					while (++j != units.end())
+					{
+						if ((j->udt & UDT_FUNC) && (j->udt & UDT_LINE)) break;
+					}
+					if ((j != units.end()) && (j->func == CProgram::elseIf))
+					{
+						ins.op = OP_END_IF;
+						ins.operand = int((j + 1)->num) - 1;
+					}
+				}
+				else if (func == multiRunBegin)
+				{
+					ins.op = OP_END_MULTIRUN;
+				}
+			}
+		}
+		else if (!(i->udt & UDT_OPEN))
+		{
+			STACK_FRAME fr;
+			fr.lit = i->lit;
+			fr.num = i->num;
+			fr.udt = i->udt;
+
+			// Resolve variable names to slots now, rather than
+			// looking them up each time they are used, and number
+			// the slots this code uses so that local frames can
+			// remember them by index. Array elements are left to
+			// be found by name.
+			if ((fr.udt & UDT_ID) && !(fr.udt & UDT_OBJ) && !fr.lit.empty() &&
+				(fr.lit[fr.lit.length() - 1] != _T(']')))
+			{
+				fr.slot = CProgram::getSlot(fr.lit);
+				const std::pair<std::map<unsigned int, unsigned int>::iterator, bool> res =
+					locals.insert(std::make_pair(fr.slot, (unsigned int)locals.size()));
+				fr.local = res.first->second;
+			}
+
+			ins.op = OP_PUSH;
+			ins.operand = m_pool.size();
+			m_pool.push_back(fr);
+			++depth;
+		}
+
+		if (depth > int(m_depth)) m_depth = depth;
+		if (ins.bLine) depth = 0;
+
+		m_code.push_back(ins);
+	}
+
+	m_locals = locals.size();
+	m_bValid = true;
+}
@@ -52,39 +52,26 @@ int CCursorMap::run()
 	extern int g_resX, g_resY;
 	extern CDirectDraw *g_pDirectDraw;
 	extern CCanvas *g_cnvCursor;
-	extern void closeSystems();
 
 	CCanvas cnv;
 	cnv.CreateBlank(NULL, g_resX, g_resY, TRUE);
 	g_pDirectDraw->CopyScreenToCanvas(&cnv);
 	int toRet = 0, pos = -1;
-	MSG message;
 
 	while (true)
 	{
-		const DWORD time = GetTickCount() + 50;
-		while (GetTickCount() < time)
+		const DWORD time = engineTime() + 50;
+		while (engineTime() < time)
 		{
-			if (PeekMessage(&message, NULL, 0, 0, PM_REMOVE))
-			{
-				if (message.message == WM_QUIT)
-				{
-					closeSystems();
-					exit(message.wParam);
-				}
-				else
-				{
-					TranslateMessage(&message);
-					DispatchMessage(&message);
-				}
-			}
+			processEvent();
 		}
-		BYTE keys[256];
-		extern IDirectInputDevice8A *g_lpdiKeyboard;
-		if (FAILED(g_lpdiKeyboard->GetDeviceState(256, keys)))
+		if (isQuitting()) break;
+		INPUT_STATE state;
+		if (!getInputState(state))
 		{
 			continue;
 		}
+		const BYTE *const keys = state.keys;
 		if ((keys[DIK_UP] & 0x80) || (keys[DIK_LEFT] & 0x80))
 		{
 			if (toRet) --toRet;
@@ -104,7 +91,7 @@ int CCursorMap::run()
 			g_pDirectDraw->DrawCanvas(&cnv, 0, 0);
 			g_pDirectDraw->DrawCanvasTransparent(g_cnvCursor, m_points[toRet].x - 40, m_points[toRet].y - 10, RGB(255, 0, 0));
 			g_pDirectDraw->Refresh();
-			Sleep(80);
+			engineSleep(80);
 		}
 		pos = toRet;
 	}
@@ -31,12 +31,12 @@
  */
 
 /**
- * A naive garbage collector.
+ * An incremental garbage collector.
  */
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
-#include <process.h>
+#include <limits.h>
 #include "CGarbageCollector.h"
 #include "CProgram.h"
 
@@ -46,173 +46,361 @@
 CGarbageCollector CGarbageCollector::m_instance;
 
 /**
- * Stub for threads.
+ * Whether a heap variable or array is a member of an object, that
+ * is, whether its name is of the form x::var, where x is the
+ * identifier of the object.
  */
-DWORD WINAPI threadStub(void *p)
+static inline bool isMember(const STRING &name)
 {
-	CGarbageCollector *const pCollector = (CGarbageCollector *)p;
-	const LPCRITICAL_SECTION mutex = &pCollector->m_mutex;
+	return (!name.empty() && (name[0] >= _T('0')) && (name[0] <= _T('9')));
+}
 
-	while (true)
+/**
+ * Construct the garbage collector.
+ */
+CGarbageCollector::CGarbageCollector():
+	m_phase(GP_IDLE),
+	m_lastStep(engineTime()),
+	m_lastCycle(engineTime()),
+	m_frequency(1.0)
+{
+	LARGE_INTEGER freq;
+	if (QueryPerformanceFrequency(&freq))
 	{
-		// Sleep between each collection of garbage.
-		Sleep(GARBAGE_CYCLE);
-
-		EnterCriticalSection(mutex);
+		m_frequency = double(freq.QuadPart) / 1000.0;
+	}
+	memset(&m_stats, 0, sizeof(m_stats));
+}
 
-		//t = GetTickCount();
+/**
+ * Mark an object.
+ */
+void CGarbageCollector::shade(const unsigned int obj)
+{
+	if (m_marked.insert(obj).second)
+	{
+		m_grey.push_back(obj);
+	}
+	// It may have been created since the last cycle decided
+	// what was garbage, reusing the identifier of an object
+	// that had been freed manually.
+	m_garbage.erase(obj);
+}
 
-		/**
-		 * Collect garbage whilst everything else is paused - this
-		 * must be fast or it will be an obvious delay!
-		 */
-		pCollector->collectGarbage();
+/**
+ * Mark objects held by global variables.
+ */
+unsigned int CGarbageCollector::markGlobals(unsigned int budget)
+{
+	std::map<STRING, CPtrData<STACK_FRAME> >::const_iterator i = CProgram::m_heap.lower_bound(m_cursor);
+	for (; (i != CProgram::m_heap.end()) && budget; ++i, --budget)
+	{
+		if (isMember(i->first)) continue;
+		const CPtrData<STACK_FRAME> &var = i->second;
+		if (var->udt & UDT_OBJ)
+		{
+			shade((unsigned int)var->num);
+		}
+	}
+	if (i == CProgram::m_heap.end())
+	{
+		m_cursor.erase();
+		m_phase = GP_ARRAYS;
+	}
+	else m_cursor = i->first;
+	return budget;
+}
 
-		/**t = GetTickCount() - t;
-		char str[255];
-		itoa(t, str, 10);
-		MessageBox(NULL, str, NULL, 0);**/
+/**
+ * Mark objects held by global arrays.
+ */
+unsigned int CGarbageCollector::markArrays(unsigned int budget)
+{
+	std::vector<CArray::ENTRY> elements;
+	ARRAY_MAP::const_iterator i = CProgram::m_arrays.lower_bound(m_cursor);
+	for (; (i != CProgram::m_arrays.end()) && budget; ++i, --budget)
+	{
+		if (isMember(i->first)) continue;
 
-		LeaveCriticalSection(mutex);
+		// Each array is scanned in one go.
+		elements.clear();
+		i->second.enumerate(elements);
+		std::vector<CArray::ENTRY>::const_iterator j = elements.begin();
+		for (; j != elements.end(); ++j)
+		{
+			const CPtrData<STACK_FRAME> &var = *j->second;
+			if (var->udt & UDT_OBJ)
+			{
+				shade((unsigned int)var->num);
+			}
+		}
+		budget -= min(budget - 1, (unsigned int)elements.size());
 	}
-
-	return 0;
+	if (i == CProgram::m_arrays.end())
+	{
+		m_cursor.erase();
+		m_phase = GP_TRACE;
+	}
+	else m_cursor = i->first;
+	return budget;
 }
 
 /**
- * Collect garbage.
+ * Mark objects held by members of marked objects.
  */
-void CGarbageCollector::collectGarbage()
+unsigned int CGarbageCollector::trace(unsigned int budget)
 {
-	if (CProgram::m_objects.size() == 0)
+	std::vector<CArray::ENTRY> elements;
+	while (!m_grey.empty() && budget)
 	{
-		// No objects exist!
-		return;
-	}
-	const unsigned int count = (--CProgram::m_objects.end())->first;
-	std::vector<bool> objects;
+		const unsigned int obj = m_grey.back();
+		m_grey.pop_back();
+		--budget;
 
-	/**
-	 * This will cause the vector to have potentially many unused
-	 * elements, but this is the only way of doing this that is not
-	 * ridiculously slow.
-	 */
-	objects.resize(count + 1, true);
+		TCHAR str[20];
+		_itot_s(obj, str, 20, 10);
+		const STRING prefix = STRING(str) + _T("::");
 
-	// Loop over all globals.
-	{
-		HEAP_ENUM::ITR i = CProgram::m_heap.begin();
-		for (; i != CProgram::m_heap.end(); ++i)
+		std::map<STRING, CPtrData<STACK_FRAME> >::const_iterator i = CProgram::m_heap.lower_bound(prefix);
+		for (; (i != CProgram::m_heap.end()) && (i->first.compare(0, prefix.length(), prefix) == 0); ++i)
 		{
-			const CPtrData<tagStackFrame> &var = i->second;
+			const CPtrData<STACK_FRAME> &var = i->second;
 			if (var->udt & UDT_OBJ)
 			{
-				objects[(unsigned int)var->num] = false;
+				shade((unsigned int)var->num);
 			}
+			if (budget) --budget;
+		}
+
+		elements.clear();
+		ARRAY_MAP::const_iterator j = CProgram::m_arrays.lower_bound(prefix);
+		for (; (j != CProgram::m_arrays.end()) && (j->first.compare(0, prefix.length(), prefix) == 0); ++j)
+		{
+			j->second.enumerate(elements);
 		}
+		std::vector<CArray::ENTRY>::const_iterator k = elements.begin();
+		for (; k != elements.end(); ++k)
+		{
+			const CPtrData<STACK_FRAME> &var = *k->second;
+			if (var->udt & UDT_OBJ)
+			{
+				shade((unsigned int)var->num);
+			}
+		}
+		budget -= min(budget, (unsigned int)elements.size());
+	}
+	return budget;
+}
+
+/**
+ * Mark objects held by the heap again, since variables may have been
+ * set since they were scanned without going through the barrier.
+ */
+void CGarbageCollector::rescan()
+{
+	std::map<STRING, CPtrData<STACK_FRAME> >::const_iterator i = CProgram::m_heap.begin();
+	for (; i != CProgram::m_heap.end(); ++i)
+	{
+		const CPtrData<STACK_FRAME> &var = i->second;
+		if (!(var->udt & UDT_OBJ)) continue;
+		// Members of objects not yet marked are scanned by trace()
+		// if their objects turn out to be reachable.
+		if (isMember(i->first) && (m_marked.find(_ttoi(i->first.c_str())) == m_marked.end())) continue;
+		shade((unsigned int)var->num);
 	}
 
-	// Loop over all locals.
+	std::vector<CArray::ENTRY> elements;
+	ARRAY_MAP::const_iterator j = CProgram::m_arrays.begin();
+	for (; j != CProgram::m_arrays.end(); ++j)
 	{
-		// For each program.
-		std::set<CProgram *>::iterator i = m_programs.begin();
-		for (; i != m_programs.end(); ++i)
+		if (isMember(j->first) && (m_marked.find(_ttoi(j->first.c_str())) == m_marked.end())) continue;
+		j->second.enumerate(elements);
+	}
+	std::vector<CArray::ENTRY>::const_iterator k = elements.begin();
+	for (; k != elements.end(); ++k)
+	{
+		const CPtrData<STACK_FRAME> &var = *k->second;
+		if (var->udt & UDT_OBJ)
+		{
+			shade((unsigned int)var->num);
+		}
+	}
+}
+
+/**
+ * Mark everything held by the programs, and decide what is garbage.
+ */
+void CGarbageCollector::finishMarking()
+{
+	// Variables written since they were scanned.
+	rescan();
+
+	// For each program.
+	std::set<CProgram *>::iterator i = m_programs.begin();
+	for (; i != m_programs.end(); ++i)
+	{
+		// Loop over the stack.
 		{
-			// Loop over the stack.
+			STACK_ITR j = (*i)->m_stack.begin();
+			for (; j != (*i)->m_stack.end(); ++j)
 			{
-				STACK_ITR j = (*i)->m_stack.begin();
-				for (; j != (*i)->m_stack.end(); ++j)
+				// Loop over this frame of the stack.
+				std::vector<STACK_FRAME>::const_iterator k = j->begin();
+				for (; k != j->end(); ++k)
 				{
-					// Loop over this frame of the stack.
-					std::vector<STACK_FRAME>::const_iterator k = j->begin();
-					for (; k != j->end(); ++k)
+					if (k->udt & UDT_OBJ)
 					{
-						const STACK_FRAME &var = *k;
-						if (var.udt & UDT_OBJ)
-						{
-							objects[(unsigned int)var.num] = false;
-						}
+						shade((unsigned int)k->num);
 					}
 				}
 			}
+		}
 
-			// Loop over the locals
+		// Loop over the locals.
+		{
+			std::vector<CArray::ENTRY> elements;
+			std::list<LOCAL_FRAME>::iterator j = (*i)->m_locals.begin();
+			for (; j != (*i)->m_locals.end(); ++j)
 			{
-				std::list<std::map<STRING, STACK_FRAME> >::iterator j = (*i)->m_locals.begin();
-				for (; j != (*i)->m_locals.end(); ++j)
+				// For each variable in the frame.
+				LOCAL_FRAME::const_iterator k = j->begin();
+				for (; k != j->end(); ++k)
 				{
-					// For each variable in the stack.
-					std::map<STRING, STACK_FRAME>::const_iterator k = j->begin();
-					for (; k != j->end(); ++k)
+					const STACK_FRAME &var = k->second;
+					if (var.udt & UDT_OBJ)
 					{
-						const STACK_FRAME &var = k->second;
-						if (var.udt & UDT_OBJ)
-						{
-							objects[(unsigned int)var.num] = false;
-						}
+						shade((unsigned int)var.num);
 					}
 				}
+
+				// And each array element.
+				ARRAY_MAP::const_iterator m = j->arrays().begin();
+				for (; m != j->arrays().end(); ++m)
+				{
+					m->second.enumerate(elements);
+				}
+			}
+			std::vector<CArray::ENTRY>::const_iterator n = elements.begin();
+			for (; n != elements.end(); ++n)
+			{
+				const CPtrData<STACK_FRAME> &var = *n->second;
+				if (var->udt & UDT_OBJ)
+				{
+					shade((unsigned int)var->num);
+				}
+			}
+		}
+
+		// And the objects whose methods are running.
+		{
+			std::vector<CALL_FRAME>::const_iterator j = (*i)->m_calls.begin();
+			for (; j != (*i)->m_calls.end(); ++j)
+			{
+				if (j->obj) shade(j->obj);
 			}
 		}
 	}
 
-	/**
-	 * Free any objects that we've proved to be unreachable.
-	 *
-	 * Because of how object data is stored, we have to look through
-	 * the whole heap for variables of the form x:var where x is
-	 * the identifier of the object to be freed.
-	 */
-	std::map<STRING, CPtrData<STACK_FRAME> >::iterator i = CProgram::m_heap.begin();
-	for (; i != CProgram::m_heap.end(); ++i)
-	{
-		const STRING &name = i->first;
-		int pos = name.find(_T(':'));
-		if (pos == -1) continue;
+	// Trace from those to completion.
+	trace(UINT_MAX);
 
-		const unsigned int obj = atoi(name.substr(0, pos + 1).c_str());
-		if (objects[obj])
+	// Whatever is left unmarked is unreachable.
+	m_garbage.clear();
+	std::map<unsigned int, STRING>::const_iterator j = CProgram::m_objects.begin();
+	for (; j != CProgram::m_objects.end(); ++j)
+	{
+		if (m_marked.find(j->first) == m_marked.end())
 		{
-			i = CProgram::m_heap.erase(i);
+			m_garbage.insert(m_garbage.end(), j->first);
 		}
 	}
-
+	m_marked.clear();
+	m_stats.reclaimed = 0;
+	m_phase = GP_SWEEP;
 }
 
 /**
- * Initialise the garbage collector.
+ * Free unmarked objects.
  */
-CGarbageCollector::CGarbageCollector()
+unsigned int CGarbageCollector::sweep(unsigned int budget)
 {
-	m_bRunning = true;
-	InitializeCriticalSection(&m_mutex);
-	DWORD id;
-	if (!(m_garbageThread = CreateThread(NULL, 0, threadStub, this, 0, &id)))
+	while (!m_garbage.empty() && budget)
+	{
+		const unsigned int obj = *m_garbage.begin();
+		m_garbage.erase(m_garbage.begin());
+		--budget;
+
+		// The object may have been freed manually, or all objects
+		// cleared when a saved state was loaded.
+		if (CProgram::m_objects.find(obj) == CProgram::m_objects.end()) continue;
+
+		CProgram::forgetObject(obj);
+		++m_stats.reclaimed;
+		++m_stats.totalReclaimed;
+	}
+	if (m_garbage.empty())
 	{
-		MessageBox(NULL, _T("Could not create a thread for the garbage collector."), NULL, 0);
+		++m_stats.cycles;
+		m_lastCycle = engineTime();
+		m_phase = GP_IDLE;
 	}
+	return budget;
 }
 
 /**
- * Shut down the garbage collector.
+ * Take a step of the current cycle.
  */
-CGarbageCollector::~CGarbageCollector()
+void CGarbageCollector::step()
 {
-	// End the garbage collector's thread.
-	/**m_bRunning = false;
+	m_lastStep = engineTime();
+	if (m_phase == GP_IDLE)
+	{
+		if ((m_lastStep - m_lastCycle < GARBAGE_CYCLE) || CProgram::m_objects.empty())
+		{
+			return;
+		}
+		m_cursor.erase();
+		m_phase = GP_GLOBALS;
+	}
 
-	EnterCriticalSection(&m_mutex);
-	LeaveCriticalSection(&m_mutex);
+	LARGE_INTEGER start, end;
+	QueryPerformanceCounter(&start);
 
-	DWORD code;
-	do
+	unsigned int budget = GARBAGE_BUDGET;
+	while (budget && (m_phase != GP_IDLE))
 	{
-		if (!GetExitCodeThread(m_garbageThread, &code)) break;
-	} while (code == STILL_ACTIVE);**/
+		switch (m_phase)
+		{
+			case GP_GLOBALS: budget = markGlobals(budget); break;
+			case GP_ARRAYS: budget = markArrays(budget); break;
+			case GP_TRACE:
+				budget = trace(budget);
+				if (m_grey.empty()) finishMarking();
+				break;
+			case GP_SWEEP: budget = sweep(budget); break;
+			default: budget = 0;
+		}
+	}
 
-	// No way to use TryExitCriticalSection in 9x, so we'll just do this.
-	TerminateThread(m_garbageThread, EXIT_SUCCESS);
+	QueryPerformanceCounter(&end);
+	m_stats.lastPause = double(end.QuadPart - start.QuadPart) / m_frequency;
+	if (m_stats.lastPause > m_stats.maxPause)
+	{
+		m_stats.maxPause = m_stats.lastPause;
+	}
+}
 
-	CloseHandle(m_garbageThread);
-	DeleteCriticalSection(&m_mutex);
+/**
+ * Collect garbage right now.
+ */
+void CGarbageCollector::collectGarbage()
+{
+	if (m_phase == GP_IDLE)
+	{
+		m_lastCycle -= GARBAGE_CYCLE;
+	}
+	do
+	{
+		step();
+	} while (m_phase != GP_IDLE);
 }
@@ -33,13 +33,22 @@
 /*
  * RPGCode garbage collector.
  *
- * This is a just a naive implementation of a garbage collector that
- * runs in its own thread. At regular intervals, it suspends the main
- * program thread (there is assumed to be only one) and checks if there
- * are any objects that are not referenced by any variable. If there are,
- * they are freed. Their deconstructors are not called, though, since
- * there is no easy way to tell where that code even is. So, if a class's
+ * An incremental mark and sweep collector. Objects are live if they
+ * can be reached from a program's variables or stack, either directly
+ * or through the members of other live objects; all other objects are
+ * freed. Their deconstructors are not called, though, since there is
+ * no easy way to tell where that code even is. So, if a class's
  * deconstructor actually needs to be run, it should be run manually.
+ *
+ * Collection is cooperative: it only happens at safepoints, which the
+ * interpreter reaches at loop back-edges, method calls and between
+ * thread slices. Each safepoint does at most a small, fixed amount of
+ * work, so a cycle is spread over many frames. Since programs run in
+ * between, assignments of objects during marking call barrier(), and
+ * the stacks, locals and heap variables are all scanned again before
+ * anything is freed. The heap is scanned again because built-in
+ * functions and plugins write variables without going through the
+ * barrier.
  */
 
 #ifndef _GARBAGE_COLLECTOR_H_
@@ -47,20 +56,44 @@
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <string>
+#include <tchar.h>
+#include <vector>
 #include <set>
+#include "../app/replay.h"
+
+/**
+ * Number of milliseconds between the end of one garbage collection
+ * cycle and the start of the next. It is important that collection
+ * runs even when programs are not running, or else programs might all
+ * be short enough to fit between cycles; see CThread::multitask().
+ */
+#define GARBAGE_CYCLE	5000
 
 /**
- * Number of milliseconds between each garbage collection cycle.
- * This is really quite fast (30-100 milliseconds), so I've got it
- * at ten minutes for now. If this drops the FPS, post about it
- * and we will change it (maybe tied to FPS). It is important, though
- * that is run even when programs are not running, or else programs
- * might all be short enough to fit between cycles.
+ * Minimum number of milliseconds between steps of a cycle.
  */
-#define GARBAGE_CYCLE	600000
+#define GARBAGE_STEP	15
+
+/**
+ * Number of variables or objects examined in each step.
+ */
+#define GARBAGE_BUDGET	256
 
 class CProgram;
 
+/**
+ * Statistics about garbage collection.
+ */
+typedef struct tagGarbageStats
+{
+	unsigned int cycles;			// Completed cycles.
+	unsigned int reclaimed;			// Objects freed by the last cycle.
+	unsigned int totalReclaimed;	// Objects freed by all cycles.
+	double lastPause;				// Duration of the last step, in milliseconds.
+	double maxPause;				// Duration of the longest step, in milliseconds.
+} GARBAGE_STATS;
+
 /**
  * The garbage collector is implemented as a singleton. To obtain the
  * instance, call CGarbageCollector::getInstance().
@@ -74,21 +107,39 @@ public:
 	 */
 	CGarbageCollector();
 
-	/**
-	 * Shut down the garbage collector.
-	 */
-	~CGarbageCollector();
-
 	/**
 	 * Return the unique instance of the garbage collector.
 	 */
 	static CGarbageCollector &getInstance() { return m_instance; }
 
 	/**
-	 * Cause garbage to be collected right now.
+	 * Cause garbage to be collected right now, finishing any cycle
+	 * in progress.
 	 */
 	void collectGarbage();
 
+	/**
+	 * Take a step of the current cycle, starting one if it is due.
+	 */
+	void step();
+
+	/**
+	 * Take a step if one is due. Only call this where no object can be
+	 * referenced from anywhere but a program's variables and stack.
+	 */
+	void safepoint()
+	{
+		if (engineTime() - m_lastStep >= GARBAGE_STEP) step();
+	}
+
+	/**
+	 * Record that an object has been stored in a variable, or created.
+	 */
+	void barrier(const unsigned int obj)
+	{
+		if (m_phase != GP_IDLE) shade(obj);
+	}
+
 	/**
 	 * Add a program to the set.
 	 */
@@ -100,16 +151,48 @@ public:
 	void removeProgram(CProgram *p) { m_programs.erase(p); }
 
 	/**
-	 * Get the mutex used for garbage collection.
+	 * Get statistics about collection so far.
 	 */
-	LPCRITICAL_SECTION getMutex() { return &m_mutex; }
+	const GARBAGE_STATS &getStats() const { return m_stats; }
 
 private:
 
 	/**
-	 * The location where execution of threads begins.
+	 * The phases of a cycle.
+	 */
+	typedef enum tagGarbagePhase
+	{
+		GP_IDLE,		// Waiting for the next cycle.
+		GP_GLOBALS,		// Marking objects held by global variables.
+		GP_ARRAYS,		// Marking objects held by global arrays.
+		GP_TRACE,		// Marking objects held by members of marked objects.
+		GP_SWEEP		// Freeing unmarked objects.
+	} GARBAGE_PHASE;
+
+	/**
+	 * Mark an object, and queue it to have its members scanned.
+	 */
+	void shade(const unsigned int obj);
+
+	/**
+	 * Do up to the given amount of work in each phase.
+	 */
+	unsigned int markGlobals(unsigned int budget);
+	unsigned int markArrays(unsigned int budget);
+	unsigned int trace(unsigned int budget);
+	unsigned int sweep(unsigned int budget);
+
+	/**
+	 * Mark objects held by global variables and arrays, and by
+	 * members of objects already marked, in one go.
+	 */
+	void rescan();
+
+	/**
+	 * Mark everything held by the programs, then decide which
+	 * objects are garbage. This is done in one go.
 	 */
-	friend DWORD WINAPI threadStub(void *p);
+	void finishMarking();
 
 	/**
 	 * The set of programs that this instance is responsible for.
@@ -117,19 +200,36 @@ private:
 	std::set<CProgram *> m_programs;
 
 	/**
-	 * The handle of the thread the garbage collector is running in.
+	 * The current phase, and the name of the next variable or
+	 * array to scan in that phase.
+	 */
+	GARBAGE_PHASE m_phase;
+	std::basic_string<TCHAR> m_cursor;
+
+	/**
+	 * Objects marked in this cycle, and those whose members have
+	 * yet to be scanned.
 	 */
-	HANDLE m_garbageThread;
+	std::set<unsigned int> m_marked;
+	std::vector<unsigned int> m_grey;
 
 	/**
-	 * The critical section for garbage collection.
+	 * Objects found to be garbage, waiting to be freed.
 	 */
-	CRITICAL_SECTION m_mutex;
+	std::set<unsigned int> m_garbage;
 
 	/**
-	 * A flag indicating whether the garbage thread is running.
+	 * The times at which the last step was taken and the last
+	 * cycle finished.
 	 */
-	volatile bool m_bRunning;
+	DWORD m_lastStep, m_lastCycle;
+
+	/**
+	 * Performance counter frequency, in counts per millisecond.
+	 */
+	double m_frequency;
+
+	GARBAGE_STATS m_stats;
 
 	/**
 	 * The unique instance of the garbage collector.
@@ -138,5 +238,3 @@ private:
 };
 
 #endif
-
-
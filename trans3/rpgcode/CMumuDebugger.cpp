@@ -14,7 +14,7 @@
 		Panels should be separate objects
 
 	Features to consider:
-		Performance Profiler
+		Profiler results in the debugger (see CProgramProfiler)
 */
 
 #ifdef ENABLE_MUMU_DBG
@@ -177,6 +177,29 @@ namespace // Anonymous namespace
 		}
 	}
 
+	void searchArrays(const ARRAY_MAP &arrays, const STRING &search, int maxResults, std::vector<STRING> &results)
+	{
+		// Only arrays whose names start with the unbracketed part of the search value can match.
+		const STRING prefix = search.substr(0, search.find(_T('[')));
+		int i = 0;
+		for (ARRAY_MAP::const_iterator it = arrays.lower_bound(prefix);
+			it != arrays.end() && it->first.substr(0, prefix.length()) == prefix;
+			++it)
+		{
+			std::vector<CArray::ENTRY> elements;
+			it->second.enumerate(elements, it->first);
+			for (std::vector<CArray::ENTRY>::const_iterator j = elements.begin(); j != elements.end(); ++j)
+			{
+				if (j->first.substr(0, search.length()) == search)
+				{
+					results.push_back(j->first);
+					if (++i == maxResults)
+						return;
+				}
+			}
+		}
+	}
+
 } // Anonymous namespace
 
 CMumuDebugger::VariableParser::VariableParser(CProgram &prg, const STRING &var)
@@ -338,7 +361,7 @@ LPSTACK_FRAME CMumuDebugger::VariableParser::resolveToVariable(const STRING &for
 	// TODO: Getting kind of unwieldy. Consider breaking this into smaller methods. This would also
 	//       make it easier to implement explicit scope resolution later on.
 	// TODO: check only globals when x::y format?
-	std::list<std::map<STRING, STACK_FRAME> > *pLocalList = m_program.getLocals();
+	std::list<LOCAL_FRAME> *pLocalList = m_program.getLocals();
 
 	// Check parameters
 	if (pLocalList && !pLocalList->empty() && !m_program.m_calls.empty())
@@ -353,12 +376,12 @@ LPSTACK_FRAME CMumuDebugger::VariableParser::resolveToVariable(const STRING &for
 			{
 				// Name exists in parameter list; Search locals for its internal parameter name:
 				const STRING &internalName = res->second;
-				std::map<STRING, STACK_FRAME> &locals = pLocalList->back();
-				std::map<STRING, STACK_FRAME>::iterator local_it = locals.find(internalName);
-				if (local_it != locals.end())
+				LOCAL_FRAME &locals = pLocalList->back();
+				const LPSTACK_FRAME local = locals.get(internalName);
+				if (local)
 				{
 					// Normal parameter.
-					return &local_it->second;
+					return local;
 				}
 				else if (internalName.length() == 2 && internalName[0] == _T(' '))
 				{
@@ -379,31 +402,31 @@ LPSTACK_FRAME CMumuDebugger::VariableParser::resolveToVariable(const STRING &for
 	// Check locals & instance variables:
 	if (pLocalList && !pLocalList->empty())
 	{
-		std::map<STRING, STACK_FRAME> &locals = pLocalList->back();
-		std::map<STRING, STACK_FRAME>::iterator res = locals.find(formattedName);
-		if (res != locals.end())
+		LOCAL_FRAME &locals = pLocalList->back();
+		const LPSTACK_FRAME local = locals.get(formattedName);
+		if (local)
 		{
-			return &res->second;
+			return local;
 		}
 
 		// Check instance variables belonging to local "this":
-		res = locals.find("this");
+		LOCAL_FRAME::iterator res = locals.find("this");
 		if (res != locals.end())
 		{
 			STRING instanceVar = res->second.getLit() + _T("::") + formattedName;
-			std::map<STRING, CPtrData<STACK_FRAME> >::iterator res = m_program.m_heap.find(instanceVar);
-			if (res != m_program.m_heap.end())
+			CPtrData<STACK_FRAME> *const pVar = CProgram::findHeapVar(instanceVar);
+			if (pVar)
 			{
-				return res->second;
+				return *pVar;
 			}
 		}
 	}
 
 	// Check globals:
-	std::map<STRING, CPtrData<STACK_FRAME> >::iterator res = m_program.m_heap.find(formattedName);
-	if (res != m_program.m_heap.end())
+	CPtrData<STACK_FRAME> *const pVar = CProgram::findHeapVar(formattedName);
+	if (pVar)
 	{
-		return res->second;
+		return *pVar;
 	}
 
 	return NULL; //<- Could not resolve indicated variable.
@@ -458,22 +481,23 @@ void CMumuDebugger::VariableParser::searchParameters(const STRING &search, int m
 void CMumuDebugger::VariableParser::searchLocals(const STRING &search, int maxResults,
 												 std::vector<STRING> &results) const
 {
-	std::list<std::map<STRING, STACK_FRAME> > *pLocalList = m_program.getLocals();
+	std::list<LOCAL_FRAME> *pLocalList = m_program.getLocals();
 	if (!pLocalList || pLocalList->empty())
 		return;
 
 	searchVariables(pLocalList->back(), search, maxResults, results);
+	searchArrays(pLocalList->back().arrays(), search, maxResults, results);
 }
 
 void CMumuDebugger::VariableParser::searchMembers(const STRING &search, int maxResults,
 												  std::vector<STRING> &results) const
 {
-	std::list<std::map<STRING, STACK_FRAME> > *pLocalList = m_program.getLocals();
+	std::list<LOCAL_FRAME> *pLocalList = m_program.getLocals();
 	if (!pLocalList || pLocalList->empty())
 		return;
 
-	const std::map<STRING, STACK_FRAME> &locals = pLocalList->back();
-	std::map<STRING, STACK_FRAME>::const_iterator res = locals.find(_T("this"));
+	const LOCAL_FRAME &locals = pLocalList->back();
+	LOCAL_FRAME::const_iterator res = locals.find(_T("this"));
 	if (res == locals.end())
 		return;
 
@@ -497,6 +521,7 @@ void CMumuDebugger::VariableParser::searchGlobals(const STRING &search, int maxR
 												  std::vector<STRING> &results) const
 {
 	searchVariables(m_program.m_heap, search, maxResults, results);
+	searchArrays(m_program.m_arrays, search, maxResults, results);
 }
 
 std::vector<STRING> CMumuDebugger::VariableParser::getAutocomplete(const STRING &input, int maxResults) 
@@ -1673,15 +1698,15 @@ bool CMumuDebugger::dumpLocalVariables()
 	STRINGSTREAM ss;
 	ss << _T("NAME,VALUE,UDT,L#\n");
 
-	std::list< std::map<STRING, STACK_FRAME> > *pLocalList = m_program.getLocals();
+	std::list<LOCAL_FRAME> *pLocalList = m_program.getLocals();
 	if (pLocalList)
 	{
 		int ct = 0;
-		for (std::list< std::map<STRING, STACK_FRAME> >::const_iterator i = pLocalList->begin();
+		for (std::list<LOCAL_FRAME>::const_iterator i = pLocalList->begin();
 			i != pLocalList->end();
 			++i)
 		{
-			for (std::map<STRING, STACK_FRAME>::const_iterator j = i->begin(); j != i->end(); ++j)
+			for (LOCAL_FRAME::const_iterator j = i->begin(); j != i->end(); ++j)
 			{
 				ss << quoteString(j->first) << _T(",");
 
@@ -1692,6 +1717,24 @@ bool CMumuDebugger::dumpLocalVariables()
 	 
 				ss << quoteString(getShortUnitDataType(j->second.getType())) << _T(",") << ct << _T("\n");
 			}
+
+			std::vector<CArray::ENTRY> elements;
+			for (ARRAY_MAP::const_iterator j = i->arrays().begin(); j != i->arrays().end(); ++j)
+			{
+				j->second.enumerate(elements, j->first);
+			}
+			for (std::vector<CArray::ENTRY>::const_iterator j = elements.begin(); j != elements.end(); ++j)
+			{
+				const CPtrData<STACK_FRAME> &var = *j->second;
+				ss << quoteString(j->first) << _T(",");
+
+				if (var->getType() & UDT_LIT)
+					ss << quoteString(var->getLit()) << _T(",");
+				else
+					ss << var->getNum() << _T(",");
+
+				ss << quoteString(getShortUnitDataType(var->getType())) << _T(",") << ct << _T("\n");
+			}
 			ct++;
 		}
 	}
@@ -1726,6 +1769,24 @@ bool CMumuDebugger::dumpGlobalVariables()
 		ss << quoteString(getShortUnitDataType(it->second->getType())) << _T("\n");
 	}
 
+	std::vector<CArray::ENTRY> elements;
+	for (ARRAY_MAP::const_iterator it = m_program.m_arrays.begin(); it != m_program.m_arrays.end(); ++it)
+	{
+		it->second.enumerate(elements, it->first);
+	}
+	for (std::vector<CArray::ENTRY>::const_iterator it = elements.begin(); it != elements.end(); ++it)
+	{
+		const CPtrData<STACK_FRAME> &var = *it->second;
+		ss << quoteString(it->first) << _T(",");
+
+		if (var->getType() & UDT_LIT)
+			ss << quoteString(var->getLit()) << _T(",");
+		else
+			ss << var->getNum() << _T(",");
+
+		ss << quoteString(getShortUnitDataType(var->getType())) << _T("\n");
+	}
+
 	file << ss.str();
 	return true;
 }
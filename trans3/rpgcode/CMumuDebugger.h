@@ -16,7 +16,9 @@ public:
 	~CMumuDebugger();
 
 	static int loadProgram(const STRING &filename = CProgram::m_parsing);
+	static STRING getFileName(int idx) { return (idx >= 0 && idx < s_cachedFilenames.size()) ? s_cachedFilenames[idx] : STRING(); }
 	static void clearBreakpoints();
+	static STRING getDumpDir(const STRING &subdir = STRING());
 
 	// Accessors for Watches
 	int getMaxWatches() const { assert(m_watches.size() == kMaxWatches); return m_watches.size(); }
@@ -184,7 +186,6 @@ private:
 	void mUnitsPanel_drawRows(HDC hdc);
 	void fileStrip_arrangeFilenames();
 
-	STRING getDumpDir(const STRING &subdir = STRING());
 	bool dumpAll();
 	bool dumpMachineUnits();
 	bool dumpVariables();
@@ -38,18 +38,22 @@
 #include "COptimiser.h"
 #include "CVariant.h"
 #include "CGarbageCollector.h"
+#include "CProgramCache.h"
 #include "../plugins/plugins.h"
 #include "../plugins/constants.h"
 #include "../common/mbox.h"
 #include "../common/paths.h"
+#include "../common/pakfs.h"
 #include "../common/CFile.h"
 #include "../input/input.h"
+#include "../misc/profiler.h"
 #include "../../tkCommon/strings.h"
 #include <malloc.h>
 #include <math.h>
 #include <algorithm> 
 #include "assert.h"
 
+#include "CProgramProfiler.h"
 #ifdef ENABLE_MUMU_DBG
 #include "CMumuDebugger.h"
 bool CProgram::m_enableMumu = true;
@@ -61,6 +65,10 @@ std::map<STRING, MACHINE_FUNC> CProgram::m_functions;
 LPMACHINE_UNITS CProgram::m_pyyUnits = NULL;
 std::deque<MACHINE_UNITS> CProgram::m_yyFors;
 std::map<STRING, CPtrData<STACK_FRAME> > CProgram::m_heap;
+unsigned int CProgram::m_heapGeneration = 0;
+ARRAY_MAP CProgram::m_arrays;
+std::map<STRING, unsigned int> CProgram::m_slotIndex;
+std::vector<VAR_SLOT> CProgram::m_slots(1);			// Slot zero is "no slot".
 std::deque<int> CProgram::m_params;
 std::map<STRING, CLASS> *CProgram::m_pClasses = NULL;
 std::map<unsigned int, STRING> CProgram::m_objects;
@@ -72,14 +80,31 @@ std::map<STRING, STRING> CProgram::m_redirects;
 std::set<CThread *> CThread::m_threads;
 STRING CProgram::m_parsing;
 unsigned long CProgram::m_runningPrograms = 0;
+unsigned long CProgram::m_unitsExecuted = 0;
 EXCEPTION_TYPE CProgram::m_debugLevel = E_WARNING;	// Show all error messages by default.
-
-// Critical section for garbage collection.
-LPCRITICAL_SECTION g_mutex = NULL;
+bool CProgram::m_bBytecode = true;						// Run compiled programs by default.
 
 static std::map<STRING, CProgram> g_cache; // Program cache.
 typedef std::map<STRING, CProgram>::iterator CACHE_ITR;
 
+#ifdef ENABLE_UNIT_LOCK
+// The critical section every unit held while the garbage collector ran
+// on its own thread. Collection now happens at safepoints; the lock is
+// kept behind this flag only to time its cost.
+static CRITICAL_SECTION g_unitMutex;
+
+// Hold the unit lock for a scope.
+typedef struct tagUnitLock
+{
+	tagUnitLock() { EnterCriticalSection(&g_unitMutex); }
+	~tagUnitLock() { LeaveCriticalSection(&g_unitMutex); }
+
+} UNIT_LOCK;
+#define LOCK_UNIT() const UNIT_LOCK unitLock
+#else
+#define LOCK_UNIT()
+#endif
+
 /*
  * *************************************************************************
  * Global Scope
@@ -283,6 +308,7 @@ CProgram &CProgram::operator=(const CProgram &rhs)
 	m_lines = rhs.m_lines;
 	//m_pBoardPrg = rhs.m_pBoardPrg; // Do not copy this.
 	m_units = rhs.m_units;
+	m_bytecode = rhs.m_bytecode;
 	m_i = rhs.m_i;
 	m_methods = rhs.m_methods;
 	m_inclusions = rhs.m_inclusions;
@@ -364,7 +390,7 @@ LPSTACK_FRAME CProgram::getVar(const STRING &name, unsigned int *pFrame, STRING
 	{
 		STRING var = name.substr(1);
 		if (pName) *pName = var;
-		return m_heap[var];
+		return heapVar(var);
 	}
 	if (name[0] == _T(' '))
 	{
@@ -382,40 +408,391 @@ LPSTACK_FRAME CProgram::getVar(const STRING &name, unsigned int *pFrame, STRING
 	{
 		const STRING &qualified = res.second;
 		if (pName) *pName = qualified;
-		return m_heap[qualified];
+		return heapVar(qualified);
 	}
 	return (this->*m_pResolveFunc)(name, pFrame);
 }
 
+// Get the variable an identifier refers to. This finds the same
+// variable as getVar(var.lit), but uses the identifier's slot to
+// avoid looking its name up.
+LPSTACK_FRAME CProgram::getVar(const STACK_FRAME &var)
+{
+	if (var.pElement && CArray::isCurrent(var.pArray, var.generation))
+	{
+		return *var.pElement;
+	}
+	if (!var.slot)
+	{
+		return getVar(var.lit);
+	}
+
+	VAR_SLOT &slot = m_slots[var.slot];
+	if (slot.global)
+	{
+		return global(m_slots[slot.global]);
+	}
+	if (slot.bParam)
+	{
+		REFERENCE_MAP &r = m_calls.back().refs;
+		REFERENCE_MAP::iterator j = r.find((unsigned int)slot.name[1]);
+		if (j != r.end())
+		{
+			return j->second.first;
+		}
+	}
+	if (m_calls.size() && m_calls.back().obj)
+	{
+		CALL_FRAME &fr = m_calls.back();
+		if (!fr.pClass)
+		{
+			// Let getInstanceVar() find the class.
+			return getVar(var.lit);
+		}
+		const int idx = fr.pClass->memberIndex(var.slot, slot.name);
+		if (idx >= 0)
+		{
+			return member(fr, idx);
+		}
+	}
+
+	LOCAL_FRAME &locals = getLocals()->back();
+	if (m_pResolveFunc == &CProgram::resolveVarGlobal)
+	{
+		const LPSTACK_FRAME p = locals.find(var, slot.name);
+		if (p) return p;
+		return global(slot);
+	}
+	CPtrData<STACK_FRAME> *const p = findGlobal(slot);
+	if (p) return *p;
+	return &locals[slot.name];
+}
+
+// Get a member of a call's this pointer by its index in the class,
+// remembering it for as long as nothing is erased from the heap.
+CPtrData<STACK_FRAME> &CProgram::member(CALL_FRAME &fr, const unsigned int idx)
+{
+	const unsigned int count = fr.pClass->members.size();
+	if ((fr.heapGeneration != m_heapGeneration) || (fr.members.size() != count))
+	{
+		fr.members.assign(count, NULL);
+		fr.heapGeneration = m_heapGeneration;
+	}
+
+	CPtrData<STACK_FRAME> *&p = fr.members[idx];
+	if (!p)
+	{
+		TCHAR str[33];
+		_itot(fr.obj, str, 10);
+		p = &m_heap[STRING(str) + _T("::") + fr.pClass->members[idx].first];
+	}
+	return *p;
+}
+
+// Get the slot of a variable name, allocating one if needed.
+unsigned int CProgram::getSlot(const STRING &name)
+{
+	std::map<STRING, unsigned int>::const_iterator i = m_slotIndex.find(name);
+	if (i != m_slotIndex.end())
+	{
+		return i->second;
+	}
+
+	const unsigned int idx = m_slots.size();
+	m_slotIndex.insert(std::map<STRING, unsigned int>::value_type(name, idx));
+	m_slots.push_back(VAR_SLOT());
+	m_slots.back().name = name;
+	m_slots.back().bParam = (name.length() > 1 && name[0] == _T(' '));
+
+	if (name.length() > 1 && name[0] == _T(':'))
+	{
+		// Explicit globals refer to the slot of the bare name.
+		const unsigned int global = getSlot(name.substr(1));
+		m_slots[idx].global = global;
+	}
+	return idx;
+}
+
+// Find the global in a slot, without creating it.
+CPtrData<STACK_FRAME> *CProgram::findGlobal(VAR_SLOT &slot)
+{
+	if (slot.pGlobal)
+	{
+		return slot.pGlobal;
+	}
+
+	// No global can have appeared if the heap has neither grown
+	// nor had anything erased from it since we last looked.
+	if ((slot.heapSize == m_heap.size()) && (slot.heapGeneration == m_heapGeneration))
+	{
+		return NULL;
+	}
+
+	std::map<STRING, CPtrData<STACK_FRAME> >::iterator i = m_heap.find(slot.name);
+	if (i != m_heap.end())
+	{
+		return (slot.pGlobal = &i->second);
+	}
+	slot.heapSize = m_heap.size();
+	slot.heapGeneration = m_heapGeneration;
+	return NULL;
+}
+
+// Get the global in a slot, creating it if needed.
+CPtrData<STACK_FRAME> &CProgram::global(VAR_SLOT &slot)
+{
+	CPtrData<STACK_FRAME> *const p = findGlobal(slot);
+	return (p ? *p : *(slot.pGlobal = &m_heap[slot.name]));
+}
+
+// Forget any slot's knowledge of a global that is about to be erased.
+void CProgram::forgetGlobal(const STRING &name)
+{
+	++m_heapGeneration;
+	std::map<STRING, unsigned int>::const_iterator i = m_slotIndex.find(name);
+	if (i != m_slotIndex.end())
+	{
+		m_slots[i->second].pGlobal = NULL;
+	}
+}
+
+// Forget every slot's knowledge of the globals.
+void CProgram::forgetGlobals()
+{
+	++m_heapGeneration;
+	std::vector<VAR_SLOT>::iterator i = m_slots.begin();
+	for (; i != m_slots.end(); ++i)
+	{
+		i->pGlobal = NULL;
+	}
+}
+
 // Prefer the global scope when resolving a variable.
 LPSTACK_FRAME CProgram::resolveVarGlobal(const STRING &name, unsigned int *pFrame)
 {
-	std::list<std::map<STRING, STACK_FRAME> > *pLocalList = getLocals();
-	std::map<STRING, STACK_FRAME> *pLocals = &pLocalList->back();
+	std::list<LOCAL_FRAME> *pLocalList = getLocals();
+	LOCAL_FRAME *pLocals = &pLocalList->back();
 
-	std::map<STRING, STACK_FRAME>::iterator res = pLocals->find(name);
+	const LPSTACK_FRAME res = pLocals->get(name);
 
-	if (res != pLocals->end())
+	if (res)
 	{
 		if (pFrame) *pFrame = pLocalList->size();
-		return &res->second;
+		return res;
 	}
-	return m_heap[name];
+	return heapVar(name);
 }
 
 // Prefer the local scope when resolving a variable.
 LPSTACK_FRAME CProgram::resolveVarLocal(const STRING &name, unsigned int *pFrame)
 {
-	std::map<STRING, CPtrData<STACK_FRAME> >::iterator i = m_heap.find(name);
-	if (i != m_heap.end())
+	CPtrData<STACK_FRAME> *const p = findHeapVar(name);
+	if (p)
 	{
-		return i->second;
+		return *p;
 	}
-	std::list<std::map<STRING, STACK_FRAME> > *pLocals = getLocals();
+	std::list<LOCAL_FRAME> *pLocals = getLocals();
 	if (pFrame) *pFrame = pLocals->size();
 	return &pLocals->back()[name];
 }
 
+// Get an element of an array by index, creating it if needed. This
+// finds the element getVar() would find by name, or returns NULL if
+// the element must be found by name.
+CArray::ELEMENT *CProgram::getElement(const STRING &array, const unsigned int idx, const CArray *&pArray)
+{
+	pArray = NULL;
+	if (array[0] == _T(':'))
+	{
+		CArray &global = m_arrays[array.substr(1)];
+		pArray = &global;
+		return &global.at(idx);
+	}
+	if (array[0] == _T(' '))
+	{
+		// Parameters may be references.
+		return NULL;
+	}
+
+	LOCAL_FRAME &locals = getLocals()->back();
+	if (m_pResolveFunc == &CProgram::resolveVarGlobal)
+	{
+		CArray *const pLocal = locals.findArray(array);
+		CArray::ELEMENT *const p = (pLocal ? pLocal->find(idx) : NULL);
+		if (p)
+		{
+			pArray = pLocal;
+			return p;
+		}
+		CArray &global = m_arrays[array];
+		pArray = &global;
+		return &global.at(idx);
+	}
+	ARRAY_MAP::iterator i = m_arrays.find(array);
+	CArray::ELEMENT *const p = ((i != m_arrays.end()) ? i->second.find(idx) : NULL);
+	if (p)
+	{
+		pArray = &i->second;
+		return p;
+	}
+	CArray &local = locals.array(array);
+	pArray = &local;
+	return &local.at(idx);
+}
+
+// Get a global variable or array element, creating it if needed.
+CPtrData<STACK_FRAME> &CProgram::heapVar(const STRING &name)
+{
+	STRING array, key;
+	if (CArray::split(name, array, key))
+	{
+		return m_arrays[array][key];
+	}
+	return m_heap[name];
+}
+
+// Find a global variable or array element, or NULL if it does not exist.
+CPtrData<STACK_FRAME> *CProgram::findHeapVar(const STRING &name)
+{
+	STRING array, key;
+	if (CArray::split(name, array, key))
+	{
+		ARRAY_MAP::const_iterator i = m_arrays.find(array);
+		return ((i != m_arrays.end()) ? i->second.find(key) : NULL);
+	}
+	std::map<STRING, CPtrData<STACK_FRAME> >::iterator i = m_heap.find(name);
+	return ((i != m_heap.end()) ? &i->second : NULL);
+}
+
+// Free a global variable or array element.
+void CProgram::freeHeapVar(const STRING &name)
+{
+	STRING array, key;
+	if (CArray::split(name, array, key))
+	{
+		ARRAY_MAP::iterator i = m_arrays.find(array);
+		if ((i != m_arrays.end()) && i->second.erase(key) && !i->second.size())
+		{
+			m_arrays.erase(i);
+		}
+		return;
+	}
+	forgetGlobal(name);
+	m_heap.erase(name);
+}
+
+// Assign a local frame. Remembered lookups are not copied.
+tagLocalFrame &tagLocalFrame::operator=(const tagLocalFrame &rhs)
+{
+	m_vars = rhs.m_vars;
+	m_arrays = rhs.m_arrays;
+	m_slots.clear();
+	return *this;
+}
+
+// Get a local variable or array element, creating it if needed.
+STACK_FRAME &tagLocalFrame::operator[](const STRING &name)
+{
+	STRING array, key;
+	if (CArray::split(name, array, key))
+	{
+		return *static_cast<LPSTACK_FRAME>(m_arrays[array][key]);
+	}
+
+	VARIABLES::iterator i = m_vars.lower_bound(name);
+	if ((i == m_vars.end()) || m_vars.key_comp()(name, i->first))
+	{
+		i = m_vars.insert(i, VARIABLES::value_type(name, STACK_FRAME()));
+
+		// Forget which slots were found to be absent.
+		++m_generation;
+	}
+	return i->second;
+}
+
+// Find a local array, or NULL if it does not exist.
+CArray *tagLocalFrame::findArray(const STRING &name)
+{
+	ARRAY_MAP::iterator i = m_arrays.find(name);
+	return ((i != m_arrays.end()) ? &i->second : NULL);
+}
+
+// Find a local variable or array element, or NULL if it does not exist.
+LPSTACK_FRAME tagLocalFrame::get(const STRING &name)
+{
+	STRING array, key;
+	if (CArray::split(name, array, key))
+	{
+		ARRAY_MAP::const_iterator i = m_arrays.find(array);
+		CArray::ELEMENT *const p = ((i != m_arrays.end()) ? i->second.find(key) : NULL);
+		if (p) return *p;
+		return NULL;
+	}
+	VARIABLES::iterator i = m_vars.find(name);
+	return ((i != m_vars.end()) ? &i->second : NULL);
+}
+
+// Find a local variable by an identifier's slot, or NULL if it
+// does not exist.
+LPSTACK_FRAME tagLocalFrame::find(const STACK_FRAME &var, const STRING &name)
+{
+	if (var.local >= m_slots.size())
+	{
+		m_slots.resize(var.local + 1);
+	}
+
+	SLOT_ENTRY &entry = m_slots[var.local];
+	if ((entry.slot == var.slot) && (entry.p || (entry.generation == m_generation)))
+	{
+		return entry.p;
+	}
+
+	VARIABLES::iterator i = m_vars.find(name);
+	entry.slot = var.slot;
+	entry.generation = m_generation;
+	entry.p = ((i != m_vars.end()) ? &i->second : NULL);
+	return entry.p;
+}
+
+// Erase a local variable or array element.
+unsigned int tagLocalFrame::erase(const STRING &name)
+{
+	STRING array, key;
+	if (CArray::split(name, array, key))
+	{
+		ARRAY_MAP::iterator i = m_arrays.find(array);
+		if ((i == m_arrays.end()) || !i->second.erase(key))
+		{
+			return 0;
+		}
+		if (!i->second.size()) m_arrays.erase(i);
+		return 1;
+	}
+
+	VARIABLES::iterator i = m_vars.find(name);
+	if (i == m_vars.end())
+	{
+		return 0;
+	}
+
+	std::vector<SLOT_ENTRY>::iterator j = m_slots.begin();
+	for (; j != m_slots.end(); ++j)
+	{
+		if (j->p == &i->second) *j = SLOT_ENTRY();
+	}
+	m_vars.erase(i);
+	return 1;
+}
+
+// Exchange the contents of two local frames.
+void tagLocalFrame::swap(tagLocalFrame &rhs)
+{
+	m_vars.swap(rhs.m_vars);
+	m_arrays.swap(rhs.m_arrays);
+	m_slots.swap(rhs.m_slots);
+	std::swap(m_generation, rhs.m_generation);
+}
+
 // Remove a redirect from the list.
 void CProgram::removeRedirect(CONST STRING str)
 {
@@ -452,12 +829,12 @@ void CProgram::addFunction(const STRING &name, const MACHINE_FUNC func)
 // Free a variable.
 void CProgram::freeVar(const STRING &var)
 {
-	std::map<STRING, STACK_FRAME> *pLocals = &getLocals()->back();
+	LOCAL_FRAME *pLocals = &getLocals()->back();
 	if (pLocals->erase(var))
 	{
 		return;
 	}
-	m_heap.erase(var);
+	freeHeapVar(var);
 }
 
 // Free an object.
@@ -467,30 +844,48 @@ void CProgram::freeObject(unsigned int obj)
 	assert(res != m_objects.end() && m_classes.find(res->second) != m_classes.end());
 	if (res != m_objects.end())
 	{
-		TCHAR str[20];
-		_itot_s(obj, str, 20, 10);
+		forgetObject(obj);
+	}
+}
 
-		//` Remove any heap vars that are in the expected format. Doesn't explicitly check the members
-		//  list, but that doesn't appear to be needed. This way, array elements will get destroyed too,
-		//  which are typically going to be the bulk of heavier objects.
-		STRING prefix = STRING(str) + _T("::");
-		std::map<STRING, CPtrData<STACK_FRAME> >::const_iterator it = m_heap.lower_bound(prefix);
-		while (it != m_heap.end() && it->first.substr(0, prefix.length()) == prefix)
-		{
-			m_heap.erase(it++); //<- Increments before invalidating iterator.
-		}
+// Free an object's members and its identifier, without checking its class.
+void CProgram::forgetObject(unsigned int obj)
+{
+	TCHAR str[20];
+	_itot_s(obj, str, 20, 10);
 
-		m_objects.erase(obj);
+	//` Remove any heap vars that are in the expected format. Doesn't explicitly check the members
+	//  list, but that doesn't appear to be needed. This way, array elements will get destroyed too,
+	//  which are typically going to be the bulk of heavier objects.
+	STRING prefix = STRING(str) + _T("::");
+	std::map<STRING, CPtrData<STACK_FRAME> >::const_iterator it = m_heap.lower_bound(prefix);
+	while (it != m_heap.end() && it->first.substr(0, prefix.length()) == prefix)
+	{
+		forgetGlobal(it->first);
+		m_heap.erase(it++); //<- Increments before invalidating iterator.
+	}
+	ARRAY_MAP::iterator arr = m_arrays.lower_bound(prefix);
+	while (arr != m_arrays.end() && arr->first.substr(0, prefix.length()) == prefix)
+	{
+		m_arrays.erase(arr++);
 	}
+
+	m_objects.erase(obj);
 }
 
 // Handle a method call.
 void CProgram::methodCall(CALL_DATA &call)
 {
-	std::map<STRING, STACK_FRAME> local;
+	// Method calls are safepoints for garbage collection: for now,
+	// everything the call refers to is still on the stack.
+	CGarbageCollector::getInstance().safepoint();
+
+	LOCAL_FRAME local;
 
 	CALL_FRAME fr;
 	fr.obj = 0;
+	fr.pClass = NULL;
+	fr.heapGeneration = 0;
 
 	// Will be > 0 because the first line is at least a skipMethod.
 	fr.errorReturn = 0;
@@ -573,6 +968,7 @@ void CProgram::methodCall(CALL_DATA &call)
 		STACK_FRAME &lvar = local[_T("this")];
 		lvar.udt = UNIT_DATA_TYPE(UDT_OBJ | UDT_NUM);
 		lvar.num = fr.obj = obj;
+		fr.pClass = &cls_it->second;
 
 		// The parameters are offset because of the object pointer.
 		bObjectCall = true;
@@ -647,7 +1043,8 @@ void CProgram::methodCall(CALL_DATA &call)
 	}
 
 	// Push a new local heap onto the stack of heaps for this method.
-	call.prg->getLocals()->push_back(local);
+	call.prg->getLocals()->push_back(LOCAL_FRAME());
+	call.prg->getLocals()->back().swap(local);
 
 	// Record the current position in the program.
 	fr.i = call.prg->m_i - call.prg->m_units.begin();
@@ -749,7 +1146,10 @@ void CProgram::pluginCall(CALL_DATA &call)
 	CProgram *const prg = g_prg;
 	g_prg = call.prg;
 	int dt = PLUG_DT_VOID; STRING lit; double num = 0.0;
-	pPlugin->execute(line, dt, lit, num, !(call.prg->m_i->udt & UDT_LINE));
+	{
+		PROFILE("plugin");
+		pPlugin->execute(line, dt, lit, num, !(call.prg->m_i->udt & UDT_LINE));
+	}
 	g_prg = prg;
 
 	if (dt == PLUG_DT_NUM)
@@ -789,7 +1189,11 @@ void CProgram::returnReference(CALL_DATA &call)
 	if (res.first)
 	{
 		call[0].lit = _T(':') + res.second;
+		call[0].slot = 0;
+		call[0].local = 0;
 	}
+	// The element may be local to the method.
+	call[0].pElement = NULL;
 	call.prg->returnFromMethod(call[0]);
 }
 
@@ -805,19 +1209,32 @@ bool CProgram::open(const STRING fileName)
 		return true;
 	}
 
-	FILE *file = fopen(resolve(fileName).c_str(), _T("rb"));
-	if (!file) return false;
+	// Read programs in the pak file from its cache.
+	PAK_FILE *const pPak = pakAcquire(fileName);
+	FILE *file = pPak ? NULL : fopen(resolve(fileName).c_str(), _T("rb"));
+	if (!pPak && !file) return false;
 
 	m_fileName = fileName;
 
 	// Get the length of the file.
-	fseek(file, 0, SEEK_END);
-	const long length = ftell(file);
+	long length = 0;
+	if (file)
+	{
+		fseek(file, 0, SEEK_END);
+		length = ftell(file);
+		fseek(file, 0, SEEK_SET);
+	}
+	else
+	{
+		length = pPak->data.size();
+	}
 	if (length == 0)
 	{
 		// It is unlikely that the file is completely blank,
 		// but this avoids a crash in case it is.
-		fclose(file);
+		if (file) fclose(file);
+		pakRelease(pPak);
+		CProgramCache::store(*this, CProgramCache::hashSource(NULL, 0));
 		prime();
 		g_cache[fileName] = *this;
 		return true;
@@ -825,14 +1242,34 @@ bool CProgram::open(const STRING fileName)
 
 	const STRING parsing = m_parsing;
 	m_parsing = fileName;
-	fseek(file, 0, SEEK_SET);
 
 	// Programs starting with include, redirect and possibly
 	// other things crash. As a quick solution, we add "1",
 	// a line that does nothing, to the start of each file.
 
 	char *const str = (char *const)malloc(sizeof(char) * (length + 3));
-	fread(str + 2, sizeof(char), length, file);
+	if (file)
+	{
+		fread(str + 2, sizeof(char), length, file);
+		fclose(file);				// Close the original file...
+	}
+	else
+	{
+		memcpy(str + 2, &pPak->data[0], length);
+		pakRelease(pPak);
+	}
+
+	// Read the compiled program from the on-disk cache, if
+	// it was compiled from this source.
+	const unsigned __int64 source = CProgramCache::hashSource(str + 2, length);
+	if (CProgramCache::load(*this, fileName, source))
+	{
+		free(str);
+		m_parsing = parsing;
+		prime();
+		g_cache[fileName] = *this;
+		return true;
+	}
 
 	str[0] = '1';		// Arbitrary first line.
 	str[1] = '\n';
@@ -842,7 +1279,6 @@ bool CProgram::open(const STRING fileName)
 	// blank line.
 	str[length + 2] = '\n';
 
-	fclose(file);					// Close the original file...
 	file = createTemporaryFile();	// ...and create another.
 
 	// Write the updated version to our temp file.
@@ -856,6 +1292,7 @@ bool CProgram::open(const STRING fileName)
 
 	fclose(file);
 
+	CProgramCache::store(*this, source);
 	prime();
 
 	// Store this program in the cache.
@@ -872,7 +1309,7 @@ void CProgram::prime()
 	m_stackIndex = 0;
 	m_calls.clear();
 	m_locals.clear();
-	m_locals.push_back(std::map<STRING, STACK_FRAME>());
+	m_locals.push_back(LOCAL_FRAME());
 	m_i = m_units.begin();
 	// Prefer the global scope when resolving a variable by default.
 	m_pResolveFunc = &CProgram::resolveVarGlobal;
@@ -1217,6 +1654,9 @@ void CProgram::parseFile(FILE *pFile)
 
 	// Resolve function calls.
 	resolveFunctions();
+
+	// Lower the final units to bytecode.
+	m_bytecode.compile(m_units);
 }
 
 // Match all curly braces and update method locations.
@@ -1483,17 +1923,32 @@ void CProgram::serialiseState(CFile &stream) const
 	// Local variables.
 	{
 		stream << int(m_locals.size());
-		std::list<std::map<STRING, STACK_FRAME> >::const_iterator i = m_locals.begin();
+		std::list<LOCAL_FRAME>::const_iterator i = m_locals.begin();
 		for (; i != m_locals.end(); ++i)
 		{
-			stream << int(i->size());
+			// Array elements are written by name, as "array[key]".
+			std::vector<CArray::ENTRY> elements;
+			ARRAY_MAP::const_iterator k = i->arrays().begin();
+			for (; k != i->arrays().end(); ++k)
+			{
+				k->second.enumerate(elements, k->first);
+			}
 
-			std::map<STRING, STACK_FRAME>::const_iterator j = i->begin();
+			stream << int(i->size() + elements.size());
+
+			LOCAL_FRAME::const_iterator j = i->begin();
 			for (; j != i->end(); ++j)
 			{
 				stream << j->first;
 				serialiseStackFrame(stream, j->second);
 			}
+
+			std::vector<CArray::ENTRY>::const_iterator m = elements.begin();
+			for (; m != elements.end(); ++m)
+			{
+				stream << m->first;
+				serialiseStackFrame(stream, *static_cast<LPSTACK_FRAME>(*m->second));
+			}
 		}
 	}
 
@@ -1580,12 +2035,12 @@ void CProgram::reconstructState(CFile &stream)
 		stream >> stackSize;
 		for (unsigned int i = 0; i < stackSize; ++i)
 		{
-			m_locals.push_back(std::map<STRING, STACK_FRAME>());
+			m_locals.push_back(LOCAL_FRAME());
 
 			int frameSize = 0;
 			stream >> frameSize;
 
-			std::map<STRING, STACK_FRAME> &frame = m_locals.back();
+			LOCAL_FRAME &frame = m_locals.back();
 
 			for (unsigned int j = 0; j < frameSize; ++j)
 			{
@@ -1612,6 +2067,8 @@ void CProgram::reconstructState(CFile &stream)
 			stream >> cf.i;
 			stream >> cf.j;
 			stream >> cf.obj;
+			cf.pClass = NULL;
+			cf.heapGeneration = 0;
 			cf.p = &(m_stack.end() - j)->back();
 			int count;
 			stream >> count;
@@ -1636,12 +2093,12 @@ void CProgram::reconstructState(CFile &stream)
 					const unsigned int frame = ref.second.first;
 					if (frame == 0)
 					{
-						ref.first = m_heap[ref.second.second];
+						ref.first = heapVar(ref.second.second);
 						continue;
 					}
-					std::list<std::map<STRING, STACK_FRAME> >::iterator itr = getLocals()->begin();
+					std::list<LOCAL_FRAME>::iterator itr = getLocals()->begin();
 					for (int i = 0; i < frame - 1; ++i) ++itr;
-					ref.first = &itr->find(ref.second.second)->second;
+					ref.first = itr->get(ref.second.second);
 				}
 			}
 
@@ -1704,34 +2161,86 @@ STACK_FRAME CProgram::run()
 	if (!isReady())
 		return STACK_FRAME();
 
+	PROFILE("program");
+#ifdef ENABLE_MUMU_DBG
+	CProgramProfiler::CRun profiled(*this);
+#endif
+
 	++m_runningPrograms;
 	programInit();
 
+	if (isCompiled())
+	{
+		// Reserve enough of the data stack that pushing
+		// within a statement never reallocates.
+		m_stack[m_stackIndex].reserve(m_bytecode.depth());
+	}
+
 #ifdef ENABLE_MUMU_DBG
 	if (m_enableMumu)
 	{
 		CMumuDebugger mumu(*this);
 		
-		for (m_i = m_units.begin(); m_i != m_units.end(); ++m_i)
+		if (isCompiled())
 		{
-			mumu.update(m_i);
-			m_i->execute(this);
-			processEvent();
+			for (unsigned int pc = 0; pc < m_bytecode.size(); ++pc)
+			{
+				// The debugger inspects m_i, so keep it current.
+				m_i = m_units.begin() + pc;
+				mumu.update(m_i);
+				const bool bLine = m_bytecode[pc].bLine;
+				const unsigned int unit = pc;
+				pc = executeInstruction(pc);
+				profileUnit(*this, unit);
+				if (bLine)
+				{
+					processEvent();
+					if (isQuitting()) break;
+				}
+			}
+			m_i = m_units.end();
 		}
+		else
+		{
+			for (m_i = m_units.begin(); m_i != m_units.end(); ++m_i)
+			{
+				mumu.update(m_i);
+				const unsigned int unit = m_i - m_units.begin();
+				m_i->execute(this);
+				profileUnit(*this, unit);
+				processEvent();
+				if (isQuitting()) break;
+			}
+		}
+	}
+	else if (isCompiled())
+	{
+		runCompiled();
 	}
 	else
 	{
 		for (m_i = m_units.begin(); m_i != m_units.end(); ++m_i)
 		{
+			const unsigned int unit = m_i - m_units.begin();
 			m_i->execute(this);
+			profileUnit(*this, unit);
 			processEvent();
+			if (isQuitting()) break;
 		}
 	}
 #else
-	for (m_i = m_units.begin(); m_i != m_units.end(); ++m_i)
+	if (isCompiled())
 	{
-		m_i->execute(this);
-		processEvent();
+		runCompiled();
+	}
+	else
+	{
+		for (m_i = m_units.begin(); m_i != m_units.end(); ++m_i)
+		{
+			m_i->execute(this);
+			processEvent();
+			if (isQuitting()) break;
+		}
 	}
 #endif
 
@@ -1749,6 +2258,121 @@ STACK_FRAME CProgram::run()
 	return ret;
 }
 
+// Run the compiled form of the program from the beginning.
+void CProgram::runCompiled()
+{
+	for (unsigned int pc = 0; pc < m_bytecode.size(); ++pc)
+	{
+		const bool bLine = m_bytecode[pc].bLine;
+		const unsigned int unit = pc;
+		pc = executeInstruction(pc);
+		profileUnit(*this, unit);
+
+		// Pump messages once per statement rather than once per unit.
+		if (bLine)
+		{
+			processEvent();
+			if (isQuitting()) break;
+		}
+	}
+	m_i = m_units.end();
+}
+
+// Execute a single bytecode instruction. This mirrors tagMachineUnit::execute(),
+// with the decisions it makes about closing braces taken at compile-time.
+unsigned int CProgram::executeInstruction(unsigned int pc)
+{
+	extern void multiRunEnd(CProgram *prg);
+
+	LOCK_UNIT();
+	++m_unitsExecuted;
+
+	const INSTRUCTION &ins = m_bytecode[pc];
+	const bool bLine = ins.bLine;
+
+	switch (ins.op)
+	{
+		case OP_PUSH:
+		{
+			std::vector<STACK_FRAME> &stack = m_stack[m_stackIndex];
+			stack.push_back(m_bytecode.operand(ins.operand));
+			stack.back().prg = this;
+		} break;
+
+		case OP_CALL:
+		{
+			// The function may recompile the program (runtime inclusion),
+			// so nothing is read from the instruction after the call.
+			const int params = ins.params;
+			const MACHINE_FUNC func = ins.func;
+
+			m_stack[m_stackIndex].push_back(this);
+			if (func)
+			{
+				// Functions read and move m_i, so it must be current.
+				m_i = m_units.begin() + pc;
+				try
+				{
+					assert(m_stack[m_stackIndex].size() > params);
+					CALL_DATA call = {params, &m_stack[m_stackIndex].back() - params, this};
+					func(call);
+				}
+				catch (CException exp)
+				{
+					handleError(&exp);
+				}
+				catch (...)
+				{
+					handleError(NULL);
+				}
+				pc = m_i - m_units.begin();
+			}
+
+			// methodCall() may have switched stacks; see tagMachineUnit::execute().
+			std::vector<STACK_FRAME> &stack = m_stack[m_stackIndex];
+			assert(stack.size() > params);
+			stack.erase(stack.end() - params - 1, stack.end() - 1);
+		} break;
+
+		case OP_LOOP:
+			// Loop back-edges are safepoints for garbage collection.
+			CGarbageCollector::getInstance().safepoint();
+			pc = ins.operand;
+			break;
+
+		case OP_END_IF:
+			pc = ins.operand;
+			break;
+
+		case OP_RETURN:
+		{
+			const bool bReturn = m_calls.back().bReturn;
+			pc = m_calls.back().i;
+			m_calls.pop_back();
+			m_stack.pop_back();
+			m_stackIndex = m_stack.size() - 1;
+			getLocals()->pop_back();
+			if (bReturn)
+			{
+				return pc;
+			}
+		} break;
+
+		case OP_END_MULTIRUN:
+			multiRunEnd(this);
+			break;
+
+		default:
+			break;
+	}
+
+	if (bLine)
+	{
+		m_stack[m_stackIndex].clear();
+	}
+	return pc;
+}
+
 // Jump to a label.
 bool CProgram::jump(const STRING label)
 {
@@ -1912,6 +2536,7 @@ void CProgram::classFactory(CALL_DATA &call)
 	unsigned int obj = m_objects.size() + 1;
 	while (m_objects.count(obj)) ++obj;
 	m_objects.insert(std::map<unsigned int, STRING>::value_type(obj, cls));
+	CGarbageCollector::getInstance().barrier(obj);
 
 	call.ret().udt = UNIT_DATA_TYPE(UDT_OBJ | UDT_NUM);
 	call.ret().num = obj;
@@ -2006,6 +2631,10 @@ void CProgram::runtimeInclusion(CALL_DATA &call)
 	// And update references to the code that we just injected into the program.
 	call.prg->updateLocations(call.prg->m_units.begin() + size);
 	call.prg->resolveFunctions();
+
+	// The new units have to be compiled too. The existing ones
+	// keep their positions, so a running program is unaffected.
+	call.prg->m_bytecode.compile(call.prg->m_units);
 }
 
 void CProgram::initialize()
@@ -2054,6 +2683,7 @@ void CProgram::initialize()
 	addFunction(_T("i--"), operators::postfixDecrement);
 	addFunction(_T("-i"), operators::unaryNegation);
 	addFunction(_T("!"), operators::lnot);
+	addFunction(_T("~"), operators::bnot);			// For CProgramCache; see below.
 	addFunction(_T("?:"), operators::tertiary);
 	addFunction(_T("->"), operators::member);
 
@@ -2076,8 +2706,13 @@ void CProgram::initialize()
 	addFunction(_T("null op"), nullOp);
 	addFunction(_T(" releaseObj"), releaseObj);
 
-	// Get the mutex for program execution.
-	g_mutex = CGarbageCollector::getInstance().getMutex();
+	// The parser calls these directly rather than by name, but every
+	// function a unit calls needs a name for CProgramCache to store it.
+	addFunction(_T(" switch"), switchFunc);
+
+#ifdef ENABLE_UNIT_LOCK
+	InitializeCriticalSection(&g_unitMutex);
+#endif
 }
 
 /*
@@ -2140,10 +2775,16 @@ void CThread::destroyAll()
 // Multitask now.
 void CThread::multitask(const unsigned int units)
 {
+	// This runs every frame, whether or not there are threads, so
+	// garbage is collected even when no program is running.
+	CGarbageCollector &gc = CGarbageCollector::getInstance();
+	gc.safepoint();
+
 	std::set<CThread *>::iterator i = m_threads.begin();
 	for (; i != m_threads.end(); ++i)
 	{
 		(*i)->execute(units);
+		gc.safepoint();
 	}
 }
 
@@ -2153,7 +2794,7 @@ void CThread::sleep(const unsigned long milliseconds)
 {
 	m_bSleeping = true;
 	m_sleepDuration = milliseconds;
-	m_sleepBegin = GetTickCount();
+	m_sleepBegin = engineTime();
 }
 
 // Is a thread sleeping?
@@ -2161,7 +2802,7 @@ bool CThread::isSleeping() const
 {
 	if (!m_bSleeping) return false;
 
-	if (m_sleepDuration && (GetTickCount() - m_sleepBegin >= m_sleepDuration))
+	if (m_sleepDuration && (engineTime() - m_sleepBegin >= m_sleepDuration))
 	{
 		m_bSleeping = false;
 		return false;
@@ -2173,16 +2814,35 @@ bool CThread::isSleeping() const
 unsigned long CThread::sleepRemaining() const
 {
 	if (!isSleeping() || !m_sleepDuration) return 0;
-	return (m_sleepDuration - (GetTickCount() - m_sleepBegin));
+	return (m_sleepDuration - (engineTime() - m_sleepBegin));
 }
 
 // Execute n units from a program.
 bool CThread::execute(const unsigned int units)
 {
+#ifdef ENABLE_MUMU_DBG
+	CProgramProfiler::CRun profiled(*this);
+#endif
+
 	unsigned int i = 0;
+	if (isCompiled())
+	{
+		unsigned int pc = m_i - m_units.begin();
+		while ((pc < m_bytecode.size()) && (i++ < units) && !isSleeping())
+		{
+			const unsigned int unit = pc;
+			pc = executeInstruction(pc) + 1;
+			profileUnit(*this, unit);
+		}
+		m_i = m_units.begin() + pc;
+		return true;
+	}
+
 	while ((m_i != m_units.end()) && (i++ < units) && !isSleeping())
 	{
+		const unsigned int unit = m_i - m_units.begin();
 		m_i->execute(this);
+		profileUnit(*this, unit);
 		++m_i; 
 	}
 	return true;
@@ -2218,6 +2878,37 @@ bool tagClass::memberExists(const STRING &name, const CLASS_VISIBILITY vis) cons
 	return false;
 }
 
+// Find the member a variable slot names, looking its name up only the
+// first time the slot is used with the class.
+int tagClass::memberIndex(const unsigned int slot, const STRING &name) const
+{
+	if (m_indexed != members.size())
+	{
+		// Members have been added since.
+		m_slotMembers.clear();
+		m_indexed = members.size();
+	}
+	if (slot >= m_slotMembers.size())
+	{
+		m_slotMembers.resize(slot + 1, -2);
+	}
+
+	int &idx = m_slotMembers[slot];
+	if (idx == -2)
+	{
+		idx = -1;
+		for (unsigned int i = 0; i < members.size(); ++i)
+		{
+			if (members[i].first == name)
+			{
+				idx = i;
+				break;
+			}
+		}
+	}
+	return idx;
+}
+
 // Inherit a class.
 void tagClass::inherit(const tagClass &cls)
 {
@@ -2272,7 +2963,9 @@ void tagClass::inherit(const tagClass &cls)
 // Execute an instruction unit.
 void tagMachineUnit::execute(CProgram *prg) const
 {
-	EnterCriticalSection(g_mutex);
+	LOCK_UNIT();
+	++CProgram::m_unitsExecuted;
+
 	if (udt & UDT_FUNC)
 	{
 		prg->m_stack[prg->m_stackIndex].push_back(prg);
@@ -2323,6 +3016,7 @@ void tagMachineUnit::execute(CProgram *prg) const
 			if ((func == CProgram::whileLoop) || (func == CProgram::forLoop) || (func == CProgram::untilLoop))
 			{
 				prg->m_i = prg->m_units.begin() + (pLines[1] > 0 ? pLines[1] : 1) - 1;
+				CGarbageCollector::getInstance().safepoint();
 			}
 			else if (func == CProgram::skipMethod)
 			{
@@ -2334,7 +3028,6 @@ void tagMachineUnit::execute(CProgram *prg) const
 				prg->getLocals()->pop_back();
 				if (bReturn)
 				{
-					LeaveCriticalSection(g_mutex);
 					return;
 				}
 			}
@@ -2372,7 +3065,6 @@ void tagMachineUnit::execute(CProgram *prg) const
 	{
 		prg->m_stack[prg->m_stackIndex].clear();
 	}
-	LeaveCriticalSection(g_mutex);
 }
 
 /*
@@ -2419,7 +3111,7 @@ double tagStackFrame::getNum() const
 {
 	if (udt & UDT_ID)
 	{
-		return prg->getVar(lit)->getNum();
+		return prg->getVar(*this)->getNum();
 	}
 	else if (udt & UDT_LIT)
 	{
@@ -2443,7 +3135,7 @@ STRING tagStackFrame::getLit() const
 {
 	if (udt & UDT_ID)
 	{
-		return prg->getVar(lit)->getLit();
+		return prg->getVar(*this)->getLit();
 #if !defined(_DEBUG) && defined(_MSC_VER)
 		// Without the following line, VC++ will crash
 		// in release mode. I'll be damned if I know why.
@@ -2472,7 +3164,7 @@ UNIT_DATA_TYPE tagStackFrame::getType() const
 {
 	if (udt & UDT_ID)
 	{
-		return prg->getVar(lit)->getType();
+		return prg->getVar(*this)->getType();
 	}
 	return udt;
 }
@@ -2482,7 +3174,7 @@ tagStackFrame tagStackFrame::getValue() const
 {
 	if (udt & UDT_ID)
 	{
-		return prg->getVar(lit)->getValue();
+		return prg->getVar(*this)->getValue();
 	}
 
 	// Ensure proper copying of virtual vars by using
@@ -2668,7 +3360,18 @@ void operators::assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(=, false);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	*call.prg->getVar(call.ret().lit) = call[1].getValue();
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	const STACK_FRAME value = call[1].getValue();
+	if (value.udt & UDT_OBJ)
+	{
+		// Tell the collector, in case it has already scanned this variable.
+		CGarbageCollector::getInstance().barrier((unsigned int)value.num);
+	}
+	*call.prg->getVar(call.ret()) = value;
 }
 
 void operators::xor_assign(CALL_DATA &call)
@@ -2676,7 +3379,12 @@ void operators::xor_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(`=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = int(call[0].getNum()) ^ int(call[1].getNum());
 	var.udt = UDT_NUM;
 }
@@ -2686,7 +3394,12 @@ void operators::or_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(|=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = int(call[0].getNum()) | int(call[1].getNum());
 	var.udt = UDT_NUM;
 }
@@ -2696,7 +3409,12 @@ void operators::and_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(&=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = int(call[0].getNum()) & int(call[1].getNum());
 	var.udt = UDT_NUM;
 }
@@ -2706,7 +3424,12 @@ void operators::rs_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(>>=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = int(call[0].getNum()) >> int(call[1].getNum());
 	var.udt = UDT_NUM;
 }
@@ -2716,7 +3439,12 @@ void operators::ls_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(<<=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = int(call[0].getNum()) << int(call[1].getNum());
 	var.udt = UDT_NUM;
 }
@@ -2726,7 +3454,12 @@ void operators::sub_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(-=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = call[0].getNum() - call[1].getNum();
 	var.udt = UDT_NUM;
 }
@@ -2736,7 +3469,12 @@ void operators::add_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(+=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	if ((call[0].getType() & UDT_NUM) && (call[1].getType() & UDT_NUM))
 	{
 		var.num = call[0].getNum() + call[1].getNum();
@@ -2754,7 +3492,12 @@ void operators::mod_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(%=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = int(call[0].getNum()) % int(call[1].getNum());
 	var.udt = UDT_NUM;
 }
@@ -2764,7 +3507,12 @@ void operators::div_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(/=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = call[0].getNum() / call[1].getNum();
 	var.udt = UDT_NUM;
 }
@@ -2774,7 +3522,12 @@ void operators::mul_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(*=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = call[0].getNum() * call[1].getNum();
 	var.udt = UDT_NUM;
 }
@@ -2784,7 +3537,12 @@ void operators::pow_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(^=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = ::pow(call[0].getNum(), call[1].getNum());
 	var.udt = UDT_NUM;
 }
@@ -2794,7 +3552,12 @@ void operators::lor_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(||=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = call[0].getNum() || call[1].getNum();
 	var.udt = UDT_NUM;
 }
@@ -2804,7 +3567,12 @@ void operators::land_assign(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(&&=, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = call[0].getNum() && call[1].getNum();
 	var.udt = UDT_NUM;
 }
@@ -2814,7 +3582,12 @@ void operators::prefixIncrement(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(++, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = call[0].getNum() + 1;
 	var.udt = UDT_NUM;
 }
@@ -2825,7 +3598,7 @@ void operators::postfixIncrement(CALL_DATA &call)
 	call.ret().udt = UDT_NUM;
 	call.ret().num = call[0].getNum();
 
-	STACK_FRAME &var = *call.prg->getVar(call[0].lit);
+	STACK_FRAME &var = *call.prg->getVar(call[0]);
 	var.num = var.getNum() + 1;
 	var.udt = UDT_NUM;
 }
@@ -2835,7 +3608,12 @@ void operators::prefixDecrement(CALL_DATA &call)
 	CHECK_OVERLOADED_OPERATOR(--, true);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = call[0].lit;
-	STACK_FRAME &var = *call.prg->getVar(call.ret().lit);
+	call.ret().slot = call[0].slot;
+	call.ret().local = call[0].local;
+	call.ret().pElement = call[0].pElement;
+	call.ret().pArray = call[0].pArray;
+	call.ret().generation = call[0].generation;
+	STACK_FRAME &var = *call.prg->getVar(call.ret());
 	var.num = var.getNum() - 1;
 	var.udt = UDT_NUM;
 }
@@ -2846,7 +3624,7 @@ void operators::postfixDecrement(CALL_DATA &call)
 	call.ret().udt = UDT_NUM;
 	call.ret().num = call[0].getNum();
 
-	STACK_FRAME &var = *call.prg->getVar(call[0].lit);
+	STACK_FRAME &var = *call.prg->getVar(call[0]);
 	var.num = var.getNum() - 1;
 	var.udt = UDT_NUM;
 }
@@ -2910,6 +3688,15 @@ void operators::member(CALL_DATA &call)
 	_itot(obj, str, 10);
 	call.ret().udt = UDT_ID;
 	call.ret().lit = _T(":") + STRING(str) + _T("::") + mem;
+
+	// A member of the this pointer is found by its slot, as the bare
+	// name would be (see CProgram::getVar()).
+	if (call[1].slot && call.prg->m_calls.size() &&
+		(call.prg->m_calls.back().obj == obj) && (call.prg->m_calls.back().pClass == &cls_it->second))
+	{
+		call.ret().slot = call[1].slot;
+		call.ret().local = call[1].local;
+	}
 }
 
 void operators::array(CALL_DATA &call)
@@ -2920,5 +3707,28 @@ void operators::array(CALL_DATA &call)
 	// TBD: This should be done at compile-time.
 	const std::pair<bool, STRING> res = call.prg->getInstanceVar(call[0].lit);
 	const STRING prefix = (res.first ? (_T(':') + res.second) : call[0].lit);
-	call.ret().lit = prefix + _T('[') + call[1].getLit() + _T(']');
+
+	// Address an element by index directly, so that using it does not
+	// look its name up. The name is still formed, in one allocation,
+	// for functions that take variables by name.
+	const STACK_FRAME key = call[1].getValue();
+	unsigned int idx = 0;
+	if ((key.udt & UDT_NUM) && !(key.udt & UDT_UNSET) && CArray::toIndex(key.num, idx))
+	{
+		TCHAR str[33];
+		_itot(idx, str, 10);
+		STRING &lit = call.ret().lit;
+		lit.reserve(prefix.length() + _tcslen(str) + 2);
+		lit = prefix;
+		lit += _T('[');
+		lit += str;
+		lit += _T(']');
+
+		const CArray *pArray = NULL;
+		call.ret().pElement = call.prg->getElement(prefix, idx, pArray);
+		call.ret().pArray = pArray;
+		call.ret().generation = (pArray ? pArray->reference() : 0);
+		return;
+	}
+	call.ret().lit = prefix + _T('[') + key.getLit() + _T(']');
 }
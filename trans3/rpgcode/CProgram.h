@@ -44,6 +44,7 @@
 #include <deque>
 #include <string>
 #include <vector>
+#include <hash_map>
 #include <tchar.h>
 #include <iostream>
 #include "../misc/misc.h"
@@ -60,6 +61,7 @@ typedef std::basic_string<TCHAR> STRING;
 extern unsigned int g_lines;
 extern int g_mumuProgramIdx;
 class CMumuDebugger;
+class CProgramProfiler;
 #endif
 
 /*
@@ -91,6 +93,8 @@ typedef enum tagUnitDataType
  */
 
 class CProgram;
+class CArray;
+template <class T> class CPtrData;
 
 /*
  * *************************************************************************
@@ -105,6 +109,11 @@ typedef struct tagStackFrame
 	STRING lit;
 	UNIT_DATA_TYPE udt;
 	CProgram *prg;
+	unsigned int slot;		// Variable slot of an identifier, or zero.
+	unsigned int local;		// Index of the slot among its program's.
+	CPtrData<tagStackFrame> *pElement;	// An array element found by index,
+	const CArray *pArray;				// its array and the array's generation;
+	unsigned int generation;			// see CArray::reference().
 	//void *tag;
 
 	bool getBool() const;
@@ -118,11 +127,21 @@ typedef struct tagStackFrame
 	tagStackFrame():
 		prg(NULL),
 		num(0.0),
-		udt(UNIT_DATA_TYPE(UDT_NUM | UDT_UNSET)) { }
+		udt(UNIT_DATA_TYPE(UDT_NUM | UDT_UNSET)),
+		slot(0),
+		local(0),
+		pElement(NULL),
+		pArray(NULL),
+		generation(0) { }
 	tagStackFrame(CProgram *prg):
 		prg(prg),
 		num(0.0),
-		udt(UNIT_DATA_TYPE(UDT_NUM | UDT_UNSET)) { }
+		udt(UNIT_DATA_TYPE(UDT_NUM | UDT_UNSET)),
+		slot(0),
+		local(0),
+		pElement(NULL),
+		pArray(NULL),
+		generation(0) { }
 } STACK_FRAME, *LPSTACK_FRAME;
 
 /*
@@ -147,6 +166,8 @@ typedef std::pair<unsigned int, STRING> REFERENCE_DESC;
 typedef std::pair<LPSTACK_FRAME, REFERENCE_DESC> REFERENCE;
 typedef std::map<unsigned int, REFERENCE> REFERENCE_MAP;
 
+struct tagClass;
+
 /*
  * *************************************************************************
  * tagCallFrame
@@ -161,6 +182,9 @@ typedef struct tagCallFrame
 	STACK_FRAME *p;				// Return value.
 	bool bReturn;				// Whether we should return a value.
 	unsigned int obj;			// This pointer.
+	const tagClass *pClass;		// Class of the this pointer, if known.
+	std::vector<CPtrData<STACK_FRAME> *> members;	// The this pointer's members by
+	unsigned int heapGeneration;	// index in pClass, when the heap was at this generation.
 	REFERENCE_MAP refs;			// Parameters that have been passed ByRef.
 	STRING errorHandler;		// Label to jump to in case of error.
 	unsigned int errorReturn;	// Unit to return to after an error.
@@ -306,9 +330,19 @@ typedef struct tagClass
 	ClassMembers members;
 	ClassMethods methods;
 
+	tagClass(): m_indexed(0) { }
+
 	tagNamedMethod *locate(const STRING &name, const int params, const CLASS_VISIBILITY vis);
 	bool memberExists(const STRING &name, const CLASS_VISIBILITY vis) const;
 	void inherit(const tagClass &cls);
+
+	// The index in members of the member a variable slot names (see
+	// CProgram::getSlot()), or -1 if it names none.
+	int memberIndex(const unsigned int slot, const STRING &name) const;
+
+private:
+	mutable std::vector<int> m_slotMembers;	// By slot: index, -1 if none, -2 if unknown.
+	mutable unsigned int m_indexed;			// Number of members when indexed.
 } CLASS, *LPCLASS;
 
 typedef std::deque<MACHINE_UNIT> MACHINE_UNITS, *LPMACHINE_UNITS;
@@ -317,6 +351,79 @@ typedef MACHINE_UNITS::iterator POS;
 
 typedef std::vector<std::vector<STACK_FRAME> >::const_iterator STACK_ITR;
 
+/*
+ * *************************************************************************
+ * tagOpcode
+ * *************************************************************************
+ */
+
+// Bytecode operations.
+typedef enum tagOpcode
+{
+	OP_PUSH,			// Push a pooled operand.
+	OP_CALL,			// Call a machine function.
+	OP_NOP,				// Opening brace.
+	OP_LOOP,			// Closing brace of a loop: jump back to its condition.
+	OP_RETURN,			// Closing brace of a method.
+	OP_END_IF,			// Closing brace of an if or elseif followed by an elseif.
+	OP_END_MULTIRUN,	// Closing brace of a multirun block.
+	OP_CLOSE			// Closing brace of any other block.
+} OPCODE;
+
+/*
+ * *************************************************************************
+ * tagInstruction
+ * *************************************************************************
+ */
+
+// A bytecode instruction. Instruction n always corresponds to
+// machine unit n, so that positions (m_i, call frames, labels)
+// mean the same thing in both representations.
+typedef struct tagInstruction
+{
+	OPCODE op;
+	bool bLine;				// Final instruction of a statement.
+	int params;				// Parameter count of an OP_CALL.
+	unsigned int operand;	// Pool index of an OP_PUSH, or a resolved jump target.
+	MACHINE_FUNC func;		// Function of an OP_CALL.
+} INSTRUCTION, *LPINSTRUCTION;
+
+/*
+ * *************************************************************************
+ * CBytecode
+ * *************************************************************************
+ */
+
+// The compiled form of a program's machine units: a contiguous
+// array of instructions with typed operands held in a pool and
+// every brace resolved to its jump target ahead of time.
+class CBytecode
+{
+public:
+	CBytecode(): m_depth(0), m_locals(0), m_bValid(false) { }
+
+	void compile(const MACHINE_UNITS &units);
+	void invalidate() { m_bValid = false; }
+	bool isValid() const { return m_bValid; }
+
+	unsigned int size() const { return m_code.size(); }
+	const INSTRUCTION &operator[](const unsigned int i) const { return m_code[i]; }
+	const STACK_FRAME &operand(const unsigned int i) const { return m_pool[i]; }
+
+	// The deepest the data stack gets within a single statement.
+	unsigned int depth() const { return m_depth; }
+
+	// The number of distinct variable slots the code uses.
+	unsigned int locals() const { return m_locals; }
+
+private:
+	std::vector<INSTRUCTION> m_code;
+	std::vector<STACK_FRAME> m_pool;
+	unsigned int m_depth;
+	unsigned int m_locals;
+	bool m_bValid;
+};
+
 // Get a lowercase string.
 inline STRING lcase(const STRING &str)
 {
@@ -372,6 +479,157 @@ private:
 	T &m_enum;
 };
 
+/*
+ * *************************************************************************
+ * CArray
+ * *************************************************************************
+ */
+
+// An RPGCode array, holding the elements "name[key]" of one name.
+// Elements with small integral keys are held contiguously; any other
+// key is hashed. Elements never move, so pointers to them remain
+// valid until they are erased.
+class CArray
+{
+public:
+	typedef CPtrData<STACK_FRAME> ELEMENT;
+	typedef std::pair<STRING, ELEMENT *> ENTRY;
+
+	CArray(): m_count(0), m_generation(0), m_bReferenced(false) { }
+	CArray(const CArray &rhs);
+	CArray &operator=(const CArray &rhs);
+	~CArray();
+
+	ELEMENT *find(const STRING &key) const;
+	ELEMENT &operator[](const STRING &key);
+	bool erase(const STRING &key);
+	void clear();
+	unsigned int size() const { return m_count; }
+
+	// Find or get an element by index, without forming its key.
+	ELEMENT *find(const unsigned int idx) const;
+	ELEMENT &at(const unsigned int idx);
+
+	// Get a generation for pointers to this array's elements. It stays
+	// current until one of the array's elements is freed, or until any
+	// array that has given out a generation is destroyed.
+	unsigned int reference() const;
+	static bool isCurrent(const CArray *pArray, const unsigned int generation)
+	{
+		// Only if no referenced array has been destroyed since is
+		// pArray certain to exist.
+		return (generation > m_destroyed) && (pArray->m_generation == generation);
+	}
+
+	// Get the index a number addresses, if it has one. Only indices
+	// whose keys a number would be formatted as are accepted.
+	static bool toIndex(const double num, unsigned int &idx);
+
+	// Append every element to a vector, with its key or, if the
+	// array's name is given, with its full name.
+	void enumerate(std::vector<ENTRY> &elements, const STRING &array = STRING()) const;
+
+	// Split the name of an element into its array and key. The
+	// last bracketed key is split off, so "a[1][2]" is element
+	// "2" of the array "a[1]".
+	static bool split(const STRING &name, STRING &array, STRING &key);
+
+private:
+	static bool isIndex(const STRING &key, unsigned int &idx);
+	void grow(const unsigned int size);
+
+	std::vector<ELEMENT *> m_items;					// By index; NULL if absent.
+	stdext::hash_map<STRING, ELEMENT *> m_keys;		// Any other key.
+	unsigned int m_count;
+	mutable unsigned int m_generation;	// Zero once an element is freed.
+	mutable bool m_bReferenced;			// Has given out a generation.
+	static unsigned int m_counter;		// The last generation given out.
+	static unsigned int m_destroyed;	// Given out when a referenced array was destroyed.
+};
+
+typedef std::map<STRING, CArray> ARRAY_MAP;
+
+/*
+ * *************************************************************************
+ * tagLocalFrame
+ * *************************************************************************
+ */
+
+// The local variables of a call. Variables are held by name, and
+// lookups by slot (see CProgram::getSlot()) are remembered by the
+// slot's dense index within its program (see CBytecode::compile()),
+// so that compiled code does not need to compare names. Array
+// elements are held in arrays, but may be used by name in the same way.
+typedef struct tagLocalFrame
+{
+	typedef std::map<STRING, STACK_FRAME> VARIABLES;
+	typedef VARIABLES::iterator iterator;
+	typedef VARIABLES::const_iterator const_iterator;
+
+	tagLocalFrame(): m_generation(1) { }
+	tagLocalFrame(const tagLocalFrame &rhs): m_vars(rhs.m_vars), m_arrays(rhs.m_arrays), m_generation(1) { }
+	tagLocalFrame &operator=(const tagLocalFrame &rhs);
+
+	STACK_FRAME &operator[](const STRING &name);
+	LPSTACK_FRAME get(const STRING &name);
+	LPSTACK_FRAME find(const STACK_FRAME &var, const STRING &name);
+	iterator find(const STRING &name) { return m_vars.find(name); }
+	const_iterator find(const STRING &name) const { return m_vars.find(name); }
+	const_iterator lower_bound(const STRING &name) const { return m_vars.lower_bound(name); }
+	unsigned int erase(const STRING &name);
+	void swap(tagLocalFrame &rhs);
+
+	iterator begin() { return m_vars.begin(); }
+	iterator end() { return m_vars.end(); }
+	const_iterator begin() const { return m_vars.begin(); }
+	const_iterator end() const { return m_vars.end(); }
+	unsigned int size() const { return m_vars.size(); }
+	const ARRAY_MAP &arrays() const { return m_arrays; }
+	CArray *findArray(const STRING &name);
+	CArray &array(const STRING &name) { return m_arrays[name]; }
+
+private:
+	// A remembered lookup. The variable is NULL if it was absent
+	// when the frame's generation was that given; the slot tells
+	// whether the entry belongs to another program's index.
+	typedef struct tagSlotEntry
+	{
+		unsigned int slot;
+		unsigned int generation;
+		LPSTACK_FRAME p;
+		tagSlotEntry(): slot(0), generation(0), p(NULL) { }
+	} SLOT_ENTRY;
+
+	VARIABLES m_vars;
+	ARRAY_MAP m_arrays;
+	std::vector<SLOT_ENTRY> m_slots;
+	unsigned int m_generation;		// Advanced when a variable is added.
+} LOCAL_FRAME;
+
+/*
+ * *************************************************************************
+ * tagVariableSlot
+ * *************************************************************************
+ */
+
+// A variable name interned by the compiler.
+typedef struct tagVariableSlot
+{
+	STRING name;
+	unsigned int global;			// For ":name", the slot of name.
+	bool bParam;					// A parameter, which may be ByRef.
+	CPtrData<STACK_FRAME> *pGlobal;	// The global by this name, if known.
+	unsigned int heapSize;			// Size and generation of the heap when
+	unsigned int heapGeneration;	// the global was last found absent.
+
+	tagVariableSlot():
+		global(0),
+		bParam(false),
+		pGlobal(NULL),
+		heapSize(~0u),
+		heapGeneration(0) { }
+} VAR_SLOT;
+
 /*
  * *************************************************************************
  * tagExceptionType
@@ -405,12 +663,14 @@ class IPlugin;				// A plugin.
 class CFile;				// A file stream.
 class CProgramChild;		// A child program;
 class COptimiser;			// An optimisation engine.
+class CProgramCache;		// A cache of compiled programs.
 class CGarbageCollector;	// A memory manager.
 class CException;			// An exception.
 struct tagBoardProgram;		// A board program;
 
 // Some types of enumerations.
 typedef CEnumeration<std::map<STRING, CPtrData<STACK_FRAME> > > HEAP_ENUM;
+typedef CEnumeration<ARRAY_MAP> ARRAY_ENUM;
 typedef CEnumeration<std::map<STRING, STRING> > REDIRECT_ENUM;
 typedef CEnumeration<std::set<CThread *> > THREAD_ENUM;
 typedef CEnumeration<std::map<unsigned int, STRING> > OBJECT_ENUM;
@@ -449,6 +709,7 @@ public:
 	tagBoardProgram *getBoardLocation() const { return m_pBoardPrg; }
 
 	virtual LPSTACK_FRAME getVar(const STRING &name, unsigned int *pFrame = NULL, STRING *pName = NULL);
+	LPSTACK_FRAME getVar(const STACK_FRAME &var);
 	virtual bool isThread() const { return false; }
 
 	// Serialisation. This feature allows for the program's state
@@ -462,6 +723,7 @@ public:
 	static void addConstant(const STRING &name, const STACK_FRAME value) { m_constants[lcase(name)] = value; }
 	static STRING getFunctionName(const MACHINE_FUNC func);
 	static int getRunningProgramCount() { return m_runningPrograms; }
+	static unsigned long getUnitsExecuted() { return m_unitsExecuted; }
 
 	// Redirections.
 	static void addRedirect(const STRING oldFunc, const STRING newFunc) { m_redirects[oldFunc] = newFunc; }
@@ -469,16 +731,27 @@ public:
 	static void clearRedirects() { m_redirects.clear(); }
 	static REDIRECT_ENUM enumerateRedirects() { return m_redirects; }
 
+	// Variable slots. Every identifier the compiler sees is given a
+	// slot, which stands in for the name at runtime.
+	static unsigned int getSlot(const STRING &name);
+
+	// Bytecode engine. When disabled, programs are interpreted
+	// directly from their machine units.
+	static void setBytecodeEnabled(const bool bEnabled) { m_bBytecode = bEnabled; }
+	static bool isBytecodeEnabled() { return m_bBytecode; }
+
 	// Debugger.
 	static void debugger(const STRING str);
 	static void setDebugLevel(const EXCEPTION_TYPE et) { m_debugLevel = et; }
 	static EXCEPTION_TYPE getDebugLevel() { return m_debugLevel; }
 
 	// Global rpgcode variables.
-	static CPtrData<STACK_FRAME> &getGlobal(const STRING var) { return m_heap[lcase(var)]; }
-	static void freeGlobal(const STRING var) { m_heap.erase(lcase(var)); }
-	static void freeGlobals() { m_heap.clear(); m_objects.clear(); }
+	static CPtrData<STACK_FRAME> &getGlobal(const STRING var) { return heapVar(lcase(var)); }
+	static void freeGlobal(const STRING var) { freeHeapVar(lcase(var)); }
+	static void forgetObject(unsigned int obj);
+	static void freeGlobals() { forgetGlobals(); m_heap.clear(); m_arrays.clear(); m_objects.clear(); }
 	static HEAP_ENUM enumerateGlobals() { return m_heap; }
+	static ARRAY_ENUM enumerateArrays() { return m_arrays; }
 	static OBJECT_ENUM enumerateObjects() { return m_objects; }
 	static void setObject(unsigned int num, const STRING cls) { m_objects[num] = lcase(cls); }
 
@@ -495,7 +768,7 @@ public:
 	CProgram &operator=(const CProgram &rhs);
 
 private:
-	std::list<std::map<STRING, STACK_FRAME> > m_locals;
+	std::list<LOCAL_FRAME> m_locals;
 	std::vector<std::vector<STACK_FRAME> > m_stack;
 	int m_stackIndex;
 	std::vector<CALL_FRAME> m_calls;
@@ -504,6 +777,9 @@ private:
 	tagBoardProgram *m_pBoardPrg;
 	std::vector<tagNamedMethod> m_methods;
 	std::vector<STRING> m_inclusions;
+#ifdef ENABLE_MUMU_DBG
+	std::vector<unsigned int> m_unitMethods;	// Method of each unit, for the profiler.
+#endif
 
 	// Yacc globals.
 	static LPMACHINE_UNITS m_pyyUnits;
@@ -520,9 +796,15 @@ private:
 	static std::map<unsigned int, STRING> m_objects;
 	static std::map<STRING, MACHINE_FUNC> m_functions;
 	static std::map<STRING, CPtrData<STACK_FRAME> > m_heap;
+	static ARRAY_MAP m_arrays;							// Global arrays.
+	static unsigned int m_heapGeneration;				// Bumped whenever a global is erased.
+	static std::map<STRING, unsigned int> m_slotIndex;	// Slots by name.
+	static std::vector<VAR_SLOT> m_slots;				// Names by slot.
 	static std::vector<IPlugin *> m_plugins;
 	static unsigned long m_runningPrograms;
+	static unsigned long m_unitsExecuted;				// Units and instructions, ever.
 	static EXCEPTION_TYPE m_debugLevel;
+	static bool m_bBytecode;
 #ifdef ENABLE_MUMU_DBG
 	static bool m_enableMumu;
 #endif
@@ -558,16 +840,29 @@ private:
 	friend CProgramChild;
 	friend COptimiser;
 	friend CGarbageCollector;
+	friend CBytecode;
+	friend CProgramCache;
 #ifdef ENABLE_MUMU_DBG
 	friend CMumuDebugger;
+	friend CProgramProfiler;
 #endif
 
 	void parseFile(FILE *pFile);
+	void runCompiled();
 	unsigned int matchBrace(POS i);
 	void include(const CProgram prg);
 	void prime();
+	static CPtrData<STACK_FRAME> &heapVar(const STRING &name);
+	static CPtrData<STACK_FRAME> *findHeapVar(const STRING &name);
+	static void freeHeapVar(const STRING &name);
+	static void forgetGlobal(const STRING &name);
+	static void forgetGlobals();
+	static CPtrData<STACK_FRAME> *findGlobal(VAR_SLOT &slot);
+	static CPtrData<STACK_FRAME> &global(VAR_SLOT &slot);
+	static CPtrData<STACK_FRAME> &member(CALL_FRAME &fr, const unsigned int idx);
+	CArray::ELEMENT *getElement(const STRING &array, const unsigned int idx, const CArray *&pArray);
 	static bool resolvePluginCall(LPMACHINE_UNIT pUnit);
-	virtual std::list<std::map<STRING, STACK_FRAME> > *getLocals() { return &m_locals; }
+	virtual std::list<LOCAL_FRAME> *getLocals() { return &m_locals; }
 	std::pair<bool, STRING> getInstanceVar(const STRING &var) const;
 	void returnFromMethod(const STACK_FRAME &value);
 	void handleError(CException *);
@@ -588,8 +883,14 @@ protected:
 	LPSTACK_FRAME resolveVarGlobal(const STRING &name, unsigned int *);
 	LPSTACK_FRAME resolveVarLocal(const STRING &name, unsigned int *);
 
+	// Execute the instruction at pc and return the position that is
+	// current afterwards; the caller steps past it, as with m_i.
+	unsigned int executeInstruction(unsigned int pc);
+	bool isCompiled() const { return m_bBytecode && m_bytecode.isValid(); }
+
 	STRING m_fileName;
 	MACHINE_UNITS m_units;
+	CBytecode m_bytecode;
 	CONST_POS m_i;
 	LPSTACK_FRAME (CProgram::*m_pResolveFunc) (const STRING &name, unsigned int *);
 };
@@ -610,7 +911,7 @@ public:
 
 private:
 	CProgram &m_prg;
-	std::list<std::map<STRING, STACK_FRAME> > *getLocals() { return m_prg.getLocals(); }
+	std::list<LOCAL_FRAME> *getLocals() { return m_prg.getLocals(); }
 };
 
 /*
@@ -0,0 +1,627 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Compiled program cache - see CProgramCache.h.
+ */
+
+#include "CProgramCache.h"
+#include "../common/paths.h"
+#include "../common/pakfs.h"
+#include "../common/CFile.h"
+#ifdef ENABLE_MUMU_DBG
+#include "CMumuDebugger.h"
+#endif
+#include <stdio.h>
+#include <iomanip>
+
+bool CProgramCache::m_bEnabled = true;
+std::map<STRING, unsigned __int64> CProgramCache::m_sources;
+std::map<STRING, CProgramCache::DEPENDENCIES> CProgramCache::m_dependencies;
+
+// Marks the start and end of an entry.
+static const UINT CACHE_MAGIC = 0x43504b54;		// "TKPC"
+
+// FNV-1a, 64 bit.
+static const unsigned __int64 HASH_BASIS = 14695981039346656037ULL;
+static const unsigned __int64 HASH_PRIME = 1099511628211ULL;
+
+static void hashBytes(unsigned __int64 &hash, const void *p, const unsigned int bytes)
+{
+	const unsigned char *c = static_cast<const unsigned char *>(p);
+	for (unsigned int i = 0; i != bytes; ++i)
+	{
+		hash = (hash ^ c[i]) * HASH_PRIME;
+	}
+}
+
+static void hashString(unsigned __int64 &hash, const STRING &str)
+{
+	// Include the terminator, so that "ab", "c" differs from "a", "bc".
+	hashBytes(hash, str.c_str(), (str.length() + 1) * sizeof(TCHAR));
+}
+
+static void writeHash(CFile &file, const unsigned __int64 hash)
+{
+	file << UINT(hash) << UINT(hash >> 32);
+}
+
+static unsigned __int64 readHash(CFile &file)
+{
+	UINT low = 0, high = 0;
+	file >> low >> high;
+	return ((unsigned __int64)high << 32) | low;
+}
+
+/*
+ * Read the number of items that follow, which can be
+ * no more than the size of the file.
+ */
+static bool readCount(CFile &file, INT &count)
+{
+	count = -1;
+	file >> count;
+	return (count >= 0) && (DWORD(count) <= file.size()) && !file.isEof();
+}
+
+/*
+ * Hash the source of a program.
+ */
+unsigned __int64 CProgramCache::hashSource(const void *pSource, const unsigned int bytes)
+{
+	unsigned __int64 hash = HASH_BASIS;
+	hashBytes(hash, pSource, bytes);
+	return hash;
+}
+
+/*
+ * Hash the source of a file, as CProgram::open() reads it.
+ * Files that do not exist hash as zero.
+ */
+unsigned __int64 CProgramCache::hashFile(const STRING &file)
+{
+	std::map<STRING, unsigned __int64>::const_iterator i = m_sources.find(file);
+	if (i != m_sources.end()) return i->second;
+
+	unsigned __int64 hash = 0;
+	PAK_FILE *const pPak = pakAcquire(file);
+	if (pPak)
+	{
+		hash = hashSource(pPak->data.empty() ? NULL : &pPak->data[0], pPak->data.size());
+		pakRelease(pPak);
+	}
+	else if (FILE *p = fopen(resolve(file).c_str(), _T("rb")))
+	{
+		fseek(p, 0, SEEK_END);
+		const long length = ftell(p);
+		fseek(p, 0, SEEK_SET);
+
+		std::vector<char> source((length > 0) ? length : 0);
+		if (!source.empty()) fread(&source[0], sizeof(char), source.size(), p);
+		fclose(p);
+		hash = hashSource(source.empty() ? NULL : &source[0], source.size());
+	}
+
+	// Files are assumed not to change while the engine runs,
+	// as with programs in CProgram's own cache.
+	m_sources[file] = hash;
+	return hash;
+}
+
+/*
+ * Hash the engine: the format of the cache and the executable,
+ * which holds the parser and the functions the units call.
+ */
+unsigned __int64 CProgramCache::hashEngine()
+{
+	static unsigned __int64 hash = 0;
+	if (hash) return hash;
+
+	hash = HASH_BASIS;
+	const int version = PROGRAM_CACHE_VERSION;
+	hashBytes(hash, &version, sizeof(version));
+
+	TCHAR exe[MAX_PATH];
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if (GetModuleFileName(NULL, exe, MAX_PATH) && GetFileAttributesEx(exe, GetFileExInfoStandard, &fad))
+	{
+		hashBytes(hash, &fad.nFileSizeLow, sizeof(fad.nFileSizeLow));
+		hashBytes(hash, &fad.nFileSizeHigh, sizeof(fad.nFileSizeHigh));
+		hashBytes(hash, &fad.ftLastWriteTime, sizeof(fad.ftLastWriteTime));
+	}
+	return hash;
+}
+
+/*
+ * Hash the redirects, which the parser applies.
+ */
+unsigned __int64 CProgramCache::hashRedirects()
+{
+	unsigned __int64 hash = HASH_BASIS;
+	std::map<STRING, STRING>::const_iterator i = CProgram::m_redirects.begin();
+	for (; i != CProgram::m_redirects.end(); ++i)
+	{
+		hashString(hash, i->first);
+		hashString(hash, i->second);
+	}
+	return hash;
+}
+
+/*
+ * Get the cache file for a program.
+ */
+STRING CProgramCache::getCacheFile(const STRING &fileName)
+{
+	extern STRING g_savePath;
+
+	unsigned __int64 hash = HASH_BASIS;
+	hashString(hash, lcase(fileName));
+
+	STRINGSTREAM ss;
+	ss << g_savePath << _T("Cache\\") << std::hex << std::setfill(_T('0')) << std::setw(16) << hash << _T(".prc");
+	return ss.str();
+}
+
+/*
+ * Read a program from the cache.
+ */
+bool CProgramCache::load(CProgram &prg, const STRING &fileName, const unsigned __int64 source)
+{
+	m_sources[fileName] = source;
+	if (!m_bEnabled) return false;
+
+	CFile file(getCacheFile(fileName));
+	if (!file.isOpen()) return false;
+
+	UINT magic = 0, version = 0;
+	STRING name;
+	file >> magic >> version >> name;
+	if ((magic != CACHE_MAGIC) || (version != PROGRAM_CACHE_VERSION) || _tcsicmp(name.c_str(), fileName.c_str())) return false;
+	if (readHash(file) != hashEngine()) return false;
+	if (readHash(file) != source) return false;
+	if (readHash(file) != hashRedirects()) return false;
+
+	// Check that the files included have not changed.
+	DEPENDENCIES depends;
+	INT count = 0;
+	if (!readCount(file, count)) return false;
+	for (INT i = 0; i < count; ++i)
+	{
+		STRING dep;
+		file >> dep;
+		const unsigned __int64 hash = readHash(file);
+		if (hashFile(dep) != hash) return false;
+		depends.push_back(std::make_pair(dep, hash));
+	}
+
+	if (!read(prg, file)) return false;
+	m_dependencies[fileName] = depends;
+
+	// Plugins may have changed since the program was written.
+	prg.resolveFunctions();
+	prg.m_bytecode.compile(prg.m_units);
+#ifdef ENABLE_MUMU_DBG
+	prg.m_unitMethods.clear();
+#endif
+	return true;
+}
+
+/*
+ * Write a program just parsed to the cache.
+ */
+void CProgramCache::store(const CProgram &prg, const unsigned __int64 source)
+{
+	extern STRING g_projectPath, g_savePath;
+
+	const STRING &fileName = prg.m_fileName;
+	m_sources[fileName] = source;
+
+	// The program depends on the files it includes, and on
+	// the files they include in turn.
+	DEPENDENCIES depends;
+	std::vector<STRING>::const_iterator i = prg.m_inclusions.begin();
+	for (; i != prg.m_inclusions.end(); ++i)
+	{
+		const STRING dep = g_projectPath + PRG_PATH + *i;
+		depends.push_back(std::make_pair(dep, hashFile(dep)));
+
+		std::map<STRING, DEPENDENCIES>::const_iterator j = m_dependencies.find(dep);
+		if (j != m_dependencies.end())
+		{
+			depends.insert(depends.end(), j->second.begin(), j->second.end());
+		}
+	}
+	m_dependencies[fileName] = depends;
+
+	if (!m_bEnabled || prg.m_units.empty()) return;
+
+	// Plugins are referred to by their position in the list of
+	// plugins, which may be different next time.
+	CONST_POS j = prg.m_units.begin();
+	for (; j != prg.m_units.end(); ++j)
+	{
+		if (j->udt & UDT_PLUGIN) return;
+	}
+
+	CreateDirectory(g_savePath.c_str(), NULL);
+	CreateDirectory((g_savePath + _T("Cache\\")).c_str(), NULL);
+	const STRING cacheFile = getCacheFile(fileName);
+	const STRING temp = cacheFile + _T(".tmp");
+	bool bWritten = false;
+	{
+		CFile file(temp, OF_WRITE | OF_CREATE);
+		if (!file.isOpen()) return;
+
+		file << CACHE_MAGIC << UINT(PROGRAM_CACHE_VERSION) << fileName;
+		writeHash(file, hashEngine());
+		writeHash(file, source);
+		writeHash(file, hashRedirects());
+
+		file << INT(depends.size());
+		DEPENDENCIES::const_iterator k = depends.begin();
+		for (; k != depends.end(); ++k)
+		{
+			file << k->first;
+			writeHash(file, k->second);
+		}
+
+		bWritten = write(prg, file);
+	}
+
+	// Replace the entry whole, so that a program is never
+	// read from a partly written entry.
+	if (!bWritten || !MoveFileEx(temp.c_str(), cacheFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFile(temp.c_str());
+	}
+}
+
+/*
+ * Write a named method.
+ */
+static void writeMethod(CFile &file, const NAMED_METHOD &method)
+{
+	file << method.name << INT(method.params) << UINT(method.i) << BYTE(method.bInline) << UINT(method.byref);
+#ifdef ENABLE_MUMU_DBG
+	file << INT(method.paramNames.size());
+	std::map<STRING, STRING>::const_iterator i = method.paramNames.begin();
+	for (; i != method.paramNames.end(); ++i)
+	{
+		file << i->first << i->second;
+	}
+#endif
+}
+
+/*
+ * Read a named method.
+ */
+static bool readMethod(CFile &file, NAMED_METHOD &method)
+{
+	INT params = 0;
+	UINT i = 0, byref = 0;
+	BYTE bInline = 0;
+	file >> method.name >> params >> i >> bInline >> byref;
+	method.params = params;
+	method.i = i;
+	method.bInline = (bInline != 0);
+	method.byref = byref;
+#ifdef ENABLE_MUMU_DBG
+	method.paramNames.clear();
+	INT count = 0;
+	if (!readCount(file, count)) return false;
+	for (INT j = 0; j < count; ++j)
+	{
+		STRING name;
+		file >> name;
+		file >> method.paramNames[name];
+	}
+#endif
+	return !file.isEof();
+}
+
+/*
+ * Write the compiled program.
+ *
+ * return (out) - false if the units call a function that has no name
+ */
+bool CProgramCache::write(const CProgram &prg, CFile &file)
+{
+	// Functions are written by name.
+	std::map<MACHINE_FUNC, STRING> names;
+	std::map<STRING, MACHINE_FUNC>::const_iterator f = CProgram::m_functions.begin();
+	for (; f != CProgram::m_functions.end(); ++f)
+	{
+		names.insert(std::make_pair(f->second, f->first));
+	}
+
+	std::map<MACHINE_FUNC, INT> functions;
+	std::vector<STRING> functionNames;
+#ifdef ENABLE_MUMU_DBG
+	std::map<int, INT> files;
+	std::vector<STRING> fileNames;
+#endif
+	CONST_POS i = prg.m_units.begin();
+	for (; i != prg.m_units.end(); ++i)
+	{
+		if (i->func && !functions.count(i->func))
+		{
+			std::map<MACHINE_FUNC, STRING>::const_iterator name = names.find(i->func);
+			if (name == names.end()) return false;
+			functions[i->func] = functionNames.size();
+			functionNames.push_back(name->second);
+		}
+#ifdef ENABLE_MUMU_DBG
+		if (!files.count(i->fileIndex))
+		{
+			files[i->fileIndex] = fileNames.size();
+			fileNames.push_back(CMumuDebugger::getFileName(i->fileIndex));
+		}
+#endif
+	}
+
+	file << INT(functionNames.size());
+	std::vector<STRING>::const_iterator j = functionNames.begin();
+	for (; j != functionNames.end(); ++j) file << *j;
+
+#ifdef ENABLE_MUMU_DBG
+	file << INT(fileNames.size());
+	for (j = fileNames.begin(); j != fileNames.end(); ++j) file << *j;
+#endif
+
+	// Units.
+	file << INT(prg.m_units.size());
+	for (i = prg.m_units.begin(); i != prg.m_units.end(); ++i)
+	{
+		file << i->num << i->lit << INT(i->udt) << (i->func ? functions[i->func] : INT(-1)) << INT(i->params);
+#ifdef ENABLE_MUMU_DBG
+		file << INT(i->line) << files[i->fileIndex];
+#endif
+	}
+
+	// Lines.
+	file << INT(prg.m_lines.size());
+	std::vector<unsigned int>::const_iterator k = prg.m_lines.begin();
+	for (; k != prg.m_lines.end(); ++k) file << UINT(*k);
+
+	// Methods.
+	file << INT(prg.m_methods.size());
+	std::vector<NAMED_METHOD>::const_iterator m = prg.m_methods.begin();
+	for (; m != prg.m_methods.end(); ++m) writeMethod(file, *m);
+
+	// Classes.
+	file << INT(prg.m_classes.size());
+	std::map<STRING, CLASS>::const_iterator c = prg.m_classes.begin();
+	for (; c != prg.m_classes.end(); ++c)
+	{
+		const CLASS &cls = c->second;
+		file << c->first;
+
+		file << INT(cls.inherits.size());
+		std::deque<STRING>::const_iterator n = cls.inherits.begin();
+		for (; n != cls.inherits.end(); ++n) file << *n;
+
+		file << INT(cls.members.size());
+		ClassMembers::const_iterator o = cls.members.begin();
+		for (; o != cls.members.end(); ++o) file << o->first << INT(o->second);
+
+		file << INT(cls.methods.size());
+		ClassMethods::const_iterator p = cls.methods.begin();
+		for (; p != cls.methods.end(); ++p)
+		{
+			writeMethod(file, p->first);
+			file << INT(p->second);
+		}
+	}
+
+	// Inclusions.
+	file << INT(prg.m_inclusions.size());
+	for (j = prg.m_inclusions.begin(); j != prg.m_inclusions.end(); ++j) file << *j;
+
+	file << CACHE_MAGIC;
+	return true;
+}
+
+/*
+ * Read the compiled program.
+ *
+ * return (out) - false if the entry is damaged, or the units call
+ *				  a function the engine no longer has
+ */
+bool CProgramCache::read(CProgram &prg, CFile &file)
+{
+	INT count = 0;
+
+	std::vector<MACHINE_FUNC> functions;
+	if (!readCount(file, count)) return false;
+	for (INT i = 0; i < count; ++i)
+	{
+		STRING name;
+		file >> name;
+		std::map<STRING, MACHINE_FUNC>::const_iterator f = CProgram::m_functions.find(name);
+		if (f == CProgram::m_functions.end()) return false;
+		functions.push_back(f->second);
+	}
+
+#ifdef ENABLE_MUMU_DBG
+	// Let the debugger load the files the units came from.
+	std::vector<int> files;
+	if (!readCount(file, count)) return false;
+	for (INT i = 0; i < count; ++i)
+	{
+		STRING name;
+		file >> name;
+		files.push_back(name.empty() ? -1 : CMumuDebugger::loadProgram(name));
+	}
+#endif
+
+	// Units.
+	prg.m_units.clear();
+	if (!readCount(file, count)) return false;
+	for (INT i = 0; i < count; ++i)
+	{
+		MACHINE_UNIT mu;
+		INT udt = 0, func = -1, params = 0;
+		file >> mu.num >> mu.lit >> udt >> func >> params;
+		if ((func < -1) || (func >= INT(functions.size()))) return false;
+		mu.udt = UNIT_DATA_TYPE(udt);
+		mu.func = (func == -1) ? NULL : functions[func];
+		mu.params = params;
+#ifdef ENABLE_MUMU_DBG
+		INT line = 0, fileIndex = 0;
+		file >> line >> fileIndex;
+		if ((fileIndex < 0) || (fileIndex >= INT(files.size()))) return false;
+		mu.line = line;
+		mu.fileIndex = files[fileIndex];
+#endif
+		prg.m_units.push_back(mu);
+	}
+
+	// Lines.
+	prg.m_lines.clear();
+	if (!readCount(file, count)) return false;
+	for (INT i = 0; i < count; ++i)
+	{
+		UINT line = 0;
+		file >> line;
+		prg.m_lines.push_back(line);
+	}
+
+	// Methods.
+	prg.m_methods.clear();
+	if (!readCount(file, count)) return false;
+	for (INT i = 0; i < count; ++i)
+	{
+		NAMED_METHOD method;
+		if (!readMethod(file, method)) return false;
+		prg.m_methods.push_back(method);
+	}
+
+	// Classes.
+	prg.m_classes.clear();
+	if (!readCount(file, count)) return false;
+	for (INT i = 0; i < count; ++i)
+	{
+		STRING name;
+		file >> name;
+		CLASS &cls = prg.m_classes[name];
+
+		INT items = 0;
+		if (!readCount(file, items)) return false;
+		for (INT j = 0; j < items; ++j)
+		{
+			STRING base;
+			file >> base;
+			cls.inherits.push_back(base);
+		}
+
+		if (!readCount(file, items)) return false;
+		for (INT j = 0; j < items; ++j)
+		{
+			STRING member;
+			INT vis = 0;
+			file >> member >> vis;
+			cls.members.push_back(std::make_pair(member, CLASS_VISIBILITY(vis)));
+		}
+
+		if (!readCount(file, items)) return false;
+		for (INT j = 0; j < items; ++j)
+		{
+			NAMED_METHOD method;
+			INT vis = 0;
+			if (!readMethod(file, method)) return false;
+			file >> vis;
+			cls.methods.push_back(std::make_pair(method, CLASS_VISIBILITY(vis)));
+		}
+	}
+
+	// Inclusions.
+	prg.m_inclusions.clear();
+	if (!readCount(file, count)) return false;
+	for (INT i = 0; i < count; ++i)
+	{
+		STRING inclusion;
+		file >> inclusion;
+		prg.m_inclusions.push_back(inclusion);
+	}
+
+	UINT magic = 0;
+	file >> magic;
+	return (magic == CACHE_MAGIC);
+}
+
+/*
+ * List the programs in a folder and its subfolders.
+ */
+static void findPrograms(const STRING &folder, std::vector<STRING> &files)
+{
+	WIN32_FIND_DATA fd;
+	HANDLE hSearch = FindFirstFile((folder + _T("*")).c_str(), &fd);
+	if (hSearch == INVALID_HANDLE_VALUE) return;
+	do
+	{
+		const STRING strFile = fd.cFileName;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if ((strFile != _T(".")) && (strFile != _T("..")))
+			{
+				findPrograms(folder + strFile + _T("\\"), files);
+			}
+		}
+		else if (_tcsicmp(getExtension(strFile).c_str(), _T("PRG")) == 0)
+		{
+			files.push_back(folder + strFile);
+		}
+	} while (FindNextFile(hSearch, &fd));
+	FindClose(hSearch);
+}
+
+/*
+ * Compile every program in the project into the cache.
+ */
+unsigned int CProgramCache::compileProject()
+{
+	extern STRING g_projectPath;
+
+	std::vector<STRING> files;
+	findPrograms(g_projectPath + PRG_PATH, files);
+
+	unsigned int compiled = 0;
+	std::vector<STRING>::const_iterator i = files.begin();
+	for (; i != files.end(); ++i)
+	{
+		// Opening a program writes it (and the files
+		// it includes) to the cache.
+		CProgram prg;
+		if (prg.open(*i)) ++compiled;
+	}
+	return compiled;
+}
@@ -0,0 +1,135 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * Compiled program cache.
+ *
+ * Parsing a program (the yacc parser, inlining and resolving its
+ * functions) is slow, so each program compiled is also written to
+ * the Cache folder in the save folder, and later runs read it back
+ * instead of parsing it again:
+ *
+ *		header		- format, engine, program and source hashes
+ *		depends		- included files and the hashes of their sources
+ *		functions	- names of the functions the units call
+ *		files		- files the units came from (MuMu debugger)
+ *		units		- the machine units, after optimisation
+ *		lines		- position of each line's first unit
+ *		methods, classes, inclusions
+ *
+ * An entry is used only if the program's source, every file it
+ * includes, the redirects and the engine are all unchanged; anything
+ * else means the program is parsed as before. Bytecode is compiled
+ * afresh from the units, and calls to plugins are resolved when the
+ * program is read, so plugins may change freely. Programs that call
+ * plugins when they are parsed are not written.
+ *
+ * Running trans3 main.gam -compile writes every program in a project
+ * to the cache ahead of time.
+ */
+
+#ifndef _CPROGRAM_CACHE_H_
+#define _CPROGRAM_CACHE_H_
+
+#include "CProgram.h"
+#include <vector>
+#include <map>
+
+/**
+ * Format of the cache. Increase when the units, or the way the
+ * parser produces them, change.
+ */
+#define PROGRAM_CACHE_VERSION	1
+
+/**
+ * The cache is used through static functions only.
+ */
+class CProgramCache
+{
+public:
+
+	/**
+	 * Hash the source of a program.
+	 */
+	static unsigned __int64 hashSource(const void *pSource, const unsigned int bytes);
+
+	/**
+	 * Read a program from the cache.
+	 *
+	 * prg (out) - the program, if found
+	 * fileName (in) - unresolved name of the program
+	 * source (in) - hash of its source
+	 * return (out) - whether the program was read
+	 */
+	static bool load(CProgram &prg, const STRING &fileName, const unsigned __int64 source);
+
+	/**
+	 * Write a program just parsed to the cache.
+	 *
+	 * prg (in) - the program
+	 * source (in) - hash of its source
+	 */
+	static void store(const CProgram &prg, const unsigned __int64 source);
+
+	/**
+	 * Compile every program in the project into the cache.
+	 *
+	 * return (out) - number of programs compiled
+	 */
+	static unsigned int compileProject();
+
+	/**
+	 * Whether compiled programs are read and written.
+	 */
+	static void setEnabled(const bool bEnabled) { m_bEnabled = bEnabled; }
+	static bool isEnabled() { return m_bEnabled; }
+
+private:
+
+	/**
+	 * Files a program includes, with the hashes of their sources.
+	 */
+	typedef std::vector<std::pair<STRING, unsigned __int64> > DEPENDENCIES;
+
+	static unsigned __int64 hashFile(const STRING &file);
+	static unsigned __int64 hashEngine();
+	static unsigned __int64 hashRedirects();
+	static STRING getCacheFile(const STRING &fileName);
+	static bool read(CProgram &prg, CFile &file);
+	static bool write(const CProgram &prg, CFile &file);
+
+	static bool m_bEnabled;
+	static std::map<STRING, unsigned __int64> m_sources;	// Hashes of sources read, by file.
+	static std::map<STRING, DEPENDENCIES> m_dependencies;	// Included files, by program.
+};
+
+#endif
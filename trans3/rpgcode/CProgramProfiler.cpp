@@ -0,0 +1,343 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * RPGCode profiler - see CProgramProfiler.h.
+ */
+
+#ifdef ENABLE_MUMU_DBG
+
+#include "CProgramProfiler.h"
+#include "CMumuDebugger.h"
+#include <stdio.h>
+#include <algorithm>
+#include <set>
+
+// The unique instance of the profiler.
+CProgramProfiler CProgramProfiler::m_instance;
+bool CProgramProfiler::m_bEnabled = false;
+
+// Name given to code outside of any method.
+static const STRING MAIN_METHOD = _T("(main)");
+
+/*
+ * Initialise the profiler.
+ */
+CProgramProfiler::CProgramProfiler():
+	m_last(0),
+	m_pending(0),
+	m_interval(0),
+	m_startTicks(0)
+{
+	m_startCounter.QuadPart = 0;
+}
+
+/*
+ * Start or stop profiling.
+ */
+void CProgramProfiler::setEnabled(const bool bEnabled)
+{
+	if (bEnabled && !m_startTicks)
+	{
+		// Measure the tick rate for a moment to space the samples;
+		// write() measures it again over the whole run.
+		LARGE_INTEGER freq, now;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&m_startCounter);
+		m_startTicks = __rdtsc();
+		do
+		{
+			QueryPerformanceCounter(&now);
+		} while (now.QuadPart - m_startCounter.QuadPart < freq.QuadPart / 200);
+
+		m_interval = static_cast<unsigned __int64>(PROFILER_INTERVAL / getMicroseconds());
+		m_last = __rdtsc();
+	}
+	m_bEnabled = bEnabled;
+}
+
+/*
+ * Microseconds per processor tick since profiling was enabled.
+ */
+double CProgramProfiler::getMicroseconds() const
+{
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	const unsigned __int64 ticks = __rdtsc() - m_startTicks;
+	if (!ticks) return 0.0;
+	return double(now.QuadPart - m_startCounter.QuadPart) * 1000000.0 /
+		(double(freq.QuadPart) * double(ticks));
+}
+
+/*
+ * A program has started running.
+ */
+void CProgramProfiler::enter(CProgram &prg)
+{
+	// Time spent outside of programs is not theirs.
+	if (m_running.empty()) m_last = __rdtsc();
+	m_running.push_back(&prg);
+}
+
+/*
+ * A program has stopped running.
+ */
+void CProgramProfiler::leave()
+{
+	if (!m_running.empty()) m_running.pop_back();
+}
+
+/*
+ * Get the id of a method, adding it if it is new.
+ */
+unsigned int CProgramProfiler::methodId(const int file, const STRING &name)
+{
+	const std::pair<int, STRING> key(file, name);
+	std::map<std::pair<int, STRING>, unsigned int>::const_iterator i = m_methodIds.find(key);
+	if (i != m_methodIds.end()) return i->second;
+
+	const METHOD_STATS method = {file, name, 0, 0, 0};
+	m_methods.push_back(method);
+	return (m_methodIds[key] = m_methods.size() - 1);
+}
+
+/*
+ * Add a line.
+ */
+unsigned int CProgramProfiler::addLine(const int file, const int line, const unsigned int method)
+{
+	const LINE_STATS stats = {file, line, method, 0, 0, 0};
+	m_lines.push_back(stats);
+	if (line < 0) return m_lines.size() - 1;
+
+	const unsigned int f = file + 1;
+	if (f >= m_lineIds.size()) m_lineIds.resize(f + 1);
+	if (line >= m_lineIds[f].size()) m_lineIds[f].resize(line + 1, 0);
+	m_lineIds[f][line] = m_lines.size();
+	return m_lines.size() - 1;
+}
+
+/*
+ * Find the method of each of a program's units. A method's units run
+ * from its opening brace to its closing brace; any others are the
+ * program's main code.
+ */
+void CProgramProfiler::mapMethods(CProgram &prg)
+{
+	const unsigned int size = prg.m_units.size();
+	prg.m_unitMethods.resize(size);
+
+	int file = -2;
+	unsigned int main = 0;
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		if (prg.m_units[i].fileIndex != file)
+		{
+			file = prg.m_units[i].fileIndex;
+			main = methodId(file, MAIN_METHOD);
+		}
+		prg.m_unitMethods[i] = main;
+	}
+
+	std::vector<NAMED_METHOD>::const_iterator i = prg.m_methods.begin();
+	for (; i != prg.m_methods.end(); ++i)
+	{
+		if (i->i >= size) continue;
+		const unsigned int close = static_cast<unsigned int>(prg.m_units[i->i].num);
+		const unsigned int end = (close < size) ? close + 1 : size;
+		const unsigned int id = methodId(prg.m_units[i->i].fileIndex, i->name);
+		std::fill(prg.m_unitMethods.begin() + i->i, prg.m_unitMethods.begin() + end, id);
+	}
+}
+
+/*
+ * Add the frames of a program's calls to the sampled stack: the
+ * position of each call, and then the current position.
+ */
+void CProgramProfiler::addFrames(CProgram &prg, const unsigned int pc, const bool bInner)
+{
+	const unsigned int size = prg.m_units.size();
+	if (prg.m_unitMethods.size() != size) mapMethods(prg);
+
+	std::vector<unsigned int> positions;
+	std::vector<CALL_FRAME>::const_iterator i = prg.m_calls.begin();
+	for (; i != prg.m_calls.end(); ++i)
+	{
+		positions.push_back(i->i);
+	}
+	// The innermost unit may have been a call that has just been made.
+	if (bInner && !positions.empty() && positions.back() == pc) positions.pop_back();
+	positions.push_back(pc);
+
+	std::vector<unsigned int>::const_iterator j = positions.begin();
+	for (; j != positions.end(); ++j)
+	{
+		if (*j >= size) continue;
+		const MACHINE_UNIT &mu = prg.m_units[*j];
+		const unsigned int method = prg.m_unitMethods[*j];
+		m_stack.push_back(method);
+		m_stack.push_back(lineId(mu.fileIndex, mu.line, method));
+	}
+}
+
+/*
+ * Sample the call stacks of the running programs, giving the
+ * time run since the last sample to the current stack.
+ */
+void CProgramProfiler::sample(CProgram &prg, const unsigned int pc)
+{
+	m_stack.clear();
+
+	const bool bRunning = (!m_running.empty() && m_running.back() == &prg);
+	if (bRunning)
+	{
+		// Programs that are running the current program.
+		std::vector<CProgram *>::const_iterator i = m_running.begin();
+		for (; i != m_running.end() - 1; ++i)
+		{
+			addFrames(**i, (*i)->m_i - (*i)->m_units.begin(), false);
+		}
+	}
+	addFrames(prg, pc, true);
+
+	m_stacks[m_stack] += m_pending;
+	m_pending = 0;
+}
+
+/*
+ * Comparators to order methods and lines by exclusive time.
+ */
+template <class T>
+class CByExclusive
+{
+public:
+	CByExclusive(const std::vector<T> &stats): m_stats(stats) { }
+	bool operator()(const unsigned int a, const unsigned int b) const
+	{
+		return m_stats[a].exclusive > m_stats[b].exclusive;
+	}
+private:
+	const std::vector<T> &m_stats;
+};
+
+/*
+ * Get the name of a program file.
+ */
+static STRING getFileName(const int file)
+{
+	const STRING name = CMumuDebugger::getFileName(file);
+	return name.empty() ? _T("(inline)") : name;
+}
+
+/*
+ * Write the results to the project's _MUMU folder.
+ */
+bool CProgramProfiler::write()
+{
+	if (m_methods.empty()) return false;
+
+	const double us = getMicroseconds();
+	const STRING dir = CMumuDebugger::getDumpDir();
+
+	// Inclusive time: each method and line of a stack is given the
+	// stack's time once, however many times it appears.
+	std::vector<METHOD_STATS>::iterator m = m_methods.begin();
+	for (; m != m_methods.end(); ++m) m->inclusive = 0;
+	std::vector<LINE_STATS>::iterator l = m_lines.begin();
+	for (; l != m_lines.end(); ++l) l->inclusive = 0;
+
+	std::map<STACK, unsigned __int64>::const_iterator i = m_stacks.begin();
+	for (; i != m_stacks.end(); ++i)
+	{
+		std::set<unsigned int> methods, lines;
+		for (unsigned int j = 0; j + 1 < i->first.size(); j += 2)
+		{
+			if (methods.insert(i->first[j]).second) m_methods[i->first[j]].inclusive += i->second;
+			if (lines.insert(i->first[j + 1]).second) m_lines[i->first[j + 1]].inclusive += i->second;
+		}
+	}
+
+	// Collapsed stacks.
+	FILE *p = _tfopen((dir + _T("profile.folded")).c_str(), _T("w"));
+	if (!p) return false;
+	for (i = m_stacks.begin(); i != m_stacks.end(); ++i)
+	{
+		const unsigned long value = static_cast<unsigned long>(double(i->second) * us + 0.5);
+		if (!value) continue;
+
+		for (unsigned int j = 0; j + 1 < i->first.size(); j += 2)
+		{
+			const METHOD_STATS &method = m_methods[i->first[j]];
+			const LINE_STATS &line = m_lines[i->first[j + 1]];
+			_ftprintf(p, _T("%s%s:%s;%s:%d"),
+				j ? _T(";") : _T(""),
+				getFileName(method.file).c_str(), method.name.c_str(),
+				getFileName(line.file).c_str(), line.line);
+		}
+		_ftprintf(p, _T(" %lu\n"), value);
+	}
+	fclose(p);
+
+	// Methods, then lines, by exclusive time.
+	p = _tfopen((dir + _T("profile.csv")).c_str(), _T("w"));
+	if (!p) return false;
+	_ftprintf(p, _T("type,file,line,method,units,exclusive_us,inclusive_us\n"));
+
+	std::vector<unsigned int> order;
+	for (unsigned int j = 0; j < m_methods.size(); ++j) order.push_back(j);
+	std::sort(order.begin(), order.end(), CByExclusive<METHOD_STATS>(m_methods));
+	std::vector<unsigned int>::const_iterator k = order.begin();
+	for (; k != order.end(); ++k)
+	{
+		const METHOD_STATS &method = m_methods[*k];
+		_ftprintf(p, _T("method,\"%s\",,\"%s\",%lu,%.1f,%.1f\n"),
+			getFileName(method.file).c_str(), method.name.c_str(), method.units,
+			double(method.exclusive) * us, double(method.inclusive) * us);
+	}
+
+	order.clear();
+	for (unsigned int j = 0; j < m_lines.size(); ++j) order.push_back(j);
+	std::sort(order.begin(), order.end(), CByExclusive<LINE_STATS>(m_lines));
+	for (k = order.begin(); k != order.end(); ++k)
+	{
+		const LINE_STATS &line = m_lines[*k];
+		_ftprintf(p, _T("line,\"%s\",%d,\"%s\",%lu,%.1f,%.1f\n"),
+			getFileName(line.file).c_str(), line.line, m_methods[line.method].name.c_str(), line.units,
+			double(line.exclusive) * us, double(line.inclusive) * us);
+	}
+	fclose(p);
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ ********************************************************************
+ * The RPG Toolkit, Version 3
+ * This file copyright (C) 2006  Christopher Matthews & contributors
+ ********************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Creating a game EXE using the Make EXE feature creates a 
+ * derivative version of trans3 that includes the game's files. 
+ * Therefore the EXE must be licensed under the GPL. However, as a 
+ * special exception, you are permitted to license EXEs made with 
+ * this feature under whatever terms you like, so long as 
+ * Corresponding Source, as defined in the GPL, of the version 
+ * of trans3 used to make the EXE is available separately under 
+ * terms compatible with the Licence of this software and that you 
+ * do not charge, aside from any price of the game EXE, to obtain 
+ * these components.
+ * 
+ * If you publish a modified version of this Program, you may delete
+ * these exceptions from its distribution terms, or you may choose
+ * to propagate them.
+ */
+
+/*
+ * RPGCode profiler.
+ *
+ * Measures where programs spend their time, by file, line and method.
+ * Every unit executed is counted against its line and method, along
+ * with the time since the previous unit (exclusive time). After every
+ * PROFILER_INTERVAL microseconds of running, the call stacks of the
+ * running programs are also sampled, which gives inclusive time and the
+ * stacks for a flame graph.
+ *
+ * Enabled by the bRpgCodeProfiler setting (on by default in debug
+ * builds). When the engine closes, the results are written to the
+ * project's _MUMU folder:
+ *
+ *		profile.folded	- collapsed stacks, in microseconds, for flamegraph.pl
+ *		profile.csv		- methods and lines, by exclusive time
+ *
+ * The line and file of each unit come from the MuMu debugger, so the
+ * profiler is only available when it is compiled in.
+ */
+
+#ifndef _CPROGRAM_PROFILER_H_
+#define _CPROGRAM_PROFILER_H_
+
+#include "CProgram.h"
+
+#ifdef ENABLE_MUMU_DBG
+
+#include <intrin.h>
+#include <vector>
+#include <map>
+
+#pragma intrinsic(__rdtsc)
+
+/**
+ * Microseconds of running between samples of the call stacks.
+ */
+#define PROFILER_INTERVAL	250
+
+/**
+ * The profiler is implemented as a singleton. To obtain the
+ * instance, call CProgramProfiler::getInstance().
+ */
+class CProgramProfiler
+{
+public:
+
+	/**
+	 * Initialise the profiler.
+	 */
+	CProgramProfiler();
+
+	/**
+	 * Return the unique instance of the profiler.
+	 */
+	static CProgramProfiler &getInstance() { return m_instance; }
+
+	/**
+	 * Whether programs are being profiled.
+	 */
+	static bool isEnabled() { return m_bEnabled; }
+
+	/**
+	 * Start or stop profiling. Results gathered so far are kept.
+	 */
+	void setEnabled(const bool bEnabled);
+
+	/**
+	 * Record the unit at pc having been executed by the program.
+	 */
+	void unit(CProgram &prg, const unsigned int pc)
+	{
+		const unsigned __int64 now = __rdtsc();
+		const unsigned __int64 elapsed = now - m_last;
+		m_last = now;
+
+		if (pc >= prg.m_units.size()) return;
+		if (prg.m_unitMethods.size() != prg.m_units.size()) mapMethods(prg);
+
+		const MACHINE_UNIT &mu = prg.m_units[pc];
+		LINE_STATS &line = m_lines[lineId(mu.fileIndex, mu.line, prg.m_unitMethods[pc])];
+		++line.units;
+		line.exclusive += elapsed;
+
+		METHOD_STATS &method = m_methods[prg.m_unitMethods[pc]];
+		++method.units;
+		method.exclusive += elapsed;
+
+		m_pending += elapsed;
+		if (m_pending >= m_interval) sample(prg, pc);
+	}
+
+	/**
+	 * Write the results to the project's _MUMU folder.
+	 */
+	bool write();
+
+	/**
+	 * Marks a program as running for its lifetime, so that its calls
+	 * appear in the stacks of programs it runs.
+	 */
+	class CRun
+	{
+	public:
+		explicit CRun(CProgram &prg): m_bEnabled(isEnabled())
+		{
+			if (m_bEnabled) m_instance.enter(prg);
+		}
+		~CRun()
+		{
+			if (m_bEnabled) m_instance.leave();
+		}
+	private:
+		CRun(const CRun &);
+		CRun &operator=(const CRun &);
+		const bool m_bEnabled;
+	};
+
+private:
+
+	/**
+	 * Time spent in a method, in processor ticks.
+	 */
+	typedef struct tagMethodStats
+	{
+		int file;
+		STRING name;
+		unsigned long units;
+		unsigned __int64 exclusive, inclusive;
+	} METHOD_STATS;
+
+	/**
+	 * Time spent on a line, in processor ticks.
+	 */
+	typedef struct tagLineStats
+	{
+		int file, line;
+		unsigned int method;				// Method the line is in.
+		unsigned long units;
+		unsigned __int64 exclusive, inclusive;
+	} LINE_STATS;
+
+	/**
+	 * A sampled call stack: alternating method and line ids,
+	 * outermost first.
+	 */
+	typedef std::vector<unsigned int> STACK;
+
+	void enter(CProgram &prg);
+	void leave();
+
+	/**
+	 * Sample the call stacks of the running programs.
+	 */
+	void sample(CProgram &prg, const unsigned int pc);
+
+	/**
+	 * Add the frames of a program's calls to the sampled stack.
+	 */
+	void addFrames(CProgram &prg, const unsigned int pc, const bool bInner);
+
+	/**
+	 * Find the method of each of a program's units.
+	 */
+	void mapMethods(CProgram &prg);
+
+	/**
+	 * Get the id of a method or a line, adding it if it is new.
+	 */
+	unsigned int methodId(const int file, const STRING &name);
+	unsigned int lineId(const int file, const int line, const unsigned int method)
+	{
+		const unsigned int f = file + 1;
+		if (f < m_lineIds.size() && line >= 0 && line < m_lineIds[f].size() && m_lineIds[f][line])
+		{
+			return m_lineIds[f][line] - 1;
+		}
+		return addLine(file, line, method);
+	}
+	unsigned int addLine(const int file, const int line, const unsigned int method);
+
+	/**
+	 * Microseconds per processor tick.
+	 */
+	double getMicroseconds() const;
+
+	static CProgramProfiler m_instance;
+	static bool m_bEnabled;
+
+	std::vector<CProgram *> m_running;			// Running programs, outermost first.
+	std::vector<METHOD_STATS> m_methods;
+	std::map<std::pair<int, STRING>, unsigned int> m_methodIds;
+	std::vector<LINE_STATS> m_lines;
+	std::vector<std::vector<unsigned int> > m_lineIds;		// By file + 1 and line; id + 1.
+	std::map<STACK, unsigned __int64> m_stacks;
+	STACK m_stack;
+
+	unsigned __int64 m_last;					// Tick of the last unit.
+	unsigned __int64 m_pending;					// Ticks run since the last sample.
+	unsigned __int64 m_interval;				// Ticks between samples.
+	unsigned __int64 m_startTicks;				// Ticks and performance counter
+	LARGE_INTEGER m_startCounter;				// when profiling was enabled.
+};
+
+/**
+ * Record a unit in the profile, if profiling.
+ */
+inline void profileUnit(CProgram &prg, const unsigned int pc)
+{
+	if (CProgramProfiler::isEnabled()) CProgramProfiler::getInstance().unit(prg, pc);
+}
+
+#else
+
+inline void profileUnit(CProgram &, const unsigned int) { }
+
+#endif
+
+#endif
@@ -51,6 +51,7 @@
 #include "../common/CAllocationHeap.h"
 #include "../common/CInventory.h"
 #include "../common/CFile.h"
+#include "../common/bundle.h"
 #include "../common/CShop.h"
 #include "../common/mbox.h"
 #include "../common/state.h"
@@ -62,6 +63,7 @@
 #include "../../tkCommon/board/conversion.h"
 #include "../fight/fight.h"
 #include "../misc/misc.h"
+#include "../misc/profiler.h"
 #include "../plugins/plugins.h"
 #include "../plugins/constants.h"
 #include "../video/CVideo.h"
@@ -839,6 +841,7 @@ void gone(CALL_DATA &params)
 		if ((*i) == p)
 		{
 			g_pBoard->programs.erase(i);
+			g_pBoard->programIndex.dirty = true;
 			delete p;
 			break;
 		}
@@ -1070,6 +1073,7 @@ void move(CALL_DATA &params)
 		// Move to a new location (x,y location for first point).
 		p->vBase.move(x, y);
 		p->layer = z;
+		g_pBoard->programIndex.dirty = true;
 	}
 }
 
@@ -1110,6 +1114,7 @@ void prg(CALL_DATA &params)
 		{
 			(*i)->vBase.move(x, y);
 			(*i)->layer = z;
+			g_pBoard->programIndex.dirty = true;
 			break;
 		}
 	}
@@ -1620,7 +1625,7 @@ void delay(CALL_DATA &params)
 	{
 		throw CError(_T("Delay() requires one data element."));
 	}
-	Sleep(DWORD(params[0].getNum() * 1000.0));
+	engineSleep(DWORD(params[0].getNum() * 1000.0));
 }
 
 /*
@@ -3958,7 +3963,7 @@ void zoom(CALL_DATA &params)
 			SRCCOPY);
 
 		renderRpgCodeScreen();
-		Sleep(MISC_DELAY);
+		engineSleep(MISC_DELAY);
 		processEvent();
 	}
 }
@@ -3988,22 +3993,22 @@ void earthquake(CALL_DATA &params)
 		g_cnvRpgCode->ClearScreen(g_pBoard->bkgColor);
 		cnv.BltPart(g_cnvRpgCode, 0, 0, i, i, width - i, height - i, SRCCOPY);
 		renderRpgCodeScreen();
-		Sleep(MISC_DELAY);
+		engineSleep(MISC_DELAY);
 
 		g_cnvRpgCode->ClearScreen(g_pBoard->bkgColor);
 		cnv.BltPart(g_cnvRpgCode, i, 0, 0, i, width - i, height - i, SRCCOPY);
 		renderRpgCodeScreen();
-		Sleep(MISC_DELAY);
+		engineSleep(MISC_DELAY);
 
 		g_cnvRpgCode->ClearScreen(g_pBoard->bkgColor);
 		cnv.BltPart(g_cnvRpgCode, 0, i, i, 0, width - i, height - i, SRCCOPY);
 		renderRpgCodeScreen();
-		Sleep(MISC_DELAY);
+		engineSleep(MISC_DELAY);
 
 		g_cnvRpgCode->ClearScreen(g_pBoard->bkgColor);
 		cnv.BltPart(g_cnvRpgCode, i, i, 0, 0, width - i, height - i, SRCCOPY);
 		renderRpgCodeScreen();
-		Sleep(MISC_DELAY);
+		engineSleep(MISC_DELAY);
 
 		processEvent();
 	}
@@ -6654,19 +6659,16 @@ void cursormaphand(CALL_DATA &params)
 
 	if (!stretch)
 	{
-		STRING prFile = getAsciiString(resolve(strFile)).c_str();
-
-		FIBITMAP *bmp = FreeImage_Load(FreeImage_GetFileType(prFile.c_str(), 16), prFile.c_str());
-
-		if (bmp)
+		IMAGE image;
+		if (openImage(strFile, image))
 		{
-			g_cnvCursor->Resize(NULL, FreeImage_GetWidth(bmp), FreeImage_GetHeight(bmp));
+			g_cnvCursor->Resize(NULL, image.width, image.height);
 
 			HDC hdc = g_cnvCursor->OpenDC();
-			StretchDIBits(hdc, 0, 0, FreeImage_GetWidth(bmp), FreeImage_GetHeight(bmp), 0, 0, FreeImage_GetWidth(bmp), FreeImage_GetHeight(bmp), FreeImage_GetBits(bmp), FreeImage_GetInfo(bmp), DIB_RGB_COLORS, SRCCOPY);
+			StretchDIBits(hdc, 0, 0, image.width, image.height, 0, 0, image.width, image.height, image.bits, image.getInfo(), DIB_RGB_COLORS, SRCCOPY);
 			g_cnvCursor->CloseDC(hdc);
 
-			FreeImage_Unload(bmp);
+			closeImage(image);
 		}
 	}
 	else
@@ -6966,6 +6968,7 @@ void multiRunEnd(CProgram *prg)
 			{
 				if ((*i)->move(g_pSelectedPlayer, true)) moving = true;
 			}
+			g_sprites.sort();
 			renderNow(g_cnvRpgCode, true);
 			renderRpgCodeScreen();
 		}
@@ -7142,7 +7145,31 @@ void drawcanvastransparent(CALL_DATA &params)
 void getTickCount(CALL_DATA &params)
 {
 	params.ret().udt = UDT_NUM;
-	params.ret().num = GetTickCount();
+	params.ret().num = engineTime();
+}
+
+/*
+ * string profileDump([int frames = 120[, string file]])
+ * 
+ * Write the engine's profile of the last frames as a Chrome trace
+ * (profile.json in the project folder by default) and return the file
+ * written. Returns "" unless trans3 was built with ENABLE_PROFILER.
+ */
+void profileDump(CALL_DATA &params)
+{
+	if (params.params > 2)
+	{
+		throw CError(_T("ProfileDump() requires zero, one or two parameters."));
+	}
+	const int frames = (params.params > 0) ? int(params[0].getNum()) : PROFILE_FRAMES;
+	if (frames < 1)
+	{
+		throw CError(_T("ProfileDump(): frames must be at least one."));
+	}
+	const STRING file = (params.params > 1) ? params[1].getLit() : STRING();
+
+	params.ret().udt = UDT_LIT;
+	params.ret().lit = profileDump(frames, file);
 }
 
 /*
@@ -7516,6 +7543,9 @@ void boardsetvector(CALL_DATA &params)
 			brd->createCanvas(*g_pBoard);
 		}
 
+		// Re-file the vector under its new bounds.
+		g_pBoard->indexVector(brd - &g_pBoard->vectors[0]);
+
 		// Reset pathfinding as the collision landscape has changed.
 		CPathFind::freeAllData();
 
@@ -7578,6 +7608,7 @@ void boardsetvectorpoint(CALL_DATA &params)
 	if (brd)
 	{
 		brd->pV->setPoint((unsigned int)params[1].getNum(), params[2].getNum(), params[3].getNum());
+		g_pBoard->indexVector(brd - &g_pBoard->vectors[0]);
 		if (params[4].getBool())
 		{
 			// Redraw the 'under' canvas.
@@ -7688,6 +7719,7 @@ void boardsetprogram(CALL_DATA &params)
 		prg->vBase.close(params[4].getBool());
 		prg->activationType = int(params[5].getNum());
 		prg->distanceRepeat = int(params[6].getNum());
+		g_pBoard->programIndex.dirty = true;
 
 		/* Unneeded: useful for debugging only.
 #ifdef DEBUG_VECTORS
@@ -7746,6 +7778,7 @@ void boardsetprogrampoint(CALL_DATA &params)
 	if (prg)
 	{
 		prg->vBase.setPoint((unsigned int)params[1].getNum(), params[2].getNum(), params[3].getNum());
+		g_pBoard->programIndex.dirty = true;
 
 		/* Unneeded: useful for debugging only.
 #ifdef DEBUG_VECTORS
@@ -7763,6 +7796,8 @@ void boardsetprogrampoint(CALL_DATA &params)
  */
 void setambientlevel(CALL_DATA &params)
 {
+	extern LPBOARD g_pBoard;
+
 	if (params.params != 3)
 	{
 		throw CError(_T("SetAmbientLevel() requires three parameters."));
@@ -7779,7 +7814,18 @@ void setambientlevel(CALL_DATA &params)
 	pVar->num = params[2].getNum();
 	pVar->udt = UDT_NUM;
 
-	forceRedraw(params);
+	// The level is applied to the finished frame, so the scroll
+	// cache is left as it is.
+	setAmbientLevel();
+	if (g_pBoard->bLayerOccupied.size())
+	{
+		renderNow(g_cnvRpgCode, true);
+	}
+	else
+	{
+		g_cnvRpgCode->ClearScreen(0);
+	}
+	renderRpgCodeScreen();
 }
 
 /*
@@ -8238,6 +8284,7 @@ void initRpgCode()
 	CProgram::addFunction(_T("playerstance"), playerstance);
 	CProgram::addFunction(_T("drawcanvastransparent"), drawcanvastransparent);
 	CProgram::addFunction(_T("gettickcount"), getTickCount);
+	CProgram::addFunction(_T("profiledump"), profileDump);
 	CProgram::addFunction(_T("setvolume"), setvolume);
 	CProgram::addFunction(_T("setmwintranslucency"), setmwintranslucency);
 	CProgram::addFunction(_T("regexpreplace"), regExpReplace);